@@ -0,0 +1,703 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "btree.h"
+#include "pager.h"
+#include "parallel.h"
+
+// B-tree / pager benchmark driver. Every workload prints one JSON object per
+// line with its throughput and latency percentiles, so runs can be diffed and
+// plotted without scraping.
+//
+//   bench_btree [--keys N] [--workloads seq,random,buffered,zipf,lookup,scan,pscan,mixed,upsert]
+//               [--ops N] [--scan-length N] [--value-size N] [--zipf-theta X]
+//               [--read-ratio X] [--page-size N] [--cache-frames N]
+//               [--threads N] [--direct-io] [--io-uring] [--compress] [--seed N]
+//               [--file PATH] [--output PATH] [--keep]
+
+#define MAX_VALUE_SIZE 256
+#define DEFAULT_MEASURED_OPS 1000000
+
+// Log-linear latency histogram: values below 2^HISTOGRAM_SUB_BITS
+// nanoseconds are exact, larger ones fall in one of 2^HISTOGRAM_SUB_BITS
+// buckets per power of two (about 3% relative error)
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1u << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+} Histogram;
+
+typedef struct {
+    uint64_t num_keys;
+    uint64_t ops;                 // Measured operations for read workloads
+    uint32_t scan_length;
+    uint32_t value_size;
+    double zipf_theta;
+    double read_ratio;
+    uint32_t threads;             // Parallel scan workers, 0 for one per CPU
+    uint64_t seed;
+    const char* workloads;
+    const char* file;
+    bool keep;
+    PagerOptions pager_options;
+} BenchConfig;
+
+typedef struct {
+    const char* name;
+    uint64_t ops;
+    uint64_t failed;              // Duplicate inserts, missing keys
+    uint64_t elapsed_ns;
+    Histogram latency;
+    PagerStats pager;             // Buffer pool counters for this workload
+} BenchResult;
+
+static FILE* output;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t histogram_bucket(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (uint32_t)value;
+    }
+    uint32_t msb = 63 - (uint32_t)__builtin_clzll(value);
+    uint32_t sub = (uint32_t)(value >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// Largest value that lands in `bucket`
+static uint64_t histogram_bucket_limit(uint32_t bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    uint32_t msb = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+    uint64_t base = (HISTOGRAM_SUB_BUCKETS + sub) << (msb - HISTOGRAM_SUB_BITS);
+    return base + (1ull << (msb - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+static void histogram_record(Histogram* histogram, uint64_t value) {
+    histogram->counts[histogram_bucket(value)]++;
+    histogram->total++;
+    histogram->sum += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+static uint64_t histogram_percentile(const Histogram* histogram, double percentile) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * (double)histogram->total);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen >= rank) {
+            uint64_t limit = histogram_bucket_limit(bucket);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// xorshift64*: fast, and reproducible across runs for a given seed
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ull;
+}
+
+static double next_unit(uint64_t* state) {
+    return (double)(next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// A bijection on [0, n) that scatters consecutive indices, so random inserts
+// need no shuffled key array (which would not fit at 10^8 keys). Invertible
+// mixing on the enclosing power of two, cycle-walking back into range.
+typedef struct {
+    uint64_t mask;
+    uint32_t shift;
+    uint64_t seed;
+} Permutation;
+
+static void permutation_init(Permutation* permutation, uint64_t n, uint64_t seed) {
+    uint32_t bits = 1;
+    while ((1ull << bits) < n) {
+        bits++;
+    }
+    permutation->mask = (1ull << bits) - 1;
+    permutation->shift = bits / 2 + 1;
+    permutation->seed = seed;
+}
+
+static uint64_t permute(const Permutation* permutation, uint64_t n, uint64_t index) {
+    uint64_t x = index;
+    do {
+        for (int round = 0; round < 3; round++) {
+            x = (x ^ (permutation->seed + (uint64_t)round)) & permutation->mask;
+            x = (x * 0x9e3779b97f4a7c15ull) & permutation->mask;
+            x ^= x >> permutation->shift;
+        }
+    } while (x >= n);
+    return x;
+}
+
+// Zipfian ranks in [0, n) as in Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases" (the YCSB generator)
+typedef struct {
+    uint64_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} Zipf;
+
+static double zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) {
+        sum += 1.0 / pow((double)i, theta);
+    }
+    return sum;
+}
+
+static void zipf_init(Zipf* zipf, uint64_t n, double theta) {
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->zetan = zeta(n, theta);
+    double zeta2 = zeta(2, theta);
+    zipf->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetan);
+}
+
+static uint64_t zipf_next(const Zipf* zipf, uint64_t* state) {
+    double u = next_unit(state);
+    double uz = u * zipf->zetan;
+    if (uz < 1.0) {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, zipf->theta)) {
+        return 1;
+    }
+    uint64_t rank = (uint64_t)((double)zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+    return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+static void make_value(char* value, uint32_t value_size, uint32_t key) {
+    memset(value, 'v', value_size);
+    snprintf(value, value_size, "%u", key);
+}
+
+static Pager* open_pager(const BenchConfig* config, bool fresh) {
+    if (fresh) {
+        remove(config->file);
+    }
+    Pager* pager = pager_open_with_options(config->file, &config->pager_options);
+    if (!pager) {
+        printf("ERROR: Unable to open benchmark database %s\n", config->file);
+        exit(EXIT_FAILURE);
+    }
+    return pager;
+}
+
+static void report(const BenchConfig* config, const BenchResult* result) {
+    double seconds = (double)result->elapsed_ns / 1e9;
+    const Histogram* latency = &result->latency;
+    fprintf(output,
+            "{\"workload\":\"%s\",\"keys\":%llu,\"ops\":%llu,\"failed\":%llu,"
+            "\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+            "\"latency_ns\":{\"mean\":%.1f,\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu},"
+            "\"pager\":{\"hits\":%llu,\"misses\":%llu,\"page_reads\":%llu,\"page_writes\":%llu,"
+            "\"bytes_read\":%llu,\"bytes_written\":%llu},"
+            "\"page_size\":%u,\"cache_frames\":%u,\"value_size\":%u}\n",
+            result->name, (unsigned long long)config->num_keys, (unsigned long long)result->ops,
+            (unsigned long long)result->failed, seconds, seconds > 0 ? (double)result->ops / seconds : 0.0,
+            latency->total ? (double)latency->sum / (double)latency->total : 0.0,
+            (unsigned long long)histogram_percentile(latency, 50.0),
+            (unsigned long long)histogram_percentile(latency, 99.0),
+            (unsigned long long)histogram_percentile(latency, 99.9),
+            (unsigned long long)latency->max, (unsigned long long)result->pager.hits,
+            (unsigned long long)result->pager.misses, (unsigned long long)result->pager.page_reads,
+            (unsigned long long)result->pager.page_writes, (unsigned long long)result->pager.bytes_read,
+            (unsigned long long)result->pager.bytes_written, config->pager_options.page_size,
+            config->pager_options.cache_frames, config->value_size);
+    fflush(output);
+}
+
+static BenchResult* new_result(const char* name) {
+    BenchResult* result = calloc(1, sizeof(BenchResult));
+    if (!result) {
+        printf("ERROR: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    result->name = name;
+    return result;
+}
+
+typedef enum { ORDER_SEQUENTIAL, ORDER_RANDOM, ORDER_ZIPF } InsertOrder;
+
+// Loads num_keys keys into a fresh database in the given order. Zipfian
+// inserts draw keys with replacement, so repeats count as failed inserts.
+// A buffered load goes through the internal node buffers, see
+// btree_set_buffered().
+static void bench_insert(const BenchConfig* config, const char* name, InsertOrder order, bool buffered) {
+    BenchResult* result = new_result(name);
+    Pager* pager = open_pager(config, true);
+    BTree* btree = btree_open(pager);
+    btree_set_buffered(btree, buffered);
+    Permutation permutation;
+    permutation_init(&permutation, config->num_keys, config->seed);
+    Zipf zipf;
+    if (order == ORDER_ZIPF) {
+        zipf_init(&zipf, config->num_keys, config->zipf_theta);
+    }
+    uint64_t state = config->seed | 1;
+    char value[MAX_VALUE_SIZE];
+
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < config->num_keys; i++) {
+        uint32_t key;
+        if (order == ORDER_SEQUENTIAL) {
+            key = (uint32_t)i;
+        } else if (order == ORDER_RANDOM) {
+            key = (uint32_t)permute(&permutation, config->num_keys, i);
+        } else {
+            key = (uint32_t)permute(&permutation, config->num_keys, zipf_next(&zipf, &state));
+        }
+        make_value(value, config->value_size, key);
+
+        uint64_t op_start = now_ns();
+        if (btree_insert(btree, key, value, config->value_size) != 0) {
+            result->failed++;
+        }
+        histogram_record(&result->latency, now_ns() - op_start);
+    }
+    // Writing back what is still dirty, and whatever is still buffered, is
+    // part of the cost of a load
+    btree_flush_buffers(btree);
+    pager_flush_all(pager);
+    result->elapsed_ns = now_ns() - start;
+    result->ops = config->num_keys;
+
+    result->pager = pager_stats(pager);
+    btree_close(btree);
+    pager_close(pager);
+    report(config, result);
+    free(result);
+}
+
+// The read workloads need a loaded database; reuse the file if it already
+// holds num_keys keys from an earlier workload in this run
+static bool loaded = false;
+
+static void ensure_loaded(const BenchConfig* config) {
+    if (loaded) {
+        return;
+    }
+    Pager* pager = open_pager(config, true);
+    BTree* btree = btree_open(pager);
+    Permutation permutation;
+    permutation_init(&permutation, config->num_keys, config->seed);
+    char value[MAX_VALUE_SIZE];
+    for (uint64_t i = 0; i < config->num_keys; i++) {
+        uint32_t key = (uint32_t)permute(&permutation, config->num_keys, i);
+        make_value(value, config->value_size, key);
+        btree_insert(btree, key, value, config->value_size);
+    }
+    btree_close(btree);
+    pager_close(pager);
+    loaded = true;
+}
+
+static void bench_lookup(const BenchConfig* config) {
+    ensure_loaded(config);
+    BenchResult* result = new_result("point_lookup");
+    Pager* pager = open_pager(config, false);
+    BTree* btree = btree_open(pager);
+    uint64_t state = config->seed | 1;
+    char value[MAX_VALUE_SIZE];
+    uint32_t value_size;
+
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < config->ops; i++) {
+        uint32_t key = (uint32_t)(next_random(&state) % config->num_keys);
+        uint64_t op_start = now_ns();
+        BTreeCursor* cursor = btree_find(btree, key);
+        btree_cursor_get_value(cursor, value, sizeof(value), &value_size);
+        free(cursor);
+        histogram_record(&result->latency, now_ns() - op_start);
+        if (value_size != config->value_size) {
+            result->failed++;
+        }
+    }
+    result->elapsed_ns = now_ns() - start;
+    result->ops = config->ops;
+
+    result->pager = pager_stats(pager);
+    btree_close(btree);
+    pager_close(pager);
+    report(config, result);
+    free(result);
+}
+
+// Each op seeks to a random key and reads the following scan_length values
+static void bench_scan(const BenchConfig* config) {
+    ensure_loaded(config);
+    BenchResult* result = new_result("range_scan");
+    Pager* pager = open_pager(config, false);
+    BTree* btree = btree_open(pager);
+    uint64_t state = config->seed | 1;
+    char value[MAX_VALUE_SIZE];
+    uint32_t value_size;
+    uint64_t scans = config->ops / config->scan_length;
+    if (scans == 0) {
+        scans = 1;
+    }
+
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < scans; i++) {
+        uint32_t key = (uint32_t)(next_random(&state) % config->num_keys);
+        uint64_t op_start = now_ns();
+        BTreeCursor* cursor = btree_find(btree, key);
+        uint32_t rows = 0;
+        while (!cursor->end_of_table && rows < config->scan_length) {
+            btree_cursor_get_value(cursor, value, sizeof(value), &value_size);
+            btree_cursor_advance(cursor);
+            rows++;
+        }
+        free(cursor);
+        histogram_record(&result->latency, now_ns() - op_start);
+        if (rows < config->scan_length && key + config->scan_length <= config->num_keys) {
+            result->failed++;
+        }
+    }
+    result->elapsed_ns = now_ns() - start;
+    result->ops = scans;
+
+    result->pager = pager_stats(pager);
+    btree_close(btree);
+    pager_close(pager);
+    report(config, result);
+    free(result);
+}
+
+static void count_init(void* state, void* context) {
+    (void)context;
+    memset(state, 0, 2 * sizeof(uint64_t));
+}
+
+static void count_row(void* state, void* context, uint32_t key, const uint8_t* value, uint32_t value_size) {
+    (void)context;
+    (void)key;
+    (void)value;
+    uint64_t* counts = state;
+    counts[0]++;
+    counts[1] += value_size;
+}
+
+static void count_merge(void* state, const void* partial, void* context) {
+    (void)context;
+    uint64_t* counts = state;
+    const uint64_t* other = partial;
+    counts[0] += other[0];
+    counts[1] += other[1];
+}
+
+// Each op is a full parallel scan counting rows and value bytes
+static void bench_parallel_scan(const BenchConfig* config) {
+    ensure_loaded(config);
+    BenchResult* result = new_result("parallel_scan");
+    Pager* pager = open_pager(config, false);
+    BTree* btree = btree_open(pager);
+    ThreadPool* pool = thread_pool_new(config->threads);
+    ScanAggregate aggregate = { 2 * sizeof(uint64_t), count_init, count_row, count_merge };
+    uint64_t scans = config->ops / config->num_keys;
+    if (scans == 0) {
+        scans = 1;
+    }
+
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < scans; i++) {
+        uint64_t counts[2];
+        uint64_t op_start = now_ns();
+        if (parallel_scan(pool, btree, 0, UINT32_MAX, &aggregate, NULL, counts, NULL) != 0 ||
+            counts[0] != config->num_keys || counts[1] != config->num_keys * config->value_size) {
+            result->failed++;
+        }
+        histogram_record(&result->latency, now_ns() - op_start);
+    }
+    result->elapsed_ns = now_ns() - start;
+    result->ops = scans;
+
+    result->pager = pager_stats(pager);
+    thread_pool_free(pool);
+    btree_close(btree);
+    pager_close(pager);
+    report(config, result);
+    free(result);
+}
+
+// Zipfian point reads over the loaded keys mixed with inserts of new keys
+// above them. Inserts modify the database, so later read workloads reload.
+static void bench_mixed(const BenchConfig* config) {
+    ensure_loaded(config);
+    BenchResult* result = new_result("mixed");
+    Pager* pager = open_pager(config, false);
+    BTree* btree = btree_open(pager);
+    Permutation permutation;
+    permutation_init(&permutation, config->num_keys, config->seed);
+    Zipf zipf;
+    zipf_init(&zipf, config->num_keys, config->zipf_theta);
+    uint64_t state = config->seed | 1;
+    uint32_t next_key = (uint32_t)config->num_keys;
+    char value[MAX_VALUE_SIZE];
+    uint32_t value_size;
+
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < config->ops; i++) {
+        bool read = next_unit(&state) < config->read_ratio;
+        uint32_t key = read ? (uint32_t)permute(&permutation, config->num_keys, zipf_next(&zipf, &state))
+                            : next_key++;
+        if (!read) {
+            make_value(value, config->value_size, key);
+        }
+
+        uint64_t op_start = now_ns();
+        if (read) {
+            BTreeCursor* cursor = btree_find(btree, key);
+            btree_cursor_get_value(cursor, value, sizeof(value), &value_size);
+            free(cursor);
+        } else if (btree_insert(btree, key, value, config->value_size) != 0) {
+            result->failed++;
+        }
+        histogram_record(&result->latency, now_ns() - op_start);
+    }
+    pager_flush_all(pager);
+    result->elapsed_ns = now_ns() - start;
+    result->ops = config->ops;
+
+    result->pager = pager_stats(pager);
+    btree_close(btree);
+    pager_close(pager);
+    loaded = false;
+    report(config, result);
+    free(result);
+}
+
+// Counter-style updates: zipfian keys, half of them new, each upserted with
+// its read value bumped. Existing keys are rewritten in place in their leaf.
+static void bench_upsert(const BenchConfig* config) {
+    ensure_loaded(config);
+    BenchResult* result = new_result("upsert");
+    Pager* pager = open_pager(config, false);
+    BTree* btree = btree_open(pager);
+    Zipf zipf;
+    zipf_init(&zipf, config->num_keys * 2, config->zipf_theta);
+    uint64_t state = config->seed | 1;
+    char value[MAX_VALUE_SIZE];
+    uint32_t value_size;
+
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < config->ops; i++) {
+        uint32_t key = (uint32_t)zipf_next(&zipf, &state);
+
+        uint64_t op_start = now_ns();
+        BTreeCursor* cursor = btree_find(btree, key);
+        void* node = pager_get_page(pager, cursor->page_num);
+        uint64_t count = 0;
+        if (cursor->cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, cursor->cell_num) == key) {
+            btree_cursor_get_value(cursor, value, sizeof(value), &value_size);
+            count = strtoull(value, NULL, 10);
+        }
+        free(cursor);
+        memset(value, ' ', config->value_size);
+        snprintf(value, config->value_size, "%llu", (unsigned long long)count + 1);
+        btree_upsert(btree, key, value, config->value_size);
+        histogram_record(&result->latency, now_ns() - op_start);
+    }
+    pager_flush_all(pager);
+    result->elapsed_ns = now_ns() - start;
+    result->ops = config->ops;
+
+    result->pager = pager_stats(pager);
+    btree_close(btree);
+    pager_close(pager);
+    loaded = false;
+    report(config, result);
+    free(result);
+}
+
+static bool workload_selected(const BenchConfig* config, const char* name) {
+    const char* list = config->workloads;
+    size_t length = strlen(name);
+    while (*list) {
+        const char* end = strchr(list, ',');
+        size_t item = end ? (size_t)(end - list) : strlen(list);
+        if ((item == length && strncmp(list, name, length) == 0) || (item == 3 && strncmp(list, "all", 3) == 0)) {
+            return true;
+        }
+        list += item;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return false;
+}
+
+static void usage(const char* program) {
+    printf("Usage: %s [--keys N] [--workloads seq,random,buffered,zipf,lookup,scan,pscan,mixed,upsert|all]\n"
+           "          [--ops N] [--scan-length N] [--value-size N] [--zipf-theta X]\n"
+           "          [--read-ratio X] [--page-size N] [--cache-frames N] [--threads N]\n"
+           "          [--direct-io] [--io-uring] [--compress] [--seed N] [--file PATH] [--output PATH] [--keep]\n",
+           program);
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    memset(&config, 0, sizeof(config));
+    config.num_keys = 100000;
+    config.scan_length = 100;
+    config.value_size = 16;
+    config.zipf_theta = 0.99;
+    config.read_ratio = 0.9;
+    config.seed = 42;
+    config.workloads = "all";
+    config.file = "bench.db";
+    pager_default_options(&config.pager_options);
+    const char* output_path = NULL;
+    bool ops_given = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* next = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool has_value = true;
+        if (strcmp(arg, "--direct-io") == 0) {
+            config.pager_options.direct_io = true;
+            has_value = false;
+        } else if (strcmp(arg, "--io-uring") == 0) {
+            config.pager_options.io_backend = PAGE_IO_URING;
+            has_value = false;
+        } else if (strcmp(arg, "--compress") == 0) {
+            config.pager_options.compression = PAGER_COMPRESSION_LZ;
+            has_value = false;
+        } else if (strcmp(arg, "--keep") == 0) {
+            config.keep = true;
+            has_value = false;
+        } else if (strcmp(arg, "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (!next) {
+            usage(argv[0]);
+            return 1;
+        } else if (strcmp(arg, "--keys") == 0) {
+            config.num_keys = strtoull(next, NULL, 10);
+        } else if (strcmp(arg, "--ops") == 0) {
+            config.ops = strtoull(next, NULL, 10);
+            ops_given = true;
+        } else if (strcmp(arg, "--workloads") == 0) {
+            config.workloads = next;
+        } else if (strcmp(arg, "--scan-length") == 0) {
+            config.scan_length = (uint32_t)strtoul(next, NULL, 10);
+        } else if (strcmp(arg, "--value-size") == 0) {
+            config.value_size = (uint32_t)strtoul(next, NULL, 10);
+        } else if (strcmp(arg, "--zipf-theta") == 0) {
+            config.zipf_theta = strtod(next, NULL);
+        } else if (strcmp(arg, "--read-ratio") == 0) {
+            config.read_ratio = strtod(next, NULL);
+        } else if (strcmp(arg, "--page-size") == 0) {
+            config.pager_options.page_size = (uint32_t)strtoul(next, NULL, 10);
+        } else if (strcmp(arg, "--cache-frames") == 0) {
+            config.pager_options.cache_frames = (uint32_t)strtoul(next, NULL, 10);
+        } else if (strcmp(arg, "--threads") == 0) {
+            config.threads = (uint32_t)strtoul(next, NULL, 10);
+        } else if (strcmp(arg, "--seed") == 0) {
+            config.seed = strtoull(next, NULL, 10);
+        } else if (strcmp(arg, "--file") == 0) {
+            config.file = next;
+        } else if (strcmp(arg, "--output") == 0) {
+            output_path = next;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        if (has_value) {
+            i++;
+        }
+    }
+
+    // Keys are 32-bit, and the zipf generator needs theta in (0, 1)
+    if (config.num_keys < 2 || config.num_keys > UINT32_MAX / 2 || config.value_size < 1 ||
+        config.value_size > MAX_VALUE_SIZE || config.scan_length == 0 || config.zipf_theta <= 0 ||
+        config.zipf_theta >= 1) {
+        printf("ERROR: Invalid benchmark configuration\n");
+        return 1;
+    }
+    if (!ops_given) {
+        config.ops = config.num_keys < DEFAULT_MEASURED_OPS ? config.num_keys : DEFAULT_MEASURED_OPS;
+    }
+
+    output = stdout;
+    if (output_path) {
+        output = fopen(output_path, "w");
+        if (!output) {
+            printf("ERROR: Unable to open %s\n", output_path);
+            return 1;
+        }
+    }
+
+    if (workload_selected(&config, "seq")) {
+        bench_insert(&config, "sequential_insert", ORDER_SEQUENTIAL, false);
+    }
+    if (workload_selected(&config, "random")) {
+        bench_insert(&config, "random_insert", ORDER_RANDOM, false);
+        loaded = true;  // Leaves exactly the database the read workloads use
+    }
+    if (workload_selected(&config, "buffered")) {
+        bench_insert(&config, "buffered_random_insert", ORDER_RANDOM, true);
+        loaded = false;  // Same keys, but internal nodes with a smaller fanout
+    }
+    if (workload_selected(&config, "zipf")) {
+        bench_insert(&config, "zipf_insert", ORDER_ZIPF, false);
+        loaded = false;
+    }
+    if (workload_selected(&config, "lookup")) {
+        bench_lookup(&config);
+    }
+    if (workload_selected(&config, "scan")) {
+        bench_scan(&config);
+    }
+    if (workload_selected(&config, "pscan")) {
+        bench_parallel_scan(&config);
+    }
+    if (workload_selected(&config, "mixed")) {
+        bench_mixed(&config);
+    }
+    if (workload_selected(&config, "upsert")) {
+        bench_upsert(&config);
+    }
+
+    if (output != stdout) {
+        fclose(output);
+    }
+    if (!config.keep) {
+        remove(config.file);
+    }
+    return 0;
+}
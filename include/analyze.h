@@ -0,0 +1,67 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "btree.h"
+#include "index.h"
+#include "row.h"
+
+// Table and index statistics, gathered by ANALYZE and read by the code
+// generator to cost access paths and join orders. A table's are collected in
+// one walk of its leaf chain: the row and leaf page counts, a HyperLogLog
+// sketch of each column's distinct values, its NULLs, and for INT columns a
+// reservoir sample of ANALYZE_SAMPLE_SIZE values, sorted into an equi-depth
+// histogram of ANALYZE_HISTOGRAM_BUCKETS buckets, each holding about as many
+// rows as the others. The tree's height and interior pages come from its
+// interior nodes alone. An index's are its number of distinct images and
+// the shape of its B-tree together with the entry trees of its crowded
+// images.
+//
+// Statistics are a snapshot: rows written since the last ANALYZE are not in
+// them, and estimates drift until it runs again.
+
+#define ANALYZE_HISTOGRAM_BUCKETS 16
+#define ANALYZE_SAMPLE_SIZE 4096
+
+typedef struct {
+    uint64_t distinct;            // Estimated distinct non-NULL values
+    uint64_t nulls;
+    // INT columns with values: the smallest value, then each bucket's
+    // largest; 0 bounds otherwise
+    uint32_t num_bounds;
+    int64_t bounds[ANALYZE_HISTOGRAM_BUCKETS + 1];
+} ColumnStats;
+
+typedef struct {
+    uint32_t height;              // Levels, 1 for a lone root leaf
+    uint64_t leaf_pages;
+    uint64_t internal_pages;
+} TreeShape;
+
+typedef struct {
+    bool analyzed;                // False until ANALYZE first runs
+    uint64_t rows;
+    TreeShape shape;
+    uint32_t num_columns;         // Including the key, column 0
+    ColumnStats columns[ROW_MAX_COLUMNS + 1];
+} TableStats;
+
+typedef struct {
+    bool analyzed;
+    uint64_t images;              // Distinct index images, the tree's keys
+    // Pages include the entry trees', and the height the tallest of them
+    TreeShape shape;
+} IndexStats;
+
+// Collects the statistics of a table keyed by an INT column 0 whose other
+// columns are laid out by `schema`. Returns false if a row is corrupt or
+// memory runs out.
+bool analyze_table(BTree* btree, const RowSchema* schema, TableStats* stats);
+void analyze_index(const SecondaryIndex* index, IndexStats* stats);
+
+// Estimated rows of an analyzed table whose column equals one value
+double estimate_equal_rows(const TableStats* stats, uint32_t column);
+// Estimated rows whose INT column lies between the bounds, either of which
+// may be NULL for none. Columns without a histogram count every non-NULL row.
+double estimate_range_rows(const TableStats* stats, uint32_t column, const int64_t* lower, const int64_t* upper);
+
+#endif
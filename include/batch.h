@@ -0,0 +1,60 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "vm.h"
+
+// Vectorized scans. A batch holds up to BATCH_SIZE consecutive rows of a
+// table, read straight from the leaf pages: keys are copied, records stay in
+// the pages. Columns are decoded into vectors only when a filter needs them,
+// and filters narrow a selection vector of row indices with tight loops
+// instead of interpreting one row at a time.
+#define BATCH_SIZE 1024
+
+// Column number that refers to the row's key rather than a record column
+#define BATCH_KEY_COLUMN 0xffff
+
+typedef struct Batch Batch;
+
+Batch* batch_new(void);
+void batch_free(Batch* batch);
+
+// Reads rows starting at the cursor's position (which must be on a row or at
+// the end of a leaf) and leaves the cursor on the first row not read. Starts
+// a pager operation: the batch's rows stay valid until the next B-tree call.
+// Rows are laid out by `schema`. Reads at most `max_leaves` leaves, and no
+// key above `max_key`: reaching one ends the cursor's scan. Returns the
+// number of rows read.
+uint32_t batch_fill(Batch* batch, BTreeCursor* cursor, const RowSchema* schema, uint32_t max_leaves,
+                    int64_t max_key);
+
+// Keeps the selected rows whose column compares true against `constant`.
+// NULLs never match.
+void batch_filter(Batch* batch, uint32_t column, CompareOp op, const Value* constant);
+
+uint32_t batch_num_rows(Batch* batch);
+uint32_t batch_num_selected(Batch* batch);
+const uint16_t* batch_selection(Batch* batch);
+
+// Per-row access, used to produce output for selected rows
+uint32_t batch_key(Batch* batch, uint32_t row);
+bool batch_column(Batch* batch, uint32_t row, uint32_t column, Value* value);
+
+// Aggregates fold into a running aggregate as vm_aggregate_fold() does, and
+// return false where it would. COUNT of BATCH_KEY_COLUMN counts rows.
+
+// Folds `column` of the selected rows with one loop over its decoded vector
+bool batch_aggregate(Batch* batch, uint32_t column, AggregateFunction function, Value* aggregate);
+
+// Aggregates one leaf_aggregate() call computes in its single pass
+#define BATCH_MAX_AGGREGATES 16
+
+// Sets aggregates[i] to functions[i] of columns[i] over the whole tree,
+// reading the leaf pages directly rather than filling batches, in one pass
+// for all of them. COUNT of the key adds up each leaf's cell count without
+// looking at the cells, MIN and MAX of the key read the tree's leftmost and
+// rightmost paths, and the rest run a tight loop over each leaf's cells that
+// reads the one column in place. Starts pager operations.
+bool leaf_aggregate(BTree* btree, const RowSchema* schema, const uint32_t* columns,
+                    const AggregateFunction* functions, uint32_t count, Value* aggregates);
+
+#endif
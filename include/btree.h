@@ -2,6 +2,7 @@
 #define BTREE_H
 
 #include "pager.h"
+#include "stats.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -12,13 +13,81 @@ typedef struct BTreeCursor BTreeCursor;
 // Node types
 typedef enum { NODE_INTERNAL, NODE_LEAF } NodeType;
 
+// Split counters accumulate from btree_open(). The shape figures come from a
+// walk of the whole tree, so btree_stats() costs one read per node.
+typedef struct {
+    uint64_t leaf_splits;
+    uint64_t internal_splits;
+    uint64_t root_splits;       // Times the tree grew a level
+    uint64_t buffer_flushes;    // Batches moved out of a full buffer
+    uint64_t buffered_duplicates; // Messages dropped at a leaf holding their key, normally 0
+    uint32_t height;            // Levels, 1 for a lone root leaf
+    uint64_t leaf_pages;
+    uint64_t internal_pages;
+    uint64_t num_keys;          // In leaves
+    uint64_t buffered_messages; // Inserts still waiting in internal node buffers
+    double average_leaf_fill;   // Cells per leaf over leaf capacity
+    uint64_t bytes_allocated;   // File pages times page size
+    PagerStats pager;
+} BTreeStats;
+
 // Main B-tree operations
 BTree* btree_open(Pager* pager);
+// A file can hold several trees. btree_open() uses the one rooted at page 0;
+// btree_create() starts another on a new page and btree_open_at() reopens it
+// by its root page (btree->root_page_num).
+BTree* btree_create(Pager* pager);
+BTree* btree_open_at(Pager* pager, page_num_t root_page_num);
 void btree_close(BTree* btree);
+// A leaf splits when it reaches its cell limit or a new cell would take it
+// past its page. Inserts, updates and upserts all return -1, changing
+// nothing, for a value no split of its leaf can hold.
+
+// -1 if the key is already there
 int btree_insert(BTree* btree, uint32_t key, void* value, uint32_t value_size);
+// Replaces the value stored under an existing key; -1 if there is none
+int btree_update(BTree* btree, uint32_t key, void* value, uint32_t value_size);
+// Inserts the key or replaces its value: 0 if it was inserted, 1 if replaced.
+// Both take one descent and rewrite the value in place in its leaf, which
+// splits if the value outgrows it.
+int btree_upsert(BTree* btree, uint32_t key, void* value, uint32_t value_size);
+BTreeStats btree_stats(BTree* btree);
+
+// Buffered (B-epsilon) mode. Internal nodes keep at most
+// internal_node_buffered_max_cells keys, and the rest of their page holds a
+// buffer of pending inserts, or messages. An insert is appended to the root's
+// buffer without writing a leaf. When a buffer fills, the messages bound for
+// its busiest child move down in one batch, into the child's buffer or, one
+// level above the leaves, into the leaf. Each leaf write thus absorbs many
+// inserts.
+//
+// btree_insert() keeps its contract: it returns -1 for a key pending in a
+// buffer on its path or already in its leaf. It reads that leaf to find out
+// but leaves writing it to the flush.
+//
+// Reads see every insert. btree_find() first moves the messages on its
+// search path down into the leaf it returns, and btree_cursor_advance() does
+// the same for each leaf it enters. btree_start() empties every buffer,
+// since a scan reads every leaf. Code that walks the leaf chain without a
+// cursor calls btree_flush_buffers() first.
+//
+// Buffers live in the tree's pages and are flagged in each node's header.
+// Any handle, buffered or not, honours them. Turning buffering off empties
+// them, and so does btree_close().
+#define BTREE_BUFFERED_FANOUT_DIVISOR 8
+void btree_set_buffered(BTree* btree, bool buffered);
+// Moves every pending message down to its leaf
+void btree_flush_buffers(BTree* btree);
+
+// Keys whose root-to-leaf paths btree_prefetch() reads per batch of I/O
+#define BTREE_PREFETCH_BATCH 64
 
 // Cursor operations
 BTreeCursor* btree_find(BTree* btree, uint32_t key);
+// Reads the nodes that finding each of `keys` will touch, one tree level at a
+// time with all of a level's reads submitted together. Call before a batch of
+// btree_find() calls on a cold cache.
+void btree_prefetch(BTree* btree, const uint32_t* keys, uint32_t count);
 BTreeCursor* btree_start(BTree* btree);
 void btree_cursor_advance(BTreeCursor* cursor);
 void btree_cursor_get_value(BTreeCursor* cursor, void* value_buffer, uint32_t buffer_size, uint32_t* value_size);
@@ -27,7 +96,8 @@ void btree_cursor_get_value(BTreeCursor* cursor, void* value_buffer, uint32_t bu
 BTreeCursor* leaf_node_find(BTree* btree, page_num_t page_num, uint32_t key);
 BTreeCursor* internal_node_find(BTree* btree, page_num_t page_num, uint32_t key);
 uint32_t get_node_max_key(void* node);
-void leaf_node_split_and_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size);
+uint32_t get_subtree_max_key(BTree* btree, page_num_t page_num);
+int leaf_node_split_and_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size);
 void internal_node_insert(BTree* btree, page_num_t parent_page_num, page_num_t child_page_num);
 uint32_t internal_node_find_child(void* node, uint32_t key);
 void update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key);
@@ -51,6 +121,10 @@ void* leaf_node_cell(void* node, uint32_t cell_num);
 uint32_t* leaf_node_key(void* node, uint32_t cell_num);
 uint32_t* leaf_node_value_size(void* node, uint32_t cell_num);
 void* leaf_node_value(void* node, uint32_t cell_num);
+uint32_t leaf_cell_key(void* cell);
+uint32_t leaf_cell_value_size(void* cell);
+void* leaf_cell_value(void* cell);
+void* leaf_cell_next(void* cell);
 
 // Internal node accessors
 uint16_t* internal_node_num_keys(void* node);
@@ -67,6 +141,15 @@ void initialize_internal_node(void* node);
 struct BTree {
     Pager* pager;
     page_num_t root_page_num;
+    uint32_t page_size;                 // Read from the pager's file header
+    uint32_t internal_node_max_cells;   // Derived from page_size
+    uint32_t leaf_node_max_cells;       // Derived from page_size
+    // Internal nodes of a buffered tree, and nodes holding a buffer, keep
+    // their keys below the buffer
+    uint32_t internal_node_buffered_max_cells;
+    bool buffered;                      // Inserts go to buffers, see btree_set_buffered()
+    bool has_messages;                  // Buffers may hold messages
+    StatsCounters* counters;            // Split counters, see btree_stats()
 };
 
 struct BTreeCursor {
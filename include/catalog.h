@@ -0,0 +1,89 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "analyze.h"
+#include "btree.h"
+#include "index.h"
+#include "row.h"
+
+// The catalog lists a database's tables and indexes. It is itself a B-tree,
+// the one rooted at page 0, holding one row per table (its name, root page
+// and column definitions) and one per index (its name, root page, table and
+// column). Each table is a B-tree keyed by its first column, which must be
+// an INT; the other columns are stored as a row. Indexes are described in
+// index.h. ANALYZE adds rows holding the tables' and indexes' statistics
+// (see analyze.h): one for each tree's shape and one per table column.
+
+#define CATALOG_MAX_NAME 32
+#define CATALOG_MAX_COLUMNS (ROW_MAX_COLUMNS + 1)
+
+typedef struct Index Index;
+
+typedef struct {
+    uint32_t id;                  // Key of the table's catalog row
+    char name[CATALOG_MAX_NAME];
+    uint32_t num_columns;         // Including the key, column 0
+    char column_names[CATALOG_MAX_COLUMNS][CATALOG_MAX_NAME];
+    ColumnType column_types[CATALOG_MAX_COLUMNS];
+    RowSchema schema;             // Layout of columns 1.. in the stored rows
+    BTree* btree;
+    Index** indexes;
+    uint32_t num_indexes;
+    TableStats stats;
+    // Keys of the catalog rows holding the statistics: the shape's, then
+    // each column's; 0 before the first ANALYZE
+    uint32_t stats_ids[CATALOG_MAX_COLUMNS + 1];
+} Table;
+
+struct Index {
+    uint32_t id;                  // Key of the index's catalog row
+    char name[CATALOG_MAX_NAME];
+    Table* table;
+    SecondaryIndex index;         // index.columns are the table's column numbers
+    IndexStats stats;
+    uint32_t stats_id;            // Key of the statistics' catalog row, or 0
+};
+
+typedef struct {
+    Pager* pager;
+    BTree* btree;
+    Table** tables;
+    uint32_t num_tables;
+    uint32_t tables_capacity;
+    uint32_t next_id;
+} Catalog;
+
+// Loads the catalog of the database in `pager`, creating it in a new file
+Catalog* catalog_open(Pager* pager);
+void catalog_close(Catalog* catalog);
+
+// Names are matched case-insensitively
+Table* catalog_find_table(Catalog* catalog, const char* name, uint32_t length);
+int32_t table_find_column(const Table* table, const char* name, uint32_t length);
+
+// Creates and records a table. Returns NULL with a message in `error` if the
+// name is taken, the definition is invalid or it does not fit in a catalog row.
+Table* catalog_create_table(Catalog* catalog, const char* name, uint32_t name_length, const char** column_names,
+                            const uint32_t* column_name_lengths, const ColumnType* column_types,
+                            uint32_t num_columns, char* error, uint32_t error_size);
+
+// Index and table names share one namespace
+Index* catalog_find_index(Catalog* catalog, const char* name, uint32_t length);
+// The table's index whose first column is `column`, if any
+Index* table_find_index(const Table* table, uint32_t column);
+
+// Creates and records an index on the first of the given columns, and fills
+// it from the rows already in the table. The other columns are stored in its
+// entries too (INCLUDE), so queries that need only those columns and the key
+// never read the table. Returns NULL with a message in `error` if the name is
+// taken or a column does not exist, is the key or is listed twice.
+Index* catalog_create_index(Catalog* catalog, const char* name, uint32_t name_length, Table* table,
+                            const char** column_names, const uint32_t* column_name_lengths, uint32_t num_columns,
+                            char* error, uint32_t error_size);
+
+// Collects the statistics of a table and its indexes, or of every table if
+// `table` is NULL, and records them in place of any earlier ones. Returns
+// false with a message in `error` if a row is corrupt or cannot be recorded.
+bool catalog_analyze(Catalog* catalog, Table* table, char* error, uint32_t error_size);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "catalog.h"
+#include "repl.h"
+#include "vm.h"
+
+// Compiles a parsed INSERT or SELECT into a program over the catalog's
+// tables. Parameters become OP_VARIABLE loads, so one program serves every
+// binding. Returns NULL with a message in `error` for unknown tables or
+// columns, or values that do not fit the columns they are compared with.
+Program* codegen_compile(Catalog* catalog, const ParsedStatement* statement, char* error, uint32_t error_size);
+
+// Resolves a column a SELECT names, qualified with its table's name or not,
+// the way codegen_compile() does. Returns the table it is in and sets its
+// position there, or returns NULL if it is unknown or ambiguous.
+Table* codegen_find_column(Catalog* catalog, const ParsedStatement* statement, SqlName name, uint32_t* column);
+
+#endif
@@ -4,7 +4,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define PAGE_SIZE 4096
+// Page size is chosen when a database is created and stored in its file
+// header. Any power of two in [MIN_PAGE_SIZE, MAX_PAGE_SIZE] is accepted.
+#define DEFAULT_PAGE_SIZE 4096
+#define MIN_PAGE_SIZE 4096
+#define MAX_PAGE_SIZE 65536
 typedef uint32_t page_num_t;
 
-#endif
\ No newline at end of file
+#endif
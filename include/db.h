@@ -0,0 +1,95 @@
+#ifndef DB_H
+#define DB_H
+
+#include "catalog.h"
+#include "pager.h"
+#include "repl.h"
+#include "vm.h"
+
+// Database handle and prepared statements: the API the REPL runs SQL
+// through.
+//
+// db_prepare() normalizes the SQL text (see sql_normalize()) and looks it up
+// in an LRU cache of compiled statements, so re-preparing a statement costs a
+// hash lookup rather than a parse and code generation. `?` parameters are
+// bound per execution:
+//
+//     PreparedStatement* statement = db_prepare(db, "SELECT name FROM users WHERE id = ?", -1);
+//     stmt_bind_int(statement, 1, 42);
+//     while (stmt_step(statement) == VM_ROW) { ... stmt_row(...) ... }
+//     stmt_finalize(statement);    // Back to the cache
+//
+// A statement is used by one caller at a time: preparing the same SQL again
+// before the first is finalized compiles a second, uncached copy.
+
+#define DB_DEFAULT_STATEMENT_CACHE_SIZE 128
+#define DB_ERROR_SIZE 256
+
+typedef struct Database Database;
+typedef struct PreparedStatement PreparedStatement;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint32_t size;                // Statements in the cache
+} StatementCacheStats;
+
+Database* db_open(const char* filename);
+Database* db_open_with_options(const char* filename, const PagerOptions* options);
+void db_close(Database* db);
+const char* db_error(Database* db);
+Catalog* db_catalog(Database* db);
+
+// 0 disables caching. Shrinking evicts the least recently used statements
+// that are not in use.
+void db_set_statement_cache_size(Database* db, uint32_t size);
+StatementCacheStats db_statement_cache_stats(Database* db);
+
+// Memory each ORDER BY may sort in before it spills runs to a temporary file,
+// SORTER_DEFAULT_MEMORY unless set. Applies to statements started afterwards.
+void db_set_sort_memory(Database* db, size_t bytes);
+// Memory each JOIN may hold build rows in before it spills partitions to a
+// temporary file, HASH_JOIN_DEFAULT_MEMORY unless set. Applies to statements
+// started afterwards.
+void db_set_join_memory(Database* db, size_t bytes);
+
+// Compiles one statement, or takes it from the cache. `length` may be -1 for
+// NUL-terminated SQL. Returns NULL with a message in db_error() on error.
+PreparedStatement* db_prepare(Database* db, const char* sql, int32_t length);
+
+// Parameters are numbered from 1 in order of appearance and start out NULL.
+// Bound text is not copied and must stay valid until the statement is reset
+// or finalized. Binding returns false for a parameter that does not exist.
+uint32_t stmt_num_parameters(PreparedStatement* statement);
+bool stmt_bind_int(PreparedStatement* statement, uint32_t parameter, int64_t value);
+bool stmt_bind_text(PreparedStatement* statement, uint32_t parameter, const char* text, uint32_t length);
+bool stmt_bind_null(PreparedStatement* statement, uint32_t parameter);
+
+// VM_ROW while rows are available, then VM_DONE; VM_ERROR with a message in
+// db_error(). Row values stay valid until the next step.
+VmStatus stmt_step(PreparedStatement* statement);
+// Runs the statement, pushing each row to `callback` as it is produced (see
+// vm_run()): rows are never collected, so memory use does not grow with the
+// result. Returns VM_ROW if the callback stopped the run early.
+VmStatus stmt_execute(PreparedStatement* statement, VmRowCallback callback, void* context);
+// Prepares, executes and finalizes in one call; a run the callback stopped
+// early counts as VM_DONE.
+VmStatus db_exec(Database* db, const char* sql, VmRowCallback callback, void* context);
+const Value* stmt_row(PreparedStatement* statement, uint32_t* num_columns);
+uint32_t stmt_num_columns(PreparedStatement* statement);
+const char* stmt_column_name(PreparedStatement* statement, uint32_t column);
+StatementType stmt_type(PreparedStatement* statement);
+// EXPLAIN statements yield a row per instruction of the statement's program
+// rather than its results: the address, opcode and operands, and for
+// EXPLAIN ANALYZE the instruction's VmProfile over a complete run
+ExplainMode stmt_explain(PreparedStatement* statement);
+// Rows each run writes: an INSERT's row count, 0 for other statements
+uint32_t stmt_changes(PreparedStatement* statement);
+
+// Rewinds to run again; bindings are kept
+void stmt_reset(PreparedStatement* statement);
+// Returns a cached statement to the cache, frees any other
+void stmt_finalize(PreparedStatement* statement);
+
+#endif
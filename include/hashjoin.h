@@ -0,0 +1,75 @@
+#ifndef HASHJOIN_H
+#define HASHJOIN_H
+
+#include "pager.h"
+#include "row.h"
+#include <stddef.h>
+
+// Hash join of rows of Values on their first value, within a memory budget.
+// The build rows are copied into an arena and indexed by an open-addressing
+// table of 8-byte slots, a hash tag and an entry number, so a probe reads one
+// cache line of slots and touches a row only when the tags match. Build rows
+// with the same key are chained from one slot.
+//
+// Rows hash into HASH_JOIN_PARTITIONS partitions by the top bits of their
+// hash. When the build side outgrows the budget, the join turns into a
+// hybrid Grace join: every partition but the first goes to a temporary
+// Pager, and the first goes too if it still does not fit. Probe rows of a
+// resident partition are joined as they stream in. Probe rows of a spilled
+// partition are written out next to its build rows, and are joined after the
+// probe input ends, one partition at a time. Each partition is written
+// through a page-sized buffer of its own and read back a window of
+// HASH_JOIN_PREFETCH_PAGES pages at a time. A build side that fits the
+// budget never touches a file.
+
+// Budget for joins whose owner does not set one
+#define HASH_JOIN_DEFAULT_MEMORY (8u * 1024 * 1024)
+// Smaller budgets are raised to this, which leaves room for the partition buffers
+#define HASH_JOIN_MIN_MEMORY (256u * 1024)
+#define HASH_JOIN_PARTITIONS 16
+// Pages of a partition read with one batch of I/O
+#define HASH_JOIN_PREFETCH_PAGES 8
+// Values in one row
+#define HASH_JOIN_MAX_VALUES 128
+
+typedef struct HashJoin HashJoin;
+
+typedef struct {
+    uint64_t build_rows;          // Build rows kept; those with a NULL key are dropped
+    uint64_t probe_rows;
+    uint64_t spilled_build_rows;
+    uint64_t spilled_probe_rows;
+    uint32_t spilled_partitions;
+    uint64_t pages_written;
+} HashJoinStats;
+
+// Of the budget, a quarter is the temporary Pager's buffer pool, the
+// partition buffers take HASH_JOIN_PARTITIONS pages and the rest holds the
+// hash table
+HashJoin* hash_join_new(size_t memory_budget);
+void hash_join_free(HashJoin* join);
+
+// Adds a build row keyed by row[0]. Returns false if the row has no values
+// or more than HASH_JOIN_MAX_VALUES, or the temporary file cannot be created.
+bool hash_join_insert(HashJoin* join, const Value* row, uint32_t count);
+// Ends the build input
+void hash_join_build(HashJoin* join);
+
+// Looks up a probe row by row[0] and moves to the first build row with an
+// equal key. Returns false if there is none, the key is NULL, or the row's
+// partition is spilled: the row is then saved for hash_join_replay().
+bool hash_join_probe(HashJoin* join, const Value* row, uint32_t count);
+// Moves to the next build row matching the probe; false after the last
+bool hash_join_next(HashJoin* join);
+// The current matching build row, valid until the next probe or move
+const Value* hash_join_match(HashJoin* join, uint32_t* count);
+
+// Once the probe input has ended, returns the saved probe rows one at a
+// time, each with its partition's build rows loaded, so hash_join_probe()
+// finds its matches. Returns NULL after the last. The row is valid until the
+// next call.
+const Value* hash_join_replay(HashJoin* join, uint32_t* count);
+
+HashJoinStats hash_join_stats(const HashJoin* join);
+
+#endif
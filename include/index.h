@@ -0,0 +1,58 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "btree.h"
+#include "row.h"
+
+// Secondary indexes. B-tree keys are 32 bits, so an index B-tree is keyed by
+// a 32-bit image of the indexed value rather than the value itself: integers
+// map in order (values outside the int32 range share the end images), text
+// maps through a hash. A cell holds every entry whose value has its image,
+// in primary key order. An entry is the row's primary key plus a payload:
+// the row's indexed value and any INCLUDE columns, encoded with the index's
+// RowSchema, so a query that reads only those columns never needs the row.
+//
+// Entries sit inline in the cell while they fit in INDEX_MAX_INLINE bytes.
+// Past that the cell's entries move to a B-tree of their own, keyed by
+// primary key, and the cell keeps its root page.
+//
+// Images are lossy, so readers recheck the values they get. Integer images
+// keep the values' order, so an index on an INT column serves ranges as well
+// as equality; a text index serves equality only.
+
+#define INDEX_MAX_INLINE 240
+#define INDEX_MAX_PAYLOAD 256
+
+typedef struct {
+    BTree* btree;
+    uint32_t num_columns;               // Table columns in the payload
+    uint32_t columns[ROW_MAX_COLUMNS];  // columns[0] is the indexed column
+    RowSchema schema;                   // Payload layout
+} SecondaryIndex;
+
+typedef struct IndexCursor IndexCursor;
+
+uint32_t index_image(const Value* value);
+
+// Adds the entry for the row with primary key `key`. `values` holds the
+// row's columns in table order, key first. Rows whose indexed value is NULL
+// are not indexed. Returns -1 if the entry is already there or its payload
+// is larger than INDEX_MAX_PAYLOAD.
+int index_insert(const SecondaryIndex* index, uint32_t key, const Value* values);
+
+// Cursors visit the entries whose images lie in [lower, upper], by image and
+// then primary key. Seek and next return false once there are no more.
+IndexCursor* index_cursor_new(const SecondaryIndex* index);
+void index_cursor_free(IndexCursor* cursor);
+bool index_cursor_seek(IndexCursor* cursor, uint32_t lower, uint32_t upper);
+bool index_cursor_next(IndexCursor* cursor);
+uint32_t index_cursor_key(IndexCursor* cursor);
+// Points into the page holding the entry: valid until the next pager
+// operation
+const uint8_t* index_cursor_payload(IndexCursor* cursor, uint32_t* size);
+
+// Root page of the entry tree a cell value of the index's B-tree holds, or 0
+// if its entries are inline
+page_num_t index_cell_tree(const uint8_t* cell);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A small LZ77 codec in the style of LZ4's block format, used for compressed
+// database pages. The output is a series of sequences, each a token byte
+// (literal count in the high nibble, match length minus LZ_MIN_MATCH in the
+// low one, 15 meaning more length bytes follow), the literals, and a 2-byte
+// little-endian offset back to the match. The last sequence has literals
+// only. A match may overlap its own output, so runs of one byte, such as a
+// page's unused tail, cost a few bytes.
+//
+// Matches are found through a hash table of 4-byte prefixes, one candidate
+// per slot, so compression is a single pass over the input. Inputs are at
+// most LZ_MAX_INPUT bytes, which keeps every offset in 16 bits.
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_INPUT 65536
+
+// Compresses `length` bytes into at most `capacity`. Returns the compressed
+// size, or 0 if it does not fit.
+size_t lz_compress(const void* source, size_t length, void* destination, size_t capacity);
+
+// Expands `length` compressed bytes into exactly `expected` bytes. Returns
+// false if the input is corrupt or does not expand to that size.
+bool lz_decompress(const void* source, size_t length, void* destination, size_t expected);
+
+#endif
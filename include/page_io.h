@@ -0,0 +1,36 @@
+#ifndef PAGE_IO_H
+#define PAGE_IO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "common.h"
+
+// Batched page I/O used by the pager. A batch is submitted as a whole and
+// returns once every request in it has completed; with io_uring up to the
+// queue depth of them are in flight at once, with the synchronous backend
+// adjacent requests are coalesced into vectored reads and writes. Short
+// transfers are resumed, so a request ends with its full length, less only
+// for a read that reaches end of file, or -errno.
+typedef enum {
+    PAGE_IO_SYNC,      // pread/pwrite on the calling thread
+    PAGE_IO_URING      // io_uring, falls back to synchronous I/O
+} PageIoBackend;
+
+typedef struct {
+    void* buffer;
+    size_t length;
+    off_t offset;
+    ssize_t result;    // Bytes transferred, or -errno
+} PageIoRequest;
+
+typedef struct PageIo PageIo;
+
+// Never fails for PAGE_IO_SYNC. When io_uring cannot be set up (old kernel,
+// disabled by policy) the synchronous backend is used instead.
+PageIo* page_io_open(int file_descriptor, PageIoBackend backend, uint32_t queue_depth);
+PageIoBackend page_io_backend(PageIo* io);
+void page_io_read(PageIo* io, PageIoRequest* requests, uint32_t count);
+void page_io_write(PageIo* io, PageIoRequest* requests, uint32_t count);
+void page_io_close(PageIo* io);
+
+#endif
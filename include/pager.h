@@ -2,14 +2,120 @@
 #define PAGER_H
 
 #include "common.h"
+#include "page_io.h"
 
 typedef struct Pager Pager;
 
+#define PAGER_DEFAULT_CACHE_FRAMES 2000
+#define PAGER_MIN_CACHE_FRAMES 16
+#define PAGER_DEFAULT_READ_AHEAD_PAGES 32
+#define PAGER_DEFAULT_IO_QUEUE_DEPTH 64
+
+// Backing for the buffer pool's frame arena
+typedef enum {
+    PAGER_HUGE_PAGES_OFF,
+    PAGER_HUGE_PAGES_TRANSPARENT,   // madvise(MADV_HUGEPAGE) on the arena
+    PAGER_HUGE_PAGES_EXPLICIT       // MAP_HUGETLB, falls back to transparent
+} PagerHugePages;
+
+// On-disk page format. A compressed file stores each page as an extent of
+// 512-byte sectors holding its lz.h image, or the raw page when that saves
+// nothing, and keeps a map from page numbers to extents. Frames always hold
+// whole pages: they are decompressed on read and compressed on writeback. An
+// extent that no longer fits its page moves, and the space it leaves is
+// reused by later writes. The map is written, and the file synced, at each
+// pager_flush_all(); until then the previous map and every extent it
+// references are left untouched, so a crash loses the writes since the last
+// checkpoint but not the file. Compressed files are read through the OS page
+// cache, which then caches compressed pages, so direct_io does not apply.
+typedef enum {
+    PAGER_COMPRESSION_NONE,
+    PAGER_COMPRESSION_LZ
+} PagerCompression;
+
+typedef struct {
+    uint32_t page_size;      // Only used when the file is created
+    uint32_t cache_frames;   // Buffer pool capacity in pages
+    PagerHugePages huge_pages;
+    bool direct_io;          // Bypass the OS page cache with O_DIRECT
+    uint32_t read_ahead_pages; // Largest scan read-ahead window, 0 disables
+    PageIoBackend io_backend;
+    uint32_t io_queue_depth; // I/Os kept in flight by the io_uring backend
+    PagerCompression compression; // Only used when the file is created
+} PagerOptions;
+
+// How the caller is about to use a page. The buffer pool uses this to keep
+// scans from flushing out the pages that point lookups depend on.
+typedef enum {
+    PAGE_HINT_NORMAL,     // Point access
+    PAGE_HINT_SCAN,       // Sequential scan: stays on probation, never promoted
+    PAGE_HINT_INTERNAL    // Interior B-tree node: retained preferentially
+} PageHint;
+
+// Counters accumulate from pager_open(); the rest is a snapshot
+typedef struct {
+    uint64_t hits;              // pager_get_page() calls served from the pool
+    uint64_t misses;
+    uint64_t page_reads;        // Pages read from the file
+    uint64_t page_writes;       // Pages written to the file
+    uint64_t evictions;
+    uint64_t read_ahead_pages;  // Pages read speculatively by scans
+    uint64_t bytes_read;        // File bytes behind page_reads, less if compressed
+    uint64_t bytes_written;
+    uint32_t page_size;
+    uint32_t num_pages;
+    uint32_t capacity;          // Frames in the pool
+    uint32_t cached_pages;
+    uint32_t dirty_pages;
+    uint32_t overflow_frames;   // Frames beyond capacity, see pager_begin_op()
+    uint64_t bytes_allocated;   // Frames plus pool bookkeeping
+} PagerStats;
+
+void pager_default_options(PagerOptions* options);
+
+// Opens (or creates) a database file. An existing file keeps the page size
+// recorded in its header; a new file is created with `page_size`.
 Pager* pager_open(const char* filename);
+Pager* pager_open_with_page_size(const char* filename, uint32_t page_size);
+Pager* pager_open_with_options(const char* filename, const PagerOptions* options);
+// Opens a read-only view of `source`'s file with a buffer pool of its own, so
+// that another thread can read while `source` is left alone. `source`'s dirty
+// pages are flushed first; the reader must be closed before `source` is
+// written again. Marking a reader's page dirty is a fatal error.
+Pager* pager_open_reader(Pager* source, uint32_t cache_frames);
+// Opens a pager on a new file in $TMPDIR (or /tmp) that is unlinked at once,
+// so it disappears when the pager is closed or the process exits. Operators
+// that spill keep their runs and partitions there; dirty pages are dropped
+// at close instead of written back.
+Pager* pager_open_temporary(const PagerOptions* options);
 void* pager_get_page(Pager* pager, page_num_t page_num);
+void* pager_get_page_hinted(Pager* pager, page_num_t page_num, PageHint hint);
 void pager_mark_dirty(Pager* pager, page_num_t page_num);
 void pager_flush_page(Pager* pager, page_num_t page_num);
+// Writes back every dirty page as one batch of I/O (a checkpoint). A
+// compressed file also gets its extent map and header, synced.
+void pager_flush_all(Pager* pager);
 void pager_close(Pager* pager);
 uint32_t pager_get_num_pages(Pager* pager);
+uint32_t pager_get_page_size(Pager* pager);
+uint32_t pager_get_capacity(Pager* pager);
+PagerHugePages pager_get_huge_pages(Pager* pager);
+bool pager_is_direct_io(Pager* pager);
+PageIoBackend pager_get_io_backend(Pager* pager);
+PagerCompression pager_get_compression(Pager* pager);
+PagerStats pager_stats(Pager* pager);
+// The hit and miss counters alone, without the walk of the pool
+// pager_stats() makes: cheap enough to read around every VM instruction
+void pager_access_counts(Pager* pager, uint64_t* hits, uint64_t* misses);
+
+// Pages returned since the last call stay resident; older page pointers may be
+// evicted. The B-tree calls this at the start of every public operation.
+void pager_begin_op(Pager* pager);
+bool pager_page_is_cached(Pager* pager, page_num_t page_num);
+
+// Reads whichever of `page_nums` are not resident with one batch of I/O and
+// keeps them for the current operation. Used to overlap the reads of batched
+// lookups; later pager_get_page() calls for these pages are hits.
+void pager_prefetch(Pager* pager, const page_num_t* page_nums, uint32_t count, PageHint hint);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,54 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "btree.h"
+
+// Parallel scans. A scan's key range is cut into morsels at the separator
+// keys of the B-tree's upper levels, so each morsel covers whole subtrees.
+// Each worker starts with a contiguous share of the morsels. Once its own
+// share runs out, it steals from the far end of the others' shares. Every
+// worker reads through its own pager_open_reader(), so workers never share a
+// buffer pool, and folds rows into a partial aggregate of its own. The
+// partials are merged when every worker is done.
+
+#define PARALLEL_MAX_THREADS 256
+// Morsels per worker when the tree has enough separators: enough to even out
+// skewed subtrees, few enough that a morsel spans many leaves
+#define PARALLEL_MORSELS_PER_THREAD 8
+// Buffer pool of each worker's reader
+#define PARALLEL_READER_CACHE_FRAMES 512
+
+typedef struct ThreadPool ThreadPool;
+
+// num_threads counts the calling thread, which works too; 0 means one per
+// online CPU
+ThreadPool* thread_pool_new(uint32_t num_threads);
+void thread_pool_free(ThreadPool* pool);
+uint32_t thread_pool_size(const ThreadPool* pool);
+// Runs task(context, worker) on every worker, worker 0 being the caller, and
+// returns when all of them have finished
+void thread_pool_run(ThreadPool* pool, void (*task)(void* context, uint32_t worker), void* context);
+
+typedef struct {
+    uint32_t state_size;          // Bytes of one partial aggregate
+    void (*init)(void* state, void* context);
+    // Called for each row of a morsel in key order. The value points into a
+    // page of the worker's reader and is only valid during the call.
+    void (*row)(void* state, void* context, uint32_t key, const uint8_t* value, uint32_t value_size);
+    // Folds a worker's partial into `state`
+    void (*merge)(void* state, const void* partial, void* context);
+} ScanAggregate;
+
+typedef struct {
+    uint32_t morsels;             // Key ranges the scan was cut into
+    uint32_t steals;              // Morsels run by a worker other than their owner
+} ParallelScanStats;
+
+// Aggregates the rows with keys in [lower, upper] into `result`, a
+// state_size buffer, on the pool's workers. A NULL pool scans on the calling
+// thread. The tree's pager is flushed first and must not be used until the
+// scan returns. Returns -1 if a reader could not be opened.
+int parallel_scan(ThreadPool* pool, BTree* btree, uint32_t lower, uint32_t upper, const ScanAggregate* aggregate,
+                  void* context, void* result, ParallelScanStats* stats);
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef REPL_H
+#define REPL_H
+
+#include "vm.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// SQL front end: tokenizer, parser and the REPL. Tokens and parsed
+// statements point into the SQL text, which must outlive them; nothing is
+// copied per token.
+
+typedef enum {
+    TOKEN_END,
+    TOKEN_IDENTIFIER,     // Also keywords, which are matched case-insensitively
+    TOKEN_INTEGER,
+    TOKEN_STRING,         // Text between the quotes
+    TOKEN_PARAMETER,      // ?
+    TOKEN_SYMBOL,         // ( ) , ; * = != <> < <= > >= - .
+    TOKEN_ERROR
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    const char* start;
+    uint32_t length;
+} Token;
+
+typedef struct {
+    const char* position;
+    const char* end;
+} Tokenizer;
+
+void tokenizer_init(Tokenizer* tokenizer, const char* sql, uint32_t length);
+Token tokenizer_next(Tokenizer* tokenizer);
+
+// Bump allocator for parsed statements. Everything a parse allocates comes
+// from the arena and goes away together on sql_arena_reset(), which keeps
+// the largest block, so a stream of statements stops allocating once the
+// arena has grown to fit the biggest of them.
+typedef struct SqlArenaBlock SqlArenaBlock;
+
+typedef struct {
+    SqlArenaBlock* block;         // Current block; older, smaller ones chain behind it
+} SqlArena;
+
+void sql_arena_init(SqlArena* arena);
+void* sql_arena_alloc(SqlArena* arena, size_t size);
+void sql_arena_reset(SqlArena* arena);
+void sql_arena_free(SqlArena* arena);
+
+typedef struct {
+    const char* start;
+    uint32_t length;
+} SqlName;
+
+// Splits a column name that may be qualified, `table.column`, into its
+// parts; an unqualified name gets an empty table
+void sql_split_name(SqlName name, SqlName* table, SqlName* column);
+
+typedef enum {
+    EXPR_NULL,
+    EXPR_INTEGER,
+    EXPR_STRING,
+    EXPR_PARAMETER
+} ExprType;
+
+typedef struct {
+    ExprType type;
+    int64_t integer;
+    SqlName text;
+    uint32_t parameter;   // 0-based, in order of appearance
+} Expr;
+
+// WHERE terms are `column op value`, joined by AND. Column names here and in
+// result columns, ORDER BY and ON may be qualified with their table's name.
+typedef struct {
+    SqlName column;
+    CompareOp op;
+    Expr value;
+} Condition;
+
+typedef enum {
+    STATEMENT_CREATE_TABLE,
+    STATEMENT_CREATE_INDEX,
+    STATEMENT_INSERT,
+    STATEMENT_SELECT,
+    STATEMENT_ANALYZE             // ANALYZE [table]; an empty table analyzes them all
+} StatementType;
+
+typedef enum {
+    EXPLAIN_NONE,
+    EXPLAIN_PROGRAM,              // EXPLAIN: the program's instructions
+    EXPLAIN_ANALYZE               // EXPLAIN ANALYZE: run it, then each instruction's VmProfile
+} ExplainMode;
+
+#define SQL_MAX_COLUMNS 65
+#define SQL_MAX_CONDITIONS 16
+#define SQL_MAX_ORDER_BY 16
+
+typedef struct {
+    StatementType type;
+    ExplainMode explain;          // Only for INSERT and SELECT
+    SqlName table;
+    SqlName index;                // CREATE INDEX
+    // SELECT ... FROM table JOIN join_table ON join_on[0] = join_on[1]; an
+    // empty join_table for single-table queries
+    SqlName join_table;
+    SqlName join_on[2];
+    // CREATE TABLE definitions, CREATE INDEX's column then its INCLUDE
+    // columns, or SELECT's result columns (none for *)
+    uint32_t num_columns;
+    SqlName columns[SQL_MAX_COLUMNS];
+    ColumnType column_types[SQL_MAX_COLUMNS];
+    // SELECT COUNT/SUM/MIN/MAX: every result column is then functions[i] of
+    // columns[i], and COUNT(*) has an empty column name
+    bool aggregate;
+    AggregateFunction functions[SQL_MAX_COLUMNS];
+    uint32_t num_conditions;
+    Condition conditions[SQL_MAX_CONDITIONS];
+    // SELECT ... ORDER BY columns, most significant first
+    uint32_t num_order_by;
+    SqlName order_by[SQL_MAX_ORDER_BY];
+    bool order_descending[SQL_MAX_ORDER_BY];
+    // INSERT rows, num_rows * row_width values
+    uint32_t num_rows;
+    uint32_t row_width;
+    Expr* values;
+    uint32_t values_capacity;
+    uint32_t num_parameters;
+} ParsedStatement;
+
+// Parses one statement into `arena`; a trailing ';' is optional. The
+// statement lives until the arena is reset. Returns NULL with a message in
+// `error` on a syntax error.
+ParsedStatement* sql_parse(SqlArena* arena, const char* sql, uint32_t length, char* error, uint32_t error_size);
+
+// Rewrites a statement with one space between tokens, except around the
+// dot of a qualified name, and keywords and identifiers in lower case, so
+// that statements differing only in layout or case read the same. Returns
+// the length written (not NUL-terminated), or 0 if the text does not
+// tokenize or does not fit in `size` bytes.
+uint32_t sql_normalize(const char* sql, uint32_t length, char* out, uint32_t size);
+
+// Splits SQL read from a file descriptor into statements at the `;`s outside
+// quotes, reading in large chunks. Each statement is handed out in place in
+// the read buffer, without its `;`, and stays valid until the next call.
+// Statements may span reads; the scan resumes where the last read ended, so
+// no byte is looked at twice. At the start of a statement, a line starting
+// with '.' is a REPL command and ends at the newline.
+#define SQL_READER_CHUNK 65536
+
+typedef struct {
+    int fd;
+    char* buffer;
+    size_t capacity;
+    size_t start;                 // First byte of the next statement
+    size_t scanned;               // Bytes before this hold no statement end
+    size_t end;                   // Bytes read
+    char quote;                   // Open quote at `scanned`, or 0
+    bool eof;
+    const char* prompt;           // Printed before reads at a statement start, if set
+    const char* continuation;     // Printed before reads inside a statement
+} SqlReader;
+
+void sql_reader_init(SqlReader* reader, int fd);
+// False at the end of the input. A final statement without a ';' is still
+// returned; a blank one is not.
+bool sql_reader_next(SqlReader* reader, const char** sql, uint32_t* length);
+void sql_reader_free(SqlReader* reader);
+
+struct Database;
+
+// Runs every statement read from `fd` against `db`, printing results and
+// errors. Prompts when `fd` is a terminal. Returns the number of statements
+// that failed.
+uint32_t repl_run(struct Database* db, int fd);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef ROW_H
+#define ROW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Values and the row format tables store as B-tree values
+
+typedef enum {
+    VALUE_NULL,
+    VALUE_INT,
+    VALUE_TEXT,
+    VALUE_BLOB          // Encoded row, only produced by OP_MAKE_RECORD
+} ValueType;
+
+// Text and blob values point into the page, program or row they came from
+// and are not NUL-terminated
+typedef struct {
+    ValueType type;
+    uint32_t length;      // Bytes of text or blob
+    int64_t integer;
+    const char* text;     // Text or blob bytes
+} Value;
+
+typedef enum {
+    COLUMN_INT,           // Fixed width: int64
+    COLUMN_TEXT           // Variable length
+} ColumnType;
+
+#define ROW_MAX_COLUMNS 64
+
+// Column layout derived from a table's column types. Offsets are computed
+// once here so that reading a column from a row is a few loads, not a walk
+// over the columns before it.
+//
+// Row layout:
+//   uint16 column count n (rows written before columns were added have fewer)
+//   null bitmap, (n + 7) / 8 bytes, bit set = NULL
+//   fixed area: every fixed-width column of the first n, at fixed_offset[]
+//   uint16 end offset of each variable-length column of the first n,
+//   relative to the start of the variable-length data
+//   variable-length data
+typedef struct {
+    uint16_t num_columns;
+    uint8_t types[ROW_MAX_COLUMNS];
+    uint16_t fixed_offset[ROW_MAX_COLUMNS];      // Fixed columns: offset in the fixed area
+    uint16_t var_slot[ROW_MAX_COLUMNS];          // Variable columns: index in the offset table
+    uint16_t fixed_size[ROW_MAX_COLUMNS + 1];    // Fixed area size of a row of n columns
+    uint16_t num_var[ROW_MAX_COLUMNS + 1];       // Variable columns among the first n
+} RowSchema;
+
+// Returns false if there are more than ROW_MAX_COLUMNS columns
+bool row_schema_init(RowSchema* schema, const ColumnType* types, uint32_t num_columns);
+
+// Encodes `count` values (at most the schema's columns). Returns the row size,
+// or 0 if it does not fit in `buffer_size` bytes or a value does not match its
+// column's type.
+uint32_t row_encode(const RowSchema* schema, const Value* values, uint32_t count, uint8_t* buffer,
+                    uint32_t buffer_size);
+
+// Reads one column in place: text points into the row. Columns the row
+// predates read as NULL. Returns false for a corrupt row.
+bool row_column(const RowSchema* schema, const uint8_t* row, uint32_t row_size, uint32_t column, Value* value);
+
+// Reads INT column `column` without building a Value, for loops that fold a
+// column over many rows. Returns false if it is NULL, the row predates it or
+// the row is corrupt.
+bool row_int_column(const RowSchema* schema, const uint8_t* row, uint32_t row_size, uint32_t column,
+                    int64_t* value);
+
+// Value records: a self-describing encoding of a row of Values, for operators
+// that copy rows into memory or spill them to temporary files. A record is its
+// uint32 size, including this header, and uint16 value count, then each value
+// as a type byte followed by an int64 for integers, a uint32 length and the
+// bytes for text and blobs, or nothing for NULL.
+#define VALUE_RECORD_HEADER_SIZE (sizeof(uint32_t) + sizeof(uint16_t))
+
+uint32_t value_record_size(const Value* values, uint32_t count);
+// Writes `count` values into a buffer of value_record_size() bytes
+void value_record_encode(const Value* values, uint32_t count, uint32_t size, uint8_t* out);
+// Decodes up to `max` values and returns how many; text points into the record
+uint32_t value_record_decode(const uint8_t* record, Value* values, uint32_t max);
+uint32_t value_record_length(const uint8_t* record);
+
+#endif
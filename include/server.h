@@ -0,0 +1,81 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "db.h"
+
+// Server mode: one process owns a database and serves it over a Unix domain
+// socket, so many application processes share its buffer pool and statement
+// cache instead of each opening the file with pools of their own.
+//
+// The calling thread runs an epoll loop that accepts clients and waits for
+// their sockets. A ready connection goes to one of a fixed pool of workers,
+// which reads what has arrived, runs every complete request and writes the
+// responses back. Connections are registered EPOLLONESHOT, so a connection is
+// handled by one worker at a time and its responses keep request order. The
+// engine is single-threaded, so statements run one at a time under a
+// database lock; workers overlap the rest: reading and decoding requests,
+// and writing responses that fit under SERVER_OUTPUT_HIGH_WATER.
+//
+// A larger result is written to the client while its statement runs, still
+// under the lock, so the server holds at most about SERVER_OUTPUT_HIGH_WATER
+// bytes of it. A client that takes nothing for SERVER_WRITE_TIMEOUT_MS
+// meanwhile gets the rows sent so far and then an ERROR, and the lock goes
+// to the next statement.
+//
+// Protocol. Every frame, either way, is a little-endian uint32 byte count of
+// the rest, then a uint32 request id chosen by the client and a type byte.
+// Clients may pipeline: send any number of requests without waiting.
+//
+//   SERVER_REQUEST_QUERY   uint16 parameter count, the parameters, then the
+//                          SQL text up to the end of the frame
+//   SERVER_RESPONSE_ROW    uint16 column count, then the values
+//   SERVER_RESPONSE_DONE   uint32 rows written (stmt_changes())
+//   SERVER_RESPONSE_ERROR  the message up to the end of the frame
+//
+// A value is a ValueType byte followed by an int64 for VALUE_INT, a uint32
+// length and the bytes for VALUE_TEXT, and nothing for VALUE_NULL. Each
+// request gets its rows and then one DONE or ERROR. A frame larger than
+// SERVER_MAX_FRAME, or one that cannot be decoded, closes the connection.
+
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_MAX_WORKERS 256
+#define SERVER_MAX_FRAME (16u << 20)
+#define SERVER_FRAME_HEADER_SIZE 9
+// A worker stops running a connection's requests once this many response
+// bytes are waiting for the client to read them, and a running statement
+// writes them out before it steps further
+#define SERVER_OUTPUT_HIGH_WATER (1u << 20)
+#define SERVER_WRITE_TIMEOUT_MS 1000
+
+typedef enum {
+    SERVER_REQUEST_QUERY = 1
+} ServerRequestType;
+
+typedef enum {
+    SERVER_RESPONSE_ROW = 1,
+    SERVER_RESPONSE_DONE,
+    SERVER_RESPONSE_ERROR
+} ServerResponseType;
+
+typedef struct Server Server;
+
+typedef struct {
+    uint64_t connections;         // Accepted since server_open()
+    uint64_t requests;
+    uint64_t errors;              // Requests answered with an ERROR
+} ServerStats;
+
+// Listens on `socket_path`, replacing a stale socket file there. 0 workers
+// means SERVER_DEFAULT_WORKERS. Returns NULL if the socket cannot be set up.
+Server* server_open(Database* db, const char* socket_path, uint32_t num_workers);
+// Serves clients on the calling thread until server_stop(). Returns -1 if
+// the event loop failed.
+int server_run(Server* server);
+// Makes server_run() return. Safe to call from a signal handler.
+void server_stop(Server* server);
+ServerStats server_stats(Server* server);
+// Disconnects every client and removes the socket file. The database stays
+// open.
+void server_close(Server* server);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SORTER_H
+#define SORTER_H
+
+#include "pager.h"
+#include "row.h"
+#include <stddef.h>
+
+// External merge sort of rows of Values within a memory budget. Rows are
+// copied into an in-memory run until the run's share of the budget is spent;
+// the run is then sorted and spilled as a stream of records over consecutive
+// pages of a temporary Pager, on an unlinked file created by the first spill.
+// When the input ends, the runs are merged through a loser tree, which
+// replays one leaf-to-root path of log2(k) comparisons per row for k runs.
+// Each run's reader prefetches SORTER_PREFETCH_PAGES of its pages at a time,
+// so the merge reads every run in batches of I/O. If there are more runs than
+// the buffer pool can keep a prefetch window for, intermediate passes merge
+// them into longer runs first. Input that fits the budget is sorted in memory
+// and never touches a file.
+
+// Budget for sorters whose owner does not set one
+#define SORTER_DEFAULT_MEMORY (8u * 1024 * 1024)
+// Smaller budgets are raised to this
+#define SORTER_MIN_MEMORY (64u * 1024)
+// Keys are selected by a bitmask of descending keys
+#define SORTER_MAX_KEYS 32
+// Values in one row
+#define SORTER_MAX_VALUES 128
+// Pages of a run read with one batch of I/O during a merge
+#define SORTER_PREFETCH_PAGES 8
+// Runs merged at once, whatever the buffer pool allows
+#define SORTER_MAX_FAN_IN 64
+
+typedef struct Sorter Sorter;
+
+typedef struct {
+    uint64_t rows;
+    uint32_t runs;                // Runs spilled, including those of merge passes
+    uint32_t merge_passes;        // Intermediate passes before the final merge
+    uint64_t pages_written;       // Pages of runs in the temporary file
+} SorterStats;
+
+// Rows sort by their first num_keys values in vm_value_compare() order, key
+// i descending if bit i of `descending` is set. Rows that tie on every key
+// come out in the order they were added. Of the budget, three quarters hold
+// the in-memory run and the rest is the temporary Pager's buffer pool.
+Sorter* sorter_new(uint32_t num_keys, uint32_t descending, size_t memory_budget);
+void sorter_free(Sorter* sorter);
+// Copies a row of at least num_keys and at most SORTER_MAX_VALUES values.
+// Returns false if the row does not fit those limits or the temporary file
+// cannot be created.
+bool sorter_add(Sorter* sorter, const Value* row, uint32_t count);
+// Ends the input and moves to the first row. Returns false if there are no
+// rows. No row can be added afterwards.
+bool sorter_sort(Sorter* sorter);
+// Moves to the next row; false at the end
+bool sorter_next(Sorter* sorter);
+// The current row. Text points into the sorter and is valid until the next
+// sorter_next().
+const Value* sorter_row(Sorter* sorter, uint32_t* count);
+SorterStats sorter_stats(const Sorter* sorter);
+
+#endif
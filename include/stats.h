@@ -0,0 +1,46 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "common.h"
+
+// Hot-path event counters. Each thread increments its own cache-line-sized
+// shard, so counting never contends with other threads; readers sum the
+// shards. Building with -DMINISQL_NO_STATS compiles every increment away.
+#define STATS_SHARDS 16
+#define STATS_MAX_COUNTERS 8
+
+typedef struct {
+    uint64_t values[STATS_MAX_COUNTERS];
+} __attribute__((aligned(64))) StatsShard;
+
+typedef struct {
+    StatsShard shards[STATS_SHARDS];
+} StatsCounters;
+
+StatsCounters* stats_counters_new(void);
+void stats_counters_free(StatsCounters* counters);
+uint64_t stats_counters_sum(const StatsCounters* counters, uint32_t counter);
+
+// Shard of the calling thread, assigned round-robin on first use
+extern __thread uint32_t stats_thread_shard;
+uint32_t stats_assign_thread_shard(void);
+
+static inline void stats_add(StatsCounters* counters, uint32_t counter, uint64_t amount) {
+#ifdef MINISQL_NO_STATS
+    (void)counters;
+    (void)counter;
+    (void)amount;
+#else
+    uint32_t shard = stats_thread_shard;
+    if (shard == 0) {
+        shard = stats_assign_thread_shard();
+    }
+    __atomic_fetch_add(&counters->shards[shard - 1].values[counter], amount, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void stats_inc(StatsCounters* counters, uint32_t counter) {
+    stats_add(counters, counter, 1);
+}
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef VM_H
+#define VM_H
+
+#include "btree.h"
+#include "index.h"
+#include "row.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Register-based bytecode VM. A Program is a flat array of instructions with
+// up to three integer operands; p2 is always the jump target of instructions
+// that branch. Registers hold Values, cursors walk a BTree in key order and
+// read its rows through the table's RowSchema. Index cursors walk a
+// SecondaryIndex's entries.
+
+typedef enum {
+    OP_HALT,            // Stop; vm_step() returns VM_DONE
+    OP_GOTO,            // pc = p2
+    OP_INTEGER,         // r[p1] = p3
+    OP_INT64,           // r[p1] = 64-bit integer stored as text constant p3
+    OP_STRING,          // r[p1] = text constant p3
+    OP_NULL,            // r[p1] = NULL
+    OP_VARIABLE,        // r[p1] = bound parameter p3 (0-based)
+    OP_MOVE,            // r[p1] = r[p3]
+    OP_ADD,             // r[p1] = r[p1] + r[p3] (NULL if either is NULL)
+
+    OP_OPEN_READ,       // Cursor p1 on table p3
+    OP_CLOSE,           // Close cursor p1
+    OP_REWIND,          // Cursor p1 to the first row; if the table is empty pc = p2
+    OP_SEEK_GE,         // Cursor p1 to the first key >= r[p3]; if there is none (or r[p3]
+                        // is not an integer) pc = p2
+    OP_NEXT,            // Advance cursor p1; if it is on a row pc = p2
+    OP_KEY,             // r[p1] = key of cursor p3's row
+    OP_COLUMN,          // r[p1] = column (p3 & 0xffff) of cursor (p3 >> 16)'s row
+
+    // Secondary indexes. OP_KEY on an index cursor reads the entry's primary key,
+    // and OP_COLUMN column k of its payload: the index's columns[k].
+    OP_OPEN_INDEX,      // Cursor p1 on index p3
+    OP_INDEX_SEEK_EQ,   // Index cursor p1 to the entries whose image is r[p3]'s; if none pc = p2
+    OP_INDEX_SEEK_RANGE,// Index cursor p1 to the entries of integers in [r[p3], r[p3 + 1]], where
+                        // a bound that is not an integer is open; if none pc = p2
+    OP_INDEX_NEXT,      // Advance index cursor p1; if it is on an entry pc = p2
+    OP_INDEX_INSERT,    // Add the row in registers [p1, p1 + its table's column count), key first,
+                        // to index p2; error if the payload is too large
+
+    // Vectorized scans: a cursor reads a batch of rows at once, filters narrow
+    // the batch's selection, and OP_KEY/OP_COLUMN then read the selected rows
+    OP_BATCH_NEXT,      // Fill cursor p1's batch from its position, up to key r[p3] if p3 >= 0
+                        // (inclusive, ignored unless an integer); if there are no rows pc = p2
+    OP_BATCH_FILTER,    // Keep batch rows of cursor (p3 >> 16) whose column (p3 & 0xffff)
+                        // compares true against r[p1] by CompareOp p2
+    OP_BATCH_ROW,       // Cursor p1 to its next selected batch row; if there is none pc = p2
+
+    // Aggregates. A running aggregate is a register: COUNT starts at 0, the others
+    // at NULL, which they keep until a non-NULL value arrives. NULLs are skipped.
+    OP_AGGREGATE_STEP,  // Fold r[p3] into r[p1] by AggregateFunction p2; error if a SUM overflows
+    OP_BATCH_AGGREGATE, // Fold column (p3 & 0xffff) of cursor (p3 >> 16)'s selected batch rows
+                        // into r[p1] by AggregateFunction p2
+    OP_TABLE_AGGREGATE, // r[p1] = AggregateFunction p2 of column (p3 & 0xffff) over every row of
+                        // cursor (p3 >> 16)'s table, computed straight from the leaf pages. A run
+                        // of them over one cursor shares a single pass.
+
+    // External sorts. A sorter cursor collects rows, sorts them within the VM's
+    // sort memory, spilling runs to a temporary file, and then OP_COLUMN reads
+    // value k of its current row.
+    OP_SORTER_OPEN,     // Cursor p1 becomes an empty sorter on the first p2 values of its rows,
+                        // key i descending if bit i of p3 is set
+    OP_SORTER_INSERT,   // Add registers [p3, p3 + p2) as a row of sorter cursor p1
+    OP_SORTER_SORT,     // Sort sorter cursor p1's rows and move to the first; if there are none pc = p2
+    OP_SORTER_NEXT,     // Advance sorter cursor p1; if it is on a row pc = p2
+
+    // Hash joins. A hash cursor holds the build rows, keyed by their first value,
+    // within the VM's join memory; OP_COLUMN reads value k of the build row
+    // matching the probe. Probe rows of partitions spilled to a temporary file
+    // are saved and come back through OP_HASH_REPLAY once the probe input ends.
+    OP_HASH_OPEN,       // Cursor p1 becomes an empty hash join of probe rows of p2 values
+    OP_HASH_INSERT,     // Add registers [p3, p3 + p2) as a build row of hash cursor p1
+    OP_HASH_BUILD,      // End hash cursor p1's build rows
+    OP_HASH_PROBE,      // Move hash cursor p1 to the first build row matching the probe row in
+                        // registers [p3, p3 + its width); if there is none, or the row was
+                        // saved for replay, pc = p2
+    OP_HASH_NEXT,       // Advance hash cursor p1 to the next matching build row; if there is one pc = p2
+    OP_HASH_REPLAY,     // Load hash cursor p1's next saved probe row into registers [p3, p3 + its
+                        // width), with its build rows in memory; if there are none left pc = p2
+
+    OP_EQ,              // If r[p1] == r[p3] pc = p2. Comparisons with NULL are false.
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_IS_NULL,         // If r[p1] is NULL pc = p2
+
+    OP_MAKE_RECORD,     // r[p1] = row of table p2 from registers [p3, p3 + its column count)
+    OP_INSERT,          // Insert record r[p3] under key r[p1] into table p2; error on duplicate
+    OP_RESULT_ROW,      // Yield registers [p1, p1 + p3) as a result row, to the row
+                        // callback when vm_run() has one
+
+    OP_COUNT_OPCODES
+} Opcode;
+
+typedef enum {
+    COMPARE_EQ,
+    COMPARE_NE,
+    COMPARE_LT,
+    COMPARE_LE,
+    COMPARE_GT,
+    COMPARE_GE
+} CompareOp;
+
+// SUM, MIN and MAX fold integers only
+typedef enum {
+    AGGREGATE_COUNT,
+    AGGREGATE_SUM,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX
+} AggregateFunction;
+
+typedef struct {
+    uint8_t opcode;
+    int32_t p1;
+    int32_t p2;
+    int32_t p3;
+} Instruction;
+
+typedef struct {
+    Instruction* code;
+    uint32_t length;
+    uint32_t capacity;
+    char* text_pool;              // Text constants, back to back
+    uint32_t text_pool_size;
+    uint32_t text_pool_capacity;
+    uint32_t* text_offsets;       // Constant index -> offset, length pairs
+    uint32_t num_texts;
+    uint32_t text_offsets_capacity;
+    BTree** tables;               // Tables referenced by OPEN_READ, MAKE_RECORD and INSERT
+    const RowSchema** schemas;    // Row layout of each table
+    uint32_t num_tables;
+    uint32_t tables_capacity;
+    const SecondaryIndex** indexes; // Indexes referenced by OPEN_INDEX and INDEX_INSERT
+    uint32_t num_indexes;
+    uint32_t indexes_capacity;
+    uint32_t num_registers;
+    uint32_t num_cursors;
+    uint32_t num_parameters;
+} Program;
+
+// What one instruction did while the VM was profiling. Rows in counts its
+// executions, except that batch filters and aggregates take in the batch's
+// selected rows. Rows out counts the executions that carried on with a row:
+// those of a comparison or seek that did not branch away, of a NEXT that
+// moved to one, and every execution of an instruction that cannot branch;
+// a batch fill or filter passes on the rows it selected. Time runs from the
+// instruction's dispatch to the next one's, in TSC cycles on x86 and
+// nanoseconds elsewhere, and the pages are the hits and misses of the
+// pager holding the program's tables over the same span.
+typedef struct {
+    uint64_t rows_in;
+    uint64_t rows_out;
+    uint64_t cycles;
+    uint64_t page_hits;
+    uint64_t page_misses;
+} VmProfile;
+
+typedef enum {
+    VM_ROW,                       // A result row is available from vm_row()
+    VM_DONE,
+    VM_ERROR
+} VmStatus;
+
+typedef struct Vm Vm;
+
+// Receives each result row as soon as it is produced. Text values point
+// straight into the row's page (or into the program or bindings), so they
+// are only valid during the call. Returning false stops the run.
+typedef bool (*VmRowCallback)(void* context, const Value* row, uint32_t num_columns);
+
+// Program construction
+Program* program_new(void);
+void program_free(Program* program);
+uint32_t program_emit(Program* program, Opcode opcode, int32_t p1, int32_t p2, int32_t p3);
+void program_set_jump(Program* program, uint32_t address, uint32_t target);
+uint32_t program_add_text(Program* program, const char* text, uint32_t length);
+// The schema must outlive the program
+uint32_t program_add_table(Program* program, BTree* btree, const RowSchema* schema);
+// The index must outlive the program
+uint32_t program_add_index(Program* program, const SecondaryIndex* index);
+int32_t program_column_operand(uint32_t cursor, uint32_t column);
+
+// Execution. Values returned by vm_row() stay valid until the next vm_step().
+Vm* vm_new(Program* program);
+void vm_free(Vm* vm);
+// Bindings survive vm_reset(). Text is not copied: it must stay valid while
+// the VM runs. Parameters start out NULL.
+void vm_bind(Vm* vm, uint32_t parameter, const Value* value);
+const Value* vm_binding(const Vm* vm, uint32_t parameter);
+void vm_reset(Vm* vm);
+VmStatus vm_step(Vm* vm);
+// Runs to the end, pushing rows to `callback` from inside the dispatch loop,
+// so nothing is buffered and the first row arrives as soon as it is found.
+// Returns VM_DONE or VM_ERROR, or VM_ROW if the callback stopped the run;
+// vm_step() and vm_run() carry on from there. A NULL callback discards the
+// rows. The callback must not run
+// other statements on the same pager, which could unpin the row's page.
+VmStatus vm_run(Vm* vm, VmRowCallback callback, void* context);
+const Value* vm_row(Vm* vm, uint32_t* num_columns);
+const char* vm_error(Vm* vm);
+// Memory budget of each sorter the program opens, SORTER_DEFAULT_MEMORY
+// unless set
+void vm_set_sort_memory(Vm* vm, size_t bytes);
+// Memory budget of each hash join the program opens,
+// HASH_JOIN_DEFAULT_MEMORY unless set
+void vm_set_join_memory(Vm* vm, size_t bytes);
+
+// Profiling records a VmProfile per instruction from then on; the profile
+// starts at zero and vm_reset() zeroes it again. With profiling off,
+// computed-goto builds dispatch exactly as before, so it costs nothing.
+// Returns false if the profile cannot be allocated.
+bool vm_set_profiling(Vm* vm, bool enabled);
+// One entry per instruction, or NULL when profiling is off
+const VmProfile* vm_profile(const Vm* vm);
+// "OPEN_READ" for OP_OPEN_READ, and so on
+const char* vm_opcode_name(Opcode opcode);
+
+// Largest row OP_MAKE_RECORD builds; rows must fit in a leaf cell
+#define VM_MAX_RECORD_SIZE 256
+
+int vm_value_compare(const Value* a, const Value* b);
+// Folds `value` into the running aggregate. Returns false if a SUM overflows
+// or a non-integer reaches SUM, MIN or MAX.
+bool vm_aggregate_fold(Value* aggregate, AggregateFunction function, const Value* value);
+
+#endif
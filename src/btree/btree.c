@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include "btree.h"
 #include "common.h"
+#include "stats.h"
 
 // Common Node Header Layout
 const uint32_t NODE_TYPE_SIZE = sizeof(uint8_t);
@@ -35,24 +36,51 @@ const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
 
-// Calculate max cells for internal nodes (since their cells are fixed size)
-const uint32_t INTERNAL_NODE_SPACE_FOR_CELLS = PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE;
-const uint32_t INTERNAL_NODE_MAX_CELLS = INTERNAL_NODE_SPACE_FOR_CELLS / INTERNAL_NODE_CELL_SIZE;
-
 // For leaf nodes, cells are variable size. A hardcoded, conservative estimate is
 // the simplest approach. A more complex engine would check actual byte usage.
+// The estimate is for a DEFAULT_PAGE_SIZE page and scales with the page size.
 const uint32_t LEAF_NODE_MAX_CELLS = 13;  // for test
 
-// Split counts
-const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
-const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
-
 // Invalid page number
 const uint32_t INVALID_PAGE_NUM = UINT32_MAX;
 
+// The is-root byte holds flags. A node with NODE_BUFFER_FLAG is internal and
+// keeps a message buffer: messages in leaf cell format packed from the end
+// of its largest possible key array, with their total size in the page's
+// last two bytes. No key array reaches those, so any internal node can be
+// flagged; one with more keys than the buffered maximum just has no room.
+// The root is flagged whenever a buffer in the tree may hold messages.
+const uint8_t NODE_ROOT_FLAG = 1;
+const uint8_t NODE_BUFFER_FLAG = 2;
+const uint32_t NODE_BUFFER_USED_SIZE = sizeof(uint16_t);
+const uint32_t MESSAGE_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint32_t);
+
+// For push_down(): every message, whichever child it is bound for
+#define ALL_CHILDREN UINT32_MAX
+
+typedef enum {
+    BTREE_COUNTER_LEAF_SPLITS,
+    BTREE_COUNTER_INTERNAL_SPLITS,
+    BTREE_COUNTER_ROOT_SPLITS,
+    BTREE_COUNTER_BUFFER_FLUSHES,
+    BTREE_COUNTER_BUFFERED_DUPLICATES
+} BTreeCounter;
+
+// Layout limits that depend on the page size the tree was created with
+static uint32_t internal_node_max_cells(uint32_t page_size) {
+    return (page_size - INTERNAL_NODE_HEADER_SIZE) / INTERNAL_NODE_CELL_SIZE;
+}
+
+static uint32_t leaf_node_max_cells(uint32_t page_size) {
+    return LEAF_NODE_MAX_CELLS * (page_size / DEFAULT_PAGE_SIZE);
+}
+
 // Forward declarations
-void leaf_node_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size);
-void internal_node_split_and_insert(BTree* btree, page_num_t parent_page_num, page_num_t child_page_num); 
+int leaf_node_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size);
+void internal_node_split_and_insert(BTree* btree, page_num_t parent_page_num, page_num_t child_page_num);
+static void flush_path(BTree* btree, uint32_t key);
+static int buffered_insert(BTree* btree, uint32_t key, void* value, uint32_t value_size);
+static void cursor_resume(BTreeCursor* cursor, uint32_t last_key); 
 
 // Node accessor functions
 NodeType get_node_type(void* node) {
@@ -65,14 +93,17 @@ void set_node_type(void* node, NodeType type) {
     *((uint8_t*)((char*)node + NODE_TYPE_OFFSET)) = value;
 }
 
+static uint8_t* node_flags(void* node) {
+    return (uint8_t*)((char*)node + IS_ROOT_OFFSET);
+}
+
 bool is_node_root(void* node) {
-    uint8_t value = *((uint8_t*)((char*)node + IS_ROOT_OFFSET));
-    return (bool)value;
+    return (*node_flags(node) & NODE_ROOT_FLAG) != 0;
 }
 
 void set_node_root(void* node, bool is_root) {
-    uint8_t value = is_root;
-    *((uint8_t*)((char*)node + IS_ROOT_OFFSET)) = value;
+    uint8_t* flags = node_flags(node);
+    *flags = is_root ? (*flags | NODE_ROOT_FLAG) : (*flags & ~NODE_ROOT_FLAG);
 }
 
 uint32_t* node_parent(void* node) {
@@ -109,8 +140,11 @@ void* leaf_node_cell(void* node, uint32_t cell_num) {
         cell_num = num_cells;
     }
     
+    // Walk the cells directly; going through get_leaf_cell_size() would
+    // restart the walk for every cell and make this quadratic
     for (uint32_t i = 0; i < cell_num; i++) {
-        offset += get_leaf_cell_size(node, i);
+        uint32_t value_size = *(uint32_t*)((char*)node + offset + LEAF_NODE_KEY_SIZE);
+        offset += LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE_SIZE + value_size;
     }
     return (char*)node + offset;
 }
@@ -130,6 +164,24 @@ void* leaf_node_value(void* node, uint32_t cell_num) {
     return (char*)cell + LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE_SIZE;
 }
 
+// Cell-at-a-time access for code that walks a leaf in order, where
+// leaf_node_cell() would restart from the first cell every time
+uint32_t leaf_cell_key(void* cell) {
+    return *(uint32_t*)cell;
+}
+
+uint32_t leaf_cell_value_size(void* cell) {
+    return *(uint32_t*)((char*)cell + LEAF_NODE_KEY_SIZE);
+}
+
+void* leaf_cell_value(void* cell) {
+    return (char*)cell + LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE_SIZE;
+}
+
+void* leaf_cell_next(void* cell) {
+    return (char*)leaf_cell_value(cell) + leaf_cell_value_size(cell);
+}
+
 // Internal node accessors
 uint16_t* internal_node_num_keys(void* node) {
     return (uint16_t*)((char*)node + INTERNAL_NODE_NUM_KEYS_OFFSET);
@@ -159,17 +211,17 @@ uint32_t* internal_node_key(void* node, uint32_t key_num) {
     return (uint32_t*)((char*)internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE);
 }
 
-// Node initialization
+// Node initialization. Clearing the flags drops any buffer.
 void initialize_leaf_node(void* node) {
     set_node_type(node, NODE_LEAF);
-    set_node_root(node, false);
+    *node_flags(node) = 0;
     *leaf_node_num_cells(node) = 0;
     *leaf_node_next_leaf(node) = 0; // 0 represents no sibling
 }
 
 void initialize_internal_node(void* node) {
     set_node_type(node, NODE_INTERNAL);
-    set_node_root(node, false);
+    *node_flags(node) = 0;
     *internal_node_num_keys(node) = 0;
 }
 
@@ -178,11 +230,70 @@ void* get_page(Pager* pager, page_num_t page_num) {
     return pager_get_page(pager, page_num);
 }
 
+// Get a page that is about to be modified, so the pager writes it back
+void* get_page_for_write(Pager* pager, page_num_t page_num) {
+    void* page = pager_get_page(pager, page_num);
+    pager_mark_dirty(pager, page_num);
+    return page;
+}
+
 // Get unused page number
 uint32_t get_unused_page_num(Pager* pager) {
     return pager_get_num_pages(pager);
 }
 
+// Message buffers of internal nodes, see btree_set_buffered()
+static bool node_has_buffer(void* node) {
+    return get_node_type(node) == NODE_INTERNAL && (*node_flags(node) & NODE_BUFFER_FLAG);
+}
+
+static uint16_t* node_buffer_used(BTree* btree, void* node) {
+    return (uint16_t*)((char*)node + btree->page_size - NODE_BUFFER_USED_SIZE);
+}
+
+static char* node_buffer(BTree* btree, void* node) {
+    return (char*)node + INTERNAL_NODE_HEADER_SIZE + btree->internal_node_buffered_max_cells * INTERNAL_NODE_CELL_SIZE;
+}
+
+// Bytes of messages a node can hold at most, 0 if its keys leave no room
+static uint32_t node_buffer_capacity(BTree* btree, void* node) {
+    if (*internal_node_num_keys(node) > btree->internal_node_buffered_max_cells) {
+        return 0;
+    }
+    return (uint32_t)((char*)node + btree->page_size - NODE_BUFFER_USED_SIZE - node_buffer(btree, node));
+}
+
+// Flags an internal node as holding an empty buffer; the caller marks it dirty
+static void node_start_buffer(BTree* btree, void* node) {
+    if (!node_has_buffer(node)) {
+        *node_flags(node) |= NODE_BUFFER_FLAG;
+        *node_buffer_used(btree, node) = 0;
+    }
+}
+
+// Bytes of messages a node holds
+static uint32_t node_buffered_bytes(BTree* btree, void* node) {
+    return node_has_buffer(node) ? *node_buffer_used(btree, node) : 0;
+}
+
+static bool buffer_contains(BTree* btree, void* node, uint32_t key) {
+    char* message = node_buffer(btree, node);
+    char* end = message + node_buffered_bytes(btree, node);
+    for (; message < end; message = leaf_cell_next(message)) {
+        if (leaf_cell_key(message) == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Nodes that may hold a buffer, which is every node of a buffered tree, keep
+// their keys clear of it
+static uint32_t node_max_keys(BTree* btree, void* node) {
+    return btree->buffered || node_has_buffer(node) ? btree->internal_node_buffered_max_cells
+                                                    : btree->internal_node_max_cells;
+}
+
 // Get maximum key in node
 uint32_t get_node_max_key(void* node) {
     switch (get_node_type(node)) {
@@ -200,6 +311,16 @@ uint32_t get_node_max_key(void* node) {
     return 0;
 }
 
+// Get maximum key in the subtree rooted at page_num. For internal nodes the
+// last key only covers the left children, so follow the right spine down.
+uint32_t get_subtree_max_key(BTree* btree, page_num_t page_num) {
+    void* node = get_page(btree->pager, page_num);
+    while (get_node_type(node) == NODE_INTERNAL) {
+        node = get_page(btree->pager, *internal_node_right_child(node));
+    }
+    return get_node_max_key(node);
+}
+
 void serialize_leaf_value(void* destination, uint32_t key, void* value, uint32_t value_size) {
     *(uint32_t*)destination = key;
     *(uint32_t*)((char*)destination + LEAF_NODE_KEY_SIZE) = value_size;
@@ -241,13 +362,12 @@ void update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key) {
 
 // FIXED: Complete rewrite of internal_node_insert to maintain sorted order
 void internal_node_insert(BTree* btree, page_num_t parent_page_num, page_num_t child_page_num) {
-    void* parent = get_page(btree->pager, parent_page_num);
-    void* child = get_page(btree->pager, child_page_num);
-    uint32_t child_max_key = get_node_max_key(child);
+    void* parent = get_page_for_write(btree->pager, parent_page_num);
+    uint32_t child_max_key = get_subtree_max_key(btree, child_page_num);
 
     uint32_t original_num_keys = *internal_node_num_keys(parent);
 
-    if (original_num_keys >= INTERNAL_NODE_MAX_CELLS) {
+    if (original_num_keys >= node_max_keys(btree, parent)) {
         // Split the internal node
         internal_node_split_and_insert(btree, parent_page_num, child_page_num);
         return;
@@ -268,11 +388,12 @@ void internal_node_insert(BTree* btree, page_num_t parent_page_num, page_num_t c
         *internal_node_child(parent, i) = *internal_node_child(parent, i - 1);
     }
 
-    // If we're inserting at the end, handle the right child specially
-    if (insert_index == original_num_keys) {
+    // If the new child sorts after the right child, it becomes the new right child
+    if (insert_index == original_num_keys &&
+        child_max_key > get_subtree_max_key(btree, *internal_node_right_child(parent))) {
         // The new child becomes the rightmost child
         *internal_node_child(parent, insert_index) = *internal_node_right_child(parent);
-        *internal_node_key(parent, insert_index) = get_node_max_key(get_page(btree->pager, *internal_node_right_child(parent)));
+        *internal_node_key(parent, insert_index) = get_subtree_max_key(btree, *internal_node_right_child(parent));
         *internal_node_right_child(parent) = child_page_num;
     } else {
         // Insert in the middle
@@ -283,9 +404,9 @@ void internal_node_insert(BTree* btree, page_num_t parent_page_num, page_num_t c
 
 // FIXED: Complete fix for internal node key ordering issue
 void internal_node_split_and_insert(BTree* btree, page_num_t parent_page_num, page_num_t child_page_num) {
-    printf("DEBUG: Splitting internal node %d, inserting child %d\n", parent_page_num, child_page_num);   
-    
-    void* old_node = get_page(btree->pager, parent_page_num);
+    stats_inc(btree->counters, BTREE_COUNTER_INTERNAL_SPLITS);
+
+    void* old_node = get_page_for_write(btree->pager, parent_page_num);
     void* child = get_page(btree->pager, child_page_num);
 
     if (!old_node || !child) {
@@ -293,18 +414,30 @@ void internal_node_split_and_insert(BTree* btree, page_num_t parent_page_num, pa
         exit(1);
     }
 
-    uint32_t child_max_key = get_node_max_key(child);
+    uint32_t child_max_key = get_subtree_max_key(btree, child_page_num);
     
     // Store node state before modifications
     uint32_t old_parent = *node_parent(old_node);
     bool was_root = is_node_root(old_node);
     uint32_t old_num_keys = *internal_node_num_keys(old_node);
 
-    printf("DEBUG: old_num_keys = %d, INTERNAL_NODE_MAX_CELLS = %d\n", old_num_keys, INTERNAL_NODE_MAX_CELLS);
+    // Pending messages are dealt out to the two halves below
+    bool had_buffer = node_has_buffer(old_node);
+    uint32_t buffered_bytes = node_buffered_bytes(btree, old_node);
+    char* messages = NULL;
+    if (buffered_bytes > 0) {
+        messages = malloc(buffered_bytes);
+        if (!messages) {
+            printf("ERROR: Out of memory splitting a buffered node\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(messages, node_buffer(btree, old_node), buffered_bytes);
+    }
 
-    // Create temporary arrays to hold all keys and children
-    uint32_t temp_keys[INTERNAL_NODE_MAX_CELLS + 1];
-    uint32_t temp_children[INTERNAL_NODE_MAX_CELLS + 2];
+    // Create temporary arrays holding every child with the maximum key of its
+    // subtree. The right child has no key in the node, so compute it.
+    uint32_t temp_keys[btree->internal_node_max_cells + 2];
+    uint32_t temp_children[btree->internal_node_max_cells + 2];
     
     // Copy existing keys and children
     for (uint32_t i = 0; i < old_num_keys; i++) {
@@ -312,31 +445,32 @@ void internal_node_split_and_insert(BTree* btree, page_num_t parent_page_num, pa
         temp_children[i] = *internal_node_child(old_node, i);
     }
     temp_children[old_num_keys] = *internal_node_right_child(old_node);
+    temp_keys[old_num_keys] = get_subtree_max_key(btree, temp_children[old_num_keys]);
     
-    // Find correct insertion position for the new child based on key
+    // The new child goes before the first child whose keys are larger
     uint32_t insert_index = 0;
-    while (insert_index < old_num_keys && temp_keys[insert_index] < child_max_key) {
+    while (insert_index <= old_num_keys && temp_keys[insert_index] < child_max_key) {
         insert_index++;
     }
     
     // Shift keys and children to make room
-    for (uint32_t i = old_num_keys; i > insert_index; i--) {
+    for (uint32_t i = old_num_keys + 1; i > insert_index; i--) {
         temp_keys[i] = temp_keys[i - 1];
-    }
-    for (uint32_t i = old_num_keys + 1; i > insert_index + 1; i--) {
         temp_children[i] = temp_children[i - 1];
     }
     
     // Insert new key and child
     temp_keys[insert_index] = child_max_key;
-    temp_children[insert_index + 1] = child_page_num;
+    temp_children[insert_index] = child_page_num;
     
-    uint32_t total_keys = old_num_keys + 1;
-    uint32_t split_index = total_keys / 2;
+    // Children [0, split_index) stay in the old node, the rest move right
+    uint32_t total_children = old_num_keys + 2;
+    uint32_t split_index = total_children / 2;
+    uint32_t old_max_key = temp_keys[total_children - 1];
     
     // Create new node
     page_num_t new_page_num = get_unused_page_num(btree->pager);
-    void* new_node = get_page(btree->pager, new_page_num);
+    void* new_node = get_page_for_write(btree->pager, new_page_num);
     initialize_internal_node(new_node);
     *node_parent(new_node) = old_parent;
     
@@ -347,97 +481,185 @@ void internal_node_split_and_insert(BTree* btree, page_num_t parent_page_num, pa
     }
     *node_parent(old_node) = old_parent;
     
-    // Distribute to left node (old_node): keys 0 to split_index-1
-    *internal_node_num_keys(old_node) = split_index;
-    for (uint32_t i = 0; i < split_index; i++) {
+    // Distribute to left node (old_node): children 0 to split_index-1
+    *internal_node_num_keys(old_node) = split_index - 1;
+    for (uint32_t i = 0; i < split_index - 1; i++) {
         *internal_node_key(old_node, i) = temp_keys[i];
         *internal_node_child(old_node, i) = temp_children[i];
     }
-    *internal_node_right_child(old_node) = temp_children[split_index];
+    *internal_node_right_child(old_node) = temp_children[split_index - 1];
     
-    // Distribute to right node (new_node): keys split_index+1 to total_keys-1
-    uint32_t right_keys = total_keys - split_index - 1;
+    // Distribute to right node (new_node): children split_index to total_children-1
+    uint32_t right_keys = total_children - split_index - 1;
     *internal_node_num_keys(new_node) = right_keys;
     for (uint32_t i = 0; i < right_keys; i++) {
-        *internal_node_key(new_node, i) = temp_keys[split_index + 1 + i];
-        *internal_node_child(new_node, i) = temp_children[split_index + 1 + i];
+        *internal_node_key(new_node, i) = temp_keys[split_index + i];
+        *internal_node_child(new_node, i) = temp_children[split_index + i];
     }
-    *internal_node_right_child(new_node) = temp_children[total_keys];
-    
+    *internal_node_right_child(new_node) = temp_children[total_children - 1];
+
+    // The left node's maximum gets promoted
+    uint32_t promoted_key = temp_keys[split_index - 1];
+
+    // Each message goes to the half that now holds the child it was bound
+    // for. Either half holds no more messages than the whole did.
+    if (had_buffer) {
+        node_start_buffer(btree, old_node);
+        node_start_buffer(btree, new_node);
+        for (char* message = messages; message < messages + buffered_bytes; message = leaf_cell_next(message)) {
+            void* half = leaf_cell_key(message) <= promoted_key ? old_node : new_node;
+            uint32_t size = (uint32_t)((char*)leaf_cell_next(message) - message);
+            memcpy(node_buffer(btree, half) + *node_buffer_used(btree, half), message, size);
+            *node_buffer_used(btree, half) += size;
+        }
+        free(messages);
+    }
+
     // Update parent pointers
     for (uint32_t i = 0; i <= *internal_node_num_keys(old_node); i++) {
         uint32_t child_page = *internal_node_child(old_node, i);
-        void* child_node = get_page(btree->pager, child_page);
+        void* child_node = get_page_for_write(btree->pager, child_page);
         *node_parent(child_node) = parent_page_num;
     }
     
     for (uint32_t i = 0; i <= *internal_node_num_keys(new_node); i++) {
         uint32_t child_page = *internal_node_child(new_node, i);  
-        void* child_node = get_page(btree->pager, child_page);
+        void* child_node = get_page_for_write(btree->pager, child_page);
         *node_parent(child_node) = new_page_num;
     }
     
-    // The middle key gets promoted
-    uint32_t promoted_key = temp_keys[split_index];
-    
     if (was_root) {
         create_new_root(btree, new_page_num);
-        void* root = get_page(btree->pager, btree->root_page_num);
+        void* root = get_page_for_write(btree->pager, btree->root_page_num);
         *internal_node_key(root, 0) = promoted_key;
     } else {
-        // Update parent's key for old node 
-        void* parent = get_page(btree->pager, old_parent);
-        uint32_t old_max = get_node_max_key(old_node);
-        update_internal_node_key(parent, get_node_max_key(old_node), old_max);
+        // The old node now ends at its new right child, whose maximum is the
+        // promoted key; the new node keeps the old subtree maximum
+        void* parent = get_page_for_write(btree->pager, old_parent);
+        update_internal_node_key(parent, old_max_key, promoted_key);
         internal_node_insert(btree, old_parent, new_page_num);
     }
 }
 
 // Create a new root
 page_num_t create_new_root(BTree* btree, page_num_t right_child_page_num) {
-    void* root = get_page(btree->pager, btree->root_page_num);
-    void* right_child = get_page(btree->pager, right_child_page_num);
+    stats_inc(btree->counters, BTREE_COUNTER_ROOT_SPLITS);
+    void* root = get_page_for_write(btree->pager, btree->root_page_num);
+    void* right_child = get_page_for_write(btree->pager, right_child_page_num);
     page_num_t left_child_page_num = get_unused_page_num(btree->pager);
-    void* left_child = get_page(btree->pager, left_child_page_num);
+    void* left_child = get_page_for_write(btree->pager, left_child_page_num);
 
     // Left child has data copied from old root
-    memcpy(left_child, root, PAGE_SIZE);
+    memcpy(left_child, root, btree->page_size);
     set_node_root(left_child, false);
 
-    // Root node is a new internal node with one key and two children
+    // Root node is a new internal node with one key and two children. It
+    // keeps the flag saying the tree may have messages.
     initialize_internal_node(root);
     set_node_root(root, true);
+    if (node_has_buffer(left_child)) {
+        node_start_buffer(btree, root);
+    }
     *internal_node_num_keys(root) = 1;
     *internal_node_child(root, 0) = left_child_page_num;
-    uint32_t left_child_max_key = get_node_max_key(left_child);
+    uint32_t left_child_max_key = get_subtree_max_key(btree, left_child_page_num);
     *internal_node_key(root, 0) = left_child_max_key;
     *internal_node_right_child(root) = right_child_page_num;
     *node_parent(left_child) = btree->root_page_num;
     *node_parent(right_child) = btree->root_page_num;
 
+    // The old root's children moved with it to the left child's page
+    if (get_node_type(left_child) == NODE_INTERNAL) {
+        for (uint32_t i = 0; i <= *internal_node_num_keys(left_child); i++) {
+            void* grandchild = get_page_for_write(btree->pager, *internal_node_child(left_child, i));
+            *node_parent(grandchild) = left_child_page_num;
+        }
+    }
+
     return btree->root_page_num;
 }
 
-void leaf_node_split_and_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size) {
+// Where a leaf whose cells take `cell_sizes` bytes, in key order, splits so
+// that both halves fit in a page: `preferred` if it does, else the point
+// that balances their bytes best. 0 if no split fits.
+static uint32_t leaf_split_point(BTree* btree, const uint32_t* cell_sizes, uint32_t total_cells, uint32_t preferred) {
+    uint32_t capacity = btree->page_size - LEAF_NODE_HEADER_SIZE;
+    uint32_t total_bytes = 0;
+    for (uint32_t i = 0; i < total_cells; i++) {
+        total_bytes += cell_sizes[i];
+    }
+    uint32_t best = 0;
+    uint32_t best_larger = UINT32_MAX;
+    uint32_t left_bytes = 0;
+    for (uint32_t point = 1; point < total_cells; point++) {
+        left_bytes += cell_sizes[point - 1];
+        uint32_t right_bytes = total_bytes - left_bytes;
+        if (left_bytes > capacity || right_bytes > capacity) {
+            continue;
+        }
+        if (point == preferred) {
+            return point;
+        }
+        uint32_t larger = left_bytes > right_bytes ? left_bytes : right_bytes;
+        if (larger < best_larger) {
+            best = point;
+            best_larger = larger;
+        }
+    }
+    return best;
+}
+
+static int leaf_node_split(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size, bool replace);
+
+int leaf_node_split_and_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size) {
+    return leaf_node_split(cursor, key, value, value_size, false);
+}
+
+// Splits the cursor's leaf around a new cell, or, with `replace`, around the
+// cell under the cursor with its new value. Returns -1, changing nothing, if
+// no split leaves both halves within a page.
+static int leaf_node_split(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size, bool replace) {
+    BTree* btree = cursor->btree;
     void* old_node = get_page(cursor->btree->pager, cursor->page_num);
+    uint32_t old_num_cells = *leaf_node_num_cells(old_node);
+    uint32_t total_cells = replace ? old_num_cells : old_num_cells + 1;
+
+    // Halves by count unless large values would overflow one of them
+    uint32_t cell_sizes[btree->leaf_node_max_cells + 1];
+    for (uint32_t i = 0, old = 0; i < total_cells; i++) {
+        bool is_new = i == cursor->cell_num;
+        uint32_t size = is_new ? value_size : *leaf_node_value_size(old_node, old);
+        cell_sizes[i] = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE_SIZE + size;
+        if (!is_new || replace) {
+            old++;
+        }
+    }
+    uint32_t right_split_count = (btree->leaf_node_max_cells + 1) / 2;
+    uint32_t split_point = leaf_split_point(btree, cell_sizes, total_cells,
+                                            (btree->leaf_node_max_cells + 1) - right_split_count);
+    if (split_point == 0) {
+        return -1;
+    }
+
+    stats_inc(btree->counters, BTREE_COUNTER_LEAF_SPLITS);
+    old_node = get_page_for_write(cursor->btree->pager, cursor->page_num);
     uint32_t old_max_key = get_node_max_key(old_node);
     
     // Store important state
     uint32_t parent_page = *node_parent(old_node);
     uint32_t next_leaf = *leaf_node_next_leaf(old_node);
     bool was_root = is_node_root(old_node);
-    uint32_t old_num_cells = *leaf_node_num_cells(old_node);
     
     // Allocate new node
     page_num_t new_page_num = get_unused_page_num(cursor->btree->pager);
-    void* new_node = get_page(cursor->btree->pager, new_page_num);
+    void* new_node = get_page_for_write(cursor->btree->pager, new_page_num);
     initialize_leaf_node(new_node);
     *node_parent(new_node) = parent_page;
     
     // Create arrays to hold all data (existing + new)
-    uint32_t all_keys[LEAF_NODE_MAX_CELLS + 1];
-    uint32_t all_value_sizes[LEAF_NODE_MAX_CELLS + 1];
-    void* all_values[LEAF_NODE_MAX_CELLS + 1]; // Max value buffer
+    uint32_t all_keys[btree->leaf_node_max_cells + 1];
+    uint32_t all_value_sizes[btree->leaf_node_max_cells + 1];
+    void* all_values[btree->leaf_node_max_cells + 1]; // Max value buffer
     
     // Copy existing data
     for (uint32_t i = 0; i < old_num_cells; i++) {
@@ -449,19 +671,20 @@ void leaf_node_split_and_insert(BTreeCursor* cursor, uint32_t key, void* value,
     
     // Insert new data at correct position
     uint32_t insert_pos = cursor->cell_num;
-    for (uint32_t i = old_num_cells; i > insert_pos; i--) {
-        all_keys[i] = all_keys[i - 1];
-        all_value_sizes[i] = all_value_sizes[i - 1];
-        all_values[i] = all_values[i - 1];
+    if (replace) {
+        free(all_values[insert_pos]);
+    } else {
+        for (uint32_t i = old_num_cells; i > insert_pos; i--) {
+            all_keys[i] = all_keys[i - 1];
+            all_value_sizes[i] = all_value_sizes[i - 1];
+            all_values[i] = all_values[i - 1];
+        }
     }
     all_keys[insert_pos] = key;
     all_value_sizes[insert_pos] = value_size;
     all_values[insert_pos] = malloc(value_size);
     memcpy(all_values[insert_pos], value, value_size);
     
-    uint32_t total_cells = old_num_cells + 1;
-    uint32_t split_point = LEAF_NODE_LEFT_SPLIT_COUNT;
-    
     // Re-initialize both nodes
     initialize_leaf_node(old_node);
     if (was_root) {
@@ -503,31 +726,34 @@ void leaf_node_split_and_insert(BTreeCursor* cursor, uint32_t key, void* value,
         create_new_root(cursor->btree, new_page_num);
     } else {
         uint32_t new_max_key = get_node_max_key(old_node);
-        void* parent = get_page(cursor->btree->pager, parent_page);
+        void* parent = get_page_for_write(cursor->btree->pager, parent_page);
         update_internal_node_key(parent, old_max_key, new_max_key);
         internal_node_insert(cursor->btree, parent_page, new_page_num);
     }
+    return 0;
 }
 
 // FIXED: Better cell shifting in leaf node insertion
-void leaf_node_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size) {
+// A leaf at its cell limit, or one the new cell would take past its page,
+// splits. Returns -1, changing nothing, if no split can hold the cell.
+int leaf_node_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t value_size) {
     void* node = get_page(cursor->btree->pager, cursor->page_num);
     uint32_t num_cells = *leaf_node_num_cells(node);
+    uint32_t used = (uint32_t)((char*)leaf_node_cell(node, num_cells) - (char*)node);
+    uint32_t cell_size = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE_SIZE + value_size;
     
-    if (num_cells >= LEAF_NODE_MAX_CELLS) {
-        leaf_node_split_and_insert(cursor, key, value, value_size);
-        return;
+    if (num_cells >= cursor->btree->leaf_node_max_cells || used + cell_size > cursor->btree->page_size) {
+        return leaf_node_split_and_insert(cursor, key, value, value_size);
     }
+    node = get_page_for_write(cursor->btree->pager, cursor->page_num);
 
     if (cursor->cell_num < num_cells) {
         // Calculate size needed for new cell
         uint32_t new_cell_size = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE_SIZE + value_size;
         
         // Calculate total size of cells that need to be moved
-        uint32_t total_move_size = 0;
-        for (uint32_t i = cursor->cell_num; i < num_cells; i++) {
-            total_move_size += get_leaf_cell_size(node, i);
-        }
+        uint32_t total_move_size = (uint32_t)((char*)leaf_node_cell(node, num_cells) -
+                                              (char*)leaf_node_cell(node, cursor->cell_num));
         
         // Move existing cells to make room
         if (total_move_size > 0) {
@@ -541,29 +767,105 @@ void leaf_node_insert(BTreeCursor* cursor, uint32_t key, void* value, uint32_t v
     (*leaf_node_num_cells(node))++;
     void* destination = leaf_node_cell(node, cursor->cell_num);
     serialize_leaf_value(destination, key, value, value_size);
+    return 0;
 }
 
 // Main B-tree operations
-BTree* btree_open(Pager* pager) {
+BTree* btree_open_at(Pager* pager, page_num_t root_page_num) {
     BTree* btree = malloc(sizeof(BTree));
     btree->pager = pager;
-    btree->root_page_num = 0;
+    btree->root_page_num = root_page_num;
+    btree->page_size = pager_get_page_size(pager);
+    btree->internal_node_max_cells = internal_node_max_cells(btree->page_size);
+    btree->leaf_node_max_cells = leaf_node_max_cells(btree->page_size);
+    btree->internal_node_buffered_max_cells = btree->internal_node_max_cells / BTREE_BUFFERED_FANOUT_DIVISOR;
+    btree->buffered = false;
+    btree->counters = stats_counters_new();
+    if (!btree->counters) {
+        free(btree);
+        return NULL;
+    }
 
-    if (pager_get_num_pages(pager) == 0) {
-        // New database file. Initialize page 0 as leaf node.
-        void* root_node = get_page(pager, 0);
+    pager_begin_op(pager);
+    if (pager_get_num_pages(pager) <= root_page_num) {
+        // New tree. Initialize its root as an empty leaf.
+        void* root_node = get_page_for_write(pager, root_page_num);
         initialize_leaf_node(root_node);
         set_node_root(root_node, true);
     }
+    btree->has_messages = node_has_buffer(get_page(pager, root_page_num));
 
     return btree;
 }
 
+BTree* btree_open(Pager* pager) {
+    return btree_open_at(pager, 0);
+}
+
+BTree* btree_create(Pager* pager) {
+    return btree_open_at(pager, get_unused_page_num(pager));
+}
+
 void btree_close(BTree* btree) {
+    btree_flush_buffers(btree);
+    stats_counters_free(btree->counters);
     free(btree);
 }
 
+// Visits every node. Each fetch is its own pager operation and only page
+// numbers are kept across the recursion, so the walk never pins more than one
+// page at a time however large the tree is.
+static void collect_node_stats(BTree* btree, page_num_t page_num, uint32_t depth, BTreeStats* stats) {
+    pager_begin_op(btree->pager);
+    void* node = pager_get_page_hinted(btree->pager, page_num, PAGE_HINT_SCAN);
+    if (depth > stats->height) {
+        stats->height = depth;
+    }
+    if (get_node_type(node) == NODE_LEAF) {
+        stats->leaf_pages++;
+        stats->num_keys += *leaf_node_num_cells(node);
+        return;
+    }
+
+    stats->internal_pages++;
+    char* message = node_buffer(btree, node);
+    for (char* end = message + node_buffered_bytes(btree, node); message < end; message = leaf_cell_next(message)) {
+        stats->buffered_messages++;
+    }
+    uint32_t num_children = *internal_node_num_keys(node) + 1;
+    page_num_t* children = malloc(num_children * sizeof(page_num_t));
+    if (!children) {
+        printf("ERROR: Out of memory collecting tree statistics\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < num_children; i++) {
+        children[i] = *internal_node_child(node, i);
+    }
+    for (uint32_t i = 0; i < num_children; i++) {
+        collect_node_stats(btree, children[i], depth + 1, stats);
+    }
+    free(children);
+}
+
+BTreeStats btree_stats(BTree* btree) {
+    BTreeStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.leaf_splits = stats_counters_sum(btree->counters, BTREE_COUNTER_LEAF_SPLITS);
+    stats.internal_splits = stats_counters_sum(btree->counters, BTREE_COUNTER_INTERNAL_SPLITS);
+    stats.root_splits = stats_counters_sum(btree->counters, BTREE_COUNTER_ROOT_SPLITS);
+    stats.buffer_flushes = stats_counters_sum(btree->counters, BTREE_COUNTER_BUFFER_FLUSHES);
+    stats.buffered_duplicates = stats_counters_sum(btree->counters, BTREE_COUNTER_BUFFERED_DUPLICATES);
+
+    collect_node_stats(btree, btree->root_page_num, 1, &stats);
+    stats.average_leaf_fill = (double)stats.num_keys / ((double)stats.leaf_pages * btree->leaf_node_max_cells);
+    stats.bytes_allocated = (uint64_t)pager_get_num_pages(btree->pager) * btree->page_size;
+    stats.pager = pager_stats(btree->pager);
+    return stats;
+}
+
 BTreeCursor* btree_start(BTree* btree) {
+    btree_flush_buffers(btree);
+    pager_begin_op(btree->pager);
     BTreeCursor* cursor = malloc(sizeof(BTreeCursor));
     cursor->btree = btree;
     cursor->cell_num = 0;
@@ -574,9 +876,10 @@ BTreeCursor* btree_start(BTree* btree) {
     void* node = get_page(btree->pager, page_num);
 
     while (get_node_type(node) == NODE_INTERNAL) {
-        // Go to the leftmost child
+        pager_get_page_hinted(btree->pager, page_num, PAGE_HINT_INTERNAL);
+        // Go to the leftmost child; leaves reached this way are being scanned
         page_num = *internal_node_child(node, 0);
-        node = get_page(btree->pager, page_num);
+        node = pager_get_page_hinted(btree->pager, page_num, PAGE_HINT_SCAN);
     }
 
     cursor->page_num = page_num;
@@ -619,7 +922,7 @@ BTreeCursor* leaf_node_find(BTree* btree, page_num_t page_num, uint32_t key) {
 }
 
 BTreeCursor* internal_node_find(BTree* btree, page_num_t page_num, uint32_t key) {
-    void* node = get_page(btree->pager, page_num);
+    void* node = pager_get_page_hinted(btree->pager, page_num, PAGE_HINT_INTERNAL);
 
     uint32_t child_index = internal_node_find_child(node, key);
     uint32_t child_page_num = *internal_node_child(node, child_index);
@@ -635,6 +938,10 @@ BTreeCursor* internal_node_find(BTree* btree, page_num_t page_num, uint32_t key)
 }
 
 BTreeCursor* btree_find(BTree* btree, uint32_t key) {
+    if (btree->has_messages) {
+        flush_path(btree, key);
+    }
+    pager_begin_op(btree->pager);
     page_num_t root_page_num = btree->root_page_num;
     void* root_node = get_page(btree->pager, root_page_num);
 
@@ -645,7 +952,35 @@ BTreeCursor* btree_find(BTree* btree, uint32_t key) {
     }
 }
 
+void btree_prefetch(BTree* btree, const uint32_t* keys, uint32_t count) {
+    page_num_t pages[BTREE_PREFETCH_BATCH];
+
+    for (uint32_t start = 0; start < count; start += BTREE_PREFETCH_BATCH) {
+        uint32_t batch = count - start < BTREE_PREFETCH_BATCH ? count - start : BTREE_PREFETCH_BATCH;
+        pager_begin_op(btree->pager);
+        for (uint32_t i = 0; i < batch; i++) {
+            pages[i] = btree->root_page_num;
+        }
+
+        // The tree is balanced, so every path reaches the leaves together
+        while (true) {
+            pager_prefetch(btree->pager, pages, batch, PAGE_HINT_NORMAL);
+            if (get_node_type(get_page(btree->pager, pages[0])) == NODE_LEAF) {
+                break;
+            }
+            for (uint32_t i = 0; i < batch; i++) {
+                void* node = pager_get_page_hinted(btree->pager, pages[i], PAGE_HINT_INTERNAL);
+                pages[i] = *internal_node_child(node, internal_node_find_child(node, keys[start + i]));
+            }
+        }
+    }
+}
+
 int btree_insert(BTree* btree, uint32_t key, void* value, uint32_t value_size) {
+    pager_begin_op(btree->pager);
+    if (btree->buffered && get_node_type(get_page(btree->pager, btree->root_page_num)) == NODE_INTERNAL) {
+        return buffered_insert(btree, key, value, value_size);
+    }
     BTreeCursor* cursor = btree_find(btree, key);
 
     void* node = get_page(btree->pager, cursor->page_num);
@@ -659,17 +994,344 @@ int btree_insert(BTree* btree, uint32_t key, void* value, uint32_t value_size) {
         }
     }
 
-    leaf_node_insert(cursor, key, value, value_size);
+    int result = leaf_node_insert(cursor, key, value, value_size);
     free(cursor);
+    return result;
+}
+
+// Gives the cell under the cursor a new value. One the same size is written
+// over the old; otherwise the cells after it shift by the difference. A value
+// that grows the leaf past its page splits it instead, with the bytes shared
+// out so both halves fit. Returns -1, changing nothing, if no split can hold
+// the value.
+static int leaf_node_replace(BTreeCursor* cursor, void* value, uint32_t value_size) {
+    BTree* btree = cursor->btree;
+    void* node = get_page(btree->pager, cursor->page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    char* cell = leaf_node_cell(node, cursor->cell_num);
+    uint32_t old_size = leaf_cell_value_size(cell);
+    uint32_t used = (uint32_t)((char*)leaf_node_cell(node, num_cells) - (char*)node);
+    if (value_size > old_size && used + (value_size - old_size) > btree->page_size) {
+        return leaf_node_split(cursor, leaf_cell_key(cell), value, value_size, true);
+    }
+
+    node = get_page_for_write(btree->pager, cursor->page_num);
+    if (value_size != old_size) {
+        char* next = (char*)leaf_cell_next(cell);
+        char* end = leaf_node_cell(node, *leaf_node_num_cells(node));
+        memmove((char*)leaf_cell_value(cell) + value_size, next, end - next);
+        *(uint32_t*)(cell + LEAF_NODE_KEY_SIZE) = value_size;
+    }
+    memcpy(leaf_cell_value(cell), value, value_size);
     return 0;
 }
 
+// Finds the leaf cell holding `key`, or where it would go, in one descent.
+// Returns whether the key is there.
+static bool find_cell(BTree* btree, uint32_t key, BTreeCursor** cursor) {
+    *cursor = btree_find(btree, key);
+    void* node = get_page(btree->pager, (*cursor)->page_num);
+    return (*cursor)->cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, (*cursor)->cell_num) == key;
+}
+
+int btree_update(BTree* btree, uint32_t key, void* value, uint32_t value_size) {
+    pager_begin_op(btree->pager);
+    BTreeCursor* cursor;
+    int result = find_cell(btree, key, &cursor) ? leaf_node_replace(cursor, value, value_size) : -1;
+    free(cursor);
+    return result;
+}
+
+// A buffered insert would leave the old value in place, so an upsert goes to
+// its leaf directly; btree_find() first moves the messages on its path down
+int btree_upsert(BTree* btree, uint32_t key, void* value, uint32_t value_size) {
+    pager_begin_op(btree->pager);
+    BTreeCursor* cursor;
+    int result = 0;
+    if (find_cell(btree, key, &cursor)) {
+        result = leaf_node_replace(cursor, value, value_size) == 0 ? 1 : -1;
+    } else {
+        result = leaf_node_insert(cursor, key, value, value_size);
+    }
+    free(cursor);
+    return result;
+}
+
+// Buffered mode. Levels count up from the leaves, which are level 0, so a
+// node keeps its level when the root splits.
+static uint32_t tree_levels(BTree* btree) {
+    uint32_t levels = 0;
+    void* node = get_page(btree->pager, btree->root_page_num);
+    while (get_node_type(node) == NODE_INTERNAL) {
+        levels++;
+        node = get_page(btree->pager, *internal_node_child(node, 0));
+    }
+    return levels;
+}
+
+// Follows `key` down to the node at `level`. `bound`, if given, receives the
+// largest key that leads to the same node, UINT32_MAX on the right edge.
+static page_num_t descend(BTree* btree, uint32_t key, uint32_t level, uint32_t* bound) {
+    page_num_t page_num = btree->root_page_num;
+    uint32_t upper = UINT32_MAX;
+    for (uint32_t depth = tree_levels(btree) - level; depth > 0; depth--) {
+        void* node = pager_get_page_hinted(btree->pager, page_num, PAGE_HINT_INTERNAL);
+        uint32_t child_index = internal_node_find_child(node, key);
+        if (child_index < *internal_node_num_keys(node) && *internal_node_key(node, child_index) < upper) {
+            upper = *internal_node_key(node, child_index);
+        }
+        page_num = *internal_node_child(node, child_index);
+    }
+    if (bound) {
+        *bound = upper;
+    }
+    return page_num;
+}
+
+// Inserts a message into its leaf. Returns false if the key is already there
+// or the leaf cannot make room for it.
+static bool leaf_apply(BTree* btree, page_num_t page_num, uint32_t key, void* value, uint32_t value_size) {
+    BTreeCursor* cursor = leaf_node_find(btree, page_num, key);
+    void* node = get_page(btree->pager, page_num);
+    bool duplicate = cursor->cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, cursor->cell_num) == key;
+    bool inserted = false;
+    if (duplicate) {
+        stats_inc(btree->counters, BTREE_COUNTER_BUFFERED_DUPLICATES);
+    } else {
+        inserted = leaf_node_insert(cursor, key, value, value_size) == 0;
+    }
+    free(cursor);
+    return inserted;
+}
+
+static bool deliver(BTree* btree, uint32_t key, void* value, uint32_t value_size, uint32_t level);
+
+// Moves the messages a node holds for one child, or for all of them, down a
+// level. Returns false if there were none. The page is only written when
+// something moves, so a reader's handle can call this.
+static bool push_down(BTree* btree, page_num_t page_num, uint32_t level, uint32_t child_index) {
+    void* node = get_page(btree->pager, page_num);
+    uint32_t used = node_buffered_bytes(btree, node);
+    char* buffer = node_buffer(btree, node);
+    uint32_t moving_bytes = 0;
+    for (char* message = buffer; message < buffer + used; message = leaf_cell_next(message)) {
+        if (child_index == ALL_CHILDREN || internal_node_find_child(node, leaf_cell_key(message)) == child_index) {
+            moving_bytes += (uint32_t)((char*)leaf_cell_next(message) - message);
+        }
+    }
+    if (moving_bytes == 0) {
+        return false;
+    }
+
+    // Detach the messages first: delivering them can split this node
+    char* moving = malloc(moving_bytes);
+    if (!moving) {
+        printf("ERROR: Out of memory flushing a node buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    node = get_page_for_write(btree->pager, page_num);
+    char* kept = buffer;
+    char* moved = moving;
+    for (char* message = buffer; message < buffer + used;) {
+        char* next = leaf_cell_next(message);
+        uint32_t size = (uint32_t)(next - message);
+        if (child_index == ALL_CHILDREN || internal_node_find_child(node, leaf_cell_key(message)) == child_index) {
+            memcpy(moved, message, size);
+            moved += size;
+        } else {
+            memmove(kept, message, size);
+            kept += size;
+        }
+        message = next;
+    }
+    *node_buffer_used(btree, node) = (uint16_t)(used - moving_bytes);
+
+    for (char* message = moving; message < moving + moving_bytes; message = leaf_cell_next(message)) {
+        deliver(btree, leaf_cell_key(message), leaf_cell_value(message), leaf_cell_value_size(message), level - 1);
+    }
+    free(moving);
+    return true;
+}
+
+// Makes room in a full buffer by moving down the messages bound for the
+// child that has the most of them
+static void flush_node(BTree* btree, page_num_t page_num, uint32_t level) {
+    void* node = get_page(btree->pager, page_num);
+    uint32_t num_children = *internal_node_num_keys(node) + 1;
+    uint32_t child_bytes[num_children];
+    memset(child_bytes, 0, sizeof(child_bytes));
+    char* buffer = node_buffer(btree, node);
+    for (char* message = buffer; message < buffer + node_buffered_bytes(btree, node); message = leaf_cell_next(message)) {
+        child_bytes[internal_node_find_child(node, leaf_cell_key(message))] += (uint32_t)((char*)leaf_cell_next(message) - message);
+    }
+    uint32_t busiest = 0;
+    for (uint32_t i = 1; i < num_children; i++) {
+        if (child_bytes[i] > child_bytes[busiest]) {
+            busiest = i;
+        }
+    }
+    stats_inc(btree->counters, BTREE_COUNTER_BUFFER_FLUSHES);
+    push_down(btree, page_num, level, busiest);
+}
+
+// Puts a message into the buffer of the node at `level` on its path, or into
+// its leaf at level 0. Nodes without a buffer, or too small a one, pass it
+// on. Returns false if the message reached a leaf already holding its key.
+static bool deliver(BTree* btree, uint32_t key, void* value, uint32_t value_size, uint32_t level) {
+    uint32_t size = MESSAGE_HEADER_SIZE + value_size;
+    while (true) {
+        pager_begin_op(btree->pager);
+        page_num_t page_num = descend(btree, key, level, NULL);
+        if (level == 0) {
+            return leaf_apply(btree, page_num, key, value, value_size);
+        }
+
+        void* node = get_page(btree->pager, page_num);
+        uint32_t capacity = node_buffer_capacity(btree, node);
+        if ((!node_has_buffer(node) && !btree->buffered) || size > capacity) {
+            level--;
+            continue;
+        }
+        if (node_buffered_bytes(btree, node) + size > capacity) {
+            // The node may have split by the time this returns, so look again
+            flush_node(btree, page_num, level);
+            continue;
+        }
+
+        node = get_page_for_write(btree->pager, page_num);
+        node_start_buffer(btree, node);
+        uint16_t* used = node_buffer_used(btree, node);
+        serialize_leaf_value(node_buffer(btree, node) + *used, key, value, value_size);
+        *used += size;
+        return true;
+    }
+}
+
+// Moves every message bound for the leaf holding `key` into it
+static void flush_path(BTree* btree, uint32_t key) {
+    for (uint32_t level = tree_levels(btree); level > 0; level--) {
+        pager_begin_op(btree->pager);
+        page_num_t page_num = descend(btree, key, level, NULL);
+        void* node = get_page(btree->pager, page_num);
+        push_down(btree, page_num, level, internal_node_find_child(node, key));
+    }
+}
+
+// The insert goes to the root's buffer. A key pending in a buffer on its path
+// or already in its leaf is a duplicate. The leaf is read but not written.
+static int buffered_insert(BTree* btree, uint32_t key, void* value, uint32_t value_size) {
+    uint32_t levels = tree_levels(btree);
+    page_num_t page_num = btree->root_page_num;
+    for (uint32_t level = levels; level > 0; level--) {
+        void* node = pager_get_page_hinted(btree->pager, page_num, PAGE_HINT_INTERNAL);
+        if (buffer_contains(btree, node, key)) {
+            return -1;
+        }
+        page_num = *internal_node_child(node, internal_node_find_child(node, key));
+    }
+    BTreeCursor* cursor = leaf_node_find(btree, page_num, key);
+    void* leaf = get_page(btree->pager, page_num);
+    bool exists = cursor->cell_num < *leaf_node_num_cells(leaf) && *leaf_node_key(leaf, cursor->cell_num) == key;
+    free(cursor);
+    if (exists) {
+        return -1;
+    }
+    // A leaf can always split to take a cell of at most half its space, so
+    // only those wait in buffers. A larger one goes to its leaf now, where
+    // one that does not fit can still be refused.
+    if (MESSAGE_HEADER_SIZE + value_size > (btree->page_size - LEAF_NODE_HEADER_SIZE) / 2) {
+        return leaf_apply(btree, page_num, key, value, value_size) ? 0 : -1;
+    }
+
+    void* root = get_page(btree->pager, btree->root_page_num);
+    if (!node_has_buffer(root)) {
+        node_start_buffer(btree, get_page_for_write(btree->pager, btree->root_page_num));
+    }
+    btree->has_messages = true;
+    return deliver(btree, key, value, value_size, levels) ? 0 : -1;
+}
+
+void btree_set_buffered(BTree* btree, bool buffered) {
+    if (!buffered) {
+        btree_flush_buffers(btree);
+    }
+    btree->buffered = buffered;
+}
+
+// Sweeps each level from the top, node by node from left to right, so
+// messages moved down are swept again one level lower
+void btree_flush_buffers(BTree* btree) {
+    if (!btree->has_messages) {
+        return;
+    }
+
+    bool moved = false;
+    for (uint32_t level = tree_levels(btree); level > 0; level--) {
+        uint32_t key = 0;
+        while (true) {
+            pager_begin_op(btree->pager);
+            uint32_t bound;
+            page_num_t page_num = descend(btree, key, level, &bound);
+            moved |= push_down(btree, page_num, level, ALL_CHILDREN);
+            if (bound == UINT32_MAX) {
+                break;
+            }
+            key = bound + 1;
+        }
+    }
+
+    // Unflagging the root tells later handles the buffers are empty. A
+    // reader's handle that moved nothing must not write, and may leave it.
+    if (moved || btree->buffered) {
+        pager_begin_op(btree->pager);
+        void* root = get_page(btree->pager, btree->root_page_num);
+        if (node_has_buffer(root)) {
+            root = get_page_for_write(btree->pager, btree->root_page_num);
+            *node_flags(root) &= ~NODE_BUFFER_FLAG;
+        }
+    }
+    btree->has_messages = false;
+}
+
+// Repositions a cursor that read `last_key` at the end of a leaf on the next
+// key, after moving down the pending inserts that may come before it. Each
+// pass covers the keys that lead to one leaf.
+static void cursor_resume(BTreeCursor* cursor, uint32_t last_key) {
+    BTree* btree = cursor->btree;
+    uint32_t key = last_key;
+    while (key != UINT32_MAX) {
+        key++;
+        flush_path(btree, key);
+        pager_begin_op(btree->pager);
+        uint32_t bound;
+        page_num_t page_num = descend(btree, key, 0, &bound);
+        BTreeCursor* found = leaf_node_find(btree, page_num, key);
+        uint32_t cell_num = found->cell_num;
+        free(found);
+        if (cell_num < *leaf_node_num_cells(get_page(btree->pager, page_num))) {
+            cursor->page_num = page_num;
+            cursor->cell_num = cell_num;
+            pager_get_page_hinted(btree->pager, page_num, PAGE_HINT_SCAN);
+            return;
+        }
+        key = bound;
+    }
+    cursor->end_of_table = true;
+}
+
 void btree_cursor_advance(BTreeCursor* cursor) {
+    pager_begin_op(cursor->btree->pager);
     page_num_t page_num = cursor->page_num;
-    void* node = get_page(cursor->btree->pager, page_num);
+    void* node = pager_get_page_hinted(cursor->btree->pager, page_num, PAGE_HINT_SCAN);
 
     cursor->cell_num += 1;
     if (cursor->cell_num >= (*leaf_node_num_cells(node))) {
+        if (cursor->btree->has_messages) {
+            // Pending inserts may belong after the last key read, in this
+            // leaf or in any leaf before the next one holding a key
+            cursor_resume(cursor, *leaf_node_key(node, cursor->cell_num - 1));
+            return;
+        }
         // Advance to next leaf node
         uint32_t next_page_num = *leaf_node_next_leaf(node);
         if (next_page_num == 0) {
@@ -678,11 +1340,14 @@ void btree_cursor_advance(BTreeCursor* cursor) {
         } else {
             cursor->page_num = next_page_num;
             cursor->cell_num = 0;
+            // Bring the next leaf in as part of the scan
+            pager_get_page_hinted(cursor->btree->pager, next_page_num, PAGE_HINT_SCAN);
         }
     }
 }
 
 void btree_cursor_get_value(BTreeCursor* cursor, void* value_buffer, uint32_t buffer_size, uint32_t* value_size) {
+    pager_begin_op(cursor->btree->pager);
     page_num_t page_num = cursor->page_num;
     void* node = get_page(cursor->btree->pager, page_num);
 
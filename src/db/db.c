@@ -0,0 +1,697 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "db.h"
+#include "codegen.h"
+#include "repl.h"
+#include "sorter.h"
+#include "hashjoin.h"
+
+// EXPLAIN's columns, then EXPLAIN ANALYZE's profile columns
+#define EXPLAIN_COLUMNS 5
+#define EXPLAIN_ANALYZE_COLUMNS 10
+
+struct PreparedStatement {
+    Database* db;
+    char* sql;                    // Normalized text: the cache key
+    uint32_t sql_length;
+    uint64_t hash;
+    StatementType type;
+    ExplainMode explain;
+    uint32_t explain_address;     // Instruction EXPLAIN's next row describes
+    Value explain_row[EXPLAIN_ANALYZE_COLUMNS];
+    uint32_t num_parameters;
+    uint32_t changes;
+    Program* program;             // NULL for schema changes, which stmt_step() runs itself
+    Vm* vm;
+    uint32_t num_columns;
+    const char* column_names[SQL_MAX_COLUMNS];
+    char* aggregate_names;        // Names of aggregate result columns, like sum(age)
+    uint32_t schema_version;      // Catalog version the program was compiled against
+    bool cached;
+    bool in_use;
+    bool done;                    // A statement without a program, or EXPLAIN ANALYZE's, has run
+    bool started;                 // Stepped since the last reset
+    PreparedStatement* lru_prev;  // Towards more recently used
+    PreparedStatement* lru_next;
+    PreparedStatement* hash_next;
+};
+
+struct Database {
+    Pager* pager;
+    Catalog* catalog;
+    uint32_t schema_version;      // Bumped by every schema change
+    size_t sort_memory;           // Budget of each sort a statement runs
+    size_t join_memory;           // Budget of each hash join a statement runs
+    char error[DB_ERROR_SIZE];
+    SqlArena arena;               // Parsed statements, reset before each parse
+
+    // Statement cache: a chained hash table plus an LRU list, most recent first
+    PreparedStatement** buckets;
+    uint32_t num_buckets;
+    PreparedStatement* lru_head;
+    PreparedStatement* lru_tail;
+    uint32_t cache_capacity;
+    StatementCacheStats cache_stats;
+};
+
+static uint64_t hash_sql(const char* sql, uint32_t length) {
+    uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+    for (uint32_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)sql[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void free_statement(PreparedStatement* statement) {
+    if (statement->vm) {
+        vm_free(statement->vm);
+    }
+    if (statement->program) {
+        program_free(statement->program);
+    }
+    free(statement->aggregate_names);
+    free(statement->sql);
+    free(statement);
+}
+
+static void lru_unlink(Database* db, PreparedStatement* statement) {
+    if (statement->lru_prev) {
+        statement->lru_prev->lru_next = statement->lru_next;
+    } else {
+        db->lru_head = statement->lru_next;
+    }
+    if (statement->lru_next) {
+        statement->lru_next->lru_prev = statement->lru_prev;
+    } else {
+        db->lru_tail = statement->lru_prev;
+    }
+    statement->lru_prev = statement->lru_next = NULL;
+}
+
+static void lru_push_front(Database* db, PreparedStatement* statement) {
+    statement->lru_prev = NULL;
+    statement->lru_next = db->lru_head;
+    if (db->lru_head) {
+        db->lru_head->lru_prev = statement;
+    } else {
+        db->lru_tail = statement;
+    }
+    db->lru_head = statement;
+}
+
+static PreparedStatement** bucket_of(Database* db, uint64_t hash) {
+    return &db->buckets[hash & (db->num_buckets - 1)];
+}
+
+// Takes a statement out of the cache. One that is in use is freed when it is
+// finalized.
+static void cache_remove(Database* db, PreparedStatement* statement) {
+    PreparedStatement** link = bucket_of(db, statement->hash);
+    while (*link != statement) {
+        link = &(*link)->hash_next;
+    }
+    *link = statement->hash_next;
+    lru_unlink(db, statement);
+    statement->cached = false;
+    db->cache_stats.size--;
+    if (!statement->in_use) {
+        free_statement(statement);
+    }
+}
+
+// Evicts least recently used statements, skipping those in use
+static void cache_trim(Database* db, uint32_t capacity) {
+    PreparedStatement* statement = db->lru_tail;
+    while (statement && db->cache_stats.size > capacity) {
+        PreparedStatement* previous = statement->lru_prev;
+        if (!statement->in_use) {
+            cache_remove(db, statement);
+            db->cache_stats.evictions++;
+        }
+        statement = previous;
+    }
+}
+
+static void cache_resize_buckets(Database* db, uint32_t capacity) {
+    uint32_t num_buckets = 16;
+    while (num_buckets < capacity * 2) {
+        num_buckets *= 2;
+    }
+    PreparedStatement** buckets = calloc(num_buckets, sizeof(PreparedStatement*));
+    if (!buckets) {
+        return;  // Keep the old table; chains just get longer
+    }
+    for (PreparedStatement* statement = db->lru_head; statement; statement = statement->lru_next) {
+        PreparedStatement** bucket = &buckets[statement->hash & (num_buckets - 1)];
+        statement->hash_next = *bucket;
+        *bucket = statement;
+    }
+    free(db->buckets);
+    db->buckets = buckets;
+    db->num_buckets = num_buckets;
+}
+
+Database* db_open_with_options(const char* filename, const PagerOptions* options) {
+    Database* db = calloc(1, sizeof(Database));
+    if (!db) {
+        return NULL;
+    }
+    db->pager = pager_open_with_options(filename, options);
+    if (!db->pager) {
+        free(db);
+        return NULL;
+    }
+    db->catalog = catalog_open(db->pager);
+    if (!db->catalog) {
+        pager_close(db->pager);
+        free(db);
+        return NULL;
+    }
+    sql_arena_init(&db->arena);
+    db->cache_capacity = DB_DEFAULT_STATEMENT_CACHE_SIZE;
+    db->sort_memory = SORTER_DEFAULT_MEMORY;
+    db->join_memory = HASH_JOIN_DEFAULT_MEMORY;
+    cache_resize_buckets(db, db->cache_capacity);
+    if (!db->buckets) {
+        db_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+Database* db_open(const char* filename) {
+    PagerOptions options;
+    pager_default_options(&options);
+    return db_open_with_options(filename, &options);
+}
+
+void db_close(Database* db) {
+    while (db->lru_head) {
+        PreparedStatement* statement = db->lru_head;
+        statement->in_use = false;
+        cache_remove(db, statement);
+    }
+    free(db->buckets);
+    sql_arena_free(&db->arena);
+    catalog_close(db->catalog);
+    pager_close(db->pager);
+    free(db);
+}
+
+const char* db_error(Database* db) {
+    return db->error;
+}
+
+Catalog* db_catalog(Database* db) {
+    return db->catalog;
+}
+
+void db_set_statement_cache_size(Database* db, uint32_t size) {
+    db->cache_capacity = size;
+    cache_trim(db, size);
+    if (size * 2 > db->num_buckets) {
+        cache_resize_buckets(db, size);
+    }
+}
+
+StatementCacheStats db_statement_cache_stats(Database* db) {
+    return db->cache_stats;
+}
+
+void db_set_sort_memory(Database* db, size_t bytes) {
+    db->sort_memory = bytes;
+}
+
+void db_set_join_memory(Database* db, size_t bytes) {
+    db->join_memory = bytes;
+}
+
+static void clear_bindings(PreparedStatement* statement) {
+    Value null_value;
+    memset(&null_value, 0, sizeof(null_value));
+    for (uint32_t i = 0; statement->program && i < statement->program->num_parameters; i++) {
+        vm_bind(statement->vm, i, &null_value);
+    }
+}
+
+// Parsed statements live in the database's arena until the next parse
+static ParsedStatement* parse(Database* db, const char* sql, uint32_t length) {
+    sql_arena_reset(&db->arena);
+    return sql_parse(&db->arena, sql, length, db->error, sizeof(db->error));
+}
+
+#define AGGREGATE_NAME_SIZE (CATALOG_MAX_NAME + 8)
+
+// Result column names point into the catalog, which outlives statements, or
+// for aggregates into the statement's own names
+static void name_columns(PreparedStatement* statement, const ParsedStatement* parsed) {
+    static const char* functions[] = { "count", "sum", "min", "max" };
+    static const char* explain_names[EXPLAIN_ANALYZE_COLUMNS] = {
+        "addr", "opcode", "p1", "p2", "p3", "rows_in", "rows_out", "cycles", "page_hits", "page_misses"
+    };
+    statement->num_columns = 0;
+    free(statement->aggregate_names);
+    statement->aggregate_names = NULL;
+    if (parsed->explain != EXPLAIN_NONE) {
+        statement->num_columns = parsed->explain == EXPLAIN_ANALYZE ? EXPLAIN_ANALYZE_COLUMNS : EXPLAIN_COLUMNS;
+        memcpy(statement->column_names, explain_names, statement->num_columns * sizeof(const char*));
+        return;
+    }
+    if (parsed->type != STATEMENT_SELECT) {
+        return;
+    }
+    Catalog* catalog = statement->db->catalog;
+    if (parsed->num_columns == 0) {
+        // Every column of the FROM table, then of the JOIN table
+        const SqlName* names[2] = { &parsed->table, &parsed->join_table };
+        for (uint32_t i = 0; i < 2 && names[i]->length > 0; i++) {
+            Table* table = catalog_find_table(catalog, names[i]->start, names[i]->length);
+            for (uint32_t j = 0; j < table->num_columns; j++) {
+                statement->column_names[statement->num_columns++] = table->column_names[j];
+            }
+        }
+        return;
+    }
+    if (parsed->aggregate) {
+        statement->aggregate_names = malloc(parsed->num_columns * AGGREGATE_NAME_SIZE);
+        if (!statement->aggregate_names) {
+            return;
+        }
+    }
+    statement->num_columns = parsed->num_columns;
+    for (uint32_t i = 0; i < parsed->num_columns; i++) {
+        uint32_t column;
+        if (!parsed->aggregate) {
+            Table* table = codegen_find_column(catalog, parsed, parsed->columns[i], &column);
+            statement->column_names[i] = table->column_names[column];
+            continue;
+        }
+        char* name = statement->aggregate_names + i * AGGREGATE_NAME_SIZE;
+        if (parsed->columns[i].length == 0) {
+            snprintf(name, AGGREGATE_NAME_SIZE, "%s(*)", functions[parsed->functions[i]]);
+        } else {
+            Table* table = codegen_find_column(catalog, parsed, parsed->columns[i], &column);
+            snprintf(name, AGGREGATE_NAME_SIZE, "%s(%s)", functions[parsed->functions[i]], table->column_names[column]);
+        }
+        statement->column_names[i] = name;
+    }
+}
+
+// A VM for the program, profiling for EXPLAIN ANALYZE. NULL with a message
+// in db->error on failure; the program is not freed.
+static Vm* new_vm(Database* db, Program* program, const ParsedStatement* parsed) {
+    Vm* vm = vm_new(program);
+    if (vm && parsed->explain == EXPLAIN_ANALYZE && !vm_set_profiling(vm, true)) {
+        vm_free(vm);
+        vm = NULL;
+    }
+    if (!vm) {
+        snprintf(db->error, sizeof(db->error), "Out of memory");
+    }
+    return vm;
+}
+
+static PreparedStatement* compile(Database* db, char* sql, uint32_t length, uint64_t hash) {
+    PreparedStatement* statement = calloc(1, sizeof(PreparedStatement));
+    if (!statement) {
+        snprintf(db->error, sizeof(db->error), "Out of memory");
+        free(sql);
+        return NULL;
+    }
+    statement->db = db;
+    statement->sql = sql;
+    statement->sql_length = length;
+    statement->hash = hash;
+    statement->schema_version = db->schema_version;
+    ParsedStatement* parsed = parse(db, sql, length);
+    if (!parsed) {
+        free_statement(statement);
+        return NULL;
+    }
+    statement->type = parsed->type;
+    statement->explain = parsed->explain;
+    statement->num_parameters = parsed->num_parameters;
+    // EXPLAIN ANALYZE runs the statement; plain EXPLAIN does not
+    statement->changes = parsed->type == STATEMENT_INSERT && parsed->explain != EXPLAIN_PROGRAM ? parsed->num_rows : 0;
+    // Schema changes and ANALYZE are parsed again when they run, the only
+    // time it is needed
+    if (parsed->type == STATEMENT_INSERT || parsed->type == STATEMENT_SELECT) {
+        statement->program = codegen_compile(db->catalog, parsed, db->error, sizeof(db->error));
+        statement->vm = statement->program ? new_vm(db, statement->program, parsed) : NULL;
+        if (!statement->vm) {
+            free_statement(statement);
+            return NULL;
+        }
+        name_columns(statement, parsed);
+    }
+    return statement;
+}
+
+// Compiles a statement prepared before a schema change again, keeping its
+// bindings: an INSERT compiled before CREATE INDEX would not maintain the
+// index, and a SELECT would not use it
+static bool recompile(PreparedStatement* statement) {
+    Database* db = statement->db;
+    ParsedStatement* parsed = parse(db, statement->sql, statement->sql_length);
+    Program* program = parsed ? codegen_compile(db->catalog, parsed, db->error, sizeof(db->error)) : NULL;
+    Vm* vm = program ? new_vm(db, program, parsed) : NULL;
+    if (!vm) {
+        if (program) {
+            program_free(program);
+        }
+        return false;
+    }
+    for (uint32_t i = 0; i < statement->num_parameters; i++) {
+        vm_bind(vm, i, vm_binding(statement->vm, i));
+    }
+    vm_free(statement->vm);
+    program_free(statement->program);
+    statement->program = program;
+    statement->vm = vm;
+    statement->schema_version = db->schema_version;
+    name_columns(statement, parsed);
+    return true;
+}
+
+// Called before every step: the first one recompiles if the schema changed
+static bool start(PreparedStatement* statement) {
+    if (!statement->started && statement->schema_version != statement->db->schema_version &&
+        !recompile(statement)) {
+        return false;
+    }
+    if (!statement->started) {
+        vm_set_sort_memory(statement->vm, statement->db->sort_memory);
+        vm_set_join_memory(statement->vm, statement->db->join_memory);
+    }
+    statement->started = true;
+    return true;
+}
+
+PreparedStatement* db_prepare(Database* db, const char* sql, int32_t length) {
+    uint32_t sql_length = length < 0 ? (uint32_t)strlen(sql) : (uint32_t)length;
+    // Normalizing adds at most a space per character
+    uint32_t size = sql_length * 2 + 1;
+    char* normalized = malloc(size);
+    if (!normalized) {
+        snprintf(db->error, sizeof(db->error), "Out of memory");
+        return NULL;
+    }
+    uint32_t normalized_length = sql_normalize(sql, sql_length, normalized, size);
+    if (normalized_length == 0) {
+        snprintf(db->error, sizeof(db->error), "Empty statement or unrecognized token");
+        free(normalized);
+        return NULL;
+    }
+    uint64_t hash = hash_sql(normalized, normalized_length);
+
+    bool key_taken = false;
+    for (PreparedStatement* statement = *bucket_of(db, hash); statement; statement = statement->hash_next) {
+        if (statement->hash != hash || statement->sql_length != normalized_length ||
+            memcmp(statement->sql, normalized, normalized_length) != 0) {
+            continue;
+        }
+        if (statement->schema_version != db->schema_version) {
+            key_taken = statement->in_use;
+            cache_remove(db, statement);
+        } else if (statement->in_use) {
+            key_taken = true;
+        } else {
+            free(normalized);
+            db->cache_stats.hits++;
+            lru_unlink(db, statement);
+            lru_push_front(db, statement);
+            statement->in_use = true;
+            stmt_reset(statement);
+            clear_bindings(statement);
+            return statement;
+        }
+        break;
+    }
+
+    db->cache_stats.misses++;
+    PreparedStatement* statement = compile(db, normalized, normalized_length, hash);
+    if (!statement) {
+        return NULL;
+    }
+    statement->in_use = true;
+    // Schema changes run once; caching them would only evict useful entries
+    if (!key_taken && statement->program && db->cache_capacity > 0) {
+        PreparedStatement** bucket = bucket_of(db, hash);
+        statement->hash_next = *bucket;
+        *bucket = statement;
+        lru_push_front(db, statement);
+        statement->cached = true;
+        db->cache_stats.size++;
+        cache_trim(db, db->cache_capacity);
+    }
+    return statement;
+}
+
+uint32_t stmt_num_parameters(PreparedStatement* statement) {
+    return statement->num_parameters;
+}
+
+static bool bind(PreparedStatement* statement, uint32_t parameter, const Value* value) {
+    if (parameter == 0 || parameter > statement->num_parameters) {
+        snprintf(statement->db->error, sizeof(statement->db->error), "No parameter %u", parameter);
+        return false;
+    }
+    vm_bind(statement->vm, parameter - 1, value);
+    return true;
+}
+
+bool stmt_bind_int(PreparedStatement* statement, uint32_t parameter, int64_t integer) {
+    Value value;
+    memset(&value, 0, sizeof(value));
+    value.type = VALUE_INT;
+    value.integer = integer;
+    return bind(statement, parameter, &value);
+}
+
+bool stmt_bind_text(PreparedStatement* statement, uint32_t parameter, const char* text, uint32_t length) {
+    Value value;
+    memset(&value, 0, sizeof(value));
+    value.type = VALUE_TEXT;
+    value.text = text;
+    value.length = length;
+    return bind(statement, parameter, &value);
+}
+
+bool stmt_bind_null(PreparedStatement* statement, uint32_t parameter) {
+    Value value;
+    memset(&value, 0, sizeof(value));
+    return bind(statement, parameter, &value);
+}
+
+static void column_names(const ParsedStatement* parsed, const char** names, uint32_t* lengths) {
+    for (uint32_t i = 0; i < parsed->num_columns; i++) {
+        names[i] = parsed->columns[i].start;
+        lengths[i] = parsed->columns[i].length;
+    }
+}
+
+static bool create_table(Database* db, const ParsedStatement* parsed) {
+    const char* names[SQL_MAX_COLUMNS];
+    uint32_t lengths[SQL_MAX_COLUMNS];
+    column_names(parsed, names, lengths);
+    return catalog_create_table(db->catalog, parsed->table.start, parsed->table.length, names, lengths,
+                                parsed->column_types, parsed->num_columns, db->error, sizeof(db->error)) != NULL;
+}
+
+static bool create_index(Database* db, const ParsedStatement* parsed) {
+    Table* table = catalog_find_table(db->catalog, parsed->table.start, parsed->table.length);
+    if (!table) {
+        snprintf(db->error, sizeof(db->error), "No table %.*s", (int)parsed->table.length, parsed->table.start);
+        return false;
+    }
+    const char* names[SQL_MAX_COLUMNS];
+    uint32_t lengths[SQL_MAX_COLUMNS];
+    column_names(parsed, names, lengths);
+    return catalog_create_index(db->catalog, parsed->index.start, parsed->index.length, table, names, lengths,
+                                parsed->num_columns, db->error, sizeof(db->error)) != NULL;
+}
+
+static bool analyze(Database* db, const ParsedStatement* parsed) {
+    Table* table = NULL;
+    if (parsed->table.length > 0) {
+        table = catalog_find_table(db->catalog, parsed->table.start, parsed->table.length);
+        if (!table) {
+            snprintf(db->error, sizeof(db->error), "No table %.*s", (int)parsed->table.length, parsed->table.start);
+            return false;
+        }
+    }
+    return catalog_analyze(db->catalog, table, db->error, sizeof(db->error));
+}
+
+// Every schema change bumps the version, so cached statements compiled
+// against the old schema are recompiled: after CREATE INDEX they can use it,
+// and after ANALYZE they are planned with the new statistics
+static VmStatus run_schema_change(PreparedStatement* statement) {
+    Database* db = statement->db;
+    const ParsedStatement* parsed = parse(db, statement->sql, statement->sql_length);
+    if (!parsed) {
+        return VM_ERROR;
+    }
+    bool changed;
+    switch (parsed->type) {
+        case STATEMENT_CREATE_INDEX:
+            changed = create_index(db, parsed);
+            break;
+        case STATEMENT_ANALYZE:
+            changed = analyze(db, parsed);
+            break;
+        default:
+            changed = create_table(db, parsed);
+            break;
+    }
+    if (!changed) {
+        return VM_ERROR;
+    }
+    db->schema_version++;
+    return VM_DONE;
+}
+
+static void set_integer(Value* value, int64_t integer) {
+    value->type = VALUE_INT;
+    value->integer = integer;
+}
+
+// EXPLAIN yields a row per instruction. EXPLAIN ANALYZE first runs the
+// program to its end, discarding its rows, so each row carries the
+// instruction's complete profile.
+static VmStatus explain_step(PreparedStatement* statement) {
+    const Program* program = statement->program;
+    if (statement->explain == EXPLAIN_ANALYZE && !statement->done) {
+        if (vm_run(statement->vm, NULL, NULL) == VM_ERROR) {
+            snprintf(statement->db->error, sizeof(statement->db->error), "%s", vm_error(statement->vm));
+            return VM_ERROR;
+        }
+        statement->done = true;
+    }
+    if (statement->explain_address >= program->length) {
+        return VM_DONE;
+    }
+    uint32_t address = statement->explain_address++;
+    const Instruction* instruction = &program->code[address];
+    Value* row = statement->explain_row;
+    set_integer(&row[0], address);
+    row[1].type = VALUE_TEXT;
+    row[1].text = vm_opcode_name((Opcode)instruction->opcode);
+    row[1].length = (uint32_t)strlen(row[1].text);
+    set_integer(&row[2], instruction->p1);
+    set_integer(&row[3], instruction->p2);
+    set_integer(&row[4], instruction->p3);
+    if (statement->explain == EXPLAIN_ANALYZE) {
+        const VmProfile* profile = &vm_profile(statement->vm)[address];
+        set_integer(&row[5], (int64_t)profile->rows_in);
+        set_integer(&row[6], (int64_t)profile->rows_out);
+        set_integer(&row[7], (int64_t)profile->cycles);
+        set_integer(&row[8], (int64_t)profile->page_hits);
+        set_integer(&row[9], (int64_t)profile->page_misses);
+    }
+    return VM_ROW;
+}
+
+VmStatus stmt_step(PreparedStatement* statement) {
+    if (!statement->program) {
+        if (statement->done) {
+            return VM_DONE;
+        }
+        statement->done = true;
+        return run_schema_change(statement);
+    }
+    if (!start(statement)) {
+        return VM_ERROR;
+    }
+    if (statement->explain != EXPLAIN_NONE) {
+        return explain_step(statement);
+    }
+    VmStatus status = vm_step(statement->vm);
+    if (status == VM_ERROR) {
+        snprintf(statement->db->error, sizeof(statement->db->error), "%s", vm_error(statement->vm));
+    }
+    return status;
+}
+
+VmStatus stmt_execute(PreparedStatement* statement, VmRowCallback callback, void* context) {
+    if (!statement->program) {
+        return stmt_step(statement);
+    }
+    if (!start(statement)) {
+        return VM_ERROR;
+    }
+    if (statement->explain != EXPLAIN_NONE) {
+        VmStatus status;
+        while ((status = explain_step(statement)) == VM_ROW) {
+            if (callback && !callback(context, statement->explain_row, statement->num_columns)) {
+                return VM_ROW;
+            }
+        }
+        return status;
+    }
+    VmStatus status = vm_run(statement->vm, callback, context);
+    if (status == VM_ERROR) {
+        snprintf(statement->db->error, sizeof(statement->db->error), "%s", vm_error(statement->vm));
+    }
+    return status;
+}
+
+VmStatus db_exec(Database* db, const char* sql, VmRowCallback callback, void* context) {
+    PreparedStatement* statement = db_prepare(db, sql, -1);
+    if (!statement) {
+        return VM_ERROR;
+    }
+    VmStatus status = stmt_execute(statement, callback, context);
+    stmt_finalize(statement);
+    return status == VM_ROW ? VM_DONE : status;
+}
+
+const Value* stmt_row(PreparedStatement* statement, uint32_t* num_columns) {
+    if (statement->explain != EXPLAIN_NONE) {
+        *num_columns = statement->explain_address > 0 ? statement->num_columns : 0;
+        return statement->explain_row;
+    }
+    return vm_row(statement->vm, num_columns);
+}
+
+uint32_t stmt_num_columns(PreparedStatement* statement) {
+    return statement->num_columns;
+}
+
+const char* stmt_column_name(PreparedStatement* statement, uint32_t column) {
+    return column < statement->num_columns ? statement->column_names[column] : NULL;
+}
+
+StatementType stmt_type(PreparedStatement* statement) {
+    return statement->type;
+}
+
+ExplainMode stmt_explain(PreparedStatement* statement) {
+    return statement->explain;
+}
+
+uint32_t stmt_changes(PreparedStatement* statement) {
+    return statement->changes;
+}
+
+void stmt_reset(PreparedStatement* statement) {
+    if (statement->vm) {
+        vm_reset(statement->vm);
+    }
+    statement->done = false;
+    statement->started = false;
+    statement->explain_address = 0;
+}
+
+void stmt_finalize(PreparedStatement* statement) {
+    if (!statement->cached) {
+        free_statement(statement);
+        return;
+    }
+    statement->in_use = false;
+    stmt_reset(statement);
+    // The cache may have grown past its size while every entry was in use
+    cache_trim(statement->db, statement->db->cache_capacity);
+}
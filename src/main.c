@@ -0,0 +1,87 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "db.h"
+#include "server.h"
+
+// miniSQL <database> [script.sql]
+// miniSQL --serve <socket> [--workers N] <database>
+//
+// Runs SQL from the script, or from standard input: interactively on a
+// terminal, or streamed from a pipe (miniSQL test.db < dump.sql). With
+// --serve, serves the database to clients on a Unix domain socket (see
+// server.h) until SIGINT or SIGTERM.
+
+static Server* running_server;
+
+static void stop_server(int signal_number) {
+    (void)signal_number;
+    server_stop(running_server);
+}
+
+static int serve(const char* socket_path, uint32_t num_workers, const char* filename) {
+    Database* db = db_open(filename);
+    if (!db) {
+        printf("ERROR: Cannot open database %s\n", filename);
+        return EXIT_FAILURE;
+    }
+    running_server = server_open(db, socket_path, num_workers);
+    if (!running_server) {
+        db_close(db);
+        return EXIT_FAILURE;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Serving %s on %s\n", filename, socket_path);
+    fflush(stdout);
+    int result = server_run(running_server);
+    server_close(running_server);
+    db_close(db);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+        uint32_t num_workers = 0;
+        if (argc == 6 && strcmp(argv[3], "--workers") == 0) {
+            num_workers = (uint32_t)strtoul(argv[4], NULL, 10);
+        } else if (argc != 4) {
+            printf("Usage: %s --serve <socket> [--workers N] <database>\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        return serve(argv[2], num_workers, argv[argc - 1]);
+    }
+    if (argc < 2 || argc > 3) {
+        printf("Usage: %s <database> [script.sql]\n", argv[0]);
+        printf("       %s --serve <socket> [--workers N] <database>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int fd = STDIN_FILENO;
+    if (argc == 3) {
+        fd = open(argv[2], O_RDONLY);
+        if (fd < 0) {
+            printf("ERROR: Cannot open %s\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+    }
+    Database* db = db_open(argv[1]);
+    if (!db) {
+        printf("ERROR: Cannot open database %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    uint32_t failures = repl_run(db, fd);
+    db_close(db);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
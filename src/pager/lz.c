@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <string.h>
+#include "lz.h"
+
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1u << LZ_HASH_BITS)
+#define LZ_NO_POSITION UINT32_MAX
+#define LZ_MAX_OFFSET 65535
+#define LZ_NIBBLE_MAX 15
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash32(uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Writes the 255-run continuation of a length that filled its nibble
+static uint8_t* put_length(uint8_t* out, const uint8_t* end, size_t length) {
+    for (; length >= 255; length -= 255) {
+        if (out >= end) {
+            return NULL;
+        }
+        *out++ = 255;
+    }
+    if (out >= end) {
+        return NULL;
+    }
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+// Emits one sequence; a match_length of 0 ends the block with literals only
+static uint8_t* put_sequence(uint8_t* out, const uint8_t* end, const uint8_t* literals, size_t num_literals,
+                             size_t offset, size_t match_length) {
+    if (out >= end) {
+        return NULL;
+    }
+    uint8_t* token = out++;
+    *token = (uint8_t)((num_literals < LZ_NIBBLE_MAX ? num_literals : LZ_NIBBLE_MAX) << 4);
+    if (num_literals >= LZ_NIBBLE_MAX && !(out = put_length(out, end, num_literals - LZ_NIBBLE_MAX))) {
+        return NULL;
+    }
+    if ((size_t)(end - out) < num_literals) {
+        return NULL;
+    }
+    memcpy(out, literals, num_literals);
+    out += num_literals;
+    if (match_length == 0) {
+        return out;
+    }
+
+    if (end - out < 2) {
+        return NULL;
+    }
+    *out++ = (uint8_t)offset;
+    *out++ = (uint8_t)(offset >> 8);
+    size_t extra = match_length - LZ_MIN_MATCH;
+    *token |= (uint8_t)(extra < LZ_NIBBLE_MAX ? extra : LZ_NIBBLE_MAX);
+    if (extra >= LZ_NIBBLE_MAX && !(out = put_length(out, end, extra - LZ_NIBBLE_MAX))) {
+        return NULL;
+    }
+    return out;
+}
+
+size_t lz_compress(const void* source, size_t length, void* destination, size_t capacity) {
+    const uint8_t* in = source;
+    uint8_t* out = destination;
+    const uint8_t* end = out + capacity;
+    if (length > LZ_MAX_INPUT) {
+        return 0;
+    }
+
+    uint32_t table[LZ_HASH_SIZE];
+    memset(table, 0xff, sizeof(table));
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + LZ_MIN_MATCH <= length) {
+        uint32_t prefix = read32(in + position);
+        uint32_t* slot = &table[hash32(prefix)];
+        uint32_t candidate = *slot;
+        *slot = (uint32_t)position;
+        if (candidate == LZ_NO_POSITION || position - candidate > LZ_MAX_OFFSET || read32(in + candidate) != prefix) {
+            position++;
+            continue;
+        }
+
+        size_t match_length = LZ_MIN_MATCH;
+        while (position + match_length < length && in[candidate + match_length] == in[position + match_length]) {
+            match_length++;
+        }
+        out = put_sequence(out, end, in + anchor, position - anchor, position - candidate, match_length);
+        if (!out) {
+            return 0;
+        }
+        position += match_length;
+        anchor = position;
+    }
+
+    out = put_sequence(out, end, in + anchor, length - anchor, 0, 0);
+    return out ? (size_t)(out - (uint8_t*)destination) : 0;
+}
+
+// Reads the continuation of a length whose nibble was full
+static const uint8_t* get_length(const uint8_t* in, const uint8_t* end, size_t* length) {
+    uint8_t byte;
+    do {
+        if (in >= end) {
+            return NULL;
+        }
+        byte = *in++;
+        *length += byte;
+    } while (byte == 255);
+    return in;
+}
+
+bool lz_decompress(const void* source, size_t length, void* destination, size_t expected) {
+    const uint8_t* in = source;
+    const uint8_t* in_end = in + length;
+    uint8_t* out = destination;
+    uint8_t* out_end = out + expected;
+
+    while (in < in_end) {
+        uint8_t token = *in++;
+        size_t num_literals = token >> 4;
+        if (num_literals == LZ_NIBBLE_MAX && !(in = get_length(in, in_end, &num_literals))) {
+            return false;
+        }
+        if ((size_t)(in_end - in) < num_literals || (size_t)(out_end - out) < num_literals) {
+            return false;
+        }
+        memcpy(out, in, num_literals);
+        in += num_literals;
+        out += num_literals;
+        if (in == in_end) {
+            break;  // The last sequence
+        }
+
+        if (in_end - in < 2) {
+            return false;
+        }
+        size_t offset = in[0] | ((size_t)in[1] << 8);
+        in += 2;
+        size_t match_length = token & LZ_NIBBLE_MAX;
+        if (match_length == LZ_NIBBLE_MAX && !(in = get_length(in, in_end, &match_length))) {
+            return false;
+        }
+        match_length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(out - (uint8_t*)destination) ||
+            (size_t)(out_end - out) < match_length) {
+            return false;
+        }
+        // A match overlapping its own output repeats every `offset` bytes, so
+        // it is copied in doubling runs of whole periods
+        const uint8_t* match = out - offset;
+        for (size_t copied = 0; copied < match_length;) {
+            size_t run = offset + copied;
+            if (run > match_length - copied) {
+                run = match_length - copied;
+            }
+            memcpy(out + copied, match, run);
+            copied += run;
+        }
+        out += match_length;
+    }
+    return out == out_end;
+}
@@ -0,0 +1,281 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "page_io.h"
+
+// Longest run of adjacent requests merged into one preadv/pwritev
+#define SYNC_MAX_IOVECS 64
+
+// The ring is driven with raw system calls so there is no liburing dependency
+typedef struct {
+    int fd;
+    uint32_t entries;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    uint32_t* sq_tail;
+    uint32_t* sq_mask;
+    uint32_t* sq_array;
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t* cq_mask;
+    struct io_uring_cqe* cqes;
+} Ring;
+
+struct PageIo {
+    int file_descriptor;
+    PageIoBackend backend;
+    Ring ring;
+};
+
+static void ring_unmap(Ring* ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+}
+
+static int ring_setup(Ring* ring, uint32_t queue_depth) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+    ring->entries = params.sq_entries;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring_unmap(ring);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring_unmap(ring);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring_unmap(ring);
+        return -1;
+    }
+
+    char* sq = ring->sq_ring;
+    char* cq = ring->cq_ring;
+    ring->sq_tail = (uint32_t*)(sq + params.sq_off.tail);
+    ring->sq_mask = (uint32_t*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*)(sq + params.sq_off.array);
+    ring->cq_head = (uint32_t*)(cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t*)(cq + params.cq_off.tail);
+    ring->cq_mask = (uint32_t*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+PageIo* page_io_open(int file_descriptor, PageIoBackend backend, uint32_t queue_depth) {
+    PageIo* io = calloc(1, sizeof(PageIo));
+    if (!io) {
+        return NULL;
+    }
+    io->file_descriptor = file_descriptor;
+    io->backend = PAGE_IO_SYNC;
+    if (backend == PAGE_IO_URING && queue_depth > 0 && ring_setup(&io->ring, queue_depth) == 0) {
+        io->backend = PAGE_IO_URING;
+    }
+    return io;
+}
+
+PageIoBackend page_io_backend(PageIo* io) {
+    return io->backend;
+}
+
+void page_io_close(PageIo* io) {
+    if (io->backend == PAGE_IO_URING) {
+        ring_unmap(&io->ring);
+    }
+    free(io);
+}
+
+// Issues requests [first, first + count), which are known to be adjacent in
+// the file, as one vectored call and spreads the result over them
+static void sync_run(PageIo* io, PageIoRequest* requests, uint32_t count, bool write) {
+    struct iovec iov[SYNC_MAX_IOVECS];
+    for (uint32_t i = 0; i < count; i++) {
+        iov[i].iov_base = requests[i].buffer;
+        iov[i].iov_len = requests[i].length;
+    }
+    ssize_t transferred = write ? pwritev(io->file_descriptor, iov, count, requests[0].offset)
+                                : preadv(io->file_descriptor, iov, count, requests[0].offset);
+    if (transferred < 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            requests[i].result = -errno;
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        ssize_t length = (ssize_t)requests[i].length;
+        requests[i].result = transferred < length ? transferred : length;
+        transferred -= requests[i].result;
+    }
+    // Resume a short transfer one request at a time until it completes, the
+    // read reaches end of file or the call fails
+    for (uint32_t i = 0; i < count; i++) {
+        PageIoRequest* request = &requests[i];
+        while ((size_t)request->result < request->length) {
+            char* buffer = (char*)request->buffer + request->result;
+            size_t remaining = request->length - (size_t)request->result;
+            off_t offset = request->offset + request->result;
+            ssize_t more = write ? pwrite(io->file_descriptor, buffer, remaining, offset)
+                                 : pread(io->file_descriptor, buffer, remaining, offset);
+            if (more < 0 && errno == EINTR) {
+                continue;
+            }
+            if (more < 0) {
+                request->result = -errno;
+            }
+            if (more <= 0) {
+                break;
+            }
+            request->result += more;
+        }
+    }
+}
+
+static void sync_batch(PageIo* io, PageIoRequest* requests, uint32_t count, bool write) {
+    uint32_t start = 0;
+    while (start < count) {
+        uint32_t run = 1;
+        while (start + run < count && run < SYNC_MAX_IOVECS &&
+               requests[start + run].offset ==
+                   requests[start + run - 1].offset + (off_t)requests[start + run - 1].length) {
+            run++;
+        }
+        sync_run(io, requests + start, run, write);
+        start += run;
+    }
+}
+
+// Queues what is left of request `index`: all of it, or the rest after a
+// short transfer, whose byte count is its result so far
+static void ring_queue(PageIo* io, PageIoRequest* requests, uint32_t index, bool write) {
+    Ring* ring = &io->ring;
+    PageIoRequest* request = &requests[index];
+    size_t done = (size_t)request->result;
+    uint32_t tail = *ring->sq_tail;
+    uint32_t slot = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = io->file_descriptor;
+    sqe->addr = (uint64_t)(uintptr_t)((char*)request->buffer + done);
+    sqe->len = (uint32_t)(request->length - done);
+    sqe->off = (uint64_t)request->offset + done;
+    sqe->user_data = index;
+    ring->sq_array[slot] = slot;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void ring_batch(PageIo* io, PageIoRequest* requests, uint32_t count, bool write) {
+    Ring* ring = &io->ring;
+    uint32_t next = 0;           // First request not queued yet
+    uint32_t finished = 0;
+    uint32_t in_flight = 0;      // Queued and not completed
+    uint32_t unsubmitted = 0;    // Queued but not yet taken by the kernel
+    for (uint32_t i = 0; i < count; i++) {
+        requests[i].result = 0;
+    }
+
+    while (finished < count) {
+        // Fill the submission queue as far as the ring allows
+        while (next < count && in_flight < ring->entries) {
+            ring_queue(io, requests, next++, write);
+            in_flight++;
+            unsubmitted++;
+        }
+
+        // The kernel may take only some of the queued entries; the rest are
+        // passed again on the next call. EINTR, EAGAIN and EBUSY are
+        // transient: reap whatever has completed and try again.
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret >= 0) {
+            unsubmitted -= (uint32_t)ret;
+        } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            printf("ERROR: io_uring_enter failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        uint32_t head = *ring->cq_head;
+        uint32_t cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != cq_tail) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            uint32_t index = (uint32_t)cqe->user_data;
+            PageIoRequest* request = &requests[index];
+            int res = cqe->res;
+            head++;
+            if (res > 0) {
+                request->result += res;
+            }
+            // Resume short transfers and transient failures in the slot the
+            // completion freed. Zero bytes means end of file for a read.
+            if (res == -EINTR || res == -EAGAIN || (res > 0 && (size_t)request->result < request->length)) {
+                ring_queue(io, requests, index, write);
+                unsubmitted++;
+                continue;
+            }
+            if (res < 0) {
+                request->result = res;
+            }
+            in_flight--;
+            finished++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+void page_io_read(PageIo* io, PageIoRequest* requests, uint32_t count) {
+    if (io->backend == PAGE_IO_URING) {
+        ring_batch(io, requests, count, false);
+    } else {
+        sync_batch(io, requests, count, false);
+    }
+}
+
+void page_io_write(PageIo* io, PageIoRequest* requests, uint32_t count) {
+    if (io->backend == PAGE_IO_URING) {
+        ring_batch(io, requests, count, true);
+    } else {
+        sync_batch(io, requests, count, true);
+    }
+}
@@ -1,65 +1,1416 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "lz.h"
 #include "pager.h"
+#include "stats.h"
 
-#define TABLE_MAX_PAGES 100
+// File header layout. The header occupies the first page-sized block of the
+// file so that page N always starts at a page-aligned offset.
+#define FILE_MAGIC "miniSQL"
+#define FILE_MAGIC_SIZE 8
+#define FILE_FORMAT_VERSION 1
+#define FILE_FORMAT_VERSION_COMPRESSED 2
+#define FILE_HEADER_VERSION_OFFSET 8
+#define FILE_HEADER_PAGE_SIZE_OFFSET 12
+#define FILE_HEADER_NUM_PAGES_OFFSET 16
+#define FILE_HEADER_SIZE 20
+// Compressed files only: where the extent map of the last checkpoint is
+#define FILE_HEADER_MAP_SECTOR_OFFSET 20
+
+// Compressed files place page images in units of this many bytes
+#define SECTOR_SIZE 512
+
+// Buffer pool replacement is 2Q: pages enter a FIFO probation queue and only
+// move to the LRU protected queue when they are referenced again outside the
+// correlation window (or were recently evicted from probation, which the ghost
+// queue remembers). Scans never leave probation, so they cannot push hot pages
+// out of the protected queue.
+#define PROBATION_SHARE_DIVISOR 4      // Probation may hold 1/4 of the pool
+#define GHOST_SHARE_DIVISOR 2          // Ghost queue remembers 1/2 pool of evictions
+#define CORRELATION_WINDOW 32          // Accesses that still count as the same use
+#define SEQUENTIAL_RUN_THRESHOLD 8     // Consecutive-page misses that signal a scan
+
+#define FRAME_NONE UINT32_MAX
+
+// Frames live in one preallocated arena. Huge page backing uses 2 MB pages.
+#define HUGE_PAGE_SIZE (2u * 1024 * 1024)
+#define OS_PAGE_SIZE 4096
+
+// Read-ahead starts small and doubles while the pages it brings in get used
+#define READ_AHEAD_MIN_PAGES 2
+
+// Largest number of page reads or writes handed to the I/O layer at once
+#define IO_BATCH_PAGES 64
+
+typedef enum { QUEUE_NONE, QUEUE_PROBATION, QUEUE_PROTECTED } FrameQueue;
+
+typedef enum {
+    PAGER_COUNTER_HITS,
+    PAGER_COUNTER_MISSES,
+    PAGER_COUNTER_PAGE_READS,
+    PAGER_COUNTER_PAGE_WRITES,
+    PAGER_COUNTER_EVICTIONS,
+    PAGER_COUNTER_READ_AHEAD_PAGES,
+    PAGER_COUNTER_BYTES_READ,
+    PAGER_COUNTER_BYTES_WRITTEN
+} PagerCounter;
+
+typedef struct {
+    void* data;
+    page_num_t page_num;
+    uint32_t prev;            // Queue links (frame indices)
+    uint32_t next;
+    uint32_t hash_next;       // Page table chain
+    uint32_t op_epoch;        // Operation that last returned this frame
+    uint64_t loaded_at;       // Access clock when the page was read in
+    uint8_t queue;
+    bool dirty;
+    bool internal;
+    bool scan;                // Brought in by a hinted scan
+    bool sequential;          // Part of a detected run of consecutive misses
+    bool read_ahead;          // Read ahead and not yet used
+} Frame;
+
+typedef struct {
+    uint32_t head;            // Oldest / least recently used
+    uint32_t tail;
+    uint32_t size;
+} FrameQueueList;
+
+typedef struct {
+    page_num_t page_num;
+    uint32_t hash_next;
+} GhostEntry;
+
+// Where a compressed file keeps a page's image. A length of 0 means the page
+// was never written, and a length of page_size that it is stored raw.
+typedef struct {
+    uint32_t sector;
+    uint32_t length;
+} PageExtent;
+
+// Free extents that are all the same number of sectors long
+typedef struct {
+    uint32_t* sectors;
+    uint32_t count;
+    uint32_t allocated;
+} ExtentBin;
 
 struct Pager {
-    void* pages[TABLE_MAX_PAGES];
-    uint32_t num_pages;
+    int file_descriptor;
+    bool direct_io;            // File opened with O_DIRECT
+    PageIo* io;
+    StatsCounters* counters;
+    uint32_t page_size;
+    uint32_t num_pages;        // Pages known to the database (on disk or in memory)
+    uint32_t num_file_pages;   // Pages that have been written to the file
+
+    Frame* frames;
+    uint32_t num_frames;       // Arena frames plus any overflow frames
+    uint32_t frames_allocated; // Length of the frames array
+    uint32_t capacity;         // Frames in the arena
+    uint32_t free_frames;      // Frames holding no page, linked through `next`
+    void* arena;
+    size_t arena_size;
+    PagerHugePages huge_pages; // Backing actually in effect
+    uint32_t* page_table;      // Hash buckets of frame indices
+    uint32_t page_table_mask;
+    FrameQueueList probation;
+    FrameQueueList protected_queue;
+
+    GhostEntry* ghosts;        // Ring of page numbers evicted from probation
+    uint32_t* ghost_table;
+    uint32_t ghost_capacity;
+    uint32_t ghost_head;
+    uint32_t ghost_count;
+
+    uint32_t op_epoch;
+    uint64_t access_clock;
+    page_num_t last_miss;
+    uint32_t sequential_run;
+
+    uint32_t read_ahead_max;     // Largest window in pages, 0 when disabled
+    uint32_t read_ahead_window;  // Current window
+    uint32_t read_ahead_issued;  // Pages read by the last window
+    uint32_t read_ahead_used;    // ... and how many of them were used since
+    bool read_only;              // A reader from pager_open_reader()
+    bool temporary;              // From pager_open_temporary(): nothing outlives it
+
+    PagerCompression compression;
+    PageExtent* extents;         // Compressed files: one per page below num_file_pages
+    uint32_t extents_allocated;
+    ExtentBin* free_extents;     // Indexed by length in sectors, up to one page
+    uint32_t end_sector;         // First sector past every extent and the durable map
+    // The map the header points to, as of the last checkpoint. A crash
+    // before the next one leaves it in force, so the extents it references
+    // and its own sectors are not overwritten until then.
+    PageExtent* durable_extents;
+    uint32_t num_durable_extents;
+    uint32_t durable_map_sector;
+    uint32_t durable_map_sectors;
+    PageExtent* deferred;        // Durable extents freed since, lengths in sectors
+    uint32_t num_deferred;
+    uint32_t deferred_allocated;
+    bool map_dirty;              // Extents moved since the last checkpoint
+    uint8_t* staging;            // Compressed images: IO_BATCH_PAGES pages for reads, as many for writes
 };
 
+static bool is_valid_page_size(uint32_t page_size) {
+    return page_size >= MIN_PAGE_SIZE && page_size <= MAX_PAGE_SIZE &&
+           (page_size & (page_size - 1)) == 0;
+}
+
+static off_t page_offset(Pager* pager, page_num_t page_num) {
+    // Block 0 holds the file header
+    return (off_t)(page_num + 1) * pager->page_size;
+}
+
+static uint32_t sectors_for(uint32_t length) {
+    return (length + SECTOR_SIZE - 1) / SECTOR_SIZE;
+}
+
+static uint32_t page_sectors(Pager* pager) {
+    return pager->page_size / SECTOR_SIZE;
+}
+
+// Whether a page has an image in the file; the others read as zeroes
+static bool page_in_file(Pager* pager, page_num_t page_num) {
+    return page_num < pager->num_file_pages &&
+           (pager->compression == PAGER_COMPRESSION_NONE || pager->extents[page_num].length > 0);
+}
+
+static uint32_t hash_page_num(page_num_t page_num) {
+    return page_num * 2654435761u;
+}
+
+// Extent map helpers, for compressed files
+
+static void ensure_extents(Pager* pager, uint32_t count) {
+    if (count <= pager->extents_allocated) {
+        return;
+    }
+    uint32_t allocated = pager->extents_allocated ? pager->extents_allocated : 64;
+    while (allocated < count) {
+        allocated *= 2;
+    }
+    PageExtent* extents = realloc(pager->extents, allocated * sizeof(PageExtent));
+    if (!extents) {
+        printf("ERROR: Out of memory growing the extent map\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(extents + pager->extents_allocated, 0, (allocated - pager->extents_allocated) * sizeof(PageExtent));
+    pager->extents = extents;
+    pager->extents_allocated = allocated;
+}
+
+static void free_extent(Pager* pager, uint32_t sector, uint32_t sectors) {
+    ExtentBin* bin = &pager->free_extents[sectors];
+    if (bin->count == bin->allocated) {
+        uint32_t allocated = bin->allocated ? bin->allocated * 2 : 16;
+        uint32_t* grown = realloc(bin->sectors, allocated * sizeof(uint32_t));
+        if (!grown) {
+            printf("ERROR: Out of memory freeing an extent\n");
+            exit(EXIT_FAILURE);
+        }
+        bin->sectors = grown;
+        bin->allocated = allocated;
+    }
+    bin->sectors[bin->count++] = sector;
+}
+
+// Frees a run of any length, in pieces no longer than a page
+static void free_sectors(Pager* pager, uint32_t sector, uint32_t sectors) {
+    while (sectors > 0) {
+        uint32_t piece = sectors < page_sectors(pager) ? sectors : page_sectors(pager);
+        free_extent(pager, sector, piece);
+        sector += piece;
+        sectors -= piece;
+    }
+}
+
+// Whether a page's extent is the one the durable map references
+static bool extent_is_durable(Pager* pager, page_num_t page_num) {
+    return page_num < pager->num_durable_extents && pager->durable_extents[page_num].length > 0 &&
+           pager->durable_extents[page_num].sector == pager->extents[page_num].sector;
+}
+
+// Frees the sectors a page's extent no longer needs. Those the durable map
+// references wait for the next checkpoint.
+static void release_extent(Pager* pager, page_num_t page_num, uint32_t sector, uint32_t sectors) {
+    if (!extent_is_durable(pager, page_num)) {
+        free_extent(pager, sector, sectors);
+        return;
+    }
+    if (pager->num_deferred == pager->deferred_allocated) {
+        uint32_t allocated = pager->deferred_allocated ? pager->deferred_allocated * 2 : 64;
+        PageExtent* grown = realloc(pager->deferred, allocated * sizeof(PageExtent));
+        if (!grown) {
+            printf("ERROR: Out of memory freeing an extent\n");
+            exit(EXIT_FAILURE);
+        }
+        pager->deferred = grown;
+        pager->deferred_allocated = allocated;
+    }
+    pager->deferred[pager->num_deferred].sector = sector;
+    pager->deferred[pager->num_deferred].length = sectors;
+    pager->num_deferred++;
+}
+
+// Takes a free extent of exactly `sectors`, else splits the shortest longer
+// one, else grows the file
+static uint32_t allocate_extent(Pager* pager, uint32_t sectors) {
+    for (uint32_t size = sectors; size <= page_sectors(pager); size++) {
+        ExtentBin* bin = &pager->free_extents[size];
+        if (bin->count > 0) {
+            uint32_t sector = bin->sectors[--bin->count];
+            if (size > sectors) {
+                free_extent(pager, sector + sectors, size - sectors);
+            }
+            return sector;
+        }
+    }
+    uint32_t sector = pager->end_sector;
+    pager->end_sector += sectors;
+    return sector;
+}
+
+static int compare_extents(const void* a, const void* b) {
+    uint32_t sector_a = ((const PageExtent*)a)->sector;
+    uint32_t sector_b = ((const PageExtent*)b)->sector;
+    return (sector_a > sector_b) - (sector_a < sector_b);
+}
+
+// Extents cannot be block-aligned, so a compressed file gives up O_DIRECT
+static int disable_direct_io(Pager* pager) {
+    if (!pager->direct_io) {
+        return 0;
+    }
+    int flags = fcntl(pager->file_descriptor, F_GETFL);
+    if (flags == -1 || fcntl(pager->file_descriptor, F_SETFL, flags & ~O_DIRECT) == -1) {
+        return -1;
+    }
+    pager->direct_io = false;
+    return 0;
+}
+
+// Sets up the extent map of a compressed file: empty for a new one, else
+// read from `map_sector`. The gaps between the extents in use and the map
+// itself are free.
+static int open_extents(Pager* pager, bool existing, uint32_t map_sector) {
+    pager->compression = PAGER_COMPRESSION_LZ;
+    pager->free_extents = calloc(page_sectors(pager) + 1, sizeof(ExtentBin));
+    if (!pager->free_extents || disable_direct_io(pager) != 0) {
+        return -1;
+    }
+    uint32_t data_start = page_sectors(pager);  // Block 0 holds the file header
+    pager->end_sector = data_start;
+    pager->map_dirty = !existing;  // A new file gets its header at the first checkpoint
+    if (!existing || pager->num_pages == 0) {
+        return 0;
+    }
+
+    ensure_extents(pager, pager->num_pages);
+    size_t map_size = (size_t)pager->num_pages * sizeof(PageExtent);
+    if (pread(pager->file_descriptor, pager->extents, map_size, (off_t)map_sector * SECTOR_SIZE) != (ssize_t)map_size) {
+        printf("ERROR: Unable to read the extent map\n");
+        return -1;
+    }
+
+    pager->durable_extents = malloc(map_size);
+    PageExtent* used = malloc(map_size + sizeof(PageExtent));
+    if (!pager->durable_extents || !used) {
+        free(used);
+        return -1;
+    }
+    memcpy(pager->durable_extents, pager->extents, map_size);
+    pager->num_durable_extents = pager->num_pages;
+    pager->durable_map_sector = map_sector;
+    pager->durable_map_sectors = sectors_for((uint32_t)map_size);
+    if (map_sector < data_start) {
+        printf("ERROR: Corrupt extent map location\n");
+        free(used);
+        return -1;
+    }
+    uint32_t num_used = 0;
+    used[num_used].sector = map_sector;
+    used[num_used++].length = (uint32_t)map_size;
+    for (uint32_t i = 0; i < pager->num_pages; i++) {
+        PageExtent extent = pager->extents[i];
+        if (extent.length > pager->page_size || (extent.length > 0 && extent.sector < data_start)) {
+            printf("ERROR: Corrupt extent map entry for page %u\n", i);
+            free(used);
+            return -1;
+        }
+        if (extent.length > 0) {
+            used[num_used++] = extent;
+        }
+    }
+    qsort(used, num_used, sizeof(PageExtent), compare_extents);
+    for (uint32_t i = 0; i < num_used; i++) {
+        if (used[i].sector < pager->end_sector) {
+            printf("ERROR: Overlapping extents in the extent map\n");
+            free(used);
+            return -1;
+        }
+        free_sectors(pager, pager->end_sector, used[i].sector - pager->end_sector);
+        pager->end_sector = used[i].sector + sectors_for(used[i].length);
+    }
+    free(used);
+    return 0;
+}
+
+// Writes the map after the last extent and trims the file there. Returns
+// the map's sector for the header.
+static uint32_t write_extent_map(Pager* pager) {
+    ensure_extents(pager, pager->num_pages);
+    size_t map_size = (size_t)pager->num_pages * sizeof(PageExtent);
+    off_t offset = (off_t)pager->end_sector * SECTOR_SIZE;
+    if (pwrite(pager->file_descriptor, pager->extents, map_size, offset) != (ssize_t)map_size ||
+        ftruncate(pager->file_descriptor, offset + (off_t)map_size) != 0) {
+        printf("ERROR: Failed to write the extent map: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return pager->end_sector;
+}
+
+static void sync_file(Pager* pager) {
+    if (fdatasync(pager->file_descriptor) != 0) {
+        printf("ERROR: Failed to sync the database file: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void free_extents(Pager* pager) {
+    if (pager->free_extents) {
+        for (uint32_t i = 0; i <= page_sectors(pager); i++) {
+            free(pager->free_extents[i].sectors);
+        }
+        free(pager->free_extents);
+    }
+    free(pager->extents);
+    free(pager->durable_extents);
+    free(pager->deferred);
+}
+
+// Header I/O goes through an aligned, block-sized buffer so it also works on
+// files opened with O_DIRECT
+static int read_header(Pager* pager) {
+    uint8_t* header;
+    if (posix_memalign((void**)&header, OS_PAGE_SIZE, MIN_PAGE_SIZE) != 0) {
+        return -1;
+    }
+    ssize_t bytes_read = pread(pager->file_descriptor, header, MIN_PAGE_SIZE, 0);
+    if (bytes_read < FILE_HEADER_SIZE || memcmp(header, FILE_MAGIC, FILE_MAGIC_SIZE) != 0) {
+        printf("ERROR: Not a miniSQL database file\n");
+        free(header);
+        return -1;
+    }
+
+    uint32_t version, page_size, num_pages;
+    memcpy(&version, header + FILE_HEADER_VERSION_OFFSET, sizeof(uint32_t));
+    memcpy(&page_size, header + FILE_HEADER_PAGE_SIZE_OFFSET, sizeof(uint32_t));
+    memcpy(&num_pages, header + FILE_HEADER_NUM_PAGES_OFFSET, sizeof(uint32_t));
+    uint32_t map_sector;
+    memcpy(&map_sector, header + FILE_HEADER_MAP_SECTOR_OFFSET, sizeof(uint32_t));
+    free(header);
+    if ((version != FILE_FORMAT_VERSION && version != FILE_FORMAT_VERSION_COMPRESSED) ||
+        !is_valid_page_size(page_size)) {
+        printf("ERROR: Unsupported database format (version %u, page size %u)\n", version, page_size);
+        return -1;
+    }
+
+    pager->page_size = page_size;
+    pager->num_pages = num_pages;
+    pager->num_file_pages = num_pages;
+    if (version == FILE_FORMAT_VERSION_COMPRESSED) {
+        return open_extents(pager, true, map_sector);
+    }
+    return 0;
+}
+
+static void write_header(Pager* pager, uint32_t map_sector) {
+    uint8_t* header;
+    if (posix_memalign((void**)&header, OS_PAGE_SIZE, pager->page_size) != 0) {
+        printf("ERROR: Out of memory writing file header\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(header, 0, pager->page_size);
+    // Builds that predate compression refuse compressed files
+    uint32_t version = pager->compression == PAGER_COMPRESSION_NONE ? FILE_FORMAT_VERSION
+                                                                    : FILE_FORMAT_VERSION_COMPRESSED;
+    memcpy(header, FILE_MAGIC, FILE_MAGIC_SIZE);
+    memcpy(header + FILE_HEADER_VERSION_OFFSET, &version, sizeof(uint32_t));
+    memcpy(header + FILE_HEADER_PAGE_SIZE_OFFSET, &pager->page_size, sizeof(uint32_t));
+    memcpy(header + FILE_HEADER_NUM_PAGES_OFFSET, &pager->num_pages, sizeof(uint32_t));
+    if (pager->compression != PAGER_COMPRESSION_NONE) {
+        memcpy(header + FILE_HEADER_MAP_SECTOR_OFFSET, &map_sector, sizeof(uint32_t));
+    }
+
+    ssize_t bytes_written = pwrite(pager->file_descriptor, header, pager->page_size, 0);
+    free(header);
+    if (bytes_written != (ssize_t)pager->page_size) {
+        printf("ERROR: Failed to write file header: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Makes the current extent map of a compressed file the durable one. The
+// page images are synced before the map that points to them, and the map
+// before the header that points to it; a crash at any step leaves the
+// previous map in force, intact. Only then do the old map's sectors and the
+// extents freed since become free.
+static void write_checkpoint(Pager* pager) {
+    if (!pager->map_dirty && pager->num_pages == pager->num_durable_extents) {
+        return;
+    }
+    sync_file(pager);
+    uint32_t map_sector = write_extent_map(pager);
+    sync_file(pager);
+    write_header(pager, map_sector);
+    sync_file(pager);
+
+    free_sectors(pager, pager->durable_map_sector, pager->durable_map_sectors);
+    for (uint32_t i = 0; i < pager->num_deferred; i++) {
+        free_extent(pager, pager->deferred[i].sector, pager->deferred[i].length);
+    }
+    pager->num_deferred = 0;
+
+    size_t map_size = (size_t)pager->num_pages * sizeof(PageExtent);
+    PageExtent* durable = realloc(pager->durable_extents, map_size > 0 ? map_size : sizeof(PageExtent));
+    if (!durable) {
+        printf("ERROR: Out of memory recording the extent map\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(durable, pager->extents, map_size);
+    pager->durable_extents = durable;
+    pager->num_durable_extents = pager->num_pages;
+    pager->durable_map_sector = map_sector;
+    pager->durable_map_sectors = sectors_for((uint32_t)map_size);
+    pager->end_sector = map_sector + pager->durable_map_sectors;
+    pager->map_dirty = false;
+}
+
+// Compresses a page into its slot of the write staging area and moves its
+// extent if the image no longer fits. Images that would not save a sector
+// are stored raw, straight from the frame.
+static void place_compressed(Pager* pager, Frame* frame, uint32_t slot, PageIoRequest* request) {
+    uint8_t* image = pager->staging + (size_t)(IO_BATCH_PAGES + slot) * pager->page_size;
+    uint32_t length = pager->page_size;
+    size_t compressed = lz_compress(frame->data, pager->page_size, image, pager->page_size - SECTOR_SIZE);
+    if (compressed > 0) {
+        length = (uint32_t)compressed;
+        request->buffer = image;
+        request->length = (size_t)sectors_for(length) * SECTOR_SIZE;
+        memset(image + length, 0, request->length - length);
+    }
+
+    ensure_extents(pager, frame->page_num + 1);
+    PageExtent* extent = &pager->extents[frame->page_num];
+    uint32_t sectors = sectors_for(length);
+    uint32_t old_sectors = sectors_for(extent->length);
+    // The durable map's image must survive until the next checkpoint, so
+    // only an extent written since then is rewritten in place
+    if (extent->length > 0 && sectors <= old_sectors && !extent_is_durable(pager, frame->page_num)) {
+        if (sectors < old_sectors) {
+            free_extent(pager, extent->sector + sectors, old_sectors - sectors);
+        }
+    } else {
+        if (extent->length > 0) {
+            release_extent(pager, frame->page_num, extent->sector, old_sectors);
+        }
+        extent->sector = allocate_extent(pager, sectors);
+    }
+    extent->length = length;
+    pager->map_dirty = true;
+    request->offset = (off_t)extent->sector * SECTOR_SIZE;
+}
+
+// Frame queue helpers
+
+static void queue_push_tail(Pager* pager, FrameQueueList* queue, uint32_t frame_index) {
+    Frame* frame = &pager->frames[frame_index];
+    frame->prev = queue->tail;
+    frame->next = FRAME_NONE;
+    if (queue->tail != FRAME_NONE) {
+        pager->frames[queue->tail].next = frame_index;
+    } else {
+        queue->head = frame_index;
+    }
+    queue->tail = frame_index;
+    queue->size++;
+}
+
+static void queue_remove(Pager* pager, FrameQueueList* queue, uint32_t frame_index) {
+    Frame* frame = &pager->frames[frame_index];
+    if (frame->prev != FRAME_NONE) {
+        pager->frames[frame->prev].next = frame->next;
+    } else {
+        queue->head = frame->next;
+    }
+    if (frame->next != FRAME_NONE) {
+        pager->frames[frame->next].prev = frame->prev;
+    } else {
+        queue->tail = frame->prev;
+    }
+    frame->prev = frame->next = FRAME_NONE;
+    queue->size--;
+}
+
+static FrameQueueList* frame_queue(Pager* pager, Frame* frame) {
+    return frame->queue == QUEUE_PROBATION ? &pager->probation : &pager->protected_queue;
+}
+
+static void move_to_protected(Pager* pager, uint32_t frame_index) {
+    Frame* frame = &pager->frames[frame_index];
+    queue_remove(pager, frame_queue(pager, frame), frame_index);
+    frame->queue = QUEUE_PROTECTED;
+    queue_push_tail(pager, &pager->protected_queue, frame_index);
+}
+
+// Page table helpers
+
+static uint32_t page_table_lookup(Pager* pager, page_num_t page_num) {
+    uint32_t frame_index = pager->page_table[hash_page_num(page_num) & pager->page_table_mask];
+    while (frame_index != FRAME_NONE && pager->frames[frame_index].page_num != page_num) {
+        frame_index = pager->frames[frame_index].hash_next;
+    }
+    return frame_index;
+}
+
+static void page_table_insert(Pager* pager, uint32_t frame_index) {
+    uint32_t* bucket = &pager->page_table[hash_page_num(pager->frames[frame_index].page_num) &
+                                          pager->page_table_mask];
+    pager->frames[frame_index].hash_next = *bucket;
+    *bucket = frame_index;
+}
+
+static void page_table_remove(Pager* pager, uint32_t frame_index) {
+    uint32_t* link = &pager->page_table[hash_page_num(pager->frames[frame_index].page_num) &
+                                        pager->page_table_mask];
+    while (*link != frame_index) {
+        link = &pager->frames[*link].hash_next;
+    }
+    *link = pager->frames[frame_index].hash_next;
+}
+
+// Ghost queue helpers. Entries are overwritten oldest-first.
+
+static uint32_t* ghost_bucket(Pager* pager, page_num_t page_num) {
+    return &pager->ghost_table[hash_page_num(page_num) & pager->page_table_mask];
+}
+
+static bool ghost_remove(Pager* pager, page_num_t page_num) {
+    uint32_t* link = ghost_bucket(pager, page_num);
+    while (*link != FRAME_NONE) {
+        if (pager->ghosts[*link].page_num == page_num) {
+            *link = pager->ghosts[*link].hash_next;
+            return true;
+        }
+        link = &pager->ghosts[*link].hash_next;
+    }
+    return false;
+}
+
+static void ghost_unlink_slot(Pager* pager, uint32_t slot) {
+    uint32_t* link = ghost_bucket(pager, pager->ghosts[slot].page_num);
+    while (*link != FRAME_NONE) {
+        if (*link == slot) {
+            *link = pager->ghosts[slot].hash_next;
+            return;
+        }
+        link = &pager->ghosts[*link].hash_next;
+    }
+}
+
+static void ghost_add(Pager* pager, page_num_t page_num) {
+    uint32_t slot = (pager->ghost_head + pager->ghost_count) % pager->ghost_capacity;
+    if (pager->ghost_count == pager->ghost_capacity) {
+        // Forget the oldest eviction; it may already have been consumed
+        ghost_unlink_slot(pager, slot);
+        pager->ghost_head = (pager->ghost_head + 1) % pager->ghost_capacity;
+    } else {
+        pager->ghost_count++;
+    }
+    uint32_t* bucket = ghost_bucket(pager, page_num);
+    pager->ghosts[slot].page_num = page_num;
+    pager->ghosts[slot].hash_next = *bucket;
+    *bucket = slot;
+}
+
+// Maps the frame arena. Explicit huge pages need a reserved hugetlbfs pool,
+// so fall back to transparent huge pages when none are available.
+static int map_arena(Pager* pager, PagerHugePages huge_pages) {
+    size_t size = (size_t)pager->capacity * pager->page_size;
+
+    if (huge_pages == PAGER_HUGE_PAGES_EXPLICIT) {
+        size_t huge_size = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+        void* arena = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (arena != MAP_FAILED) {
+            pager->arena = arena;
+            pager->arena_size = huge_size;
+            pager->huge_pages = PAGER_HUGE_PAGES_EXPLICIT;
+            return 0;
+        }
+        huge_pages = PAGER_HUGE_PAGES_TRANSPARENT;
+    }
+
+    if (huge_pages == PAGER_HUGE_PAGES_OFF) {
+        void* arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED) {
+            return -1;
+        }
+        pager->arena = arena;
+        pager->arena_size = size;
+        pager->huge_pages = PAGER_HUGE_PAGES_OFF;
+        return 0;
+    }
+
+    // Over-map so the arena can start on a huge page boundary, then trim
+    size_t huge_size = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+    size_t mapped_size = huge_size + HUGE_PAGE_SIZE;
+    char* mapping = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+    char* arena = (char*)(((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~((uintptr_t)HUGE_PAGE_SIZE - 1));
+    size_t head = arena - mapping;
+    if (head > 0) {
+        munmap(mapping, head);
+    }
+    if (mapped_size - head > huge_size) {
+        munmap(arena + huge_size, mapped_size - head - huge_size);
+    }
+    pager->arena = arena;
+    pager->arena_size = huge_size;
+    pager->huge_pages = (madvise(arena, huge_size, MADV_HUGEPAGE) == 0) ? PAGER_HUGE_PAGES_TRANSPARENT
+                                                                       : PAGER_HUGE_PAGES_OFF;
+    return 0;
+}
+
+void pager_default_options(PagerOptions* options) {
+    options->page_size = DEFAULT_PAGE_SIZE;
+    options->cache_frames = PAGER_DEFAULT_CACHE_FRAMES;
+    options->huge_pages = PAGER_HUGE_PAGES_OFF;
+    options->direct_io = false;
+    options->read_ahead_pages = PAGER_DEFAULT_READ_AHEAD_PAGES;
+    options->io_backend = PAGE_IO_SYNC;
+    options->io_queue_depth = PAGER_DEFAULT_IO_QUEUE_DEPTH;
+    options->compression = PAGER_COMPRESSION_NONE;
+}
+
 Pager* pager_open(const char* filename) {
-    Pager* pager = malloc(sizeof(Pager));
+    return pager_open_with_page_size(filename, DEFAULT_PAGE_SIZE);
+}
+
+Pager* pager_open_with_page_size(const char* filename, uint32_t page_size) {
+    PagerOptions options;
+    pager_default_options(&options);
+    options.page_size = page_size;
+    return pager_open_with_options(filename, &options);
+}
+
+// Sets up the buffer pool and I/O for an open file
+static int init_pool(Pager* pager, const PagerOptions* options) {
+    pager->capacity = options->cache_frames;
+    if (pager->capacity < PAGER_MIN_CACHE_FRAMES) {
+        pager->capacity = PAGER_MIN_CACHE_FRAMES;
+    }
+    uint32_t buckets = 1;
+    while (buckets < pager->capacity * 2) {
+        buckets *= 2;
+    }
+    pager->page_table_mask = buckets - 1;
+    pager->frames_allocated = pager->capacity;
+    pager->ghost_capacity = pager->capacity / GHOST_SHARE_DIVISOR;
+    pager->frames = calloc(pager->frames_allocated, sizeof(Frame));
+    pager->page_table = malloc(buckets * sizeof(uint32_t));
+    pager->ghosts = calloc(pager->ghost_capacity, sizeof(GhostEntry));
+    pager->ghost_table = malloc(buckets * sizeof(uint32_t));
+    pager->io = page_io_open(pager->file_descriptor, options->io_backend, options->io_queue_depth);
+    pager->counters = stats_counters_new();
+    if (pager->compression != PAGER_COMPRESSION_NONE) {
+        pager->staging = malloc((size_t)2 * IO_BATCH_PAGES * pager->page_size);
+    }
+    if (!pager->frames || !pager->page_table || !pager->ghosts || !pager->ghost_table || !pager->io ||
+        !pager->counters || (pager->compression != PAGER_COMPRESSION_NONE && !pager->staging) ||
+        map_arena(pager, options->huge_pages) != 0) {
+        if (pager->io) {
+            page_io_close(pager->io);
+        }
+        stats_counters_free(pager->counters);
+        free(pager->staging);
+        free(pager->frames);
+        free(pager->page_table);
+        free(pager->ghosts);
+        free(pager->ghost_table);
+        return -1;
+    }
+    memset(pager->page_table, 0xff, buckets * sizeof(uint32_t));
+    memset(pager->ghost_table, 0xff, buckets * sizeof(uint32_t));
+
+    // Carve the arena into frames, all of them initially free
+    pager->num_frames = pager->capacity;
+    for (uint32_t i = 0; i < pager->capacity; i++) {
+        pager->frames[i].data = (char*)pager->arena + (size_t)i * pager->page_size;
+        pager->frames[i].next = (i + 1 < pager->capacity) ? i + 1 : FRAME_NONE;
+    }
+    pager->free_frames = 0;
+    pager->probation.head = pager->probation.tail = FRAME_NONE;
+    pager->protected_queue.head = pager->protected_queue.tail = FRAME_NONE;
+    pager->op_epoch = 1;
+    pager->last_miss = FRAME_NONE;
+
+    // A read-ahead window must fit comfortably inside probation
+    pager->read_ahead_max = options->read_ahead_pages;
+    if (pager->read_ahead_max > pager->capacity / (PROBATION_SHARE_DIVISOR * 2)) {
+        pager->read_ahead_max = pager->capacity / (PROBATION_SHARE_DIVISOR * 2);
+    }
+    pager->read_ahead_window = READ_AHEAD_MIN_PAGES;
+    return 0;
+}
+
+Pager* pager_open_with_options(const char* filename, const PagerOptions* options) {
+    if (!is_valid_page_size(options->page_size)) {
+        printf("ERROR: Invalid page size %u\n", options->page_size);
+        return NULL;
+    }
+
+    // Not every filesystem supports O_DIRECT (tmpfs does not); fall back to
+    // buffered I/O there
+    bool direct_io = options->direct_io;
+    int fd = -1;
+    if (direct_io) {
+        fd = open(filename, O_RDWR | O_CREAT | O_DIRECT, S_IRUSR | S_IWUSR);
+        if (fd == -1 && errno == EINVAL) {
+            direct_io = false;
+        }
+    }
+    if (!direct_io) {
+        fd = open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    }
+    if (fd == -1) {
+        printf("ERROR: Unable to open file %s: %s\n", filename, strerror(errno));
+        return NULL;
+    }
+
+    Pager* pager = calloc(1, sizeof(Pager));
     if (!pager) {
+        close(fd);
         return NULL;
     }
-    pager->num_pages = 0;
-    for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-        pager->pages[i] = NULL;
+    pager->file_descriptor = fd;
+    pager->direct_io = direct_io;
+    pager->page_size = options->page_size;
+
+    // An existing file keeps the format it was created with
+    off_t file_length = lseek(fd, 0, SEEK_END);
+    int opened = file_length > 0 ? read_header(pager)
+                 : options->compression != PAGER_COMPRESSION_NONE ? open_extents(pager, false, 0)
+                                                                  : 0;
+    if (opened != 0 || init_pool(pager, options) != 0) {
+        close(fd);
+        free_extents(pager);
+        free(pager);
+        return NULL;
     }
     return pager;
 }
 
-void pager_close(Pager* pager) {
-    for (uint32_t i = 0; i < pager->num_pages; i++) {
-        if (pager->pages[i]) {
-            free(pager->pages[i]);
+Pager* pager_open_reader(Pager* source, uint32_t cache_frames) {
+    pager_flush_all(source);
+    int fd = dup(source->file_descriptor);
+    if (fd == -1) {
+        printf("ERROR: Unable to open a reader: %s\n", strerror(errno));
+        return NULL;
+    }
+    Pager* pager = calloc(1, sizeof(Pager));
+    if (!pager) {
+        close(fd);
+        return NULL;
+    }
+    pager->file_descriptor = fd;
+    pager->direct_io = source->direct_io;  // dup() shares the O_DIRECT flag
+    pager->read_only = true;
+    pager->page_size = source->page_size;
+    pager->num_pages = source->num_pages;
+    pager->num_file_pages = source->num_file_pages;
+    pager->compression = source->compression;
+    if (source->compression != PAGER_COMPRESSION_NONE) {
+        // A copy, since the source may move extents while the reader runs
+        ensure_extents(pager, source->num_file_pages);
+        if (source->num_file_pages > 0) {
+            memcpy(pager->extents, source->extents, source->num_file_pages * sizeof(PageExtent));
         }
     }
-    free(pager);
+
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = cache_frames;
+    options.read_ahead_pages = source->read_ahead_max;
+    options.io_backend = pager_get_io_backend(source);
+    if (init_pool(pager, &options) != 0) {
+        close(fd);
+        free_extents(pager);
+        free(pager);
+        return NULL;
+    }
+    return pager;
 }
 
-void* pager_get_page(Pager* pager, page_num_t page_num) {
-    if (page_num >= TABLE_MAX_PAGES) {
+Pager* pager_open_temporary(const PagerOptions* options) {
+    const char* directory = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/miniSQL-temp-XXXXXX", directory && directory[0] ? directory : "/tmp");
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        printf("ERROR: Unable to create a temporary file: %s\n", strerror(errno));
         return NULL;
     }
+    close(fd);
+    Pager* pager = pager_open_with_options(path, options);
+    // The file lives on through the pager's descriptor and goes away with it
+    unlink(path);
+    if (pager) {
+        pager->temporary = true;
+    }
+    return pager;
+}
+
+// Writes back a batch of dirty frames, submitted together
+static void write_frames(Pager* pager, const uint32_t* frame_indices, uint32_t count) {
+    PageIoRequest requests[IO_BATCH_PAGES];
+    uint64_t bytes_written = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        Frame* frame = &pager->frames[frame_indices[i]];
+        requests[i].buffer = frame->data;
+        requests[i].length = pager->page_size;
+        requests[i].offset = page_offset(pager, frame->page_num);
+        if (pager->compression != PAGER_COMPRESSION_NONE) {
+            place_compressed(pager, frame, i, &requests[i]);
+        }
+        bytes_written += requests[i].length;
+    }
+    page_io_write(pager->io, requests, count);
+    stats_add(pager->counters, PAGER_COUNTER_PAGE_WRITES, count);
+    stats_add(pager->counters, PAGER_COUNTER_BYTES_WRITTEN, bytes_written);
+
+    for (uint32_t i = 0; i < count; i++) {
+        Frame* frame = &pager->frames[frame_indices[i]];
+        if (requests[i].result != (ssize_t)requests[i].length) {
+            printf("ERROR: Failed to write page %u: %s\n", frame->page_num,
+                   requests[i].result < 0 ? strerror((int)-requests[i].result) : "short write");
+            exit(EXIT_FAILURE);
+        }
+        if (frame->page_num >= pager->num_file_pages) {
+            pager->num_file_pages = frame->page_num + 1;
+        }
+        frame->dirty = false;
+    }
+}
+
+static void write_frame(Pager* pager, uint32_t frame_index) {
+    write_frames(pager, &frame_index, 1);
+}
+
+static int compare_frame_pages(const void* a, const void* b, void* frames) {
+    page_num_t page_a = ((Frame*)frames)[*(const uint32_t*)a].page_num;
+    page_num_t page_b = ((Frame*)frames)[*(const uint32_t*)b].page_num;
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+void pager_flush_all(Pager* pager) {
+    uint32_t* dirty = malloc(pager->num_frames * sizeof(uint32_t));
+    if (!dirty) {
+        printf("ERROR: Out of memory flushing pages\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t num_dirty = 0;
+    for (uint32_t i = 0; i < pager->num_frames; i++) {
+        if (pager->frames[i].queue != QUEUE_NONE && pager->frames[i].dirty) {
+            dirty[num_dirty++] = i;
+        }
+    }
+
+    // In file order, so the synchronous backend can merge adjacent pages
+    qsort_r(dirty, num_dirty, sizeof(uint32_t), compare_frame_pages, pager->frames);
+    for (uint32_t start = 0; start < num_dirty; start += IO_BATCH_PAGES) {
+        uint32_t count = num_dirty - start < IO_BATCH_PAGES ? num_dirty - start : IO_BATCH_PAGES;
+        write_frames(pager, dirty + start, count);
+    }
+    free(dirty);
+    if (pager->compression != PAGER_COMPRESSION_NONE && !pager->read_only && !pager->temporary) {
+        write_checkpoint(pager);
+    }
+}
+
+void pager_close(Pager* pager) {
+    // A temporary file's pages are dropped, not written back
+    bool write_back = !pager->read_only && !pager->temporary;
+    if (write_back) {
+        pager_flush_all(pager);
+    }
+    for (uint32_t i = pager->capacity; i < pager->num_frames; i++) {
+        free(pager->frames[i].data);  // Overflow frame
+    }
+    // pager_flush_all() already wrote a compressed file's map and header
+    if (write_back && pager->compression == PAGER_COMPRESSION_NONE) {
+        write_header(pager, 0);
+    }
+    page_io_close(pager->io);
+    close(pager->file_descriptor);
+    munmap(pager->arena, pager->arena_size);
+    stats_counters_free(pager->counters);
+    free_extents(pager);
+    free(pager->staging);
+    free(pager->frames);
+    free(pager->page_table);
+    free(pager->ghosts);
+    free(pager->ghost_table);
+    free(pager);
+}
+
+// Picks the frame to reuse for a new page. Frames returned during the current
+// operation are never chosen, since the caller may still hold pointers to them.
+static uint32_t find_victim(Pager* pager) {
+    uint32_t probation_limit = pager->capacity / PROBATION_SHARE_DIVISOR;
+
+    if (pager->probation.size > probation_limit) {
+        for (uint32_t i = pager->probation.head; i != FRAME_NONE; i = pager->frames[i].next) {
+            if (pager->frames[i].op_epoch != pager->op_epoch) {
+                return i;
+            }
+        }
+    }
+
+    // Least recently used protected page, sparing internal nodes if possible
+    uint32_t internal_candidate = FRAME_NONE;
+    for (uint32_t i = pager->protected_queue.head; i != FRAME_NONE; i = pager->frames[i].next) {
+        if (pager->frames[i].op_epoch == pager->op_epoch) {
+            continue;
+        }
+        if (!pager->frames[i].internal) {
+            return i;
+        }
+        if (internal_candidate == FRAME_NONE) {
+            internal_candidate = i;
+        }
+    }
+
+    for (uint32_t i = pager->probation.head; i != FRAME_NONE; i = pager->frames[i].next) {
+        if (pager->frames[i].op_epoch != pager->op_epoch) {
+            return i;
+        }
+    }
+    return internal_candidate;
+}
+
+static void evict_frame(Pager* pager, uint32_t frame_index) {
+    Frame* frame = &pager->frames[frame_index];
+    if (frame->dirty) {
+        write_frame(pager, frame_index);
+    }
+    if (frame->queue == QUEUE_PROBATION && !frame->scan && !frame->sequential) {
+        ghost_add(pager, frame->page_num);
+    }
+    queue_remove(pager, frame_queue(pager, frame), frame_index);
+    page_table_remove(pager, frame_index);
+    frame->queue = QUEUE_NONE;
+    stats_inc(pager->counters, PAGER_COUNTER_EVICTIONS);
+}
+
+static uint32_t allocate_frame(Pager* pager) {
+    if (pager->free_frames != FRAME_NONE) {
+        uint32_t frame_index = pager->free_frames;
+        pager->free_frames = pager->frames[frame_index].next;
+        return frame_index;
+    }
+
+    uint32_t victim = find_victim(pager);
+    if (victim != FRAME_NONE) {
+        evict_frame(pager, victim);
+        return victim;
+    }
+
+    // Every frame is in use by the current operation: add an overflow frame
+    // outside the arena rather than invalidate a page pointer the caller holds
+    if (pager->num_frames == pager->frames_allocated) {
+        uint32_t new_allocated = pager->frames_allocated * 2;
+        Frame* frames = realloc(pager->frames, new_allocated * sizeof(Frame));
+        if (!frames) {
+            return FRAME_NONE;
+        }
+        memset(frames + pager->frames_allocated, 0, (new_allocated - pager->frames_allocated) * sizeof(Frame));
+        pager->frames = frames;
+        pager->frames_allocated = new_allocated;
+    }
+    if (posix_memalign(&pager->frames[pager->num_frames].data, OS_PAGE_SIZE, pager->page_size) != 0) {
+        return FRAME_NONE;
+    }
+    return pager->num_frames++;
+}
+
+// Finishes bringing a page into a frame whose data has just been read
+static void install_frame(Pager* pager, uint32_t frame_index, page_num_t page_num, ssize_t bytes_read,
+                          PageHint hint, bool sequential) {
+    Frame* frame = &pager->frames[frame_index];
+
+    // Only the part of the frame the file does not cover needs zeroing
+    if (bytes_read < (ssize_t)pager->page_size) {
+        if (bytes_read < 0) {
+            bytes_read = 0;
+        }
+        memset((char*)frame->data + bytes_read, 0, pager->page_size - bytes_read);
+    }
 
-    if (pager->pages[page_num] == NULL) {
-        void* page = malloc(PAGE_SIZE);
-        if(!page){
+    frame->page_num = page_num;
+    frame->dirty = false;
+    frame->internal = (hint == PAGE_HINT_INTERNAL);
+    frame->scan = (hint == PAGE_HINT_SCAN);
+    frame->sequential = sequential;
+    frame->read_ahead = false;
+    frame->loaded_at = pager->access_clock;
+    frame->op_epoch = pager->op_epoch;
+    page_table_insert(pager, frame_index);
+
+    // Pages evicted from probation and wanted again have proven themselves,
+    // unless this is a repeat of the scan that read them the first time
+    bool recently_evicted = !frame->scan && !sequential && ghost_remove(pager, page_num);
+    if (frame->internal || recently_evicted) {
+        frame->queue = QUEUE_PROTECTED;
+        queue_push_tail(pager, &pager->protected_queue, frame_index);
+    } else {
+        frame->queue = QUEUE_PROBATION;
+        queue_push_tail(pager, &pager->probation, frame_index);
+    }
+
+    if (page_num >= pager->num_pages) {
+        pager->num_pages = page_num + 1;
+    }
+}
+
+// Reads a set of non-resident pages into freshly allocated frames with one
+// batch of I/O. The frames are stamped with the current operation so a batch
+// cannot evict its own earlier frames. Returns how many pages were loaded,
+// which is short only if no frame could be found.
+static uint32_t load_pages(Pager* pager, const page_num_t* page_nums, uint32_t count, PageHint hint,
+                           bool sequential, uint32_t* frame_indices) {
+    PageIoRequest requests[IO_BATCH_PAGES];
+    uint32_t num_requests = 0;
+    uint32_t loaded = 0;
+    uint64_t bytes_read = 0;
+    while (loaded < count && loaded < IO_BATCH_PAGES) {
+        uint32_t frame_index = allocate_frame(pager);
+        if (frame_index == FRAME_NONE) {
+            break;
+        }
+        pager->frames[frame_index].op_epoch = pager->op_epoch;
+        frame_indices[loaded] = frame_index;
+
+        // Pages past the end of the file start out zeroed without any I/O.
+        // Compressed images land in a staging slot and expand into the frame.
+        if (page_in_file(pager, page_nums[loaded])) {
+            PageIoRequest* request = &requests[num_requests];
+            request->buffer = pager->frames[frame_index].data;
+            request->length = pager->page_size;
+            request->offset = page_offset(pager, page_nums[loaded]);
+            if (pager->compression != PAGER_COMPRESSION_NONE) {
+                PageExtent extent = pager->extents[page_nums[loaded]];
+                request->offset = (off_t)extent.sector * SECTOR_SIZE;
+                if (extent.length < pager->page_size) {
+                    request->buffer = pager->staging + (size_t)num_requests * pager->page_size;
+                    request->length = extent.length;
+                }
+            }
+            bytes_read += request->length;
+            num_requests++;
+        }
+        loaded++;
+    }
+    page_io_read(pager->io, requests, num_requests);
+    stats_add(pager->counters, PAGER_COUNTER_PAGE_READS, num_requests);
+    stats_add(pager->counters, PAGER_COUNTER_BYTES_READ, bytes_read);
+
+    uint32_t request = 0;
+    for (uint32_t i = 0; i < loaded; i++) {
+        ssize_t page_bytes = 0;
+        if (page_in_file(pager, page_nums[i])) {
+            PageIoRequest* read = &requests[request++];
+            page_bytes = read->result;
+            if (page_bytes < 0) {
+                printf("ERROR: Failed to read page %u: %s\n", page_nums[i], strerror((int)-page_bytes));
+                exit(EXIT_FAILURE);
+            }
+            if (read->buffer != pager->frames[frame_indices[i]].data) {
+                if (page_bytes != (ssize_t)read->length ||
+                    !lz_decompress(read->buffer, read->length, pager->frames[frame_indices[i]].data,
+                                   pager->page_size)) {
+                    printf("ERROR: Corrupt compressed page %u\n", page_nums[i]);
+                    exit(EXIT_FAILURE);
+                }
+                page_bytes = pager->page_size;
+            }
+        }
+        install_frame(pager, frame_indices[i], page_nums[i], page_bytes, hint, sequential);
+    }
+    return loaded;
+}
+
+// Reads the non-resident pages following a scan miss as one batch. With
+// O_DIRECT there is no kernel read-ahead, so this is what keeps sequential
+// leaf chains from paying one synchronous read per leaf.
+static void read_ahead(Pager* pager, page_num_t first) {
+    if (pager->read_ahead_max == 0) {
+        return;
+    }
+
+    // Grow the window while read-ahead pages get used, shrink it otherwise
+    if (pager->read_ahead_issued > 0) {
+        if (pager->read_ahead_used * 2 >= pager->read_ahead_issued) {
+            pager->read_ahead_window *= 2;
+        } else {
+            pager->read_ahead_window /= 2;
+        }
+    }
+    if (pager->read_ahead_window < READ_AHEAD_MIN_PAGES) {
+        pager->read_ahead_window = READ_AHEAD_MIN_PAGES;
+    }
+    if (pager->read_ahead_window > pager->read_ahead_max) {
+        pager->read_ahead_window = pager->read_ahead_max;
+    }
+    pager->read_ahead_issued = 0;
+    pager->read_ahead_used = 0;
+
+    page_num_t end = first + pager->read_ahead_window;
+    if (end > pager->num_file_pages) {
+        end = pager->num_file_pages;
+    }
+
+    page_num_t page_num = first;
+    while (page_num < end) {
+        page_num_t missing[IO_BATCH_PAGES];
+        uint32_t num_missing = 0;
+        for (; page_num < end && num_missing < IO_BATCH_PAGES; page_num++) {
+            if (page_table_lookup(pager, page_num) == FRAME_NONE) {
+                missing[num_missing++] = page_num;
+            }
+        }
+
+        uint32_t frame_indices[IO_BATCH_PAGES];
+        uint32_t loaded = load_pages(pager, missing, num_missing, PAGE_HINT_SCAN, true, frame_indices);
+        for (uint32_t i = 0; i < loaded; i++) {
+            pager->frames[frame_indices[i]].read_ahead = true;
+        }
+        pager->read_ahead_issued += loaded;
+        stats_add(pager->counters, PAGER_COUNTER_READ_AHEAD_PAGES, loaded);
+        if (loaded < num_missing) {
+            return;
+        }
+    }
+}
+
+static uint32_t load_page(Pager* pager, page_num_t page_num, PageHint hint) {
+    // A run of misses on consecutive pages is a scan even if nobody said so
+    if (pager->last_miss != FRAME_NONE && page_num == pager->last_miss + 1) {
+        pager->sequential_run++;
+    } else {
+        pager->sequential_run = 0;
+    }
+    pager->last_miss = page_num;
+    bool sequential = (pager->sequential_run >= SEQUENTIAL_RUN_THRESHOLD);
+
+    uint32_t frame_index;
+    if (load_pages(pager, &page_num, 1, hint, sequential, &frame_index) == 0) {
+        return FRAME_NONE;
+    }
+
+    if (hint == PAGE_HINT_SCAN || sequential) {
+        read_ahead(pager, page_num + 1);
+    }
+    return frame_index;
+}
+
+static void touch_frame(Pager* pager, uint32_t frame_index, PageHint hint) {
+    Frame* frame = &pager->frames[frame_index];
+    if (frame->read_ahead) {
+        frame->read_ahead = false;
+        pager->read_ahead_used++;
+    }
+    if (hint == PAGE_HINT_INTERNAL) {
+        frame->internal = true;
+    }
+
+    if (frame->queue == QUEUE_PROTECTED) {
+        if (hint != PAGE_HINT_SCAN) {
+            move_to_protected(pager, frame_index);  // Refresh LRU position
+        }
+    } else if (frame->internal) {
+        move_to_protected(pager, frame_index);
+    } else if (hint == PAGE_HINT_NORMAL && !frame->scan &&
+               pager->access_clock - frame->loaded_at > CORRELATION_WINDOW) {
+        // Re-referenced after its first use finished
+        move_to_protected(pager, frame_index);
+    }
+}
+
+void* pager_get_page(Pager* pager, page_num_t page_num) {
+    return pager_get_page_hinted(pager, page_num, PAGE_HINT_NORMAL);
+}
+
+void* pager_get_page_hinted(Pager* pager, page_num_t page_num, PageHint hint) {
+    pager->access_clock++;
+
+    uint32_t frame_index = page_table_lookup(pager, page_num);
+    if (frame_index != FRAME_NONE) {
+        stats_inc(pager->counters, PAGER_COUNTER_HITS);
+        touch_frame(pager, frame_index, hint);
+    } else {
+        stats_inc(pager->counters, PAGER_COUNTER_MISSES);
+        frame_index = load_page(pager, page_num, hint);
+        if (frame_index == FRAME_NONE) {
             return NULL;
         }
-        memset(page, 0, PAGE_SIZE);
-        pager->pages[page_num] = page;
+    }
+
+    pager->frames[frame_index].op_epoch = pager->op_epoch;
+    return pager->frames[frame_index].data;
+}
 
-        if (page_num >= pager->num_pages) {
-            pager->num_pages = page_num + 1;
+void pager_prefetch(Pager* pager, const page_num_t* page_nums, uint32_t count, PageHint hint) {
+    // At most a quarter of the pool, so prefetching cannot pin all of it
+    uint32_t limit = pager->capacity / PROBATION_SHARE_DIVISOR;
+    page_num_t missing[IO_BATCH_PAGES];
+    uint32_t frame_indices[IO_BATCH_PAGES];
+    uint32_t num_missing = 0;
+    uint32_t issued = 0;
+
+    for (uint32_t i = 0; i < count && issued < limit; i++) {
+        uint32_t frame_index = page_table_lookup(pager, page_nums[i]);
+        if (frame_index != FRAME_NONE) {
+            pager->frames[frame_index].op_epoch = pager->op_epoch;
+            continue;
+        }
+        // Duplicates within one batch are only read once
+        bool duplicate = false;
+        for (uint32_t j = 0; j < num_missing && !duplicate; j++) {
+            duplicate = (missing[j] == page_nums[i]);
         }
+        if (duplicate) {
+            continue;
+        }
+        missing[num_missing++] = page_nums[i];
+        issued++;
+        if (num_missing == IO_BATCH_PAGES) {
+            load_pages(pager, missing, num_missing, hint, false, frame_indices);
+            num_missing = 0;
+        }
+    }
+    if (num_missing > 0) {
+        load_pages(pager, missing, num_missing, hint, false, frame_indices);
     }
-    return pager->pages[page_num];
+}
+
+void pager_begin_op(Pager* pager) {
+    pager->op_epoch++;
+}
+
+bool pager_page_is_cached(Pager* pager, page_num_t page_num) {
+    return page_table_lookup(pager, page_num) != FRAME_NONE;
 }
 
 uint32_t pager_get_num_pages(Pager* pager) {
     return pager->num_pages;
 }
 
+uint32_t pager_get_page_size(Pager* pager) {
+    return pager->page_size;
+}
+
+uint32_t pager_get_capacity(Pager* pager) {
+    return pager->capacity;
+}
+
+PagerHugePages pager_get_huge_pages(Pager* pager) {
+    return pager->huge_pages;
+}
+
+PagerCompression pager_get_compression(Pager* pager) {
+    return pager->compression;
+}
+
+bool pager_is_direct_io(Pager* pager) {
+    return pager->direct_io;
+}
+
+PageIoBackend pager_get_io_backend(Pager* pager) {
+    return page_io_backend(pager->io);
+}
+
+PagerStats pager_stats(Pager* pager) {
+    PagerStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.hits = stats_counters_sum(pager->counters, PAGER_COUNTER_HITS);
+    stats.misses = stats_counters_sum(pager->counters, PAGER_COUNTER_MISSES);
+    stats.page_reads = stats_counters_sum(pager->counters, PAGER_COUNTER_PAGE_READS);
+    stats.page_writes = stats_counters_sum(pager->counters, PAGER_COUNTER_PAGE_WRITES);
+    stats.evictions = stats_counters_sum(pager->counters, PAGER_COUNTER_EVICTIONS);
+    stats.read_ahead_pages = stats_counters_sum(pager->counters, PAGER_COUNTER_READ_AHEAD_PAGES);
+    stats.bytes_read = stats_counters_sum(pager->counters, PAGER_COUNTER_BYTES_READ);
+    stats.bytes_written = stats_counters_sum(pager->counters, PAGER_COUNTER_BYTES_WRITTEN);
+
+    stats.page_size = pager->page_size;
+    stats.num_pages = pager->num_pages;
+    stats.capacity = pager->capacity;
+    stats.overflow_frames = pager->num_frames - pager->capacity;
+    for (uint32_t i = 0; i < pager->num_frames; i++) {
+        if (pager->frames[i].queue != QUEUE_NONE) {
+            stats.cached_pages++;
+            if (pager->frames[i].dirty) {
+                stats.dirty_pages++;
+            }
+        }
+    }
+
+    size_t buckets = (size_t)pager->page_table_mask + 1;
+    stats.bytes_allocated = sizeof(Pager) + sizeof(StatsCounters) + pager->arena_size +
+                            (size_t)stats.overflow_frames * pager->page_size +
+                            (size_t)pager->frames_allocated * sizeof(Frame) +
+                            2 * buckets * sizeof(uint32_t) + (size_t)pager->ghost_capacity * sizeof(GhostEntry) +
+                            ((size_t)pager->extents_allocated + pager->num_durable_extents +
+                             pager->deferred_allocated) * sizeof(PageExtent);
+    if (pager->staging) {
+        stats.bytes_allocated += (size_t)2 * IO_BATCH_PAGES * pager->page_size;
+    }
+    return stats;
+}
+
+void pager_access_counts(Pager* pager, uint64_t* hits, uint64_t* misses) {
+    *hits = stats_counters_sum(pager->counters, PAGER_COUNTER_HITS);
+    *misses = stats_counters_sum(pager->counters, PAGER_COUNTER_MISSES);
+}
+
 void pager_mark_dirty(Pager* pager, page_num_t page_num) {
-    // Mock does not need to do anything here
+    if (pager->read_only) {
+        printf("ERROR: Write to page %u through a read-only pager\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+    uint32_t frame_index = page_table_lookup(pager, page_num);
+    if (frame_index != FRAME_NONE) {
+        pager->frames[frame_index].dirty = true;
+    }
 }
 
 void pager_flush_page(Pager* pager, page_num_t page_num) {
-    // Mock does not need to do anything here
-}
\ No newline at end of file
+    uint32_t frame_index = page_table_lookup(pager, page_num);
+    if (frame_index == FRAME_NONE || !pager->frames[frame_index].dirty) {
+        return;
+    }
+    write_frame(pager, frame_index);
+}
@@ -0,0 +1,381 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "parallel.h"
+
+typedef struct {
+    ThreadPool* pool;
+    uint32_t worker;
+} WorkerStart;
+
+struct ThreadPool {
+    uint32_t num_threads;         // Including the caller of thread_pool_run()
+    pthread_t* threads;           // Workers 1 .. num_threads - 1
+    WorkerStart* starts;
+    pthread_mutex_t lock;
+    pthread_cond_t posted;        // A task was posted, or the pool is shutting down
+    pthread_cond_t finished;      // The last helper finished the task
+    uint64_t generation;          // Tasks posted so far
+    uint32_t running;             // Helpers still on the current task
+    bool shutdown;
+    void (*task)(void* context, uint32_t worker);
+    void* context;
+};
+
+static void* worker_main(void* argument) {
+    WorkerStart* start = argument;
+    ThreadPool* pool = start->pool;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->posted, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        void (*task)(void*, uint32_t) = pool->task;
+        void* context = pool->context;
+        pthread_mutex_unlock(&pool->lock);
+        task(context, start->worker);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->finished);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* thread_pool_new(uint32_t num_threads) {
+    if (num_threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    if (num_threads > PARALLEL_MAX_THREADS) {
+        num_threads = PARALLEL_MAX_THREADS;
+    }
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->threads = calloc(num_threads, sizeof(pthread_t));
+    pool->starts = calloc(num_threads, sizeof(WorkerStart));
+    if (!pool->threads || !pool->starts) {
+        free(pool->threads);
+        free(pool->starts);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->posted, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    // A pool that could not start every thread runs with the ones it has
+    pool->num_threads = 1;
+    for (uint32_t i = 1; i < num_threads; i++) {
+        pool->starts[i].pool = pool;
+        pool->starts[i].worker = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->starts[i]) != 0) {
+            break;
+        }
+        pool->num_threads++;
+    }
+    return pool;
+}
+
+void thread_pool_free(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->posted);
+    pthread_mutex_unlock(&pool->lock);
+    for (uint32_t i = 1; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->posted);
+    pthread_cond_destroy(&pool->finished);
+    free(pool->threads);
+    free(pool->starts);
+    free(pool);
+}
+
+uint32_t thread_pool_size(const ThreadPool* pool) {
+    return pool->num_threads;
+}
+
+void thread_pool_run(ThreadPool* pool, void (*task)(void* context, uint32_t worker), void* context) {
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->running = pool->num_threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->posted);
+    pthread_mutex_unlock(&pool->lock);
+
+    task(context, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// A worker's share of the morsels. The owner takes from the head and
+// thieves from the tail, so a steal takes the morsel furthest from the
+// owner's position in the key space.
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t head;
+    uint32_t tail;
+} __attribute__((aligned(64))) MorselQueue;
+
+typedef struct {
+    const ScanAggregate* aggregate;
+    void* context;
+    const uint32_t* bounds;       // Morsel i is [bounds[2i], bounds[2i + 1]]
+    uint32_t num_workers;
+    MorselQueue* queues;
+    BTree** trees;                // Each worker's view of the tree, on its own reader
+    uint8_t* states;              // Each worker's partial aggregate
+    uint32_t steals;
+} Scan;
+
+static bool claim_morsel(Scan* scan, uint32_t worker, uint32_t* morsel) {
+    MorselQueue* own = &scan->queues[worker];
+    pthread_mutex_lock(&own->lock);
+    bool claimed = own->head < own->tail;
+    if (claimed) {
+        *morsel = own->head++;
+    }
+    pthread_mutex_unlock(&own->lock);
+    for (uint32_t i = 1; i < scan->num_workers && !claimed; i++) {
+        MorselQueue* victim = &scan->queues[(worker + i) % scan->num_workers];
+        pthread_mutex_lock(&victim->lock);
+        claimed = victim->head < victim->tail;
+        if (claimed) {
+            *morsel = --victim->tail;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (claimed) {
+            __atomic_fetch_add(&scan->steals, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return claimed;
+}
+
+// Feeds the rows of [lower, upper] to the aggregate, a leaf per pager
+// operation so that the scan pins one leaf at a time
+static void scan_morsel(Scan* scan, BTree* tree, void* state, uint32_t lower, uint32_t upper) {
+    BTreeCursor* cursor = btree_find(tree, lower);
+    page_num_t page_num = cursor->page_num;
+    uint32_t cell_num = cursor->cell_num;
+    free(cursor);
+    for (;;) {
+        pager_begin_op(tree->pager);
+        void* node = pager_get_page_hinted(tree->pager, page_num, PAGE_HINT_SCAN);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        void* cell = leaf_node_cell(node, cell_num);
+        for (; cell_num < num_cells; cell_num++) {
+            uint32_t key = leaf_cell_key(cell);
+            if (key > upper) {
+                return;
+            }
+            scan->aggregate->row(state, scan->context, key, leaf_cell_value(cell), leaf_cell_value_size(cell));
+            cell = leaf_cell_next(cell);
+        }
+        page_num = *leaf_node_next_leaf(node);
+        if (page_num == 0) {
+            return;
+        }
+        cell_num = 0;
+    }
+}
+
+static void scan_worker(void* context, uint32_t worker) {
+    Scan* scan = context;
+    void* state = scan->states + (size_t)worker * scan->aggregate->state_size;
+    uint32_t morsel;
+    while (claim_morsel(scan, worker, &morsel)) {
+        scan_morsel(scan, scan->trees[worker], state, scan->bounds[2 * morsel], scan->bounds[2 * morsel + 1]);
+    }
+}
+
+static int compare_keys(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Grows `*array` to hold at least `needed` entries
+static bool reserve(uint32_t** array, uint32_t* capacity, uint32_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    uint32_t grown = *capacity ? *capacity : 64;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    uint32_t* resized = realloc(*array, grown * sizeof(uint32_t));
+    if (!resized) {
+        return false;
+    }
+    *array = resized;
+    *capacity = grown;
+    return true;
+}
+
+// Collects the separator keys of the tree's top levels, going down a level
+// while there are fewer than `target`. Returns them sorted and distinct.
+static uint32_t collect_separators(BTree* btree, uint32_t target, uint32_t** separators) {
+    uint32_t* keys = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    page_num_t* level = NULL;
+    uint32_t level_size = 0;
+    uint32_t level_capacity = 0;
+    bool ok = reserve(&level, &level_capacity, 1);
+    if (ok) {
+        level[level_size++] = btree->root_page_num;
+    }
+    pager_begin_op(btree->pager);
+    while (ok && level_size > 0 && count < target) {
+        page_num_t* next = NULL;
+        uint32_t next_size = 0;
+        uint32_t next_capacity = 0;
+        for (uint32_t i = 0; i < level_size && ok; i++) {
+            void* node = pager_get_page_hinted(btree->pager, level[i], PAGE_HINT_INTERNAL);
+            if (get_node_type(node) != NODE_INTERNAL) {
+                continue;
+            }
+            uint32_t num_keys = *internal_node_num_keys(node);
+            ok = reserve(&keys, &capacity, count + num_keys) &&
+                 reserve(&next, &next_capacity, next_size + num_keys + 1);
+            for (uint32_t k = 0; ok && k < num_keys; k++) {
+                keys[count++] = *internal_node_key(node, k);
+            }
+            for (uint32_t k = 0; ok && k <= num_keys; k++) {
+                next[next_size++] = *internal_node_child(node, k);
+            }
+        }
+        free(level);
+        level = next;
+        level_size = next_size;
+    }
+    free(level);
+
+    qsort(keys, count, sizeof(uint32_t), compare_keys);
+    uint32_t distinct = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (distinct == 0 || keys[i] != keys[distinct - 1]) {
+            keys[distinct++] = keys[i];
+        }
+    }
+    *separators = keys;
+    return distinct;
+}
+
+int parallel_scan(ThreadPool* pool, BTree* btree, uint32_t lower, uint32_t upper, const ScanAggregate* aggregate,
+                  void* context, void* result, ParallelScanStats* stats) {
+    aggregate->init(result, context);
+    if (lower > upper) {
+        if (stats) {
+            stats->morsels = stats->steals = 0;
+        }
+        return 0;
+    }
+    uint32_t num_workers = pool ? thread_pool_size(pool) : 1;
+
+    // Workers walk leaves through read-only pagers, which cannot take messages
+    // down from the buffers
+    btree_flush_buffers(btree);
+
+    // Separators are the largest keys of their subtrees: each one closes a
+    // morsel
+    uint32_t* separators;
+    uint32_t num_separators = collect_separators(btree, num_workers * PARALLEL_MORSELS_PER_THREAD, &separators);
+    uint32_t* bounds = malloc(2 * (num_separators + 1) * sizeof(uint32_t));
+    Scan scan = {
+        .aggregate = aggregate,
+        .context = context,
+        .bounds = bounds,
+        .num_workers = num_workers,
+        .queues = NULL,
+        .trees = calloc(num_workers, sizeof(BTree*)),
+        .states = malloc((size_t)num_workers * aggregate->state_size),
+        .steals = 0,
+    };
+    if (posix_memalign((void**)&scan.queues, 64, num_workers * sizeof(MorselQueue)) != 0) {
+        scan.queues = NULL;
+    }
+    int status = bounds && scan.queues && scan.trees && scan.states ? 0 : -1;
+    uint32_t num_morsels = 0;
+    uint32_t start = lower;
+    for (uint32_t i = 0; i < num_separators && status == 0; i++) {
+        if (separators[i] < start) {
+            continue;
+        }
+        if (separators[i] >= upper) {
+            break;
+        }
+        bounds[2 * num_morsels] = start;
+        bounds[2 * num_morsels + 1] = separators[i];
+        num_morsels++;
+        start = separators[i] + 1;
+    }
+    if (status == 0) {
+        bounds[2 * num_morsels] = start;
+        bounds[2 * num_morsels + 1] = upper;
+        num_morsels++;
+    }
+    free(separators);
+
+    // Readers are opened here, one after another: opening one flushes the
+    // tree's pager, which no worker may touch
+    for (uint32_t i = 0; i < num_workers && status == 0; i++) {
+        Pager* reader = pager_open_reader(btree->pager, PARALLEL_READER_CACHE_FRAMES);
+        scan.trees[i] = reader ? btree_open_at(reader, btree->root_page_num) : NULL;
+        if (!scan.trees[i]) {
+            if (reader) {
+                pager_close(reader);
+            }
+            status = -1;
+            break;
+        }
+        pthread_mutex_init(&scan.queues[i].lock, NULL);
+        scan.queues[i].head = (uint32_t)((uint64_t)num_morsels * i / num_workers);
+        scan.queues[i].tail = (uint32_t)((uint64_t)num_morsels * (i + 1) / num_workers);
+        aggregate->init(scan.states + (size_t)i * aggregate->state_size, context);
+    }
+
+    if (status == 0) {
+        if (pool) {
+            thread_pool_run(pool, scan_worker, &scan);
+        } else {
+            scan_worker(&scan, 0);
+        }
+        for (uint32_t i = 0; i < num_workers; i++) {
+            aggregate->merge(result, scan.states + (size_t)i * aggregate->state_size, context);
+        }
+        if (stats) {
+            stats->morsels = num_morsels;
+            stats->steals = scan.steals;
+        }
+    }
+
+    for (uint32_t i = 0; scan.trees && i < num_workers && scan.trees[i]; i++) {
+        Pager* reader = scan.trees[i]->pager;
+        btree_close(scan.trees[i]);
+        pager_close(reader);
+        pthread_mutex_destroy(&scan.queues[i].lock);
+    }
+    free(bounds);
+    free(scan.queues);
+    free(scan.trees);
+    free(scan.states);
+    return status;
+}
@@ -0,0 +1,805 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "repl.h"
+#include "db.h"
+
+#define SQL_ARENA_BLOCK_SIZE 16384
+#define SQL_ARENA_ALIGNMENT 8
+
+struct SqlArenaBlock {
+    SqlArenaBlock* previous;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+static bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static size_t arena_align(size_t size) {
+    return (size + SQL_ARENA_ALIGNMENT - 1) & ~(size_t)(SQL_ARENA_ALIGNMENT - 1);
+}
+
+void sql_arena_init(SqlArena* arena) {
+    arena->block = NULL;
+}
+
+void* sql_arena_alloc(SqlArena* arena, size_t size) {
+    size = arena_align(size);
+    SqlArenaBlock* block = arena->block;
+    if (!block || block->size - block->used < size) {
+        // Blocks at least double, so the newest is always the largest
+        size_t block_size = block ? block->size * 2 : SQL_ARENA_BLOCK_SIZE;
+        while (block_size < size) {
+            block_size *= 2;
+        }
+        block = malloc(sizeof(SqlArenaBlock) + block_size);
+        if (!block) {
+            return NULL;
+        }
+        block->previous = arena->block;
+        block->size = block_size;
+        block->used = 0;
+        arena->block = block;
+    }
+    void* memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+// Grows the arena's most recent allocation in place when it fits, otherwise
+// moves it to a new allocation
+static void* arena_grow(SqlArena* arena, void* memory, size_t size, size_t new_size) {
+    SqlArenaBlock* block = arena->block;
+    if (memory && (char*)memory + arena_align(size) == block->data + block->used &&
+        block->used - arena_align(size) + arena_align(new_size) <= block->size) {
+        block->used += arena_align(new_size) - arena_align(size);
+        return memory;
+    }
+    void* moved = sql_arena_alloc(arena, new_size);
+    if (moved && memory) {
+        memcpy(moved, memory, size);
+    }
+    return moved;
+}
+
+void sql_arena_reset(SqlArena* arena) {
+    SqlArenaBlock* block = arena->block;
+    if (!block) {
+        return;
+    }
+    while (block->previous) {
+        SqlArenaBlock* previous = block->previous;
+        block->previous = previous->previous;
+        free(previous);
+    }
+    block->used = 0;
+}
+
+void sql_arena_free(SqlArena* arena) {
+    while (arena->block) {
+        SqlArenaBlock* previous = arena->block->previous;
+        free(arena->block);
+        arena->block = previous;
+    }
+}
+
+void tokenizer_init(Tokenizer* tokenizer, const char* sql, uint32_t length) {
+    tokenizer->position = sql;
+    tokenizer->end = sql + length;
+}
+
+Token tokenizer_next(Tokenizer* tokenizer) {
+    const char* p = tokenizer->position;
+    const char* end = tokenizer->end;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+
+    Token token = { TOKEN_END, p, 0 };
+    if (p == end) {
+        tokenizer->position = p;
+        return token;
+    }
+
+    const char* start = p;
+    if (is_alpha(*p)) {
+        while (p < end && (is_alpha(*p) || is_digit(*p))) {
+            p++;
+        }
+        token.type = TOKEN_IDENTIFIER;
+    } else if (is_digit(*p)) {
+        while (p < end && is_digit(*p)) {
+            p++;
+        }
+        token.type = TOKEN_INTEGER;
+    } else if (*p == '\'' || *p == '"') {
+        const char* close = memchr(p + 1, *p, end - p - 1);
+        if (!close) {
+            token.type = TOKEN_ERROR;
+            tokenizer->position = end;
+            return token;
+        }
+        token.type = TOKEN_STRING;
+        token.start = p + 1;
+        token.length = close - p - 1;
+        tokenizer->position = close + 1;
+        return token;
+    } else if (*p == '?') {
+        p++;
+        token.type = TOKEN_PARAMETER;
+    } else if ((*p == '<' || *p == '>' || *p == '!') && p + 1 < end && (p[1] == '=' || (*p == '<' && p[1] == '>'))) {
+        p += 2;
+        token.type = TOKEN_SYMBOL;
+    } else if (strchr("(),;*=<>-.", *p)) {
+        p++;
+        token.type = TOKEN_SYMBOL;
+    } else {
+        p++;
+        token.type = TOKEN_ERROR;
+    }
+    token.start = start;
+    token.length = p - start;
+    tokenizer->position = p;
+    return token;
+}
+
+static bool token_is(Token token, const char* text) {
+    if (token.type != TOKEN_IDENTIFIER && token.type != TOKEN_SYMBOL) {
+        return false;
+    }
+    uint32_t i = 0;
+    for (; i < token.length; i++) {
+        if (text[i] == '\0' || lower(token.start[i]) != lower(text[i])) {
+            return false;
+        }
+    }
+    return text[i] == '\0';
+}
+
+typedef struct {
+    Tokenizer tokenizer;
+    Token token;                  // Next token, not yet consumed
+    SqlArena* arena;
+    ParsedStatement* statement;
+    char* error;
+    uint32_t error_size;
+    bool failed;
+} Parser;
+
+static void advance(Parser* parser) {
+    parser->token = tokenizer_next(&parser->tokenizer);
+}
+
+static bool fail(Parser* parser, const char* expected) {
+    if (!parser->failed) {
+        if (parser->token.type == TOKEN_END) {
+            snprintf(parser->error, parser->error_size, "Expected %s at end of statement", expected);
+        } else {
+            snprintf(parser->error, parser->error_size, "Expected %s near '%.*s'", expected,
+                     (int)parser->token.length, parser->token.start);
+        }
+        parser->failed = true;
+    }
+    return false;
+}
+
+static bool accept(Parser* parser, const char* text) {
+    if (token_is(parser->token, text)) {
+        advance(parser);
+        return true;
+    }
+    return false;
+}
+
+static bool expect(Parser* parser, const char* text) {
+    return accept(parser, text) || fail(parser, text);
+}
+
+static bool parse_name(Parser* parser, SqlName* name, const char* what) {
+    if (parser->token.type != TOKEN_IDENTIFIER) {
+        return fail(parser, what);
+    }
+    name->start = parser->token.start;
+    name->length = parser->token.length;
+    advance(parser);
+    return true;
+}
+
+// column or table.column, as one name spanning both
+static bool parse_column(Parser* parser, SqlName* name) {
+    if (!parse_name(parser, name, "a column name")) {
+        return false;
+    }
+    if (!accept(parser, ".")) {
+        return true;
+    }
+    const char* start = name->start;
+    if (!parse_name(parser, name, "a column name")) {
+        return false;
+    }
+    name->length = (uint32_t)(name->start + name->length - start);
+    name->start = start;
+    return true;
+}
+
+void sql_split_name(SqlName name, SqlName* table, SqlName* column) {
+    const char* dot = memchr(name.start, '.', name.length);
+    if (!dot) {
+        table->start = name.start;
+        table->length = 0;
+        *column = name;
+        return;
+    }
+    const char* table_end = dot;
+    while (table_end > name.start && (table_end[-1] == ' ' || table_end[-1] == '\t' || table_end[-1] == '\n' ||
+                                       table_end[-1] == '\r')) {
+        table_end--;
+    }
+    const char* column_start = dot + 1;
+    const char* end = name.start + name.length;
+    while (column_start < end && (*column_start == ' ' || *column_start == '\t' || *column_start == '\n' ||
+                                  *column_start == '\r')) {
+        column_start++;
+    }
+    table->start = name.start;
+    table->length = (uint32_t)(table_end - name.start);
+    column->start = column_start;
+    column->length = (uint32_t)(end - column_start);
+}
+
+static bool parse_expr(Parser* parser, Expr* expr) {
+    memset(expr, 0, sizeof(*expr));
+    bool negative = accept(parser, "-");
+    Token token = parser->token;
+    if (token.type == TOKEN_INTEGER) {
+        int64_t value = 0;
+        for (uint32_t i = 0; i < token.length; i++) {
+            if (value > (INT64_MAX - 9) / 10) {
+                return fail(parser, "a 64-bit integer");
+            }
+            value = value * 10 + (token.start[i] - '0');
+        }
+        expr->type = EXPR_INTEGER;
+        expr->integer = negative ? -value : value;
+    } else if (negative) {
+        return fail(parser, "an integer");
+    } else if (token.type == TOKEN_STRING) {
+        expr->type = EXPR_STRING;
+        expr->text.start = token.start;
+        expr->text.length = token.length;
+    } else if (token.type == TOKEN_PARAMETER) {
+        expr->type = EXPR_PARAMETER;
+        expr->parameter = parser->statement->num_parameters++;
+    } else if (token_is(token, "null")) {
+        expr->type = EXPR_NULL;
+    } else {
+        return fail(parser, "a value");
+    }
+    advance(parser);
+    return true;
+}
+
+// CREATE INDEX name ON table (column) [INCLUDE (column, ...)]
+static bool parse_create_index(Parser* parser) {
+    ParsedStatement* statement = parser->statement;
+    statement->type = STATEMENT_CREATE_INDEX;
+    statement->num_columns = 1;
+    if (!parse_name(parser, &statement->index, "an index name") || !expect(parser, "on") ||
+        !parse_name(parser, &statement->table, "a table name") || !expect(parser, "(") ||
+        !parse_name(parser, &statement->columns[0], "a column name") || !expect(parser, ")")) {
+        return false;
+    }
+    if (!accept(parser, "include")) {
+        return true;
+    }
+    if (!expect(parser, "(")) {
+        return false;
+    }
+    do {
+        if (statement->num_columns == SQL_MAX_COLUMNS) {
+            return fail(parser, "fewer columns");
+        }
+        if (!parse_name(parser, &statement->columns[statement->num_columns++], "a column name")) {
+            return false;
+        }
+    } while (accept(parser, ","));
+    return expect(parser, ")");
+}
+
+static bool parse_create_table(Parser* parser) {
+    ParsedStatement* statement = parser->statement;
+    statement->type = STATEMENT_CREATE_TABLE;
+    if (!expect(parser, "table") || !parse_name(parser, &statement->table, "a table name") ||
+        !expect(parser, "(")) {
+        return false;
+    }
+    do {
+        if (statement->num_columns == SQL_MAX_COLUMNS) {
+            return fail(parser, "fewer columns");
+        }
+        uint32_t column = statement->num_columns++;
+        if (!parse_name(parser, &statement->columns[column], "a column name")) {
+            return false;
+        }
+        if (accept(parser, "int") || accept(parser, "integer")) {
+            statement->column_types[column] = COLUMN_INT;
+        } else if (accept(parser, "text")) {
+            statement->column_types[column] = COLUMN_TEXT;
+        } else {
+            return fail(parser, "INT or TEXT");
+        }
+    } while (accept(parser, ","));
+    return expect(parser, ")");
+}
+
+static bool parse_insert(Parser* parser) {
+    ParsedStatement* statement = parser->statement;
+    statement->type = STATEMENT_INSERT;
+    if (!expect(parser, "into") || !parse_name(parser, &statement->table, "a table name") ||
+        !expect(parser, "values")) {
+        return false;
+    }
+    do {
+        if (!expect(parser, "(")) {
+            return false;
+        }
+        uint32_t width = 0;
+        do {
+            if (statement->num_rows * statement->row_width + width == statement->values_capacity) {
+                uint32_t capacity = statement->values_capacity ? statement->values_capacity * 2 : 16;
+                Expr* values = arena_grow(parser->arena, statement->values,
+                                          statement->values_capacity * sizeof(Expr), capacity * sizeof(Expr));
+                if (!values) {
+                    return fail(parser, "a shorter statement");
+                }
+                statement->values = values;
+                statement->values_capacity = capacity;
+            }
+            if (!parse_expr(parser, &statement->values[statement->num_rows * statement->row_width + width])) {
+                return false;
+            }
+            width++;
+        } while (accept(parser, ","));
+        if (statement->num_rows == 0) {
+            statement->row_width = width;
+        } else if (width != statement->row_width) {
+            return fail(parser, "rows of the same width");
+        }
+        statement->num_rows++;
+        if (!expect(parser, ")")) {
+            return false;
+        }
+    } while (accept(parser, ","));
+    return true;
+}
+
+// A result column: a column name, or COUNT(*), COUNT(column), SUM(column),
+// MIN(column) or MAX(column). Without GROUP BY, a query's result columns are
+// either all aggregates or none.
+static bool parse_result_column(Parser* parser) {
+    static const struct {
+        const char* name;
+        AggregateFunction function;
+    } functions[] = {
+        { "count", AGGREGATE_COUNT }, { "sum", AGGREGATE_SUM }, { "min", AGGREGATE_MIN }, { "max", AGGREGATE_MAX },
+    };
+    ParsedStatement* statement = parser->statement;
+    uint32_t column = statement->num_columns++;
+    Token name = parser->token;
+    if (!parse_column(parser, &statement->columns[column])) {
+        return false;
+    }
+    bool aggregate = token_is(parser->token, "(");
+    if (aggregate && statement->columns[column].length != name.length) {
+        return fail(parser, "a column");
+    }
+    if (column > 0 && aggregate != statement->aggregate) {
+        return fail(parser, aggregate ? "a column, not an aggregate" : "an aggregate, not a column");
+    }
+    statement->aggregate = aggregate;
+    if (!aggregate) {
+        return true;
+    }
+    uint32_t i = 0;
+    while (i < sizeof(functions) / sizeof(functions[0]) && !token_is(name, functions[i].name)) {
+        i++;
+    }
+    if (i == sizeof(functions) / sizeof(functions[0])) {
+        return fail(parser, "COUNT, SUM, MIN or MAX");
+    }
+    statement->functions[column] = functions[i].function;
+    advance(parser);
+    if (functions[i].function == AGGREGATE_COUNT && accept(parser, "*")) {
+        statement->columns[column].length = 0;
+    } else if (!parse_column(parser, &statement->columns[column])) {
+        return false;
+    }
+    return expect(parser, ")");
+}
+
+// column op value [AND column op value ...]
+static bool parse_conditions(Parser* parser) {
+    ParsedStatement* statement = parser->statement;
+
+    static const struct {
+        const char* symbol;
+        CompareOp op;
+    } operators[] = {
+        { "=", COMPARE_EQ }, { "!=", COMPARE_NE }, { "<>", COMPARE_NE }, { "<", COMPARE_LT },
+        { "<=", COMPARE_LE }, { ">", COMPARE_GT }, { ">=", COMPARE_GE },
+    };
+    do {
+        if (statement->num_conditions == SQL_MAX_CONDITIONS) {
+            return fail(parser, "fewer conditions");
+        }
+        Condition* condition = &statement->conditions[statement->num_conditions++];
+        if (!parse_column(parser, &condition->column)) {
+            return false;
+        }
+        uint32_t i = 0;
+        while (i < sizeof(operators) / sizeof(operators[0]) && !token_is(parser->token, operators[i].symbol)) {
+            i++;
+        }
+        if (i == sizeof(operators) / sizeof(operators[0])) {
+            return fail(parser, "a comparison");
+        }
+        condition->op = operators[i].op;
+        advance(parser);
+        if (!parse_expr(parser, &condition->value)) {
+            return false;
+        }
+    } while (accept(parser, "and"));
+    return true;
+}
+
+static bool parse_select(Parser* parser) {
+    ParsedStatement* statement = parser->statement;
+    statement->type = STATEMENT_SELECT;
+    if (!accept(parser, "*")) {
+        do {
+            if (statement->num_columns == SQL_MAX_COLUMNS) {
+                return fail(parser, "fewer columns");
+            }
+            if (!parse_result_column(parser)) {
+                return false;
+            }
+        } while (accept(parser, ","));
+    }
+    if (!expect(parser, "from") || !parse_name(parser, &statement->table, "a table name")) {
+        return false;
+    }
+    // [INNER] JOIN table ON column = column
+    if (accept(parser, "inner") ? expect(parser, "join") : accept(parser, "join")) {
+        if (!parse_name(parser, &statement->join_table, "a table name") || !expect(parser, "on") ||
+            !parse_column(parser, &statement->join_on[0]) || !expect(parser, "=") ||
+            !parse_column(parser, &statement->join_on[1])) {
+            return false;
+        }
+    } else if (parser->failed) {
+        return false;
+    }
+    if (accept(parser, "where") && !parse_conditions(parser)) {
+        return false;
+    }
+    if (!accept(parser, "order")) {
+        return true;
+    }
+    if (!expect(parser, "by")) {
+        return false;
+    }
+    do {
+        if (statement->num_order_by == SQL_MAX_ORDER_BY) {
+            return fail(parser, "fewer ORDER BY columns");
+        }
+        uint32_t i = statement->num_order_by++;
+        if (!parse_column(parser, &statement->order_by[i])) {
+            return false;
+        }
+        statement->order_descending[i] = accept(parser, "desc");
+        if (!statement->order_descending[i]) {
+            accept(parser, "asc");
+        }
+    } while (accept(parser, ","));
+    return true;
+}
+
+ParsedStatement* sql_parse(SqlArena* arena, const char* sql, uint32_t length, char* error, uint32_t error_size) {
+    ParsedStatement* statement = sql_arena_alloc(arena, sizeof(ParsedStatement));
+    if (!statement) {
+        snprintf(error, error_size, "Out of memory");
+        return NULL;
+    }
+    memset(statement, 0, sizeof(*statement));
+    Parser parser = { .arena = arena, .statement = statement, .error = error, .error_size = error_size };
+    tokenizer_init(&parser.tokenizer, sql, length);
+    advance(&parser);
+
+    bool parsed;
+    if (accept(&parser, "explain")) {
+        statement->explain = accept(&parser, "analyze") ? EXPLAIN_ANALYZE : EXPLAIN_PROGRAM;
+        if (accept(&parser, "insert")) {
+            parsed = parse_insert(&parser);
+        } else if (accept(&parser, "select")) {
+            parsed = parse_select(&parser);
+        } else {
+            parsed = fail(&parser, "INSERT or SELECT");
+        }
+    } else if (accept(&parser, "create")) {
+        parsed = accept(&parser, "index") ? parse_create_index(&parser) : parse_create_table(&parser);
+    } else if (accept(&parser, "insert")) {
+        parsed = parse_insert(&parser);
+    } else if (accept(&parser, "select")) {
+        parsed = parse_select(&parser);
+    } else if (accept(&parser, "analyze")) {
+        statement->type = STATEMENT_ANALYZE;
+        parsed = parser.token.type != TOKEN_IDENTIFIER || parse_name(&parser, &statement->table, "a table name");
+    } else {
+        parsed = fail(&parser, "CREATE, INSERT, SELECT, ANALYZE or EXPLAIN");
+    }
+    accept(&parser, ";");
+    if (parsed && parser.token.type != TOKEN_END) {
+        parsed = fail(&parser, "end of statement");
+    }
+    return parsed ? statement : NULL;
+}
+
+uint32_t sql_normalize(const char* sql, uint32_t length, char* out, uint32_t size) {
+    Tokenizer tokenizer;
+    tokenizer_init(&tokenizer, sql, length);
+    uint32_t written = 0;
+    bool after_dot = false;
+    for (Token token = tokenizer_next(&tokenizer); token.type != TOKEN_END; token = tokenizer_next(&tokenizer)) {
+        if (token.type == TOKEN_ERROR) {
+            return 0;
+        }
+        if (token_is(token, ";")) {
+            continue;
+        }
+        // Strings keep their quotes, so they never read as identifiers
+        const char* start = token.type == TOKEN_STRING ? token.start - 1 : token.start;
+        uint32_t token_length = token.type == TOKEN_STRING ? token.length + 2 : token.length;
+        // table.column stays one word
+        bool dot = token_is(token, ".");
+        bool space = written > 0 && !dot && !after_dot;
+        after_dot = dot;
+        if (written + space + token_length > size) {
+            return 0;
+        }
+        if (space) {
+            out[written++] = ' ';
+        }
+        if (token.type == TOKEN_IDENTIFIER) {
+            for (uint32_t i = 0; i < token_length; i++) {
+                out[written + i] = lower(start[i]);
+            }
+        } else {
+            memcpy(out + written, start, token_length);
+        }
+        written += token_length;
+    }
+    return written;
+}
+
+void sql_reader_init(SqlReader* reader, int fd) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+}
+
+// Appends at least one more read to the buffer, first moving the pending
+// statement to the front; false at the end of the input
+static bool reader_fill(SqlReader* reader) {
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->scanned -= reader->start;
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->capacity - reader->end < SQL_READER_CHUNK) {
+        size_t capacity = reader->capacity ? reader->capacity * 2 : SQL_READER_CHUNK;
+        while (capacity - reader->end < SQL_READER_CHUNK) {
+            capacity *= 2;
+        }
+        char* buffer = realloc(reader->buffer, capacity);
+        if (!buffer) {
+            printf("ERROR: Out of memory reading SQL\n");
+            reader->eof = true;
+            return false;
+        }
+        reader->buffer = buffer;
+        reader->capacity = capacity;
+    }
+    const char* prompt = reader->start == reader->end ? reader->prompt : reader->continuation;
+    if (prompt) {
+        printf("%s", prompt);
+        fflush(stdout);
+    }
+    ssize_t bytes;
+    do {
+        bytes = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+    } while (bytes < 0 && errno == EINTR);
+    if (bytes <= 0) {
+        if (bytes < 0) {
+            printf("ERROR: Failed to read SQL: %s\n", strerror(errno));
+        }
+        reader->eof = true;
+        return false;
+    }
+    reader->end += (size_t)bytes;
+    return true;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool sql_reader_next(SqlReader* reader, const char** sql, uint32_t* length) {
+    for (;;) {
+        char* buffer = reader->buffer;
+        if (reader->scanned == reader->start) {
+            while (reader->start < reader->end && is_space(buffer[reader->start])) {
+                reader->start++;
+            }
+            reader->scanned = reader->start;
+        }
+
+        size_t statement_end = reader->end;
+        size_t next = reader->end;
+        if (reader->start < reader->end && buffer[reader->start] == '.') {
+            char* newline = memchr(buffer + reader->scanned, '\n', reader->end - reader->scanned);
+            reader->scanned = reader->end;
+            if (newline) {
+                statement_end = (size_t)(newline - buffer);
+                next = statement_end + 1;
+            }
+        } else {
+            char quote = reader->quote;
+            size_t i = reader->scanned;
+            for (; i < reader->end; i++) {
+                char c = buffer[i];
+                if (quote) {
+                    quote = c == quote ? 0 : quote;
+                } else if (c == '\'' || c == '"') {
+                    quote = c;
+                } else if (c == ';') {
+                    break;
+                }
+            }
+            reader->quote = quote;
+            reader->scanned = i;
+            if (i < reader->end) {
+                statement_end = i;
+                next = i + 1;
+            }
+        }
+
+        if (next == reader->end && statement_end == reader->end && !reader->eof) {
+            // No statement end yet: read more, or at the end of the input
+            // take what is left
+            reader_fill(reader);
+            continue;
+        }
+        if (reader->start == reader->end && reader->eof) {
+            return false;
+        }
+        *sql = buffer + reader->start;
+        *length = (uint32_t)(statement_end - reader->start);
+        reader->start = reader->scanned = next;
+        reader->quote = 0;
+        if (*length > 0) {
+            return true;
+        }
+    }
+}
+
+void sql_reader_free(SqlReader* reader) {
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+// Rows print as the VM produces them, straight from the page
+static bool print_row(void* context, const Value* row, uint32_t num_columns) {
+    for (uint32_t i = 0; i < num_columns; i++) {
+        if (i > 0) {
+            putchar('\t');
+        }
+        switch (row[i].type) {
+            case VALUE_INT:
+                printf("%lld", (long long)row[i].integer);
+                break;
+            case VALUE_TEXT:
+                fwrite(row[i].text, 1, row[i].length, stdout);
+                break;
+            default:
+                printf("NULL");
+                break;
+        }
+    }
+    putchar('\n');
+    (*(uint64_t*)context)++;
+    return true;
+}
+
+// Runs one statement; false if it failed
+static bool execute(Database* db, const char* sql, uint32_t length, bool interactive) {
+    PreparedStatement* statement = db_prepare(db, sql, (int32_t)length);
+    if (!statement) {
+        printf("ERROR: %s\n", db_error(db));
+        return false;
+    }
+    uint32_t num_columns = stmt_num_columns(statement);
+    for (uint32_t i = 0; i < num_columns; i++) {
+        printf(i + 1 < num_columns ? "%s\t" : "%s\n", stmt_column_name(statement, i));
+    }
+    uint64_t rows = 0;
+    VmStatus status = stmt_execute(statement, print_row, &rows);
+    if (status != VM_DONE) {
+        printf("ERROR: %s\n", db_error(db));
+    } else if (interactive) {
+        switch (stmt_explain(statement) != EXPLAIN_NONE ? STATEMENT_SELECT : stmt_type(statement)) {
+            case STATEMENT_CREATE_TABLE:
+                printf("Table created.\n");
+                break;
+            case STATEMENT_CREATE_INDEX:
+                printf("Index created.\n");
+                break;
+            case STATEMENT_INSERT:
+                printf(stmt_changes(statement) == 1 ? "Row inserted.\n" : "%u rows inserted.\n",
+                       stmt_changes(statement));
+                break;
+            case STATEMENT_SELECT:
+                printf("(%llu row%s)\n", (unsigned long long)rows, rows == 1 ? "" : "s");
+                break;
+            case STATEMENT_ANALYZE:
+                printf("Statistics updated.\n");
+                break;
+        }
+    }
+    stmt_finalize(statement);
+    return status == VM_DONE;
+}
+
+uint32_t repl_run(Database* db, int fd) {
+    bool interactive = isatty(fd);
+    SqlReader reader;
+    sql_reader_init(&reader, fd);
+    if (interactive) {
+        reader.prompt = "miniSQL> ";
+        reader.continuation = "   ...> ";
+    }
+
+    uint32_t failures = 0;
+    const char* sql;
+    uint32_t length;
+    while (sql_reader_next(&reader, &sql, &length)) {
+        if (sql[0] == '.') {
+            while (length > 0 && is_space(sql[length - 1])) {
+                length--;
+            }
+            if ((length == 5 && memcmp(sql, ".exit", 5) == 0) || (length == 5 && memcmp(sql, ".quit", 5) == 0)) {
+                break;
+            }
+            printf("ERROR: Unrecognized command '%.*s'\n", (int)length, sql);
+            failures++;
+            continue;
+        }
+        if (!execute(db, sql, length, interactive)) {
+            failures++;
+        }
+    }
+    sql_reader_free(&reader);
+    return failures;
+}
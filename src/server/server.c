@@ -0,0 +1,658 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "stats.h"
+
+#define SERVER_EPOLL_EVENTS 64
+#define SERVER_READ_CHUNK 65536
+
+typedef enum {
+    SERVER_COUNTER_CONNECTIONS,
+    SERVER_COUNTER_REQUESTS,
+    SERVER_COUNTER_ERRORS
+} ServerCounter;
+
+typedef struct Connection Connection;
+
+struct Connection {
+    int fd;
+    uint8_t* input;               // Bytes received and not yet run
+    size_t input_used;
+    size_t input_capacity;
+    uint8_t* output;              // Responses not yet written
+    size_t output_used;
+    size_t output_sent;
+    size_t output_capacity;
+    bool eof;                     // The client will send nothing more
+    bool failed;                  // Unrecoverable: close without flushing
+    Connection* prev;             // Every open connection, for server_close()
+    Connection* next;
+    Connection* queue_next;       // Waiting for a worker
+};
+
+struct Server {
+    Database* db;
+    pthread_mutex_t db_lock;      // The engine is single-threaded
+    int listen_fd;
+    int epoll_fd;
+    int stop_fd;                  // eventfd written by server_stop()
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    uint32_t num_workers;
+    pthread_t* workers;
+
+    pthread_mutex_t lock;         // Guards the queue and the connection list
+    pthread_cond_t ready;         // A connection was queued, or the server is stopping
+    Connection* queue_head;
+    Connection* queue_tail;
+    bool stopping;
+    Connection* connections;
+    StatsCounters* counters;
+};
+
+// Response encoding. Every frame is built in place at the end of the
+// connection's output buffer.
+
+static void output_reserve(Connection* connection, size_t bytes) {
+    if (connection->output_used + bytes <= connection->output_capacity) {
+        return;
+    }
+    size_t capacity = connection->output_capacity ? connection->output_capacity : 4096;
+    while (capacity < connection->output_used + bytes) {
+        capacity *= 2;
+    }
+    uint8_t* output = realloc(connection->output, capacity);
+    if (!output) {
+        printf("ERROR: Out of memory buffering responses\n");
+        exit(EXIT_FAILURE);
+    }
+    connection->output = output;
+    connection->output_capacity = capacity;
+}
+
+static void put_bytes(Connection* connection, const void* bytes, size_t length) {
+    output_reserve(connection, length);
+    memcpy(connection->output + connection->output_used, bytes, length);
+    connection->output_used += length;
+}
+
+static void put_u8(Connection* connection, uint8_t value) {
+    put_bytes(connection, &value, sizeof(value));
+}
+
+static void put_u16(Connection* connection, uint16_t value) {
+    put_bytes(connection, &value, sizeof(value));
+}
+
+static void put_u32(Connection* connection, uint32_t value) {
+    put_bytes(connection, &value, sizeof(value));
+}
+
+// Starts a frame; returns where its length goes for end_frame()
+static size_t begin_frame(Connection* connection, uint32_t request_id, ServerResponseType type) {
+    size_t start = connection->output_used;
+    put_u32(connection, 0);
+    put_u32(connection, request_id);
+    put_u8(connection, (uint8_t)type);
+    return start;
+}
+
+static void end_frame(Connection* connection, size_t start) {
+    uint32_t length = (uint32_t)(connection->output_used - start - sizeof(uint32_t));
+    memcpy(connection->output + start, &length, sizeof(length));
+}
+
+static void put_error(Server* server, Connection* connection, uint32_t request_id, const char* message) {
+    stats_inc(server->counters, SERVER_COUNTER_ERRORS);
+    size_t frame = begin_frame(connection, request_id, SERVER_RESPONSE_ERROR);
+    put_bytes(connection, message, strlen(message));
+    end_frame(connection, frame);
+}
+
+static void put_row(Connection* connection, uint32_t request_id, const Value* row, uint32_t num_columns) {
+    size_t frame = begin_frame(connection, request_id, SERVER_RESPONSE_ROW);
+    put_u16(connection, (uint16_t)num_columns);
+    for (uint32_t i = 0; i < num_columns; i++) {
+        put_u8(connection, (uint8_t)row[i].type);
+        if (row[i].type == VALUE_INT) {
+            put_bytes(connection, &row[i].integer, sizeof(int64_t));
+        } else if (row[i].type != VALUE_NULL) {
+            put_u32(connection, row[i].length);
+            put_bytes(connection, row[i].text, row[i].length);
+        }
+    }
+    end_frame(connection, frame);
+}
+
+// Request decoding
+
+typedef struct {
+    const uint8_t* position;
+    const uint8_t* end;
+} Reader;
+
+static bool get_bytes(Reader* reader, void* destination, size_t length) {
+    if ((size_t)(reader->end - reader->position) < length) {
+        return false;
+    }
+    memcpy(destination, reader->position, length);
+    reader->position += length;
+    return true;
+}
+
+// Binds the request's parameters. Bound text points into the input buffer,
+// which stays put until the statement is finalized.
+static bool bind_parameters(Reader* reader, PreparedStatement* statement, const char** error) {
+    uint16_t num_parameters;
+    if (!get_bytes(reader, &num_parameters, sizeof(num_parameters))) {
+        *error = "Truncated request";
+        return false;
+    }
+    for (uint32_t parameter = 1; parameter <= num_parameters; parameter++) {
+        uint8_t type;
+        bool bound = false;
+        if (!get_bytes(reader, &type, sizeof(type))) {
+            *error = "Truncated request";
+            return false;
+        }
+        if (type == VALUE_NULL) {
+            bound = stmt_bind_null(statement, parameter);
+        } else if (type == VALUE_INT) {
+            int64_t integer;
+            if (!get_bytes(reader, &integer, sizeof(integer))) {
+                *error = "Truncated request";
+                return false;
+            }
+            bound = stmt_bind_int(statement, parameter, integer);
+        } else if (type == VALUE_TEXT) {
+            uint32_t length;
+            if (!get_bytes(reader, &length, sizeof(length)) || (size_t)(reader->end - reader->position) < length) {
+                *error = "Truncated request";
+                return false;
+            }
+            bound = stmt_bind_text(statement, parameter, (const char*)reader->position, length);
+            reader->position += length;
+        } else {
+            *error = "Unknown parameter type";
+            return false;
+        }
+        if (!bound) {
+            *error = "Too many parameters for the statement";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Skips over the parameters to find where the SQL starts
+static bool skip_parameters(Reader* reader) {
+    uint16_t num_parameters;
+    if (!get_bytes(reader, &num_parameters, sizeof(num_parameters))) {
+        return false;
+    }
+    for (uint32_t i = 0; i < num_parameters; i++) {
+        uint8_t type;
+        if (!get_bytes(reader, &type, sizeof(type))) {
+            return false;
+        }
+        size_t skip = 0;
+        if (type == VALUE_INT) {
+            skip = sizeof(int64_t);
+        } else if (type == VALUE_TEXT) {
+            uint32_t length;
+            if (!get_bytes(reader, &length, sizeof(length))) {
+                return false;
+            }
+            skip = length;
+        }
+        if ((size_t)(reader->end - reader->position) < skip) {
+            return false;
+        }
+        reader->position += skip;
+    }
+    return true;
+}
+
+static bool write_output(Connection* connection);
+
+// Sends the responses of a statement that is still running, so its rows do
+// not pile up in memory. The database stays locked meanwhile, so a client
+// that takes nothing for SERVER_WRITE_TIMEOUT_MS fails instead.
+static bool drain_output(Connection* connection) {
+    while (!write_output(connection)) {
+        if (connection->failed) {
+            return false;
+        }
+        struct pollfd poll_fd = {.fd = connection->fd, .events = POLLOUT};
+        int ready = poll(&poll_fd, 1, SERVER_WRITE_TIMEOUT_MS);
+        if (ready == 0 || (ready < 0 && errno != EINTR)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void run_query(Server* server, Connection* connection, uint32_t request_id, const uint8_t* body,
+                      size_t length) {
+    Reader reader = {body, body + length};
+    if (!skip_parameters(&reader)) {
+        put_error(server, connection, request_id, "Truncated request");
+        return;
+    }
+    const char* sql = (const char*)reader.position;
+    int32_t sql_length = (int32_t)(reader.end - reader.position);
+    Reader parameters = {body, reader.position};
+
+    pthread_mutex_lock(&server->db_lock);
+    PreparedStatement* statement = db_prepare(server->db, sql, sql_length);
+    if (!statement) {
+        put_error(server, connection, request_id, db_error(server->db));
+        pthread_mutex_unlock(&server->db_lock);
+        return;
+    }
+    const char* error = NULL;
+    if (bind_parameters(&parameters, statement, &error)) {
+        // Rows are only valid until the next step, so they are encoded here
+        VmStatus status;
+        bool stalled = false;
+        while ((status = stmt_step(statement)) == VM_ROW) {
+            uint32_t num_columns;
+            const Value* row = stmt_row(statement, &num_columns);
+            put_row(connection, request_id, row, num_columns);
+            if (connection->output_used - connection->output_sent >= SERVER_OUTPUT_HIGH_WATER &&
+                !drain_output(connection)) {
+                stalled = true;
+                break;
+            }
+        }
+        if (stalled) {
+            put_error(server, connection, request_id, "Client stopped reading the result");
+        } else if (status == VM_DONE) {
+            size_t frame = begin_frame(connection, request_id, SERVER_RESPONSE_DONE);
+            put_u32(connection, stmt_changes(statement));
+            end_frame(connection, frame);
+        } else {
+            put_error(server, connection, request_id, db_error(server->db));
+        }
+    } else {
+        put_error(server, connection, request_id, error);
+    }
+    stmt_finalize(statement);
+    pthread_mutex_unlock(&server->db_lock);
+}
+
+// Runs the complete requests at the front of the input until the responses
+// pile up past the high-water mark. A malformed frame fails the connection.
+static void run_requests(Server* server, Connection* connection) {
+    size_t consumed = 0;
+    while (connection->output_used - connection->output_sent < SERVER_OUTPUT_HIGH_WATER) {
+        size_t available = connection->input_used - consumed;
+        uint32_t length;
+        if (available < sizeof(length)) {
+            break;
+        }
+        memcpy(&length, connection->input + consumed, sizeof(length));
+        if (length < SERVER_FRAME_HEADER_SIZE - sizeof(length) || length > SERVER_MAX_FRAME) {
+            connection->failed = true;
+            return;
+        }
+        if (available < sizeof(length) + length) {
+            break;
+        }
+
+        const uint8_t* frame = connection->input + consumed + sizeof(length);
+        uint32_t request_id;
+        memcpy(&request_id, frame, sizeof(request_id));
+        uint8_t type = frame[sizeof(request_id)];
+        const uint8_t* body = frame + SERVER_FRAME_HEADER_SIZE - sizeof(length);
+        size_t body_length = length - (SERVER_FRAME_HEADER_SIZE - sizeof(length));
+        stats_inc(server->counters, SERVER_COUNTER_REQUESTS);
+        if (type == SERVER_REQUEST_QUERY) {
+            run_query(server, connection, request_id, body, body_length);
+        } else {
+            put_error(server, connection, request_id, "Unknown request type");
+        }
+        consumed += sizeof(length) + length;
+    }
+
+    memmove(connection->input, connection->input + consumed, connection->input_used - consumed);
+    connection->input_used -= consumed;
+}
+
+// Whether the input holds a whole frame, or one that will never be valid
+static bool has_request(const Connection* connection) {
+    uint32_t length;
+    if (connection->input_used < sizeof(length)) {
+        return false;
+    }
+    memcpy(&length, connection->input, sizeof(length));
+    return length > SERVER_MAX_FRAME || connection->input_used >= sizeof(length) + length;
+}
+
+// Reads whatever the socket holds. The input only grows past a read chunk
+// for a frame larger than that.
+static void read_input(Connection* connection) {
+    while (!connection->eof && !connection->failed) {
+        if (connection->input_capacity - connection->input_used < SERVER_READ_CHUNK) {
+            size_t capacity = connection->input_capacity ? connection->input_capacity * 2 : SERVER_READ_CHUNK;
+            uint8_t* input = realloc(connection->input, capacity);
+            if (!input) {
+                connection->failed = true;
+                return;
+            }
+            connection->input = input;
+            connection->input_capacity = capacity;
+        }
+        ssize_t received = recv(connection->fd, connection->input + connection->input_used,
+                                connection->input_capacity - connection->input_used, 0);
+        if (received > 0) {
+            connection->input_used += (size_t)received;
+            if (has_request(connection) && connection->input_capacity - connection->input_used < SERVER_READ_CHUNK) {
+                return;  // Run what arrived before buffering more
+            }
+        } else if (received == 0) {
+            connection->eof = true;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        } else if (errno != EINTR) {
+            connection->failed = true;
+        }
+    }
+}
+
+// Writes pending responses until the socket would block. Returns whether
+// everything went out.
+static bool write_output(Connection* connection) {
+    while (connection->output_sent < connection->output_used && !connection->failed) {
+        ssize_t sent = send(connection->fd, connection->output + connection->output_sent,
+                            connection->output_used - connection->output_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection->output_sent += (size_t)sent;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            connection->failed = true;
+        }
+    }
+    connection->output_used = 0;
+    connection->output_sent = 0;
+    return !connection->failed;
+}
+
+static void close_connection(Server* server, Connection* connection) {
+    pthread_mutex_lock(&server->lock);
+    if (connection->prev) {
+        connection->prev->next = connection->next;
+    } else {
+        server->connections = connection->next;
+    }
+    if (connection->next) {
+        connection->next->prev = connection->prev;
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    free(connection->input);
+    free(connection->output);
+    free(connection);
+}
+
+// A worker's turn with a connection: read, run, write, and hand it back to
+// epoll waiting for whichever of input or room for output it needs next
+static void serve_connection(Server* server, Connection* connection) {
+    read_input(connection);
+    bool flushed = write_output(connection);
+    while (flushed && has_request(connection) && !connection->failed) {
+        run_requests(server, connection);
+        flushed = write_output(connection);
+    }
+
+    if (connection->failed || (connection->eof && flushed && !has_request(connection))) {
+        close_connection(server, connection);
+        return;
+    }
+    // While responses are stuck, the client's requests wait in its socket
+    struct epoll_event event;
+    event.events = EPOLLONESHOT | (flushed ? EPOLLIN | EPOLLRDHUP : EPOLLOUT);
+    event.data.ptr = connection;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event) != 0) {
+        close_connection(server, connection);
+    }
+}
+
+static void* worker_main(void* argument) {
+    Server* server = argument;
+    while (true) {
+        pthread_mutex_lock(&server->lock);
+        while (!server->queue_head && !server->stopping) {
+            pthread_cond_wait(&server->ready, &server->lock);
+        }
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            return NULL;
+        }
+        Connection* connection = server->queue_head;
+        server->queue_head = connection->queue_next;
+        if (!server->queue_head) {
+            server->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&server->lock);
+        serve_connection(server, connection);
+    }
+}
+
+static void queue_connection(Server* server, Connection* connection) {
+    pthread_mutex_lock(&server->lock);
+    connection->queue_next = NULL;
+    if (server->queue_tail) {
+        server->queue_tail->queue_next = connection;
+    } else {
+        server->queue_head = connection;
+    }
+    server->queue_tail = connection;
+    pthread_cond_signal(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+}
+
+static void accept_connections(Server* server) {
+    while (true) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                printf("ERROR: accept failed: %s\n", strerror(errno));
+            }
+            return;
+        }
+        Connection* connection = calloc(1, sizeof(Connection));
+        if (!connection) {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+
+        pthread_mutex_lock(&server->lock);
+        connection->next = server->connections;
+        if (server->connections) {
+            server->connections->prev = connection;
+        }
+        server->connections = connection;
+        pthread_mutex_unlock(&server->lock);
+        stats_inc(server->counters, SERVER_COUNTER_CONNECTIONS);
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        event.data.ptr = connection;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close_connection(server, connection);
+        }
+    }
+}
+
+Server* server_open(Database* db, const char* socket_path, uint32_t num_workers) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("ERROR: Socket path %s is too long\n", socket_path);
+        return NULL;
+    }
+    strcpy(address.sun_path, socket_path);
+    if (num_workers == 0) {
+        num_workers = SERVER_DEFAULT_WORKERS;
+    }
+    if (num_workers > SERVER_MAX_WORKERS) {
+        num_workers = SERVER_MAX_WORKERS;
+    }
+
+    Server* server = calloc(1, sizeof(Server));
+    if (!server) {
+        return NULL;
+    }
+    server->db = db;
+    server->num_workers = num_workers;
+    strcpy(server->path, socket_path);
+    server->epoll_fd = -1;
+    server->stop_fd = -1;
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server->counters = stats_counters_new();
+    server->workers = calloc(num_workers, sizeof(pthread_t));
+    if (server->listen_fd == -1 || !server->counters || !server->workers) {
+        printf("ERROR: Unable to create the server socket: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    unlink(socket_path);  // Left behind by a server that did not close
+    if (bind(server->listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server->listen_fd, SOMAXCONN) != 0) {
+        printf("ERROR: Unable to listen on %s: %s\n", socket_path, strerror(errno));
+        goto fail;
+    }
+
+    // The listening socket and the stop eventfd are told apart by their
+    // event data, which for connections is the Connection
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = &server->listen_fd};
+    struct epoll_event stop_event = {.events = EPOLLIN, .data.ptr = &server->stop_fd};
+    if (server->epoll_fd == -1 || server->stop_fd == -1 ||
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &listen_event) != 0 ||
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->stop_fd, &stop_event) != 0) {
+        printf("ERROR: Unable to set up epoll: %s\n", strerror(errno));
+        unlink(socket_path);
+        goto fail;
+    }
+
+    pthread_mutex_init(&server->db_lock, NULL);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->ready, NULL);
+    return server;
+
+fail:
+    if (server->listen_fd != -1) {
+        close(server->listen_fd);
+    }
+    if (server->epoll_fd != -1) {
+        close(server->epoll_fd);
+    }
+    if (server->stop_fd != -1) {
+        close(server->stop_fd);
+    }
+    stats_counters_free(server->counters);
+    free(server->workers);
+    free(server);
+    return NULL;
+}
+
+int server_run(Server* server) {
+    server->stopping = false;
+    uint32_t started = 0;
+    for (; started < server->num_workers; started++) {
+        if (pthread_create(&server->workers[started], NULL, worker_main, server) != 0) {
+            break;
+        }
+    }
+
+    int result = started > 0 ? 0 : -1;
+    struct epoll_event events[SERVER_EPOLL_EVENTS];
+    bool running = result == 0;
+    while (running) {
+        int count = epoll_wait(server->epoll_fd, events, SERVER_EPOLL_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("ERROR: epoll_wait failed: %s\n", strerror(errno));
+            result = -1;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == &server->stop_fd) {
+                // Drained, so the server can run again
+                uint64_t value;
+                ssize_t drained = read(server->stop_fd, &value, sizeof(value));
+                (void)drained;
+                running = false;
+            } else if (events[i].data.ptr == &server->listen_fd) {
+                accept_connections(server);
+            } else {
+                queue_connection(server, events[i].data.ptr);
+            }
+        }
+    }
+
+    // Workers finish the connection they hold; queued ones are dropped by
+    // server_close()
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    pthread_cond_broadcast(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(server->workers[i], NULL);
+    }
+    server->queue_head = NULL;
+    server->queue_tail = NULL;
+    return result;
+}
+
+void server_stop(Server* server) {
+    // Only fails if the counter would overflow, which leaves it readable
+    uint64_t value = 1;
+    ssize_t written = write(server->stop_fd, &value, sizeof(value));
+    (void)written;
+}
+
+ServerStats server_stats(Server* server) {
+    ServerStats stats;
+    stats.connections = stats_counters_sum(server->counters, SERVER_COUNTER_CONNECTIONS);
+    stats.requests = stats_counters_sum(server->counters, SERVER_COUNTER_REQUESTS);
+    stats.errors = stats_counters_sum(server->counters, SERVER_COUNTER_ERRORS);
+    return stats;
+}
+
+void server_close(Server* server) {
+    while (server->connections) {
+        close_connection(server, server->connections);
+    }
+    close(server->listen_fd);
+    close(server->epoll_fd);
+    close(server->stop_fd);
+    unlink(server->path);
+    pthread_mutex_destroy(&server->db_lock);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->ready);
+    stats_counters_free(server->counters);
+    free(server->workers);
+    free(server);
+}
@@ -0,0 +1,38 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+// Zero means "not assigned yet"; shards are stored one-based
+__thread uint32_t stats_thread_shard = 0;
+
+static uint32_t next_shard = 0;
+
+uint32_t stats_assign_thread_shard(void) {
+    uint32_t shard = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) % STATS_SHARDS;
+    stats_thread_shard = shard + 1;
+    return stats_thread_shard;
+}
+
+StatsCounters* stats_counters_new(void) {
+    StatsCounters* counters;
+    if (posix_memalign((void**)&counters, sizeof(StatsShard), sizeof(StatsCounters)) != 0) {
+        return NULL;
+    }
+    memset(counters, 0, sizeof(StatsCounters));
+    return counters;
+}
+
+void stats_counters_free(StatsCounters* counters) {
+    free(counters);
+}
+
+// Concurrent increments may or may not be included; each shard value is
+// read atomically, so the sum is never torn
+uint64_t stats_counters_sum(const StatsCounters* counters, uint32_t counter) {
+    uint64_t sum = 0;
+    for (uint32_t shard = 0; shard < STATS_SHARDS; shard++) {
+        sum += __atomic_load_n(&counters->shards[shard].values[counter], __ATOMIC_RELAXED);
+    }
+    return sum;
+}
@@ -0,0 +1,297 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "analyze.h"
+
+// HyperLogLog sketches of 2^ANALYZE_SKETCH_BITS one-byte registers, about 3%
+// error on distinct counts
+#define ANALYZE_SKETCH_BITS 10
+#define ANALYZE_SKETCH_SIZE (1u << ANALYZE_SKETCH_BITS)
+
+// One column's state during the walk
+typedef struct {
+    uint8_t sketch[ANALYZE_SKETCH_SIZE];
+    uint64_t values;              // Non-NULL values seen
+    int64_t min;
+    int64_t max;
+    int64_t* sample;              // INT columns: reservoir of ANALYZE_SAMPLE_SIZE values
+} ColumnScan;
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t hash_value(const Value* value) {
+    if (value->type == VALUE_INT) {
+        return mix((uint64_t)value->integer);
+    }
+    uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+    for (uint32_t i = 0; i < value->length; i++) {
+        hash ^= (uint8_t)value->text[i];
+        hash *= 1099511628211ULL;
+    }
+    return mix(hash);
+}
+
+// The top bits pick a register, which keeps the longest run of leading zeros
+// the rest of a hash has shown
+static void sketch_add(uint8_t* sketch, uint64_t hash) {
+    uint32_t slot = (uint32_t)(hash >> (64 - ANALYZE_SKETCH_BITS));
+    uint64_t rest = hash << ANALYZE_SKETCH_BITS;
+    uint8_t rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : (uint8_t)(64 - ANALYZE_SKETCH_BITS + 1);
+    if (rank > sketch[slot]) {
+        sketch[slot] = rank;
+    }
+}
+
+// Harmonic mean of the registers, or linear counting of the empty ones while
+// the sketch is sparse
+static uint64_t sketch_estimate(const uint8_t* sketch) {
+    double m = ANALYZE_SKETCH_SIZE;
+    double sum = 0;
+    uint32_t zeros = 0;
+    for (uint32_t i = 0; i < ANALYZE_SKETCH_SIZE; i++) {
+        sum += ldexp(1.0, -sketch[i]);
+        zeros += sketch[i] == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
+    }
+    return (uint64_t)(estimate + 0.5);
+}
+
+static int compare_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void scan_value(ColumnScan* scan, const Value* value, uint64_t* random) {
+    sketch_add(scan->sketch, hash_value(value));
+    uint64_t seen = scan->values++;
+    if (!scan->sample) {
+        return;
+    }
+    scan->min = seen == 0 || value->integer < scan->min ? value->integer : scan->min;
+    scan->max = seen == 0 || value->integer > scan->max ? value->integer : scan->max;
+    if (seen < ANALYZE_SAMPLE_SIZE) {
+        scan->sample[seen] = value->integer;
+        return;
+    }
+    // Reservoir sampling: the value replaces a random one with probability
+    // ANALYZE_SAMPLE_SIZE / (seen + 1)
+    *random ^= *random << 13;
+    *random ^= *random >> 7;
+    *random ^= *random << 17;
+    uint64_t slot = *random % (seen + 1);
+    if (slot < ANALYZE_SAMPLE_SIZE) {
+        scan->sample[slot] = value->integer;
+    }
+}
+
+// The histogram runs from the column's true minimum to its true maximum, with
+// the bounds between taken at even steps through the sorted sample
+static void finish_column(ColumnScan* scan, uint64_t rows, ColumnStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->nulls = rows - scan->values;
+    stats->distinct = sketch_estimate(scan->sketch);
+    stats->distinct = stats->distinct > scan->values ? scan->values : stats->distinct;
+    stats->distinct = stats->distinct == 0 && scan->values > 0 ? 1 : stats->distinct;
+    if (!scan->sample || scan->values == 0) {
+        return;
+    }
+    uint32_t count = scan->values < ANALYZE_SAMPLE_SIZE ? (uint32_t)scan->values : ANALYZE_SAMPLE_SIZE;
+    qsort(scan->sample, count, sizeof(int64_t), compare_int64);
+    stats->num_bounds = ANALYZE_HISTOGRAM_BUCKETS + 1;
+    stats->bounds[0] = scan->min;
+    for (uint32_t i = 1; i < ANALYZE_HISTOGRAM_BUCKETS; i++) {
+        stats->bounds[i] = scan->sample[(uint64_t)i * count / ANALYZE_HISTOGRAM_BUCKETS];
+    }
+    stats->bounds[ANALYZE_HISTOGRAM_BUCKETS] = scan->max;
+}
+
+// Interior pages of the subtree at `page_num`, `levels` above the leaves,
+// counted without reading the leaves
+static uint64_t count_internal(Pager* pager, page_num_t page_num, uint32_t levels) {
+    if (levels == 0) {
+        return 0;
+    }
+    uint64_t count = 1;
+    pager_begin_op(pager);
+    uint32_t num_keys = *internal_node_num_keys(pager_get_page_hinted(pager, page_num, PAGE_HINT_INTERNAL));
+    for (uint32_t i = 0; i <= num_keys && levels > 1; i++) {
+        // Deeper reads may evict the node, so it is read again for each child
+        void* node = pager_get_page_hinted(pager, page_num, PAGE_HINT_INTERNAL);
+        page_num_t child = i < num_keys ? *internal_node_child(node, i) : *internal_node_right_child(node);
+        count += count_internal(pager, child, levels - 1);
+    }
+    return count;
+}
+
+// Measures a tree's height along its leftmost path and counts its interior
+// pages; the leaves are left to the caller's walk. Returns the leftmost leaf.
+static page_num_t measure_tree(BTree* btree, TreeShape* shape) {
+    Pager* pager = btree->pager;
+    page_num_t page_num = btree->root_page_num;
+    shape->height = 1;
+    pager_begin_op(pager);
+    void* node = pager_get_page_hinted(pager, page_num, PAGE_HINT_INTERNAL);
+    while (get_node_type(node) == NODE_INTERNAL) {
+        page_num = *internal_node_child(node, 0);
+        node = pager_get_page_hinted(pager, page_num, PAGE_HINT_INTERNAL);
+        shape->height++;
+    }
+    shape->internal_pages = count_internal(pager, btree->root_page_num, shape->height - 1);
+    shape->leaf_pages = 0;
+    return page_num;
+}
+
+bool analyze_table(BTree* btree, const RowSchema* schema, TableStats* stats) {
+    uint32_t num_columns = schema->num_columns + 1;
+    ColumnScan* scans = calloc(num_columns, sizeof(ColumnScan));
+    bool valid = scans != NULL;
+    for (uint32_t i = 0; i < num_columns && valid; i++) {
+        if (i == 0 || schema->types[i - 1] == COLUMN_INT) {
+            scans[i].sample = malloc(ANALYZE_SAMPLE_SIZE * sizeof(int64_t));
+            valid = scans[i].sample != NULL;
+        }
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    Pager* pager = btree->pager;
+    btree_flush_buffers(btree);  // The walk reads leaves only
+    page_num_t page_num = measure_tree(btree, &stats->shape);
+    uint64_t random = 0x9e3779b97f4a7c15ULL;  // Fixed, so ANALYZE is repeatable
+    while (valid) {
+        // One leaf per operation, so the walk never pins more than a page
+        pager_begin_op(pager);
+        void* node = pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        stats->shape.leaf_pages++;
+        stats->rows += num_cells;
+        void* cell = num_cells > 0 ? leaf_node_cell(node, 0) : NULL;
+        for (uint32_t i = 0; i < num_cells && valid; i++, cell = leaf_cell_next(cell)) {
+            Value value;
+            memset(&value, 0, sizeof(value));
+            value.type = VALUE_INT;
+            value.integer = leaf_cell_key(cell);
+            scan_value(&scans[0], &value, &random);
+            for (uint32_t column = 1; column < num_columns && valid; column++) {
+                valid = row_column(schema, leaf_cell_value(cell), leaf_cell_value_size(cell), column - 1, &value);
+                if (valid && value.type != VALUE_NULL) {
+                    scan_value(&scans[column], &value, &random);
+                }
+            }
+        }
+        page_num = *leaf_node_next_leaf(node);
+        if (page_num == 0) {
+            break;
+        }
+    }
+
+    stats->num_columns = num_columns;
+    for (uint32_t i = 0; i < num_columns && valid; i++) {
+        finish_column(&scans[i], stats->rows, &stats->columns[i]);
+    }
+    // Keys are unique, so the key column's count is exact
+    stats->columns[0].distinct = stats->rows;
+    stats->analyzed = valid;
+    for (uint32_t i = 0; scans && i < num_columns; i++) {
+        free(scans[i].sample);
+    }
+    free(scans);
+    return valid;
+}
+
+static uint64_t count_leaves(Pager* pager, page_num_t page_num) {
+    uint64_t count = 0;
+    while (page_num != 0) {
+        pager_begin_op(pager);
+        count++;
+        page_num = *leaf_node_next_leaf(pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN));
+    }
+    return count;
+}
+
+void analyze_index(const SecondaryIndex* index, IndexStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    BTree* btree = index->btree;
+    Pager* pager = btree->pager;
+    page_num_t page_num = measure_tree(btree, &stats->shape);
+    uint32_t entry_height = 0;
+    while (page_num != 0) {
+        pager_begin_op(pager);
+        uint32_t num_cells = *leaf_node_num_cells(pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN));
+        stats->shape.leaf_pages++;
+        stats->images += num_cells;
+        for (uint32_t i = 0; i < num_cells; i++) {
+            // Measuring an entry tree may evict the leaf, so it is read again
+            void* node = pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN);
+            page_num_t root = index_cell_tree(leaf_node_value(node, i));
+            if (root == 0) {
+                continue;
+            }
+            BTree tree = *btree;
+            tree.root_page_num = root;
+            TreeShape shape;
+            shape.leaf_pages = count_leaves(pager, measure_tree(&tree, &shape));
+            entry_height = shape.height > entry_height ? shape.height : entry_height;
+            stats->shape.leaf_pages += shape.leaf_pages;
+            stats->shape.internal_pages += shape.internal_pages;
+        }
+        page_num = *leaf_node_next_leaf(pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN));
+    }
+    stats->shape.height += entry_height;
+    stats->analyzed = true;
+}
+
+double estimate_equal_rows(const TableStats* stats, uint32_t column) {
+    const ColumnStats* column_stats = &stats->columns[column];
+    if (column_stats->distinct == 0) {
+        return 0;
+    }
+    return (double)(stats->rows - column_stats->nulls) / (double)column_stats->distinct;
+}
+
+// Fraction of the column's values below `value`, interpolated within the
+// bucket it falls in
+static double fraction_below(const ColumnStats* stats, int64_t value) {
+    const int64_t* bounds = stats->bounds;
+    if (value <= bounds[0]) {
+        return 0;
+    }
+    if (value > bounds[ANALYZE_HISTOGRAM_BUCKETS]) {
+        return 1;
+    }
+    uint32_t bucket = 0;
+    while (bucket + 1 < ANALYZE_HISTOGRAM_BUCKETS && value > bounds[bucket + 1]) {
+        bucket++;
+    }
+    double width = (double)bounds[bucket + 1] - (double)bounds[bucket];
+    double within = width > 0 ? ((double)value - (double)bounds[bucket]) / width : 1;
+    return (bucket + within) / ANALYZE_HISTOGRAM_BUCKETS;
+}
+
+double estimate_range_rows(const TableStats* stats, uint32_t column, const int64_t* lower, const int64_t* upper) {
+    const ColumnStats* column_stats = &stats->columns[column];
+    double values = (double)(stats->rows - column_stats->nulls);
+    if (column_stats->num_bounds == 0 || values == 0) {
+        return values;
+    }
+    const int64_t* bounds = column_stats->bounds;
+    if ((lower && *lower > bounds[ANALYZE_HISTOGRAM_BUCKETS]) || (upper && *upper < bounds[0]) ||
+        (lower && upper && *lower > *upper)) {
+        return 0;
+    }
+    double low = lower ? fraction_below(column_stats, *lower) : 0;
+    double high = upper ? fraction_below(column_stats, *upper) : 1;
+    // A range that meets the values holds at least those of one value
+    double rows = (high - low) * values;
+    double equal = estimate_equal_rows(stats, column);
+    return rows > equal ? rows : equal;
+}
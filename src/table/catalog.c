@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "catalog.h"
+#include "vm.h"
+
+// Catalog rows: (kind, name, root page, definition). A table's definition
+// is its "name TYPE" column pairs separated by commas; an index's is its
+// table's name, a space, and its column names separated by commas.
+// Statistics rows name their table or index, have CATALOG_STATS_SHAPE or a
+// column number in place of the root page, and a definition of int64s: for a
+// shape the row or image count, height, leaf pages and interior pages; for a
+// column its distinct values, NULLs, histogram bound count and bounds.
+enum { CATALOG_KIND, CATALOG_NAME, CATALOG_ROOT, CATALOG_COLUMNS, CATALOG_NUM_FIELDS };
+#define CATALOG_KIND_TABLE 0
+#define CATALOG_KIND_INDEX 1
+#define CATALOG_KIND_STATS 2
+#define CATALOG_STATS_SHAPE (-1)
+#define CATALOG_SHAPE_VALUES 4
+#define CATALOG_COLUMN_VALUES 3
+#define CATALOG_MAX_DEFINITION 192
+#define CATALOG_MAX_ROW_SIZE 256
+
+static RowSchema catalog_schema;
+
+static void init_catalog_schema(void) {
+    ColumnType types[CATALOG_NUM_FIELDS] = { COLUMN_INT, COLUMN_TEXT, COLUMN_INT, COLUMN_TEXT };
+    row_schema_init(&catalog_schema, types, CATALOG_NUM_FIELDS);
+}
+
+static char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool names_equal(const char* name, const char* other, uint32_t other_length) {
+    if (strlen(name) != other_length) {
+        return false;
+    }
+    for (uint32_t i = 0; i < other_length; i++) {
+        if (lower(name[i]) != lower(other[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const char* column_type_name(ColumnType type) {
+    return type == COLUMN_INT ? "INT" : "TEXT";
+}
+
+static void add_table(Catalog* catalog, Table* table) {
+    if (catalog->num_tables == catalog->tables_capacity) {
+        uint32_t capacity = catalog->tables_capacity ? catalog->tables_capacity * 2 : 8;
+        Table** tables = realloc(catalog->tables, capacity * sizeof(Table*));
+        if (!tables) {
+            printf("ERROR: Out of memory loading catalog\n");
+            exit(EXIT_FAILURE);
+        }
+        catalog->tables = tables;
+        catalog->tables_capacity = capacity;
+    }
+    catalog->tables[catalog->num_tables++] = table;
+}
+
+static bool copy_name(char* destination, const char* name, uint32_t length) {
+    if (length == 0 || length >= CATALOG_MAX_NAME) {
+        return false;
+    }
+    memcpy(destination, name, length);
+    destination[length] = '\0';
+    return true;
+}
+
+// Fills in a table's columns from its definition text
+static bool parse_columns(Table* table, const char* text, uint32_t length) {
+    const char* end = text + length;
+    table->num_columns = 0;
+    while (text < end) {
+        const char* space = memchr(text, ' ', end - text);
+        const char* comma = memchr(text, ',', end - text);
+        if (!comma) {
+            comma = end;
+        }
+        if (!space || space > comma || table->num_columns == CATALOG_MAX_COLUMNS) {
+            return false;
+        }
+        uint32_t column = table->num_columns++;
+        if (!copy_name(table->column_names[column], text, space - text)) {
+            return false;
+        }
+        uint32_t type_length = comma - space - 1;
+        if (type_length == 3 && memcmp(space + 1, "INT", 3) == 0) {
+            table->column_types[column] = COLUMN_INT;
+        } else if (type_length == 4 && memcmp(space + 1, "TEXT", 4) == 0) {
+            table->column_types[column] = COLUMN_TEXT;
+        } else {
+            return false;
+        }
+        text = comma + 1;
+    }
+    return table->num_columns > 0 && table->column_types[0] == COLUMN_INT &&
+           row_schema_init(&table->schema, table->column_types + 1, table->num_columns - 1);
+}
+
+static void add_index(Table* table, Index* index) {
+    Index** indexes = realloc(table->indexes, (table->num_indexes + 1) * sizeof(Index*));
+    if (!indexes) {
+        printf("ERROR: Out of memory loading catalog\n");
+        exit(EXIT_FAILURE);
+    }
+    table->indexes = indexes;
+    table->indexes[table->num_indexes++] = index;
+}
+
+// Sets up an index's payload from the table columns it holds
+static bool init_index(Index* index, Table* table, const uint32_t* columns, uint32_t num_columns) {
+    ColumnType types[ROW_MAX_COLUMNS];
+    if (num_columns == 0 || num_columns > ROW_MAX_COLUMNS) {
+        return false;
+    }
+    for (uint32_t i = 0; i < num_columns; i++) {
+        index->index.columns[i] = columns[i];
+        types[i] = table->column_types[columns[i]];
+    }
+    index->index.num_columns = num_columns;
+    index->table = table;
+    return row_schema_init(&index->index.schema, types, num_columns);
+}
+
+static bool load_index(Catalog* catalog, uint32_t id, const Value* name, page_num_t root, const Value* definition) {
+    const char* text = definition->text;
+    const char* end = text + definition->length;
+    const char* space = memchr(text, ' ', definition->length);
+    Table* table = space ? catalog_find_table(catalog, text, space - text) : NULL;
+    if (!table) {
+        return false;
+    }
+    uint32_t columns[ROW_MAX_COLUMNS];
+    uint32_t num_columns = 0;
+    for (text = space + 1; text < end && num_columns < ROW_MAX_COLUMNS;) {
+        const char* comma = memchr(text, ',', end - text);
+        if (!comma) {
+            comma = end;
+        }
+        int32_t column = table_find_column(table, text, comma - text);
+        if (column <= 0) {
+            return false;
+        }
+        columns[num_columns++] = (uint32_t)column;
+        text = comma + 1;
+    }
+
+    Index* index = calloc(1, sizeof(Index));
+    if (!index) {
+        return false;
+    }
+    index->id = id;
+    if (!copy_name(index->name, name->text, name->length) || !init_index(index, table, columns, num_columns)) {
+        free(index);
+        return false;
+    }
+    index->index.btree = btree_open_at(catalog->pager, root);
+    add_index(table, index);
+    return true;
+}
+
+static void set_shape(TreeShape* shape, const int64_t* values) {
+    shape->height = (uint32_t)values[1];
+    shape->leaf_pages = (uint64_t)values[2];
+    shape->internal_pages = (uint64_t)values[3];
+}
+
+static bool load_stats(Catalog* catalog, uint32_t id, const Value* name, int64_t target, const Value* definition) {
+    int64_t values[CATALOG_COLUMN_VALUES + ANALYZE_HISTOGRAM_BUCKETS + 1];
+    uint32_t count = definition->length / sizeof(int64_t);
+    if (definition->length % sizeof(int64_t) != 0 || count > sizeof(values) / sizeof(values[0])) {
+        return false;
+    }
+    memcpy(values, definition->text, definition->length);
+    Table* table = catalog_find_table(catalog, name->text, name->length);
+    Index* index = table ? NULL : catalog_find_index(catalog, name->text, name->length);
+    if (target == CATALOG_STATS_SHAPE && count == CATALOG_SHAPE_VALUES && table) {
+        table->stats.analyzed = true;
+        table->stats.rows = (uint64_t)values[0];
+        table->stats.num_columns = table->num_columns;
+        set_shape(&table->stats.shape, values);
+        table->stats_ids[0] = id;
+        return true;
+    }
+    if (target == CATALOG_STATS_SHAPE && count == CATALOG_SHAPE_VALUES && index) {
+        index->stats.analyzed = true;
+        index->stats.images = (uint64_t)values[0];
+        set_shape(&index->stats.shape, values);
+        index->stats_id = id;
+        return true;
+    }
+    if (!table || target < 0 || target >= table->num_columns || count < CATALOG_COLUMN_VALUES ||
+        count != CATALOG_COLUMN_VALUES + (uint64_t)values[2]) {
+        return false;
+    }
+    ColumnStats* stats = &table->stats.columns[target];
+    stats->distinct = (uint64_t)values[0];
+    stats->nulls = (uint64_t)values[1];
+    stats->num_bounds = (uint32_t)values[2];
+    memcpy(stats->bounds, values + CATALOG_COLUMN_VALUES, stats->num_bounds * sizeof(int64_t));
+    table->stats_ids[1 + target] = id;
+    return true;
+}
+
+static bool load_table(Catalog* catalog, uint32_t id, const uint8_t* row, uint32_t row_size) {
+    Value kind, name, root, columns;
+    if (!row_column(&catalog_schema, row, row_size, CATALOG_KIND, &kind) ||
+        !row_column(&catalog_schema, row, row_size, CATALOG_NAME, &name) ||
+        !row_column(&catalog_schema, row, row_size, CATALOG_ROOT, &root) ||
+        !row_column(&catalog_schema, row, row_size, CATALOG_COLUMNS, &columns) || kind.type != VALUE_INT ||
+        name.type != VALUE_TEXT || root.type != VALUE_INT || columns.type != VALUE_TEXT) {
+        return false;
+    }
+    if (kind.integer == CATALOG_KIND_INDEX) {
+        return load_index(catalog, id, &name, (page_num_t)root.integer, &columns);
+    }
+    if (kind.integer == CATALOG_KIND_STATS) {
+        return load_stats(catalog, id, &name, root.integer, &columns);
+    }
+    if (kind.integer != CATALOG_KIND_TABLE) {
+        return true;  // Written by a newer version; skip rather than fail
+    }
+
+    Table* table = calloc(1, sizeof(Table));
+    if (!table) {
+        return false;
+    }
+    table->id = id;
+    if (!copy_name(table->name, name.text, name.length) || !parse_columns(table, columns.text, columns.length)) {
+        free(table);
+        return false;
+    }
+    table->btree = btree_open_at(catalog->pager, (page_num_t)root.integer);
+    add_table(catalog, table);
+    return true;
+}
+
+Catalog* catalog_open(Pager* pager) {
+    init_catalog_schema();
+    Catalog* catalog = calloc(1, sizeof(Catalog));
+    if (!catalog) {
+        return NULL;
+    }
+    catalog->pager = pager;
+    catalog->btree = btree_open(pager);
+    catalog->next_id = 1;
+
+    BTreeCursor* cursor = btree_start(catalog->btree);
+    while (!cursor->end_of_table) {
+        uint8_t row[CATALOG_MAX_ROW_SIZE];
+        uint32_t row_size;
+        btree_cursor_get_value(cursor, row, sizeof(row), &row_size);
+        void* node = pager_get_page(pager, cursor->page_num);
+        uint32_t id = *leaf_node_key(node, cursor->cell_num);
+        catalog->next_id = id + 1;
+        if (row_size > sizeof(row) || !load_table(catalog, id, row, row_size)) {
+            printf("ERROR: Corrupt catalog entry %u\n", id);
+            free(cursor);
+            catalog_close(catalog);
+            return NULL;
+        }
+        btree_cursor_advance(cursor);
+    }
+    free(cursor);
+    return catalog;
+}
+
+void catalog_close(Catalog* catalog) {
+    for (uint32_t i = 0; i < catalog->num_tables; i++) {
+        Table* table = catalog->tables[i];
+        for (uint32_t j = 0; j < table->num_indexes; j++) {
+            btree_close(table->indexes[j]->index.btree);
+            free(table->indexes[j]);
+        }
+        free(table->indexes);
+        btree_close(table->btree);
+        free(table);
+    }
+    free(catalog->tables);
+    btree_close(catalog->btree);
+    free(catalog);
+}
+
+Table* catalog_find_table(Catalog* catalog, const char* name, uint32_t length) {
+    for (uint32_t i = 0; i < catalog->num_tables; i++) {
+        if (names_equal(catalog->tables[i]->name, name, length)) {
+            return catalog->tables[i];
+        }
+    }
+    return NULL;
+}
+
+Index* catalog_find_index(Catalog* catalog, const char* name, uint32_t length) {
+    for (uint32_t i = 0; i < catalog->num_tables; i++) {
+        Table* table = catalog->tables[i];
+        for (uint32_t j = 0; j < table->num_indexes; j++) {
+            if (names_equal(table->indexes[j]->name, name, length)) {
+                return table->indexes[j];
+            }
+        }
+    }
+    return NULL;
+}
+
+Index* table_find_index(const Table* table, uint32_t column) {
+    for (uint32_t i = 0; i < table->num_indexes; i++) {
+        if (table->indexes[i]->index.columns[0] == column) {
+            return table->indexes[i];
+        }
+    }
+    return NULL;
+}
+
+int32_t table_find_column(const Table* table, const char* name, uint32_t length) {
+    for (uint32_t i = 0; i < table->num_columns; i++) {
+        if (names_equal(table->column_names[i], name, length)) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+// Encodes a catalog row into `row`, CATALOG_MAX_ROW_SIZE bytes. Returns its
+// size, or 0 if it does not fit.
+static uint32_t encode_entry(uint32_t kind, const char* name, int64_t root, const char* definition,
+                             uint32_t definition_length, uint8_t* row) {
+    Value fields[CATALOG_NUM_FIELDS];
+    memset(fields, 0, sizeof(fields));
+    fields[CATALOG_KIND].type = VALUE_INT;
+    fields[CATALOG_KIND].integer = kind;
+    fields[CATALOG_NAME].type = VALUE_TEXT;
+    fields[CATALOG_NAME].text = name;
+    fields[CATALOG_NAME].length = strlen(name);
+    fields[CATALOG_ROOT].type = VALUE_INT;
+    fields[CATALOG_ROOT].integer = root;
+    fields[CATALOG_COLUMNS].type = VALUE_TEXT;
+    fields[CATALOG_COLUMNS].text = definition;
+    fields[CATALOG_COLUMNS].length = definition_length;
+    return row_encode(&catalog_schema, fields, CATALOG_NUM_FIELDS, row, CATALOG_MAX_ROW_SIZE);
+}
+
+// Writes a catalog row
+static bool record(Catalog* catalog, uint32_t kind, uint32_t id, const char* name, page_num_t root,
+                   const char* definition, uint32_t definition_length) {
+    uint8_t row[CATALOG_MAX_ROW_SIZE];
+    uint32_t row_size = encode_entry(kind, name, root, definition, definition_length, row);
+    return row_size > 0 && btree_insert(catalog->btree, id, row, row_size) == 0;
+}
+
+Table* catalog_create_table(Catalog* catalog, const char* name, uint32_t name_length, const char** column_names,
+                            const uint32_t* column_name_lengths, const ColumnType* column_types,
+                            uint32_t num_columns, char* error, uint32_t error_size) {
+    if (catalog_find_table(catalog, name, name_length) || catalog_find_index(catalog, name, name_length)) {
+        snprintf(error, error_size, "%.*s already exists", (int)name_length, name);
+        return NULL;
+    }
+    if (num_columns == 0 || num_columns > CATALOG_MAX_COLUMNS || column_types[0] != COLUMN_INT) {
+        snprintf(error, error_size, "A table needs an INT key column and at most %d others", ROW_MAX_COLUMNS);
+        return NULL;
+    }
+
+    Table* table = calloc(1, sizeof(Table));
+    if (!table) {
+        snprintf(error, error_size, "Out of memory");
+        return NULL;
+    }
+    char definition[CATALOG_MAX_DEFINITION];
+    uint32_t definition_length = 0;
+    bool valid = copy_name(table->name, name, name_length);
+    for (uint32_t i = 0; i < num_columns && valid; i++) {
+        valid = copy_name(table->column_names[i], column_names[i], column_name_lengths[i]);
+        for (uint32_t j = 0; j < i && valid; j++) {
+            valid = !names_equal(table->column_names[j], column_names[i], column_name_lengths[i]);
+        }
+        table->column_types[i] = column_types[i];
+        int written = snprintf(definition + definition_length, sizeof(definition) - definition_length, "%s%s %s",
+                               i ? "," : "", table->column_names[i], column_type_name(column_types[i]));
+        valid = valid && written > 0 && (uint32_t)written < sizeof(definition) - definition_length;
+        definition_length += valid ? (uint32_t)written : 0;
+    }
+    table->num_columns = num_columns;
+    if (!valid) {
+        snprintf(error, error_size, "Invalid or duplicate names, or definition longer than %d bytes",
+                 CATALOG_MAX_DEFINITION);
+        free(table);
+        return NULL;
+    }
+    row_schema_init(&table->schema, table->column_types + 1, num_columns - 1);
+
+    table->id = catalog->next_id++;
+    table->btree = btree_create(catalog->pager);
+
+    if (!record(catalog, CATALOG_KIND_TABLE, table->id, table->name, table->btree->root_page_num, definition,
+                definition_length)) {
+        snprintf(error, error_size, "Could not record table %s", table->name);
+        btree_close(table->btree);
+        free(table);
+        return NULL;
+    }
+    add_table(catalog, table);
+    return table;
+}
+
+// Adds an index entry for every row already in the table. Rows are copied
+// out of their page first: inserting into the index moves on to other pages.
+static bool fill_index(Index* index, char* error, uint32_t error_size) {
+    Table* table = index->table;
+    bool filled = true;
+    BTreeCursor* cursor = btree_start(table->btree);
+    while (!cursor->end_of_table && filled) {
+        uint8_t row[VM_MAX_RECORD_SIZE];
+        uint32_t row_size;
+        btree_cursor_get_value(cursor, row, sizeof(row), &row_size);
+        void* node = pager_get_page(table->btree->pager, cursor->page_num);
+        uint32_t key = *leaf_node_key(node, cursor->cell_num);
+        Value values[CATALOG_MAX_COLUMNS];
+        memset(values, 0, sizeof(values));
+        values[0].type = VALUE_INT;
+        values[0].integer = key;
+        for (uint32_t i = 0; i < index->index.num_columns && filled; i++) {
+            uint32_t column = index->index.columns[i];
+            filled = row_size <= sizeof(row) && row_column(&table->schema, row, row_size, column - 1, &values[column]);
+        }
+        if (!filled || index_insert(&index->index, key, values) != 0) {
+            snprintf(error, error_size, "Could not index row %u of %s", key, table->name);
+            filled = false;
+        }
+        btree_cursor_advance(cursor);
+    }
+    free(cursor);
+    return filled;
+}
+
+Index* catalog_create_index(Catalog* catalog, const char* name, uint32_t name_length, Table* table,
+                            const char** column_names, const uint32_t* column_name_lengths, uint32_t num_columns,
+                            char* error, uint32_t error_size) {
+    if (catalog_find_table(catalog, name, name_length) || catalog_find_index(catalog, name, name_length)) {
+        snprintf(error, error_size, "%.*s already exists", (int)name_length, name);
+        return NULL;
+    }
+    if (num_columns == 0 || num_columns > ROW_MAX_COLUMNS) {
+        snprintf(error, error_size, "An index holds 1 to %u columns", ROW_MAX_COLUMNS);
+        return NULL;
+    }
+    uint32_t columns[ROW_MAX_COLUMNS];
+    char definition[CATALOG_MAX_DEFINITION];
+    int definition_length = snprintf(definition, sizeof(definition), "%s", table->name);
+    for (uint32_t i = 0; i < num_columns; i++) {
+        int32_t column = table_find_column(table, column_names[i], column_name_lengths[i]);
+        if (column < 0) {
+            snprintf(error, error_size, "No column %.*s in %s", (int)column_name_lengths[i], column_names[i],
+                     table->name);
+            return NULL;
+        }
+        // The key is in every entry already
+        if (column == 0) {
+            snprintf(error, error_size, "%s is the key of %s and needs no index", table->column_names[0],
+                     table->name);
+            return NULL;
+        }
+        for (uint32_t j = 0; j < i; j++) {
+            if (columns[j] == (uint32_t)column) {
+                snprintf(error, error_size, "Column %s is in the index twice", table->column_names[column]);
+                return NULL;
+            }
+        }
+        columns[i] = (uint32_t)column;
+        definition_length += snprintf(definition + definition_length, sizeof(definition) - definition_length,
+                                      "%c%s", i == 0 ? ' ' : ',', table->column_names[column]);
+        if (definition_length >= (int)sizeof(definition)) {
+            snprintf(error, error_size, "Index definition too long");
+            return NULL;
+        }
+    }
+
+    Index* index = calloc(1, sizeof(Index));
+    if (!index) {
+        snprintf(error, error_size, "Out of memory");
+        return NULL;
+    }
+    if (!copy_name(index->name, name, name_length) || !init_index(index, table, columns, num_columns)) {
+        snprintf(error, error_size, "Invalid index name");
+        free(index);
+        return NULL;
+    }
+
+    index->id = catalog->next_id++;
+    index->index.btree = btree_create(catalog->pager);
+    bool created = fill_index(index, error, error_size);
+    if (created && !record(catalog, CATALOG_KIND_INDEX, index->id, index->name, index->index.btree->root_page_num,
+                           definition, (uint32_t)definition_length)) {
+        snprintf(error, error_size, "Could not record index %s", index->name);
+        created = false;
+    }
+    if (!created) {
+        btree_close(index->index.btree);
+        free(index);
+        return NULL;
+    }
+    add_index(table, index);
+    return index;
+}
+
+// Writes a statistics row under `*id`, taking a new key the first time
+static bool record_stats(Catalog* catalog, uint32_t* id, const char* name, int64_t target, const int64_t* values,
+                         uint32_t count) {
+    uint8_t row[CATALOG_MAX_ROW_SIZE];
+    uint32_t row_size = encode_entry(CATALOG_KIND_STATS, name, target, (const char*)values,
+                                     count * (uint32_t)sizeof(int64_t), row);
+    if (row_size == 0) {
+        return false;
+    }
+    if (*id != 0) {
+        return btree_update(catalog->btree, *id, row, row_size) == 0;
+    }
+    *id = catalog->next_id++;
+    return btree_insert(catalog->btree, *id, row, row_size) == 0;
+}
+
+static bool record_shape(Catalog* catalog, uint32_t* id, const char* name, uint64_t count, const TreeShape* shape) {
+    int64_t values[CATALOG_SHAPE_VALUES] = { (int64_t)count, shape->height, (int64_t)shape->leaf_pages,
+                                             (int64_t)shape->internal_pages };
+    return record_stats(catalog, id, name, CATALOG_STATS_SHAPE, values, CATALOG_SHAPE_VALUES);
+}
+
+static bool analyze(Catalog* catalog, Table* table, char* error, uint32_t error_size) {
+    if (!analyze_table(table->btree, &table->schema, &table->stats)) {
+        snprintf(error, error_size, "Could not analyze %s: a row is corrupt or memory ran out", table->name);
+        return false;
+    }
+    bool recorded = record_shape(catalog, &table->stats_ids[0], table->name, table->stats.rows, &table->stats.shape);
+    for (uint32_t i = 0; i < table->num_columns && recorded; i++) {
+        const ColumnStats* stats = &table->stats.columns[i];
+        int64_t values[CATALOG_COLUMN_VALUES + ANALYZE_HISTOGRAM_BUCKETS + 1] = {
+            (int64_t)stats->distinct, (int64_t)stats->nulls, stats->num_bounds
+        };
+        memcpy(values + CATALOG_COLUMN_VALUES, stats->bounds, stats->num_bounds * sizeof(int64_t));
+        recorded = record_stats(catalog, &table->stats_ids[1 + i], table->name, i, values,
+                                CATALOG_COLUMN_VALUES + stats->num_bounds);
+    }
+    for (uint32_t i = 0; i < table->num_indexes && recorded; i++) {
+        Index* index = table->indexes[i];
+        analyze_index(&index->index, &index->stats);
+        recorded = record_shape(catalog, &index->stats_id, index->name, index->stats.images, &index->stats.shape);
+    }
+    if (!recorded) {
+        snprintf(error, error_size, "Could not record the statistics of %s", table->name);
+    }
+    return recorded;
+}
+
+bool catalog_analyze(Catalog* catalog, Table* table, char* error, uint32_t error_size) {
+    if (table) {
+        return analyze(catalog, table, error, error_size);
+    }
+    for (uint32_t i = 0; i < catalog->num_tables; i++) {
+        if (!analyze(catalog, catalog->tables[i], error, error_size)) {
+            return false;
+        }
+    }
+    return true;
+}
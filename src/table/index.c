@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "index.h"
+
+// Cell values: a kind byte, then either the inline entries or the root page
+// of the cell's entry B-tree. An inline entry is the uint32 primary key, the
+// uint16 payload size and the payload.
+#define INDEX_CELL_INLINE 0
+#define INDEX_CELL_TREE 1
+#define INDEX_ENTRY_HEADER_SIZE (sizeof(uint32_t) + sizeof(uint16_t))
+#define INDEX_MAX_CELL (1 + INDEX_MAX_INLINE)
+
+struct IndexCursor {
+    const SecondaryIndex* index;
+    BTreeCursor* cells;           // Cell of the current image
+    uint32_t upper;
+    bool on_entry;
+    uint32_t offset;              // Inline cells: the current entry's offset in the cell
+    BTree entry_tree;             // Tree cells: the index's B-tree rooted at the cell's tree
+    BTreeCursor* entries;         // Tree cells: the current entry, NULL for inline cells
+};
+
+uint32_t index_image(const Value* value) {
+    if (value->type == VALUE_INT) {
+        if (value->integer < INT32_MIN) {
+            return 0;
+        }
+        if (value->integer > INT32_MAX) {
+            return UINT32_MAX;
+        }
+        return (uint32_t)(value->integer - INT32_MIN);
+    }
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (uint32_t i = 0; i < value->length; i++) {
+        hash ^= (uint8_t)value->text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t entry_key(const uint8_t* entry) {
+    uint32_t key;
+    memcpy(&key, entry, sizeof(key));
+    return key;
+}
+
+static uint32_t entry_size(const uint8_t* entry) {
+    uint16_t size;
+    memcpy(&size, entry + sizeof(uint32_t), sizeof(size));
+    return INDEX_ENTRY_HEADER_SIZE + size;
+}
+
+static uint32_t write_entry(uint8_t* destination, uint32_t key, const uint8_t* payload, uint32_t size) {
+    uint16_t payload_size = (uint16_t)size;
+    memcpy(destination, &key, sizeof(key));
+    memcpy(destination + sizeof(uint32_t), &payload_size, sizeof(payload_size));
+    memcpy(destination + INDEX_ENTRY_HEADER_SIZE, payload, size);
+    return INDEX_ENTRY_HEADER_SIZE + size;
+}
+
+// The index's B-tree handle, rooted at an entry tree: entry trees share the
+// index's split counters
+static BTree entry_tree(const SecondaryIndex* index, page_num_t root) {
+    BTree tree = *index->btree;
+    tree.root_page_num = root;
+    return tree;
+}
+
+// Moves a cell's inline entries into a new entry tree. Returns the new
+// cell value's size.
+static uint32_t make_tree_cell(const SecondaryIndex* index, const uint8_t* entries, uint32_t entries_size,
+                               uint8_t* cell) {
+    BTree* created = btree_create(index->btree->pager);
+    page_num_t root = created->root_page_num;
+    btree_close(created);
+    BTree tree = entry_tree(index, root);
+    for (uint32_t offset = 0; offset < entries_size; offset += entry_size(entries + offset)) {
+        const uint8_t* entry = entries + offset;
+        btree_insert(&tree, entry_key(entry), (void*)(entry + INDEX_ENTRY_HEADER_SIZE),
+                     entry_size(entry) - INDEX_ENTRY_HEADER_SIZE);
+    }
+    cell[0] = INDEX_CELL_TREE;
+    memcpy(cell + 1, &root, sizeof(root));
+    return 1 + sizeof(root);
+}
+
+int index_insert(const SecondaryIndex* index, uint32_t key, const Value* values) {
+    if (values[index->columns[0]].type == VALUE_NULL) {
+        return 0;
+    }
+    Value payload_values[ROW_MAX_COLUMNS];
+    for (uint32_t i = 0; i < index->num_columns; i++) {
+        payload_values[i] = values[index->columns[i]];
+    }
+    uint8_t payload[INDEX_MAX_PAYLOAD];
+    uint32_t payload_size = row_encode(&index->schema, payload_values, index->num_columns, payload, sizeof(payload));
+    if (payload_size == 0) {
+        return -1;
+    }
+    // The new entry on its own, in the inline format
+    uint8_t entry[INDEX_ENTRY_HEADER_SIZE + INDEX_MAX_PAYLOAD];
+    uint32_t new_entry_size = write_entry(entry, key, payload, payload_size);
+
+    BTree* btree = index->btree;
+    uint32_t image = index_image(&values[index->columns[0]]);
+    pager_begin_op(btree->pager);
+    BTreeCursor* cursor = btree_find(btree, image);
+    void* node = pager_get_page(btree->pager, cursor->page_num);
+    bool exists = cursor->cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, cursor->cell_num) == image;
+    uint8_t cell[INDEX_MAX_CELL];
+    uint32_t cell_size = 0;
+    if (exists) {
+        cell_size = *leaf_node_value_size(node, cursor->cell_num);
+        memcpy(cell, leaf_node_value(node, cursor->cell_num), cell_size < sizeof(cell) ? cell_size : sizeof(cell));
+    }
+    free(cursor);
+
+    if (!exists) {
+        uint8_t new_cell[INDEX_MAX_CELL];
+        uint32_t new_cell_size;
+        if (1 + new_entry_size <= INDEX_MAX_CELL) {
+            new_cell[0] = INDEX_CELL_INLINE;
+            memcpy(new_cell + 1, entry, new_entry_size);
+            new_cell_size = 1 + new_entry_size;
+        } else {
+            new_cell_size = make_tree_cell(index, entry, new_entry_size, new_cell);
+        }
+        return btree_insert(btree, image, new_cell, new_cell_size);
+    }
+
+    if (cell[0] == INDEX_CELL_TREE) {
+        page_num_t root;
+        memcpy(&root, cell + 1, sizeof(root));
+        BTree tree = entry_tree(index, root);
+        return btree_insert(&tree, key, payload, payload_size);
+    }
+
+    // Inline: splice the entry in at its key's position
+    uint32_t position = 1;
+    while (position < cell_size && entry_key(cell + position) < key) {
+        position += entry_size(cell + position);
+    }
+    if (position < cell_size && entry_key(cell + position) == key) {
+        return -1;
+    }
+    uint8_t entries[INDEX_MAX_INLINE + INDEX_ENTRY_HEADER_SIZE + INDEX_MAX_PAYLOAD];
+    memcpy(entries, cell + 1, position - 1);
+    memcpy(entries + position - 1, entry, new_entry_size);
+    memcpy(entries + position - 1 + new_entry_size, cell + position, cell_size - position);
+    uint32_t entries_size = cell_size - 1 + new_entry_size;
+
+    uint8_t new_cell[INDEX_MAX_CELL];
+    uint32_t new_cell_size;
+    if (1 + entries_size <= INDEX_MAX_CELL) {
+        new_cell[0] = INDEX_CELL_INLINE;
+        memcpy(new_cell + 1, entries, entries_size);
+        new_cell_size = 1 + entries_size;
+    } else {
+        new_cell_size = make_tree_cell(index, entries, entries_size, new_cell);
+    }
+    return btree_update(btree, image, new_cell, new_cell_size);
+}
+
+IndexCursor* index_cursor_new(const SecondaryIndex* index) {
+    IndexCursor* cursor = calloc(1, sizeof(IndexCursor));
+    if (cursor) {
+        cursor->index = index;
+    }
+    return cursor;
+}
+
+static void release(IndexCursor* cursor) {
+    free(cursor->cells);
+    free(cursor->entries);
+    cursor->cells = NULL;
+    cursor->entries = NULL;
+    cursor->on_entry = false;
+}
+
+void index_cursor_free(IndexCursor* cursor) {
+    release(cursor);
+    free(cursor);
+}
+
+static const uint8_t* current_cell(IndexCursor* cursor, uint32_t* size) {
+    void* node = pager_get_page(cursor->index->btree->pager, cursor->cells->page_num);
+    *size = *leaf_node_value_size(node, cursor->cells->cell_num);
+    return leaf_node_value(node, cursor->cells->cell_num);
+}
+
+// Settles on the first entry of the cell at or after the cells cursor, if
+// its image is in range
+static bool enter_cell(IndexCursor* cursor) {
+    BTreeCursor* cells = cursor->cells;
+    free(cursor->entries);
+    cursor->entries = NULL;
+    cursor->on_entry = false;
+    if (cells->end_of_table) {
+        return false;
+    }
+    Pager* pager = cursor->index->btree->pager;
+    void* node = pager_get_page(pager, cells->page_num);
+    while (cells->cell_num >= *leaf_node_num_cells(node)) {
+        page_num_t next = *leaf_node_next_leaf(node);
+        if (next == 0) {
+            cells->end_of_table = true;
+            return false;
+        }
+        cells->page_num = next;
+        cells->cell_num = 0;
+        node = pager_get_page_hinted(pager, next, PAGE_HINT_SCAN);
+    }
+    if (*leaf_node_key(node, cells->cell_num) > cursor->upper) {
+        return false;
+    }
+
+    const uint8_t* cell = leaf_node_value(node, cells->cell_num);
+    if (cell[0] == INDEX_CELL_TREE) {
+        page_num_t root;
+        memcpy(&root, cell + 1, sizeof(root));
+        cursor->entry_tree = entry_tree(cursor->index, root);
+        cursor->entries = btree_start(&cursor->entry_tree);
+    } else {
+        cursor->offset = 1;
+    }
+    cursor->on_entry = true;
+    return true;
+}
+
+bool index_cursor_seek(IndexCursor* cursor, uint32_t lower, uint32_t upper) {
+    release(cursor);
+    if (lower > upper) {
+        return false;
+    }
+    cursor->upper = upper;
+    pager_begin_op(cursor->index->btree->pager);
+    cursor->cells = btree_find(cursor->index->btree, lower);
+    return enter_cell(cursor);
+}
+
+bool index_cursor_next(IndexCursor* cursor) {
+    if (!cursor->on_entry) {
+        return false;
+    }
+    if (cursor->entries) {
+        btree_cursor_advance(cursor->entries);
+        if (!cursor->entries->end_of_table) {
+            return true;
+        }
+    } else {
+        uint32_t size;
+        const uint8_t* cell = current_cell(cursor, &size);
+        cursor->offset += entry_size(cell + cursor->offset);
+        if (cursor->offset < size) {
+            return true;
+        }
+    }
+    btree_cursor_advance(cursor->cells);
+    return enter_cell(cursor);
+}
+
+uint32_t index_cursor_key(IndexCursor* cursor) {
+    if (cursor->entries) {
+        void* node = pager_get_page(cursor->index->btree->pager, cursor->entries->page_num);
+        return *leaf_node_key(node, cursor->entries->cell_num);
+    }
+    uint32_t size;
+    return entry_key(current_cell(cursor, &size) + cursor->offset);
+}
+
+const uint8_t* index_cursor_payload(IndexCursor* cursor, uint32_t* size) {
+    if (cursor->entries) {
+        void* node = pager_get_page(cursor->index->btree->pager, cursor->entries->page_num);
+        *size = *leaf_node_value_size(node, cursor->entries->cell_num);
+        return leaf_node_value(node, cursor->entries->cell_num);
+    }
+    uint32_t cell_size;
+    const uint8_t* entry = current_cell(cursor, &cell_size) + cursor->offset;
+    *size = entry_size(entry) - INDEX_ENTRY_HEADER_SIZE;
+    return entry + INDEX_ENTRY_HEADER_SIZE;
+}
+
+page_num_t index_cell_tree(const uint8_t* cell) {
+    page_num_t root = 0;
+    if (cell[0] == INDEX_CELL_TREE) {
+        memcpy(&root, cell + 1, sizeof(root));
+    }
+    return root;
+}
@@ -0,0 +1,197 @@
+#include <string.h>
+#include "row.h"
+
+#define ROW_HEADER_SIZE sizeof(uint16_t)
+#define ROW_FIXED_WIDTH sizeof(int64_t)
+#define ROW_VAR_OFFSET_SIZE sizeof(uint16_t)
+
+bool row_schema_init(RowSchema* schema, const ColumnType* types, uint32_t num_columns) {
+    if (num_columns > ROW_MAX_COLUMNS) {
+        return false;
+    }
+    memset(schema, 0, sizeof(*schema));
+    schema->num_columns = (uint16_t)num_columns;
+    for (uint32_t i = 0; i < num_columns; i++) {
+        schema->types[i] = (uint8_t)types[i];
+        schema->fixed_size[i + 1] = schema->fixed_size[i];
+        schema->num_var[i + 1] = schema->num_var[i];
+        if (types[i] == COLUMN_INT) {
+            schema->fixed_offset[i] = schema->fixed_size[i];
+            schema->fixed_size[i + 1] += ROW_FIXED_WIDTH;
+        } else {
+            schema->var_slot[i] = schema->num_var[i];
+            schema->num_var[i + 1]++;
+        }
+    }
+    return true;
+}
+
+uint32_t row_encode(const RowSchema* schema, const Value* values, uint32_t count, uint8_t* buffer,
+                    uint32_t buffer_size) {
+    if (count > schema->num_columns) {
+        return 0;
+    }
+    uint32_t bitmap_size = (count + 7) / 8;
+    uint32_t fixed_start = ROW_HEADER_SIZE + bitmap_size;
+    uint32_t var_table = fixed_start + schema->fixed_size[count];
+    uint32_t var_start = var_table + schema->num_var[count] * ROW_VAR_OFFSET_SIZE;
+
+    uint32_t var_size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        ValueType expected = schema->types[i] == COLUMN_INT ? VALUE_INT : VALUE_TEXT;
+        if (values[i].type != VALUE_NULL && values[i].type != expected) {
+            return 0;
+        }
+        if (values[i].type == VALUE_TEXT) {
+            var_size += values[i].length;
+        }
+    }
+    if (var_size > UINT16_MAX || var_start + var_size > buffer_size) {
+        return 0;
+    }
+
+    uint16_t num_columns = (uint16_t)count;
+    memcpy(buffer, &num_columns, sizeof(num_columns));
+    memset(buffer + ROW_HEADER_SIZE, 0, var_start - ROW_HEADER_SIZE);
+    uint16_t var_end = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const Value* value = &values[i];
+        if (value->type == VALUE_NULL) {
+            buffer[ROW_HEADER_SIZE + i / 8] |= (uint8_t)(1 << (i % 8));
+        } else if (schema->types[i] == COLUMN_INT) {
+            memcpy(buffer + fixed_start + schema->fixed_offset[i], &value->integer, ROW_FIXED_WIDTH);
+        } else {
+            memcpy(buffer + var_start + var_end, value->text, value->length);
+            var_end += (uint16_t)value->length;
+        }
+        // NULL text columns still get an offset, so slots stay positional
+        if (schema->types[i] == COLUMN_TEXT) {
+            memcpy(buffer + var_table + schema->var_slot[i] * ROW_VAR_OFFSET_SIZE, &var_end, sizeof(var_end));
+        }
+    }
+    return var_start + var_end;
+}
+
+bool row_column(const RowSchema* schema, const uint8_t* row, uint32_t row_size, uint32_t column, Value* value) {
+    uint16_t num_columns;
+    if (row_size < ROW_HEADER_SIZE || column >= schema->num_columns) {
+        return false;
+    }
+    memcpy(&num_columns, row, sizeof(num_columns));
+    if (num_columns > schema->num_columns) {
+        return false;
+    }
+    memset(value, 0, sizeof(*value));
+    if (column >= num_columns) {
+        value->type = VALUE_NULL;  // Columns added after the row was written
+        return true;
+    }
+
+    uint32_t fixed_start = ROW_HEADER_SIZE + (num_columns + 7) / 8;
+    uint32_t var_table = fixed_start + schema->fixed_size[num_columns];
+    uint32_t var_start = var_table + schema->num_var[num_columns] * ROW_VAR_OFFSET_SIZE;
+    if (var_start > row_size) {
+        return false;
+    }
+    if (row[ROW_HEADER_SIZE + column / 8] & (1 << (column % 8))) {
+        value->type = VALUE_NULL;
+        return true;
+    }
+    if (schema->types[column] == COLUMN_INT) {
+        value->type = VALUE_INT;
+        memcpy(&value->integer, row + fixed_start + schema->fixed_offset[column], ROW_FIXED_WIDTH);
+        return true;
+    }
+
+    uint16_t slot = schema->var_slot[column];
+    uint16_t begin = 0;
+    uint16_t end;
+    if (slot > 0) {
+        memcpy(&begin, row + var_table + (slot - 1) * ROW_VAR_OFFSET_SIZE, sizeof(begin));
+    }
+    memcpy(&end, row + var_table + slot * ROW_VAR_OFFSET_SIZE, sizeof(end));
+    if (begin > end || var_start + end > row_size) {
+        return false;
+    }
+    value->type = VALUE_TEXT;
+    value->text = (const char*)row + var_start + begin;
+    value->length = end - begin;
+    return true;
+}
+
+bool row_int_column(const RowSchema* schema, const uint8_t* row, uint32_t row_size, uint32_t column,
+                    int64_t* value) {
+    uint16_t num_columns;
+    if (row_size < ROW_HEADER_SIZE) {
+        return false;
+    }
+    memcpy(&num_columns, row, sizeof(num_columns));
+    if (column >= num_columns || num_columns > schema->num_columns ||
+        (row[ROW_HEADER_SIZE + column / 8] & (1 << (column % 8)))) {
+        return false;
+    }
+    uint32_t offset = ROW_HEADER_SIZE + (num_columns + 7) / 8 + schema->fixed_offset[column];
+    if (offset + ROW_FIXED_WIDTH > row_size) {
+        return false;
+    }
+    memcpy(value, row + offset, ROW_FIXED_WIDTH);
+    return true;
+}
+
+uint32_t value_record_size(const Value* values, uint32_t count) {
+    uint32_t size = VALUE_RECORD_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        size += 1;
+        if (values[i].type == VALUE_INT) {
+            size += sizeof(int64_t);
+        } else if (values[i].type != VALUE_NULL) {
+            size += sizeof(uint32_t) + values[i].length;
+        }
+    }
+    return size;
+}
+
+void value_record_encode(const Value* values, uint32_t count, uint32_t size, uint8_t* out) {
+    uint16_t num_values = (uint16_t)count;
+    memcpy(out, &size, sizeof(size));
+    memcpy(out + sizeof(size), &num_values, sizeof(num_values));
+    uint8_t* p = out + VALUE_RECORD_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        *p++ = (uint8_t)values[i].type;
+        if (values[i].type == VALUE_INT) {
+            memcpy(p, &values[i].integer, sizeof(int64_t));
+            p += sizeof(int64_t);
+        } else if (values[i].type != VALUE_NULL) {
+            memcpy(p, &values[i].length, sizeof(uint32_t));
+            memcpy(p + sizeof(uint32_t), values[i].text, values[i].length);
+            p += sizeof(uint32_t) + values[i].length;
+        }
+    }
+}
+
+uint32_t value_record_decode(const uint8_t* record, Value* values, uint32_t max) {
+    uint16_t count;
+    memcpy(&count, record + sizeof(uint32_t), sizeof(count));
+    uint32_t n = count < max ? count : max;
+    const uint8_t* p = record + VALUE_RECORD_HEADER_SIZE;
+    for (uint32_t i = 0; i < n; i++) {
+        Value* value = &values[i];
+        memset(value, 0, sizeof(*value));
+        value->type = (ValueType)*p++;
+        if (value->type == VALUE_INT) {
+            memcpy(&value->integer, p, sizeof(int64_t));
+            p += sizeof(int64_t);
+        } else if (value->type != VALUE_NULL) {
+            memcpy(&value->length, p, sizeof(uint32_t));
+            value->text = (const char*)p + sizeof(uint32_t);
+            p += sizeof(uint32_t) + value->length;
+        }
+    }
+    return n;
+}
+
+uint32_t value_record_length(const uint8_t* record) {
+    uint32_t size;
+    memcpy(&size, record, sizeof(size));
+    return size;
+}
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "pager.h"
+
+// A decoded column. Rows that are not integers (NULL, text) fail every
+// integer comparison through `is_int`, so integer filters need no branches.
+typedef struct {
+    uint32_t column;
+    uint32_t decoded_for;         // Batch generation the vectors belong to
+    int64_t integers[BATCH_SIZE];
+    uint8_t is_int[BATCH_SIZE];
+    Value values[BATCH_SIZE];     // Full values, for non-integer comparisons
+} ColumnVector;
+
+// Filters in one query touch few distinct columns
+#define BATCH_MAX_VECTORS 8
+
+struct Batch {
+    uint32_t num_rows;
+    const RowSchema* schema;      // Layout of the rows of the last fill
+    uint32_t generation;          // Bumped by every fill
+    uint32_t keys[BATCH_SIZE];
+    const uint8_t* records[BATCH_SIZE];
+    uint32_t record_sizes[BATCH_SIZE];
+    uint16_t selection[BATCH_SIZE];
+    uint32_t num_selected;
+    ColumnVector* vectors[BATCH_MAX_VECTORS];
+    uint32_t num_vectors;
+    uint32_t next_vector;         // Round-robin reuse once all are taken
+};
+
+Batch* batch_new(void) {
+    return calloc(1, sizeof(Batch));
+}
+
+void batch_free(Batch* batch) {
+    for (uint32_t i = 0; i < batch->num_vectors; i++) {
+        free(batch->vectors[i]);
+    }
+    free(batch);
+}
+
+uint32_t batch_fill(Batch* batch, BTreeCursor* cursor, const RowSchema* schema, uint32_t max_leaves,
+                    int64_t max_key) {
+    Pager* pager = cursor->btree->pager;
+    pager_begin_op(pager);
+    batch->schema = schema;
+    batch->generation++;
+    batch->num_rows = 0;
+
+    uint32_t leaves = 0;
+    while (!cursor->end_of_table && batch->num_rows < BATCH_SIZE && leaves < max_leaves) {
+        void* node = pager_get_page_hinted(pager, cursor->page_num, PAGE_HINT_SCAN);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        leaves++;
+
+        uint32_t cell_num = cursor->cell_num;
+        if (cell_num < num_cells) {
+            void* cell = leaf_node_cell(node, cell_num);
+            uint32_t room = BATCH_SIZE - batch->num_rows;
+            uint32_t take = num_cells - cell_num < room ? num_cells - cell_num : room;
+            for (uint32_t i = 0; i < take; i++) {
+                uint32_t key = leaf_cell_key(cell);
+                if ((int64_t)key > max_key) {
+                    cursor->cell_num = cell_num + i;
+                    cursor->end_of_table = true;
+                    goto done;
+                }
+                uint32_t row = batch->num_rows++;
+                batch->keys[row] = key;
+                batch->records[row] = leaf_cell_value(cell);
+                batch->record_sizes[row] = leaf_cell_value_size(cell);
+                cell = leaf_cell_next(cell);
+            }
+            cell_num += take;
+        }
+
+        if (cell_num < num_cells) {
+            cursor->cell_num = cell_num;  // Batch is full mid-leaf
+        } else if (*leaf_node_next_leaf(node) == 0) {
+            cursor->cell_num = num_cells;
+            cursor->end_of_table = true;
+        } else {
+            cursor->page_num = *leaf_node_next_leaf(node);
+            cursor->cell_num = 0;
+        }
+    }
+
+done:
+    for (uint32_t row = 0; row < batch->num_rows; row++) {
+        batch->selection[row] = (uint16_t)row;
+    }
+    batch->num_selected = batch->num_rows;
+    return batch->num_rows;
+}
+
+// Decodes `column` for the currently selected rows, once per fill
+static ColumnVector* column_vector(Batch* batch, uint32_t column) {
+    ColumnVector* vector = NULL;
+    for (uint32_t i = 0; i < batch->num_vectors; i++) {
+        if (batch->vectors[i]->column == column) {
+            vector = batch->vectors[i];
+            break;
+        }
+    }
+    if (!vector) {
+        if (batch->num_vectors < BATCH_MAX_VECTORS) {
+            vector = malloc(sizeof(ColumnVector));
+            if (!vector) {
+                printf("ERROR: Out of memory allocating column vector\n");
+                exit(EXIT_FAILURE);
+            }
+            batch->vectors[batch->num_vectors++] = vector;
+        } else {
+            vector = batch->vectors[batch->next_vector];
+            batch->next_vector = (batch->next_vector + 1) % BATCH_MAX_VECTORS;
+        }
+        vector->column = column;
+        vector->decoded_for = 0;
+    }
+    if (vector->decoded_for == batch->generation) {
+        return vector;
+    }
+
+    // Later filters only ever see a subset of these rows
+    for (uint32_t i = 0; i < batch->num_selected; i++) {
+        uint16_t row = batch->selection[i];
+        Value* value = &vector->values[row];
+        if (column == BATCH_KEY_COLUMN) {
+            memset(value, 0, sizeof(*value));
+            value->type = VALUE_INT;
+            value->integer = batch->keys[row];
+        } else if (!row_column(batch->schema, batch->records[row], batch->record_sizes[row], column, value)) {
+            value->type = VALUE_NULL;
+        }
+        vector->is_int[row] = (value->type == VALUE_INT);
+        vector->integers[row] = value->integer;
+    }
+    vector->decoded_for = batch->generation;
+    return vector;
+}
+
+// Branch-free selection narrowing: every candidate is written, and the output
+// index only advances for rows that pass
+#define FILTER_INT_LOOP(condition)                                            \
+    for (uint32_t i = 0; i < num_selected; i++) {                             \
+        uint16_t row = selection[i];                                          \
+        int64_t v = integers[row];                                            \
+        selection[out] = row;                                                 \
+        out += is_int[row] & (uint32_t)(condition);                           \
+    }
+
+static uint32_t filter_int(ColumnVector* vector, uint16_t* selection, uint32_t num_selected, CompareOp op,
+                           int64_t constant) {
+    const int64_t* integers = vector->integers;
+    const uint8_t* is_int = vector->is_int;
+    uint32_t out = 0;
+    switch (op) {
+        case COMPARE_EQ: FILTER_INT_LOOP(v == constant); break;
+        case COMPARE_NE: FILTER_INT_LOOP(v != constant); break;
+        case COMPARE_LT: FILTER_INT_LOOP(v < constant); break;
+        case COMPARE_LE: FILTER_INT_LOOP(v <= constant); break;
+        case COMPARE_GT: FILTER_INT_LOOP(v > constant); break;
+        case COMPARE_GE: FILTER_INT_LOOP(v >= constant); break;
+    }
+    return out;
+}
+
+static bool compare_matches(int cmp, CompareOp op) {
+    switch (op) {
+        case COMPARE_EQ: return cmp == 0;
+        case COMPARE_NE: return cmp != 0;
+        case COMPARE_LT: return cmp < 0;
+        case COMPARE_LE: return cmp <= 0;
+        case COMPARE_GT: return cmp > 0;
+        case COMPARE_GE: return cmp >= 0;
+    }
+    return false;
+}
+
+void batch_filter(Batch* batch, uint32_t column, CompareOp op, const Value* constant) {
+    if (constant->type == VALUE_NULL) {
+        batch->num_selected = 0;
+        return;
+    }
+    ColumnVector* vector = column_vector(batch, column);
+    if (constant->type == VALUE_INT) {
+        batch->num_selected = filter_int(vector, batch->selection, batch->num_selected, op, constant->integer);
+        return;
+    }
+
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < batch->num_selected; i++) {
+        uint16_t row = batch->selection[i];
+        const Value* value = &vector->values[row];
+        if (value->type != VALUE_NULL && compare_matches(vm_value_compare(value, constant), op)) {
+            batch->selection[out++] = row;
+        }
+    }
+    batch->num_selected = out;
+}
+
+uint32_t batch_num_rows(Batch* batch) {
+    return batch->num_rows;
+}
+
+uint32_t batch_num_selected(Batch* batch) {
+    return batch->num_selected;
+}
+
+const uint16_t* batch_selection(Batch* batch) {
+    return batch->selection;
+}
+
+uint32_t batch_key(Batch* batch, uint32_t row) {
+    return batch->keys[row];
+}
+
+bool batch_column(Batch* batch, uint32_t row, uint32_t column, Value* value) {
+    if (column == BATCH_KEY_COLUMN) {
+        memset(value, 0, sizeof(*value));
+        value->type = VALUE_INT;
+        value->integer = batch->keys[row];
+        return true;
+    }
+    return row_column(batch->schema, batch->records[row], batch->record_sizes[row], column, value);
+}
+
+// Integers folded by the tight loops below, merged into the running
+// aggregate once per batch or table
+typedef struct {
+    uint64_t count;
+    int64_t sum;
+    int64_t min;
+    int64_t max;
+    bool overflow;                // The sum left the int64 range
+} Partial;
+
+static void partial_add(Partial* partial, int64_t value) {
+    if (partial->count == 0) {
+        partial->min = partial->max = value;
+    } else {
+        partial->min = value < partial->min ? value : partial->min;
+        partial->max = value > partial->max ? value : partial->max;
+    }
+    partial->count++;
+    if ((value > 0 && partial->sum > INT64_MAX - value) || (value < 0 && partial->sum < INT64_MIN - value)) {
+        partial->overflow = true;
+    }
+    partial->sum += partial->overflow ? 0 : value;
+}
+
+static bool partial_merge(const Partial* partial, AggregateFunction function, Value* aggregate) {
+    if (function == AGGREGATE_COUNT) {
+        aggregate->integer += (int64_t)partial->count;
+        return true;
+    }
+    if (partial->count == 0) {
+        return true;
+    }
+    if (function == AGGREGATE_SUM && partial->overflow) {
+        return false;
+    }
+    Value value;
+    memset(&value, 0, sizeof(value));
+    value.type = VALUE_INT;
+    value.integer = function == AGGREGATE_SUM ? partial->sum : function == AGGREGATE_MIN ? partial->min : partial->max;
+    return vm_aggregate_fold(aggregate, function, &value);
+}
+
+bool batch_aggregate(Batch* batch, uint32_t column, AggregateFunction function, Value* aggregate) {
+    Partial partial;
+    memset(&partial, 0, sizeof(partial));
+    if (column == BATCH_KEY_COLUMN) {
+        if (function == AGGREGATE_COUNT) {
+            partial.count = batch->num_selected;
+        } else {
+            for (uint32_t i = 0; i < batch->num_selected; i++) {
+                partial_add(&partial, batch->keys[batch->selection[i]]);
+            }
+        }
+        return partial_merge(&partial, function, aggregate);
+    }
+
+    ColumnVector* vector = column_vector(batch, column);
+    for (uint32_t i = 0; i < batch->num_selected; i++) {
+        uint16_t row = batch->selection[i];
+        if (vector->is_int[row]) {
+            partial_add(&partial, vector->integers[row]);
+        } else if (vector->values[row].type != VALUE_NULL) {
+            if (function != AGGREGATE_COUNT) {
+                return false;
+            }
+            partial.count++;
+        }
+    }
+    return partial_merge(&partial, function, aggregate);
+}
+
+// Folds one leaf's cells. MIN and MAX of the key are answered by the tree's
+// ends instead.
+static void fold_leaf(Partial* partial, void* node, uint32_t num_cells, const RowSchema* schema, uint32_t column,
+                      AggregateFunction function) {
+    void* cell = leaf_node_cell(node, 0);
+    if (column == BATCH_KEY_COLUMN) {
+        if (function == AGGREGATE_COUNT) {
+            partial->count += num_cells;
+        } else if (function == AGGREGATE_SUM) {
+            for (uint32_t i = 0; i < num_cells; i++, cell = leaf_cell_next(cell)) {
+                partial_add(partial, leaf_cell_key(cell));
+            }
+        }
+    } else if (schema->types[column] == COLUMN_TEXT) {
+        for (uint32_t i = 0; i < num_cells; i++, cell = leaf_cell_next(cell)) {
+            Value value;
+            if (row_column(schema, leaf_cell_value(cell), leaf_cell_value_size(cell), column, &value) &&
+                value.type != VALUE_NULL) {
+                partial->count++;
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < num_cells; i++, cell = leaf_cell_next(cell)) {
+            int64_t value;
+            if (row_int_column(schema, leaf_cell_value(cell), leaf_cell_value_size(cell), column, &value)) {
+                partial_add(partial, value);
+            }
+        }
+    }
+}
+
+bool leaf_aggregate(BTree* btree, const RowSchema* schema, const uint32_t* columns,
+                    const AggregateFunction* functions, uint32_t count, Value* aggregates) {
+    Partial partials[BATCH_MAX_AGGREGATES];
+    bool scan = false;
+    if (count > BATCH_MAX_AGGREGATES) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        memset(&aggregates[i], 0, sizeof(aggregates[i]));
+        aggregates[i].type = functions[i] == AGGREGATE_COUNT ? VALUE_INT : VALUE_NULL;
+        memset(&partials[i], 0, sizeof(partials[i]));
+        bool key = columns[i] == BATCH_KEY_COLUMN;
+        if (!key && (columns[i] >= schema->num_columns ||
+                     (schema->types[columns[i]] == COLUMN_TEXT && functions[i] != AGGREGATE_COUNT))) {
+            return false;
+        }
+        scan = scan || !key || functions[i] == AGGREGATE_COUNT || functions[i] == AGGREGATE_SUM;
+    }
+
+    Pager* pager = btree->pager;
+    BTreeCursor* start = btree_start(btree);
+    page_num_t page_num = start->page_num;
+    bool empty = start->end_of_table;
+    free(start);
+    if (empty) {
+        return true;
+    }
+    // Leaves are never left empty, so the ends of the tree hold the key range
+    for (uint32_t i = 0; i < count; i++) {
+        if (columns[i] == BATCH_KEY_COLUMN && functions[i] == AGGREGATE_MIN) {
+            partial_add(&partials[i], *leaf_node_key(pager_get_page(pager, page_num), 0));
+        } else if (columns[i] == BATCH_KEY_COLUMN && functions[i] == AGGREGATE_MAX) {
+            partial_add(&partials[i], get_subtree_max_key(btree, btree->root_page_num));
+        }
+    }
+
+    while (scan) {
+        // One leaf per operation, so a scan never pins more than a page
+        pager_begin_op(pager);
+        void* node = pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        for (uint32_t i = 0; i < count; i++) {
+            fold_leaf(&partials[i], node, num_cells, schema, columns[i], functions[i]);
+        }
+        page_num = *leaf_node_next_leaf(node);
+        scan = page_num != 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!partial_merge(&partials[i], functions[i], &aggregates[i])) {
+            return false;
+        }
+    }
+    return true;
+}
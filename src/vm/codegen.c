@@ -0,0 +1,920 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codegen.h"
+#include "batch.h"
+
+// Table cursor used by every generated program, the index cursor of
+// programs that scan an index and the sorter of programs with ORDER BY. A
+// join scans its probe table with CODEGEN_CURSOR and its build table with
+// CODEGEN_BUILD_CURSOR into the hash join under CODEGEN_HASH_CURSOR.
+#define CODEGEN_CURSOR 0
+#define CODEGEN_INDEX_CURSOR 1
+#define CODEGEN_SORTER_CURSOR 2
+#define CODEGEN_BUILD_CURSOR 3
+#define CODEGEN_HASH_CURSOR 4
+
+// Column ids of a join run through both of its tables: the FROM table's
+// columns, then the JOIN table's from JOIN_SIDE_COLUMNS on
+#define JOIN_SIDE_COLUMNS CATALOG_MAX_COLUMNS
+
+// A SELECT's tables: the FROM table, then the JOIN table if there is one
+typedef struct {
+    Table* tables[2];
+    uint32_t count;
+} Tables;
+
+static bool find_tables(Catalog* catalog, const ParsedStatement* statement, Tables* tables, char* error,
+                        uint32_t error_size) {
+    const SqlName* names[2] = { &statement->table, &statement->join_table };
+    tables->count = statement->join_table.length > 0 ? 2 : 1;
+    for (uint32_t i = 0; i < tables->count; i++) {
+        tables->tables[i] = catalog_find_table(catalog, names[i]->start, names[i]->length);
+        if (!tables->tables[i]) {
+            snprintf(error, error_size, "No table %.*s", (int)names[i]->length, names[i]->start);
+            return false;
+        }
+    }
+    if (tables->count == 2 && tables->tables[0] == tables->tables[1]) {
+        snprintf(error, error_size, "Cannot join %s with itself", tables->tables[0]->name);
+        return false;
+    }
+    return true;
+}
+
+// Finds a column by its name, qualified with its table's name or not.
+// Returns false with a message in `error` if no table has it, or an
+// unqualified name is in both.
+static bool resolve_column(Catalog* catalog, const Tables* tables, SqlName name, uint32_t* side, uint32_t* column,
+                           char* error, uint32_t error_size) {
+    SqlName qualifier;
+    SqlName column_name;
+    sql_split_name(name, &qualifier, &column_name);
+    Table* named = qualifier.length > 0 ? catalog_find_table(catalog, qualifier.start, qualifier.length) : NULL;
+    bool found = false;
+    for (uint32_t i = 0; i < tables->count; i++) {
+        if (qualifier.length > 0 && tables->tables[i] != named) {
+            continue;
+        }
+        int32_t position = table_find_column(tables->tables[i], column_name.start, column_name.length);
+        if (position < 0) {
+            continue;
+        }
+        if (found) {
+            snprintf(error, error_size, "Column %.*s is in both %s and %s", (int)name.length, name.start,
+                     tables->tables[0]->name, tables->tables[1]->name);
+            return false;
+        }
+        found = true;
+        *side = i;
+        *column = (uint32_t)position;
+    }
+    if (!found && tables->count == 1) {
+        snprintf(error, error_size, "No column %.*s in %s", (int)name.length, name.start, tables->tables[0]->name);
+    } else if (!found) {
+        snprintf(error, error_size, "No column %.*s in %s or %s", (int)name.length, name.start,
+                 tables->tables[0]->name, tables->tables[1]->name);
+    }
+    return found;
+}
+
+static void emit_value(Program* program, const Expr* expr, int32_t reg) {
+    switch (expr->type) {
+        case EXPR_NULL:
+            program_emit(program, OP_NULL, reg, 0, 0);
+            break;
+        case EXPR_INTEGER:
+            if (expr->integer >= INT32_MIN && expr->integer <= INT32_MAX) {
+                program_emit(program, OP_INTEGER, reg, 0, (int32_t)expr->integer);
+            } else {
+                uint32_t constant = program_add_text(program, (const char*)&expr->integer, sizeof(int64_t));
+                program_emit(program, OP_INT64, reg, 0, (int32_t)constant);
+            }
+            break;
+        case EXPR_STRING:
+            program_emit(program, OP_STRING, reg, 0,
+                         (int32_t)program_add_text(program, expr->text.start, expr->text.length));
+            break;
+        case EXPR_PARAMETER:
+            program_emit(program, OP_VARIABLE, reg, 0, (int32_t)expr->parameter);
+            break;
+    }
+}
+
+static Program* compile_insert(Table* table, const ParsedStatement* statement, char* error, uint32_t error_size) {
+    if (statement->row_width != table->num_columns) {
+        snprintf(error, error_size, "%s has %u columns but %u values were given", table->name, table->num_columns,
+                 statement->row_width);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < statement->num_rows * statement->row_width; i++) {
+        const Expr* value = &statement->values[i];
+        ColumnType type = table->column_types[i % statement->row_width];
+        if ((value->type == EXPR_INTEGER && type != COLUMN_INT) || (value->type == EXPR_STRING && type != COLUMN_TEXT)) {
+            snprintf(error, error_size, "Wrong type of value for column %s",
+                     table->column_names[i % statement->row_width]);
+            return NULL;
+        }
+    }
+
+    // r[0] key, r[1..n) columns, r[n] the encoded row
+    Program* program = program_new();
+    uint32_t table_index = program_add_table(program, table->btree, &table->schema);
+    int32_t record = (int32_t)table->num_columns;
+    for (uint32_t row = 0; row < statement->num_rows; row++) {
+        for (uint32_t column = 0; column < table->num_columns; column++) {
+            emit_value(program, &statement->values[row * statement->row_width + column], (int32_t)column);
+        }
+        program_emit(program, OP_MAKE_RECORD, record, (int32_t)table_index, 1);
+        program_emit(program, OP_INSERT, 0, (int32_t)table_index, record);
+        for (uint32_t i = 0; i < table->num_indexes; i++) {
+            uint32_t index = program_add_index(program, &table->indexes[i]->index);
+            program_emit(program, OP_INDEX_INSERT, 0, (int32_t)index, 0);
+        }
+    }
+    program_emit(program, OP_HALT, 0, 0, 0);
+    return program;
+}
+
+// Jumps taken when `column op value` is false; operands are never NULL here
+static Opcode inverse_jump(CompareOp op) {
+    switch (op) {
+        case COMPARE_EQ: return OP_NE;
+        case COMPARE_NE: return OP_EQ;
+        case COMPARE_LT: return OP_GE;
+        case COMPARE_LE: return OP_GT;
+        case COMPARE_GT: return OP_LE;
+        case COMPARE_GE: return OP_LT;
+    }
+    return OP_NE;
+}
+
+// Position of a table column in a covering index's entries, or -1
+static int32_t index_position(const Index* index, uint32_t column) {
+    for (uint32_t i = 0; i < index->index.num_columns; i++) {
+        if (index->index.columns[i] == column) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+static void emit_table_column(Program* program, uint32_t cursor, uint32_t column, int32_t reg) {
+    if (column == 0) {
+        program_emit(program, OP_KEY, reg, 0, (int32_t)cursor);
+    } else {
+        program_emit(program, OP_COLUMN, reg, 0, program_column_operand(cursor, column - 1));
+    }
+}
+
+// Reads a column of the current row from CODEGEN_CURSOR, or with a covering
+// index from the entry under CODEGEN_INDEX_CURSOR
+static void emit_load_column(Program* program, const Index* covering, uint32_t column, int32_t reg) {
+    if (covering && column != 0) {
+        program_emit(program, OP_COLUMN, reg, 0,
+                     program_column_operand(CODEGEN_INDEX_CURSOR, (uint32_t)index_position(covering, column)));
+    } else {
+        emit_table_column(program, covering ? CODEGEN_INDEX_CURSOR : CODEGEN_CURSOR, column, reg);
+    }
+}
+
+// Jumps to patch once their target is emitted
+typedef struct {
+    uint32_t addresses[2 * SQL_MAX_CONDITIONS + 4];
+    uint32_t count;
+} JumpList;
+
+static void add_jump(JumpList* jumps, uint32_t address) {
+    jumps->addresses[jumps->count++] = address;
+}
+
+static void patch_jumps(Program* program, const JumpList* jumps, uint32_t target) {
+    for (uint32_t i = 0; i < jumps->count; i++) {
+        program_set_jump(program, jumps->addresses[i], target);
+    }
+}
+
+// Row-at-a-time filters on the current row, whose key is in r[key]: jump to
+// `skip` when a condition is false
+static void emit_filters(Program* program, const Index* covering, const ParsedStatement* statement,
+                         const uint32_t* condition_columns, int32_t constants, int32_t key, int32_t scratch,
+                         JumpList* skip) {
+    for (uint32_t i = 0; i < statement->num_conditions; i++) {
+        int32_t value = key;
+        if (condition_columns[i] != 0) {
+            value = scratch;
+            emit_load_column(program, covering, condition_columns[i], scratch);
+            add_jump(skip, program_emit(program, OP_IS_NULL, scratch, 0, 0));
+        }
+        add_jump(skip, program_emit(program, inverse_jump(statement->conditions[i].op), value, 0,
+                                    constants + (int32_t)i));
+    }
+}
+
+// Where a join's columns are found for each match: in the probe row's
+// registers, or in the matching build row under CODEGEN_HASH_CURSOR
+typedef struct {
+    int32_t registers[2 * JOIN_SIDE_COLUMNS];   // Probe row register, or -1
+    int32_t values[2 * JOIN_SIDE_COLUMNS];      // Position in the build row, or -1
+} JoinColumns;
+
+// Where the rows a scan finds go: out as results, or with ORDER BY into the
+// sorter as their sort keys followed by their result columns
+typedef struct {
+    const uint32_t* columns;
+    uint32_t count;
+    const uint32_t* order_columns;
+    uint32_t num_order;           // 0 when rows need no sort
+    int32_t sort;                 // First of the registers a sorter row is built in
+    const JoinColumns* join;      // Joins: columns are join column ids
+} Output;
+
+static void emit_output_column(Program* program, const Index* covering, const Output* output, uint32_t column,
+                               int32_t reg) {
+    if (!output->join) {
+        emit_load_column(program, covering, column, reg);
+    } else if (output->join->registers[column] >= 0) {
+        program_emit(program, OP_MOVE, reg, 0, output->join->registers[column]);
+    } else {
+        program_emit(program, OP_COLUMN, reg, 0,
+                     program_column_operand(CODEGEN_HASH_CURSOR, (uint32_t)output->join->values[column]));
+    }
+}
+
+// Outputs the current row, or with aggregates folds it into r[0, results)
+static void emit_results(Program* program, const Index* covering, const ParsedStatement* statement,
+                         const Output* output, int32_t scratch) {
+    if (statement->aggregate) {
+        for (uint32_t i = 0; i < output->count; i++) {
+            emit_output_column(program, covering, output, output->columns[i], scratch);
+            program_emit(program, OP_AGGREGATE_STEP, (int32_t)i, (int32_t)statement->functions[i], scratch);
+        }
+        return;
+    }
+    if (output->num_order > 0) {
+        for (uint32_t i = 0; i < output->num_order; i++) {
+            emit_output_column(program, covering, output, output->order_columns[i], output->sort + (int32_t)i);
+        }
+        for (uint32_t i = 0; i < output->count; i++) {
+            emit_output_column(program, covering, output, output->columns[i],
+                               output->sort + (int32_t)(output->num_order + i));
+        }
+        program_emit(program, OP_SORTER_INSERT, CODEGEN_SORTER_CURSOR, (int32_t)(output->num_order + output->count),
+                     output->sort);
+        return;
+    }
+    for (uint32_t i = 0; i < output->count; i++) {
+        emit_output_column(program, covering, output, output->columns[i], (int32_t)i);
+    }
+    program_emit(program, OP_RESULT_ROW, 0, 0, (int32_t)output->count);
+}
+
+// Every path ends here: aggregates then yield their one row, even when no
+// row matched, and sorted rows come out of the sorter
+static void emit_end(Program* program, const ParsedStatement* statement, const JumpList* done,
+                     const Output* output) {
+    uint32_t end = program->length;
+    if (statement->aggregate) {
+        program_emit(program, OP_RESULT_ROW, 0, 0, (int32_t)output->count);
+    } else if (output->num_order > 0) {
+        uint32_t sort = program_emit(program, OP_SORTER_SORT, CODEGEN_SORTER_CURSOR, 0, 0);
+        uint32_t loop = program->length;
+        for (uint32_t i = 0; i < output->count; i++) {
+            program_emit(program, OP_COLUMN, (int32_t)i, 0,
+                         program_column_operand(CODEGEN_SORTER_CURSOR, output->num_order + i));
+        }
+        program_emit(program, OP_RESULT_ROW, 0, 0, (int32_t)output->count);
+        program_emit(program, OP_SORTER_NEXT, CODEGEN_SORTER_CURSOR, (int32_t)loop, 0);
+        program_set_jump(program, sort, program->length);
+    }
+    program_emit(program, OP_HALT, 0, 0, 0);
+    patch_jumps(program, done, end);
+}
+
+// Running aggregates start at 0 for COUNT and NULL for the others
+static void emit_aggregate_start(Program* program, const ParsedStatement* statement, uint32_t count) {
+    for (uint32_t i = 0; i < count && statement->aggregate; i++) {
+        if (statement->functions[i] == AGGREGATE_COUNT) {
+            program_emit(program, OP_INTEGER, (int32_t)i, 0, 0);
+        } else {
+            program_emit(program, OP_NULL, (int32_t)i, 0, 0);
+        }
+    }
+}
+
+// Loads each condition's value into r[constants + i]; a query with a NULL
+// one, written or bound, is done before it starts
+static void emit_constants(Program* program, const ParsedStatement* statement, int32_t constants, JumpList* done) {
+    for (uint32_t i = 0; i < statement->num_conditions; i++) {
+        emit_value(program, &statement->conditions[i].value, constants + (int32_t)i);
+    }
+    // Comparisons with NULL are never true
+    for (uint32_t i = 0; i < statement->num_conditions; i++) {
+        if (statement->conditions[i].value.type == EXPR_NULL || statement->conditions[i].value.type == EXPR_PARAMETER) {
+            add_jump(done, program_emit(program, OP_IS_NULL, constants + (int32_t)i, 0, 0));
+        }
+    }
+}
+
+// Relative costs of the steps of an access path, in leaf pages read in order
+#define COST_LOOKUP 4.0           // Finding a row by key, out of order
+#define COST_ROW 0.01             // Checking a row
+// Fraction of a column's values a range whose bound is a parameter or text
+// is taken to keep
+#define ESTIMATE_UNKNOWN_RANGE (1.0 / 3)
+
+// Estimated rows of an analyzed table meeting the conditions on `column`,
+// those whose condition_sides[] is `side` in a join (condition_sides NULL
+// otherwise). Parameters are not bound yet when a plan is made, so only
+// literal INT bounds read the histogram.
+static double estimate_column(const Table* table, const ParsedStatement* statement, const uint32_t* condition_sides,
+                              uint32_t side, const uint32_t* condition_columns, uint32_t column) {
+    const TableStats* stats = &table->stats;
+    int64_t bounds[2];
+    bool bounded[2] = { false, false };
+    bool any = false;
+    double unknown = 1;
+    for (uint32_t i = 0; i < statement->num_conditions; i++) {
+        const Condition* condition = &statement->conditions[i];
+        if ((condition_sides && condition_sides[i] != side) || condition_columns[i] != column ||
+            condition->op == COMPARE_NE) {
+            continue;
+        }
+        if (condition->op == COMPARE_EQ) {
+            return condition->value.type == EXPR_NULL ? 0 : estimate_equal_rows(stats, column);
+        }
+        any = true;
+        if (condition->value.type != EXPR_INTEGER) {
+            unknown *= ESTIMATE_UNKNOWN_RANGE;
+            continue;
+        }
+        // Integers: x > v is x >= v + 1, and x < v is x <= v - 1
+        int64_t value = condition->value.integer;
+        bool low = condition->op == COMPARE_GT || condition->op == COMPARE_GE;
+        if (condition->op == COMPARE_GT && value < INT64_MAX) {
+            value++;
+        } else if (condition->op == COMPARE_LT && value > INT64_MIN) {
+            value--;
+        }
+        uint32_t end = low ? 0 : 1;
+        if (!bounded[end] || (low ? value > bounds[end] : value < bounds[end])) {
+            bounds[end] = value;
+            bounded[end] = true;
+        }
+    }
+    if (!any) {
+        return (double)stats->rows;
+    }
+    return estimate_range_rows(stats, column, bounded[0] ? &bounds[0] : NULL, bounded[1] ? &bounds[1] : NULL) *
+           unknown;
+}
+
+// Estimated rows meeting every condition, taking the columns as independent
+static double estimate_rows(const Table* table, const ParsedStatement* statement, const uint32_t* condition_sides,
+                            uint32_t side, const uint32_t* condition_columns) {
+    double rows = (double)table->stats.rows;
+    bool seen[CATALOG_MAX_COLUMNS] = { false };
+    for (uint32_t i = 0; i < statement->num_conditions && rows > 0; i++) {
+        uint32_t column = condition_columns[i];
+        if ((condition_sides && condition_sides[i] != side) || seen[column]) {
+            continue;
+        }
+        seen[column] = true;
+        rows *= estimate_column(table, statement, condition_sides, side, condition_columns, column) /
+                (double)table->stats.rows;
+    }
+    return rows;
+}
+
+// An index seek: the index and the conditions it seeks by
+typedef struct {
+    Index* index;                 // NULL for a scan of the table
+    bool point;                   // An equality, in lower
+    int32_t lower;                // Conditions bounding a range, or -1
+    int32_t upper;
+} IndexSeek;
+
+// How an index serves the conditions on its column: by an equality, or
+// failing that and if the column is an INT, by the range of the first lower
+// and upper bounds. Returns false if it cannot serve them.
+static bool plan_index_seek(Index* index, const ParsedStatement* statement, const uint32_t* condition_columns,
+                            IndexSeek* seek) {
+    uint32_t column = index->index.columns[0];
+    seek->index = index;
+    seek->point = false;
+    seek->lower = seek->upper = -1;
+    for (uint32_t i = 0; i < statement->num_conditions; i++) {
+        CompareOp op = statement->conditions[i].op;
+        if (condition_columns[i] != column) {
+            continue;
+        }
+        if (op == COMPARE_EQ) {
+            seek->point = true;
+            seek->lower = (int32_t)i;
+            return true;
+        }
+        if (seek->lower < 0 && (op == COMPARE_GE || op == COMPARE_GT)) {
+            seek->lower = (int32_t)i;
+        }
+        if (seek->upper < 0 && (op == COMPARE_LE || op == COMPARE_LT)) {
+            seek->upper = (int32_t)i;
+        }
+    }
+    return index->table->column_types[column] == COLUMN_INT && (seek->lower >= 0 || seek->upper >= 0);
+}
+
+// Whether an index's entries hold every one of the columns
+static bool index_covers(const Index* index, const uint32_t* columns, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (columns[i] != 0 && index_position(index, columns[i]) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Cost of reading the rows a key range keeps from the table's leaves
+static double scan_cost(const Table* table, double rows) {
+    const TableStats* stats = &table->stats;
+    double fraction = stats->rows > 0 ? rows / (double)stats->rows : 0;
+    return stats->shape.height + (double)stats->shape.leaf_pages * fraction + rows * COST_ROW;
+}
+
+// Cost of an index seek: reading the entries, plus a lookup in the table for
+// each unless the index covers the query. An index ANALYZE has not seen yet
+// is taken to be as large as the table.
+static double seek_cost(const Table* table, const Index* index, double entries, bool covering) {
+    const TableStats* stats = &table->stats;
+    const TreeShape* shape = index->stats.analyzed ? &index->stats.shape : &stats->shape;
+    uint64_t indexed = stats->rows - stats->columns[index->index.columns[0]].nulls;
+    double fraction = indexed > 0 ? entries / (double)indexed : 0;
+    return shape->height + (double)shape->leaf_pages * fraction + entries * COST_ROW +
+           (covering ? 0 : entries * COST_LOOKUP);
+}
+
+// A SELECT scans the table from the lowest key a key condition allows, or
+// from the start. With a key equality it reads row at a time: a point read
+// should not fill a batch. Otherwise, once ANALYZE has run, the table scan
+// is costed against a seek of each index the conditions allow (see
+// plan_index_seek()) and the cheapest runs. Without statistics an equality
+// on an indexed column, or failing that and any key condition, a range on
+// an indexed INT column drives the scan. An index's entries give the keys
+// of candidate rows, which are looked up and checked against every
+// condition, since an index only narrows by image. When the index's entries
+// hold every column the query reads, the checks and results read the
+// entries and the table is never touched. Other scans read in batches that
+// stop at the highest key a key condition allows, and filter them
+// vectorized. Aggregates take the same paths but fold rows into their
+// registers instead of yielding them, a whole batch selection at a time on
+// batch scans. Without a WHERE they skip the scan loop and are computed from
+// the leaf pages. ORDER BY feeds the rows to a sorter and yields them once
+// the scan is done, unless the scan already reads them in order: by
+// ascending key from the table, or a single row by key equality.
+static Program* compile_select(Catalog* catalog, Table* table, const ParsedStatement* statement, char* error,
+                               uint32_t error_size) {
+    Tables tables = { { table, NULL }, 1 };
+    uint32_t side;
+    uint32_t result_columns[SQL_MAX_COLUMNS];
+    uint32_t num_results = statement->num_columns;
+    if (num_results == 0) {
+        num_results = table->num_columns;
+        for (uint32_t i = 0; i < num_results; i++) {
+            result_columns[i] = i;
+        }
+    }
+    for (uint32_t i = 0; i < statement->num_columns; i++) {
+        // COUNT(*) counts keys, which are never NULL
+        uint32_t column = 0;
+        if ((!statement->aggregate || statement->columns[i].length > 0) &&
+            !resolve_column(catalog, &tables, statement->columns[i], &side, &column, error, error_size)) {
+            return NULL;
+        }
+        if (statement->aggregate && statement->functions[i] != AGGREGATE_COUNT &&
+            table->column_types[column] != COLUMN_INT) {
+            snprintf(error, error_size, "SUM, MIN and MAX need an INT column, not %s", table->column_names[column]);
+            return NULL;
+        }
+        result_columns[i] = column;
+    }
+    uint32_t order_columns[SQL_MAX_ORDER_BY];
+    uint32_t descending = 0;
+    for (uint32_t i = 0; i < statement->num_order_by; i++) {
+        if (!resolve_column(catalog, &tables, statement->order_by[i], &side, &order_columns[i], error, error_size)) {
+            return NULL;
+        }
+        descending |= statement->order_descending[i] ? 1u << i : 0;
+    }
+
+    uint32_t condition_columns[SQL_MAX_CONDITIONS];
+    int32_t lower = -1;
+    int32_t upper = -1;
+    bool point = false;
+    for (uint32_t i = 0; i < statement->num_conditions; i++) {
+        const Condition* condition = &statement->conditions[i];
+        if (!resolve_column(catalog, &tables, condition->column, &side, &condition_columns[i], error, error_size)) {
+            return NULL;
+        }
+        if (condition_columns[i] != 0) {
+            continue;
+        }
+        CompareOp op = condition->op;
+        if (lower < 0 && (op == COMPARE_EQ || op == COMPARE_GE || op == COMPARE_GT)) {
+            lower = (int32_t)i;
+        }
+        if (upper < 0 && (op == COMPARE_EQ || op == COMPARE_LE || op == COMPARE_LT)) {
+            upper = (int32_t)i;
+        }
+        if (op == COMPARE_EQ) {
+            point = true;
+            lower = upper = (int32_t)i;
+        }
+    }
+
+    IndexSeek seek = { NULL, false, -1, -1 };
+    if (!point && table->stats.analyzed) {
+        // The cheapest of the table scan, within any key range, and each
+        // index seek the conditions allow
+        double best = scan_cost(table, estimate_column(table, statement, NULL, 0, condition_columns, 0));
+        for (uint32_t i = 0; i < table->num_indexes; i++) {
+            IndexSeek candidate;
+            if (!plan_index_seek(table->indexes[i], statement, condition_columns, &candidate)) {
+                continue;
+            }
+            bool covers = index_covers(candidate.index, result_columns, num_results) &&
+                          index_covers(candidate.index, condition_columns, statement->num_conditions) &&
+                          index_covers(candidate.index, order_columns, statement->num_order_by);
+            double entries = estimate_column(table, statement, NULL, 0, condition_columns,
+                                             candidate.index->index.columns[0]);
+            double cost = seek_cost(table, candidate.index, entries, covers);
+            if (cost < best) {
+                best = cost;
+                seek = candidate;
+            }
+        }
+    } else if (!point) {
+        // Without statistics: an index equality, or with no key range an
+        // index range
+        for (uint32_t i = 0; i < statement->num_conditions && !seek.index; i++) {
+            Index* candidate = condition_columns[i] != 0 ? table_find_index(table, condition_columns[i]) : NULL;
+            if (candidate && statement->conditions[i].op == COMPARE_EQ) {
+                plan_index_seek(candidate, statement, condition_columns, &seek);
+            }
+        }
+        for (uint32_t i = 0; i < statement->num_conditions && !seek.index && lower < 0 && upper < 0; i++) {
+            Index* candidate = condition_columns[i] != 0 ? table_find_index(table, condition_columns[i]) : NULL;
+            if (candidate && !plan_index_seek(candidate, statement, condition_columns, &seek)) {
+                seek.index = NULL;
+            }
+        }
+    }
+    Index* index = seek.index;
+
+    // An index that holds every column the query reads answers it alone
+    const Index* covering = index && index_covers(index, result_columns, num_results) &&
+                                    index_covers(index, condition_columns, statement->num_conditions) &&
+                                    index_covers(index, order_columns, statement->num_order_by)
+                                ? index
+                                : NULL;
+
+    // r[0, results) output, then one register per condition's value, then
+    // the key, a column scratch register, an index range's two bounds and
+    // the sorter row
+    int32_t constants = (int32_t)num_results;
+    int32_t key = constants + (int32_t)statement->num_conditions;
+    int32_t scratch = key + 1;
+    int32_t bounds = scratch + 1;
+    bool in_order = point || (!index && (statement->num_order_by == 0 || (order_columns[0] == 0 && !(descending & 1))));
+    Output output = { .columns = result_columns, .count = num_results, .order_columns = order_columns,
+                      .num_order = statement->aggregate || in_order ? 0 : statement->num_order_by,
+                      .sort = bounds + 2 };
+
+    Program* program = program_new();
+    if (!covering) {
+        uint32_t table_index = program_add_table(program, table->btree, &table->schema);
+        program_emit(program, OP_OPEN_READ, CODEGEN_CURSOR, 0, (int32_t)table_index);
+    }
+    if (output.num_order > 0) {
+        program_emit(program, OP_SORTER_OPEN, CODEGEN_SORTER_CURSOR, (int32_t)output.num_order, (int32_t)descending);
+    }
+    if (statement->aggregate && statement->num_conditions == 0) {
+        for (uint32_t i = 0; i < num_results; i++) {
+            uint32_t column = result_columns[i] == 0 ? BATCH_KEY_COLUMN : result_columns[i] - 1;
+            program_emit(program, OP_TABLE_AGGREGATE, (int32_t)i, (int32_t)statement->functions[i],
+                         program_column_operand(CODEGEN_CURSOR, column));
+        }
+        program_emit(program, OP_RESULT_ROW, 0, 0, (int32_t)num_results);
+        program_emit(program, OP_HALT, 0, 0, 0);
+        return program;
+    }
+    emit_aggregate_start(program, statement, num_results);
+    if (index) {
+        program_emit(program, OP_OPEN_INDEX, CODEGEN_INDEX_CURSOR, 0,
+                     (int32_t)program_add_index(program, &index->index));
+    }
+    JumpList done = { .count = 0 };
+    emit_constants(program, statement, constants, &done);
+
+    if (index) {
+        if (seek.point) {
+            add_jump(&done, program_emit(program, OP_INDEX_SEEK_EQ, CODEGEN_INDEX_CURSOR, 0, constants + seek.lower));
+        } else {
+            int32_t range[2] = { seek.lower, seek.upper };
+            for (uint32_t i = 0; i < 2; i++) {
+                if (range[i] >= 0) {
+                    program_emit(program, OP_MOVE, bounds + (int32_t)i, 0, constants + range[i]);
+                } else {
+                    program_emit(program, OP_NULL, bounds + (int32_t)i, 0, 0);
+                }
+            }
+            add_jump(&done, program_emit(program, OP_INDEX_SEEK_RANGE, CODEGEN_INDEX_CURSOR, 0, bounds));
+        }
+        JumpList skip = { .count = 0 };
+        uint32_t loop = program_emit(program, OP_KEY, key, 0, CODEGEN_INDEX_CURSOR);
+        if (!covering) {
+            add_jump(&skip, program_emit(program, OP_SEEK_GE, CODEGEN_CURSOR, 0, key));
+            program_emit(program, OP_KEY, scratch, 0, CODEGEN_CURSOR);
+            add_jump(&skip, program_emit(program, OP_NE, scratch, 0, key));
+        }
+        emit_filters(program, covering, statement, condition_columns, constants, key, scratch, &skip);
+        emit_results(program, covering, statement, &output, scratch);
+        uint32_t next = program_emit(program, OP_INDEX_NEXT, CODEGEN_INDEX_CURSOR, (int32_t)loop, 0);
+        patch_jumps(program, &skip, next);
+        emit_end(program, statement, &done, &output);
+        return program;
+    }
+
+    if (lower >= 0) {
+        add_jump(&done, program_emit(program, OP_SEEK_GE, CODEGEN_CURSOR, 0, constants + lower));
+    } else {
+        add_jump(&done, program_emit(program, OP_REWIND, CODEGEN_CURSOR, 0, 0));
+    }
+
+    if (point) {
+        JumpList skip = { .count = 0 };
+        uint32_t loop = program_emit(program, OP_KEY, key, 0, CODEGEN_CURSOR);
+        add_jump(&done, program_emit(program, OP_GT, key, 0, constants + upper));
+        emit_filters(program, covering, statement, condition_columns, constants, key, scratch, &skip);
+        emit_results(program, covering, statement, &output, scratch);
+        uint32_t next = program_emit(program, OP_NEXT, CODEGEN_CURSOR, (int32_t)loop, 0);
+        patch_jumps(program, &skip, next);
+    } else {
+        int32_t bound = upper >= 0 ? constants + upper : -1;
+        uint32_t fill = program_emit(program, OP_BATCH_NEXT, CODEGEN_CURSOR, 0, bound);
+        add_jump(&done, fill);
+        for (uint32_t i = 0; i < statement->num_conditions; i++) {
+            uint32_t column = condition_columns[i] == 0 ? BATCH_KEY_COLUMN : condition_columns[i] - 1;
+            program_emit(program, OP_BATCH_FILTER, constants + (int32_t)i, (int32_t)statement->conditions[i].op,
+                         program_column_operand(CODEGEN_CURSOR, column));
+        }
+        if (statement->aggregate) {
+            for (uint32_t i = 0; i < num_results; i++) {
+                uint32_t column = result_columns[i] == 0 ? BATCH_KEY_COLUMN : result_columns[i] - 1;
+                program_emit(program, OP_BATCH_AGGREGATE, (int32_t)i, (int32_t)statement->functions[i],
+                             program_column_operand(CODEGEN_CURSOR, column));
+            }
+            program_emit(program, OP_GOTO, 0, (int32_t)fill, 0);
+        } else {
+            uint32_t row = program_emit(program, OP_BATCH_ROW, CODEGEN_CURSOR, (int32_t)fill, 0);
+            emit_results(program, covering, statement, &output, scratch);
+            program_emit(program, OP_GOTO, 0, (int32_t)row, 0);
+        }
+    }
+    emit_end(program, statement, &done, &output);
+    return program;
+}
+
+// Scans a join's table in batches narrowed by the conditions on its
+// columns. Returns the OP_BATCH_NEXT; it and the rewind before it go into
+// `end`, the jumps out when the table is done.
+static uint32_t emit_join_scan(Program* program, const ParsedStatement* statement, const uint32_t* condition_sides,
+                               const uint32_t* condition_columns, int32_t constants, uint32_t side, uint32_t cursor,
+                               JumpList* end) {
+    add_jump(end, program_emit(program, OP_REWIND, (int32_t)cursor, 0, 0));
+    uint32_t fill = program_emit(program, OP_BATCH_NEXT, (int32_t)cursor, 0, -1);
+    add_jump(end, fill);
+    for (uint32_t i = 0; i < statement->num_conditions; i++) {
+        if (condition_sides[i] != side) {
+            continue;
+        }
+        uint32_t column = condition_columns[i] == 0 ? BATCH_KEY_COLUMN : condition_columns[i] - 1;
+        program_emit(program, OP_BATCH_FILTER, constants + (int32_t)i, (int32_t)statement->conditions[i].op,
+                     program_column_operand(cursor, column));
+    }
+    return fill;
+}
+
+// Outputs every build row matching the probe row just looked up, then goes
+// back to `next`
+static void emit_join_matches(Program* program, const ParsedStatement* statement, const Output* output,
+                              int32_t scratch, uint32_t next) {
+    uint32_t match = program->length;
+    emit_results(program, NULL, statement, output, scratch);
+    program_emit(program, OP_HASH_NEXT, CODEGEN_HASH_CURSOR, (int32_t)match, 0);
+    program_emit(program, OP_GOTO, 0, (int32_t)next, 0);
+}
+
+// FROM probe JOIN build ON probe.a = build.b runs as a hash join. The build
+// table is scanned first, in batches filtered by the conditions on its
+// columns, and each row's join column and the columns the query reads from
+// it go into the hash join. The probe table is then scanned the same way;
+// each row's join column and columns are loaded into registers and looked
+// up, and every build row matching it is output, through the same results,
+// sorter or aggregates as a single-table query. Probe rows of partitions
+// the hash join spilled come back once the scan is done and are joined
+// then. The JOIN table is the build side, unless both tables are analyzed
+// and the FROM table is estimated to keep fewer rows after its conditions:
+// the smaller input builds, so it is the one held in memory.
+static Program* compile_join(Catalog* catalog, const Tables* tables, const ParsedStatement* statement, char* error,
+                             uint32_t error_size) {
+    uint32_t side;
+    uint32_t column;
+
+    uint32_t keys[2];
+    uint32_t on_sides[2];
+    for (uint32_t i = 0; i < 2; i++) {
+        if (!resolve_column(catalog, tables, statement->join_on[i], &on_sides[i], &column, error, error_size)) {
+            return NULL;
+        }
+        keys[on_sides[i]] = column;
+    }
+    if (on_sides[0] == on_sides[1]) {
+        snprintf(error, error_size, "ON must compare a column of %s with a column of %s", tables->tables[0]->name,
+                 tables->tables[1]->name);
+        return NULL;
+    }
+    if (tables->tables[0]->column_types[keys[0]] != tables->tables[1]->column_types[keys[1]]) {
+        snprintf(error, error_size, "Cannot join %s.%s with %s.%s, a column of another type", tables->tables[0]->name,
+                 tables->tables[0]->column_names[keys[0]], tables->tables[1]->name,
+                 tables->tables[1]->column_names[keys[1]]);
+        return NULL;
+    }
+
+    uint32_t condition_sides[SQL_MAX_CONDITIONS];
+    uint32_t condition_columns[SQL_MAX_CONDITIONS];
+    for (uint32_t i = 0; i < statement->num_conditions; i++) {
+        if (!resolve_column(catalog, tables, statement->conditions[i].column, &condition_sides[i],
+                            &condition_columns[i], error, error_size)) {
+            return NULL;
+        }
+    }
+    uint32_t build_side = 1;
+    if (tables->tables[0]->stats.analyzed && tables->tables[1]->stats.analyzed &&
+        estimate_rows(tables->tables[0], statement, condition_sides, 0, condition_columns) <
+            estimate_rows(tables->tables[1], statement, condition_sides, 1, condition_columns)) {
+        build_side = 0;
+    }
+    uint32_t probe_side = 1 - build_side;
+
+    uint32_t result_columns[SQL_MAX_COLUMNS];
+    uint32_t num_results = statement->num_columns;
+    if (num_results == 0) {
+        num_results = tables->tables[0]->num_columns + tables->tables[1]->num_columns;
+        if (num_results > SQL_MAX_COLUMNS) {
+            snprintf(error, error_size, "SELECT * of %s and %s returns more than %u columns", tables->tables[0]->name,
+                     tables->tables[1]->name, SQL_MAX_COLUMNS);
+            return NULL;
+        }
+        for (uint32_t i = 0; i < num_results; i++) {
+            side = i < tables->tables[0]->num_columns ? 0 : 1;
+            result_columns[i] = side * JOIN_SIDE_COLUMNS + i - side * tables->tables[0]->num_columns;
+        }
+    }
+    for (uint32_t i = 0; i < statement->num_columns; i++) {
+        // COUNT(*) counts the probe's join column, never NULL in a match
+        side = probe_side;
+        column = keys[probe_side];
+        if ((!statement->aggregate || statement->columns[i].length > 0) &&
+            !resolve_column(catalog, tables, statement->columns[i], &side, &column, error, error_size)) {
+            return NULL;
+        }
+        if (statement->aggregate && statement->functions[i] != AGGREGATE_COUNT &&
+            tables->tables[side]->column_types[column] != COLUMN_INT) {
+            snprintf(error, error_size, "SUM, MIN and MAX need an INT column, not %s",
+                     tables->tables[side]->column_names[column]);
+            return NULL;
+        }
+        result_columns[i] = side * JOIN_SIDE_COLUMNS + column;
+    }
+    uint32_t order_columns[SQL_MAX_ORDER_BY];
+    uint32_t descending = 0;
+    for (uint32_t i = 0; i < statement->num_order_by; i++) {
+        if (!resolve_column(catalog, tables, statement->order_by[i], &side, &column, error, error_size)) {
+            return NULL;
+        }
+        order_columns[i] = side * JOIN_SIDE_COLUMNS + column;
+        descending |= statement->order_descending[i] ? 1u << i : 0;
+    }
+
+    // A probe row is the probe table's join column and the columns read from
+    // that table, in registers from `probe` on; a build row likewise
+    JoinColumns join;
+    uint32_t row_columns[2][CATALOG_MAX_COLUMNS + 1];
+    uint32_t widths[2] = { 1, 1 };
+    for (uint32_t i = 0; i < 2 * JOIN_SIDE_COLUMNS; i++) {
+        join.registers[i] = -1;
+        join.values[i] = -1;
+    }
+    int32_t constants = (int32_t)num_results;
+    int32_t probe = constants + (int32_t)statement->num_conditions;
+    row_columns[probe_side][0] = keys[probe_side];
+    row_columns[build_side][0] = keys[build_side];
+    join.registers[probe_side * JOIN_SIDE_COLUMNS + keys[probe_side]] = probe;
+    join.values[build_side * JOIN_SIDE_COLUMNS + keys[build_side]] = 0;
+    for (uint32_t i = 0; i < num_results + statement->num_order_by; i++) {
+        uint32_t id = i < num_results ? result_columns[i] : order_columns[i - num_results];
+        side = id / JOIN_SIDE_COLUMNS;
+        if (side == probe_side && join.registers[id] < 0) {
+            join.registers[id] = probe + (int32_t)widths[side];
+            row_columns[side][widths[side]++] = id % JOIN_SIDE_COLUMNS;
+        } else if (side == build_side && join.values[id] < 0) {
+            join.values[id] = (int32_t)widths[side];
+            row_columns[side][widths[side]++] = id % JOIN_SIDE_COLUMNS;
+        }
+    }
+
+    // r[0, results) output, one register per condition's value, the probe
+    // row, the build row, a scratch register and the sorter row
+    int32_t build = probe + (int32_t)widths[probe_side];
+    int32_t scratch = build + (int32_t)widths[build_side];
+    Output output = { .columns = result_columns, .count = num_results, .order_columns = order_columns,
+                      .num_order = statement->aggregate ? 0 : statement->num_order_by, .sort = scratch + 1,
+                      .join = &join };
+    uint32_t cursors[2];
+    cursors[probe_side] = CODEGEN_CURSOR;
+    cursors[build_side] = CODEGEN_BUILD_CURSOR;
+
+    Program* program = program_new();
+    for (side = 0; side < 2; side++) {
+        uint32_t table_index = program_add_table(program, tables->tables[side]->btree, &tables->tables[side]->schema);
+        program_emit(program, OP_OPEN_READ, (int32_t)cursors[side], 0, (int32_t)table_index);
+    }
+    program_emit(program, OP_HASH_OPEN, CODEGEN_HASH_CURSOR, (int32_t)widths[probe_side], 0);
+    if (output.num_order > 0) {
+        program_emit(program, OP_SORTER_OPEN, CODEGEN_SORTER_CURSOR, (int32_t)output.num_order, (int32_t)descending);
+    }
+    emit_aggregate_start(program, statement, num_results);
+    JumpList done = { .count = 0 };
+    emit_constants(program, statement, constants, &done);
+
+    uint32_t cursor = cursors[build_side];
+    JumpList built = { .count = 0 };
+    uint32_t fill = emit_join_scan(program, statement, condition_sides, condition_columns, constants, build_side,
+                                   cursor, &built);
+    uint32_t row = program_emit(program, OP_BATCH_ROW, (int32_t)cursor, (int32_t)fill, 0);
+    for (uint32_t i = 0; i < widths[build_side]; i++) {
+        emit_table_column(program, cursor, row_columns[build_side][i], build + (int32_t)i);
+    }
+    program_emit(program, OP_HASH_INSERT, CODEGEN_HASH_CURSOR, (int32_t)widths[build_side], build);
+    program_emit(program, OP_GOTO, 0, (int32_t)row, 0);
+    patch_jumps(program, &built, program_emit(program, OP_HASH_BUILD, CODEGEN_HASH_CURSOR, 0, 0));
+
+    cursor = cursors[probe_side];
+    JumpList probed = { .count = 0 };
+    fill = emit_join_scan(program, statement, condition_sides, condition_columns, constants, probe_side, cursor,
+                          &probed);
+    row = program_emit(program, OP_BATCH_ROW, (int32_t)cursor, (int32_t)fill, 0);
+    for (uint32_t i = 0; i < widths[probe_side]; i++) {
+        emit_table_column(program, cursor, row_columns[probe_side][i], probe + (int32_t)i);
+    }
+    program_emit(program, OP_HASH_PROBE, CODEGEN_HASH_CURSOR, (int32_t)row, probe);
+    emit_join_matches(program, statement, &output, scratch, row);
+
+    uint32_t replay = program_emit(program, OP_HASH_REPLAY, CODEGEN_HASH_CURSOR, 0, probe);
+    patch_jumps(program, &probed, replay);
+    add_jump(&done, replay);
+    program_emit(program, OP_HASH_PROBE, CODEGEN_HASH_CURSOR, (int32_t)replay, probe);
+    emit_join_matches(program, statement, &output, scratch, replay);
+    emit_end(program, statement, &done, &output);
+    return program;
+}
+
+Table* codegen_find_column(Catalog* catalog, const ParsedStatement* statement, SqlName name, uint32_t* column) {
+    Tables tables;
+    char error[8];
+    uint32_t side;
+    if (!find_tables(catalog, statement, &tables, error, sizeof(error)) ||
+        !resolve_column(catalog, &tables, name, &side, column, error, sizeof(error))) {
+        return NULL;
+    }
+    return tables.tables[side];
+}
+
+Program* codegen_compile(Catalog* catalog, const ParsedStatement* statement, char* error, uint32_t error_size) {
+    Tables tables;
+    if (!find_tables(catalog, statement, &tables, error, error_size)) {
+        return NULL;
+    }
+    Table* table = tables.tables[0];
+    switch (statement->type) {
+        case STATEMENT_INSERT:
+            return compile_insert(table, statement, error, error_size);
+        case STATEMENT_SELECT:
+            if (tables.count == 2) {
+                return compile_join(catalog, &tables, statement, error, error_size);
+            }
+            return compile_select(catalog, table, statement, error, error_size);
+        default:
+            snprintf(error, error_size, "Statement does not compile to a program");
+            return NULL;
+    }
+}
@@ -0,0 +1,518 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hashjoin.h"
+#include "vm.h"
+
+// A row's partition is the top log2(HASH_JOIN_PARTITIONS) bits of its hash
+#define PARTITION_SHIFT 60
+#define INITIAL_SLOTS 1024
+
+typedef struct {
+    uint32_t tag;                 // High half of the hash
+    uint32_t entry;               // Newest entry with this key, plus one; 0 if the slot is free
+} Slot;
+
+typedef struct {
+    uint64_t hash;
+    size_t offset;                // Record in the arena
+    uint32_t next;                // Next older entry with the same key, plus one; 0 ends the chain
+} Entry;
+
+// A partition's spilled rows: value records back to back over `pages`
+typedef struct {
+    page_num_t* pages;
+    uint32_t num_pages;
+    uint32_t pages_capacity;
+    uint64_t bytes;
+    uint8_t* buffer;              // The page being filled
+} Stream;
+
+typedef struct {
+    const Stream* stream;
+    uint64_t position;
+} StreamReader;
+
+struct HashJoin {
+    size_t memory_budget;
+    size_t table_budget;          // Bytes of records, entries and slots held in memory
+
+    uint8_t* arena;               // Build records back to back
+    size_t arena_used;
+    size_t arena_capacity;
+    Entry* entries;
+    uint32_t num_entries;
+    uint32_t entries_capacity;
+    Slot* slots;
+    uint32_t slot_mask;           // Slot count - 1, a power of two minus one
+    uint32_t num_keys;            // Occupied slots
+
+    Pager* pager;                 // Temporary file, NULL until the first spill
+    uint32_t page_size;
+    bool spilled[HASH_JOIN_PARTITIONS];
+    Stream build_streams[HASH_JOIN_PARTITIONS];
+    Stream probe_streams[HASH_JOIN_PARTITIONS];
+    uint8_t* scratch;             // A record on its way to or from a stream
+    uint32_t scratch_capacity;
+    bool built;
+
+    uint32_t match;               // Current matching entry plus one, 0 if none
+    Value match_values[HASH_JOIN_MAX_VALUES];
+    uint32_t match_count;
+
+    bool replaying;
+    int32_t replay_partition;
+    StreamReader replay_reader;
+    uint8_t* replay_record;
+    uint32_t replay_capacity;
+    Value replay_values[HASH_JOIN_MAX_VALUES];
+
+    HashJoinStats stats;
+};
+
+static void* resize(void* memory, size_t size) {
+    void* resized = realloc(memory, size ? size : 1);
+    if (!resized) {
+        printf("ERROR: Out of memory in hash join\n");
+        exit(EXIT_FAILURE);
+    }
+    return resized;
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Equal values hash alike; an integer and text never compare equal, so their
+// hashes need not agree
+static uint64_t hash_value(const Value* value) {
+    if (value->type == VALUE_INT) {
+        return mix((uint64_t)value->integer);
+    }
+    uint64_t hash = 1469598103934665603ULL ^ (uint64_t)value->type;  // FNV-1a
+    for (uint32_t i = 0; i < value->length; i++) {
+        hash ^= (uint8_t)value->text[i];
+        hash *= 1099511628211ULL;
+    }
+    return mix(hash);
+}
+
+HashJoin* hash_join_new(size_t memory_budget) {
+    HashJoin* join = calloc(1, sizeof(HashJoin));
+    if (!join) {
+        return NULL;
+    }
+    PagerOptions options;
+    pager_default_options(&options);
+    join->memory_budget = memory_budget < HASH_JOIN_MIN_MEMORY ? HASH_JOIN_MIN_MEMORY : memory_budget;
+    join->table_budget = join->memory_budget - join->memory_budget / 4 -
+                         (size_t)HASH_JOIN_PARTITIONS * options.page_size;
+    join->slots = calloc(INITIAL_SLOTS, sizeof(Slot));
+    if (!join->slots) {
+        free(join);
+        return NULL;
+    }
+    join->slot_mask = INITIAL_SLOTS - 1;
+    join->replay_partition = -1;
+    return join;
+}
+
+void hash_join_free(HashJoin* join) {
+    for (uint32_t i = 0; i < HASH_JOIN_PARTITIONS; i++) {
+        free(join->build_streams[i].pages);
+        free(join->build_streams[i].buffer);
+        free(join->probe_streams[i].pages);
+        free(join->probe_streams[i].buffer);
+    }
+    if (join->pager) {
+        pager_close(join->pager);
+    }
+    free(join->arena);
+    free(join->entries);
+    free(join->slots);
+    free(join->scratch);
+    free(join->replay_record);
+    free(join);
+}
+
+static size_t table_bytes(const HashJoin* join) {
+    return join->arena_used + join->num_entries * sizeof(Entry) + (join->slot_mask + 1) * sizeof(Slot);
+}
+
+static bool key_equals(const HashJoin* join, const Entry* entry, const Value* key) {
+    Value stored;
+    value_record_decode(join->arena + entry->offset, &stored, 1);
+    return vm_value_compare(&stored, key) == 0;
+}
+
+static void grow_slots(HashJoin* join) {
+    uint32_t old_count = join->slot_mask + 1;
+    Slot* old = join->slots;
+    join->slots = calloc((size_t)old_count * 2, sizeof(Slot));
+    if (!join->slots) {
+        printf("ERROR: Out of memory in hash join\n");
+        exit(EXIT_FAILURE);
+    }
+    join->slot_mask = old_count * 2 - 1;
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (old[i].entry == 0) {
+            continue;
+        }
+        uint32_t slot = (uint32_t)join->entries[old[i].entry - 1].hash & join->slot_mask;
+        while (join->slots[slot].entry != 0) {
+            slot = (slot + 1) & join->slot_mask;
+        }
+        join->slots[slot] = old[i];
+    }
+    free(old);
+}
+
+// Reserves `size` bytes at the end of the arena and returns their offset
+static size_t arena_append(HashJoin* join, uint32_t size) {
+    if (join->arena_used + size > join->arena_capacity) {
+        size_t capacity = join->arena_capacity ? join->arena_capacity : 64 * 1024;
+        while (capacity < join->arena_used + size) {
+            capacity *= 2;
+        }
+        join->arena = resize(join->arena, capacity);
+        join->arena_capacity = capacity;
+    }
+    size_t offset = join->arena_used;
+    join->arena_used += size;
+    return offset;
+}
+
+// Adds the record at `offset` in the arena to the table: a new slot for a
+// new key, or the head of its key's chain
+static void index_record(HashJoin* join, uint64_t hash, size_t offset) {
+    if (join->num_entries == join->entries_capacity) {
+        join->entries_capacity = join->entries_capacity ? join->entries_capacity * 2 : 1024;
+        join->entries = resize(join->entries, join->entries_capacity * sizeof(Entry));
+    }
+    uint32_t number = ++join->num_entries;
+    Entry* entry = &join->entries[number - 1];
+    entry->hash = hash;
+    entry->offset = offset;
+    entry->next = 0;
+    if ((join->num_keys + 1) * 2 > join->slot_mask + 1) {
+        grow_slots(join);
+    }
+    Value key;
+    value_record_decode(join->arena + offset, &key, 1);
+    uint32_t tag = (uint32_t)(hash >> 32);
+    for (uint32_t slot = (uint32_t)hash & join->slot_mask;; slot = (slot + 1) & join->slot_mask) {
+        Slot* candidate = &join->slots[slot];
+        if (candidate->entry == 0) {
+            candidate->tag = tag;
+            candidate->entry = number;
+            join->num_keys++;
+            return;
+        }
+        const Entry* head = &join->entries[candidate->entry - 1];
+        if (candidate->tag == tag && head->hash == hash && key_equals(join, head, &key)) {
+            entry->next = candidate->entry;
+            candidate->entry = number;
+            return;
+        }
+    }
+}
+
+static void clear_table(HashJoin* join) {
+    join->arena_used = 0;
+    join->num_entries = 0;
+    join->num_keys = 0;
+    join->match = 0;
+    memset(join->slots, 0, (join->slot_mask + 1) * sizeof(Slot));
+}
+
+static bool open_file(HashJoin* join) {
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = (uint32_t)(join->memory_budget / 4 / options.page_size);
+    options.read_ahead_pages = 0;  // Partition readers prefetch for themselves
+    join->pager = pager_open_temporary(&options);
+    if (!join->pager) {
+        return false;
+    }
+    join->page_size = pager_get_page_size(join->pager);
+    return true;
+}
+
+// Writes the stream's buffered page out as a new page of the file. Called
+// with a full buffer, or once at the end of the stream's input.
+static void stream_flush(HashJoin* join, Stream* stream) {
+    uint64_t pages = (stream->bytes + join->page_size - 1) / join->page_size;
+    if (stream->num_pages == pages) {
+        return;
+    }
+    // Pages are never read back through these pointers, so none stays pinned
+    pager_begin_op(join->pager);
+    page_num_t page_num = pager_get_num_pages(join->pager);
+    uint8_t* page = pager_get_page(join->pager, page_num);
+    memcpy(page, stream->buffer, join->page_size);
+    pager_mark_dirty(join->pager, page_num);
+    if (stream->num_pages == stream->pages_capacity) {
+        stream->pages_capacity = stream->pages_capacity ? stream->pages_capacity * 2 : 64;
+        stream->pages = resize(stream->pages, stream->pages_capacity * sizeof(page_num_t));
+    }
+    stream->pages[stream->num_pages++] = page_num;
+    join->stats.pages_written++;
+}
+
+static void stream_write(HashJoin* join, Stream* stream, const uint8_t* bytes, uint32_t size) {
+    if (!stream->buffer) {
+        stream->buffer = resize(NULL, join->page_size);
+    }
+    while (size > 0) {
+        uint32_t offset = (uint32_t)(stream->bytes % join->page_size);
+        uint32_t chunk = size < join->page_size - offset ? size : join->page_size - offset;
+        memcpy(stream->buffer + offset, bytes, chunk);
+        stream->bytes += chunk;
+        bytes += chunk;
+        size -= chunk;
+        if (stream->bytes % join->page_size == 0) {
+            stream_flush(join, stream);
+        }
+    }
+}
+
+// Writes out the last, partial page of each spilled partition's stream
+static void streams_finish(HashJoin* join, Stream* streams) {
+    for (uint32_t i = 0; i < HASH_JOIN_PARTITIONS; i++) {
+        if (streams[i].buffer) {
+            stream_flush(join, &streams[i]);
+            free(streams[i].buffer);
+            streams[i].buffer = NULL;
+        }
+    }
+}
+
+static void write_row(HashJoin* join, Stream* stream, const Value* row, uint32_t count) {
+    uint32_t size = value_record_size(row, count);
+    if (size > join->scratch_capacity) {
+        join->scratch = resize(join->scratch, size);
+        join->scratch_capacity = size;
+    }
+    value_record_encode(row, count, size, join->scratch);
+    stream_write(join, stream, join->scratch, size);
+}
+
+// Reads from a stream, prefetching a window of its pages whenever the
+// reader enters one
+static void stream_read(HashJoin* join, StreamReader* reader, uint8_t* out, uint32_t size) {
+    const Stream* stream = reader->stream;
+    while (size > 0) {
+        uint32_t index = (uint32_t)(reader->position / join->page_size);
+        uint32_t offset = (uint32_t)(reader->position % join->page_size);
+        if (offset == 0 && index % HASH_JOIN_PREFETCH_PAGES == 0) {
+            uint32_t count = stream->num_pages - index;
+            count = count < HASH_JOIN_PREFETCH_PAGES ? count : HASH_JOIN_PREFETCH_PAGES;
+            pager_begin_op(join->pager);
+            pager_prefetch(join->pager, &stream->pages[index], count, PAGE_HINT_SCAN);
+        }
+        const uint8_t* page = pager_get_page_hinted(join->pager, stream->pages[index], PAGE_HINT_SCAN);
+        uint32_t chunk = size < join->page_size - offset ? size : join->page_size - offset;
+        memcpy(out, page + offset, chunk);
+        reader->position += chunk;
+        out += chunk;
+        size -= chunk;
+    }
+}
+
+// Reads the next record into a buffer grown to fit it; false at the end
+static bool stream_next(HashJoin* join, StreamReader* reader, uint8_t** buffer, uint32_t* capacity) {
+    if (!reader->stream || reader->position >= reader->stream->bytes) {
+        return false;
+    }
+    uint32_t size;
+    stream_read(join, reader, (uint8_t*)&size, sizeof(size));
+    if (size > *capacity) {
+        *buffer = resize(*buffer, size);
+        *capacity = size;
+    }
+    memcpy(*buffer, &size, sizeof(size));
+    stream_read(join, reader, *buffer + sizeof(size), size - (uint32_t)sizeof(size));
+    return true;
+}
+
+// Spills every partition but the first, or the first once the others are
+// out, and keeps the rows of partitions still resident
+static bool spill(HashJoin* join) {
+    if (!join->pager && !open_file(join)) {
+        return false;
+    }
+    bool first = !join->spilled[1];
+    for (uint32_t i = 0; i < HASH_JOIN_PARTITIONS; i++) {
+        if (first ? i != 0 : i == 0) {
+            join->spilled[i] = true;
+            join->stats.spilled_partitions++;
+        }
+    }
+    uint8_t* arena = join->arena;
+    Entry* entries = join->entries;
+    uint32_t num_entries = join->num_entries;
+    join->arena = NULL;
+    join->arena_capacity = 0;
+    join->entries = NULL;
+    join->entries_capacity = 0;
+    clear_table(join);
+    for (uint32_t i = 0; i < num_entries; i++) {
+        const uint8_t* record = arena + entries[i].offset;
+        uint32_t size = value_record_length(record);
+        uint32_t partition = (uint32_t)(entries[i].hash >> PARTITION_SHIFT);
+        if (join->spilled[partition]) {
+            stream_write(join, &join->build_streams[partition], record, size);
+            join->stats.spilled_build_rows++;
+        } else {
+            size_t offset = arena_append(join, size);
+            memcpy(join->arena + offset, record, size);
+            index_record(join, entries[i].hash, offset);
+        }
+    }
+    free(arena);
+    free(entries);
+    return true;
+}
+
+bool hash_join_insert(HashJoin* join, const Value* row, uint32_t count) {
+    if (join->built || count == 0 || count > HASH_JOIN_MAX_VALUES) {
+        return false;
+    }
+    // A NULL key equals nothing
+    if (row[0].type == VALUE_NULL) {
+        return true;
+    }
+    join->stats.build_rows++;
+    uint64_t hash = hash_value(&row[0]);
+    uint32_t partition = (uint32_t)(hash >> PARTITION_SHIFT);
+    if (join->spilled[partition]) {
+        write_row(join, &join->build_streams[partition], row, count);
+        join->stats.spilled_build_rows++;
+        return true;
+    }
+    uint32_t size = value_record_size(row, count);
+    size_t offset = arena_append(join, size);
+    value_record_encode(row, count, size, join->arena + offset);
+    index_record(join, hash, offset);
+    while (table_bytes(join) > join->table_budget && !join->spilled[0]) {
+        if (!spill(join)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void hash_join_build(HashJoin* join) {
+    if (!join->built && join->pager) {
+        streams_finish(join, join->build_streams);
+    }
+    join->built = true;
+}
+
+static void load_match(HashJoin* join) {
+    const Entry* entry = &join->entries[join->match - 1];
+    join->match_count = value_record_decode(join->arena + entry->offset, join->match_values, HASH_JOIN_MAX_VALUES);
+}
+
+bool hash_join_probe(HashJoin* join, const Value* row, uint32_t count) {
+    hash_join_build(join);
+    join->match = 0;
+    if (count == 0 || row[0].type == VALUE_NULL) {
+        return false;
+    }
+    uint64_t hash = hash_value(&row[0]);
+    if (!join->replaying) {
+        join->stats.probe_rows++;
+        uint32_t partition = (uint32_t)(hash >> PARTITION_SHIFT);
+        if (join->spilled[partition]) {
+            if (count <= HASH_JOIN_MAX_VALUES) {
+                write_row(join, &join->probe_streams[partition], row, count);
+                join->stats.spilled_probe_rows++;
+            }
+            return false;
+        }
+    }
+    uint32_t tag = (uint32_t)(hash >> 32);
+    for (uint32_t slot = (uint32_t)hash & join->slot_mask; join->slots[slot].entry != 0;
+         slot = (slot + 1) & join->slot_mask) {
+        const Slot* candidate = &join->slots[slot];
+        const Entry* head = &join->entries[candidate->entry - 1];
+        if (candidate->tag == tag && head->hash == hash && key_equals(join, head, &row[0])) {
+            join->match = candidate->entry;
+            load_match(join);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool hash_join_next(HashJoin* join) {
+    if (join->match == 0) {
+        return false;
+    }
+    join->match = join->entries[join->match - 1].next;
+    if (join->match == 0) {
+        return false;
+    }
+    load_match(join);
+    return true;
+}
+
+const Value* hash_join_match(HashJoin* join, uint32_t* count) {
+    *count = join->match ? join->match_count : 0;
+    return join->match ? join->match_values : NULL;
+}
+
+// Replaces the table's contents with a spilled partition's build rows. The
+// budget no longer applies: a partition is loaded whole.
+static void load_partition(HashJoin* join, uint32_t partition) {
+    clear_table(join);
+    StreamReader reader = { &join->build_streams[partition], 0 };
+    while (stream_next(join, &reader, &join->scratch, &join->scratch_capacity)) {
+        uint32_t size = value_record_length(join->scratch);
+        size_t offset = arena_append(join, size);
+        memcpy(join->arena + offset, join->scratch, size);
+        Value key;
+        value_record_decode(join->arena + offset, &key, 1);
+        index_record(join, hash_value(&key), offset);
+    }
+}
+
+const Value* hash_join_replay(HashJoin* join, uint32_t* count) {
+    *count = 0;
+    hash_join_build(join);
+    if (!join->replaying) {
+        join->replaying = true;
+        if (join->pager) {
+            streams_finish(join, join->probe_streams);
+        }
+    }
+    for (;;) {
+        if (stream_next(join, &join->replay_reader, &join->replay_record, &join->replay_capacity)) {
+            *count = value_record_decode(join->replay_record, join->replay_values, HASH_JOIN_MAX_VALUES);
+            return join->replay_values;
+        }
+        // Partitions without saved probe rows have nothing to join
+        do {
+            join->replay_partition++;
+        } while (join->replay_partition < HASH_JOIN_PARTITIONS &&
+                 join->probe_streams[join->replay_partition].bytes == 0);
+        if (join->replay_partition >= HASH_JOIN_PARTITIONS) {
+            join->replay_partition = HASH_JOIN_PARTITIONS;
+            join->replay_reader.stream = NULL;
+            return NULL;
+        }
+        load_partition(join, (uint32_t)join->replay_partition);
+        join->replay_reader.stream = &join->probe_streams[join->replay_partition];
+        join->replay_reader.position = 0;
+    }
+}
+
+HashJoinStats hash_join_stats(const HashJoin* join) {
+    return join->stats;
+}
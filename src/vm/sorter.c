@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sorter.h"
+#include "vm.h"
+
+// A sorted run: a stream of value records over consecutive pages of the file
+typedef struct {
+    page_num_t first_page;
+    uint32_t num_pages;
+    uint64_t bytes;
+} Run;
+
+typedef struct {
+    Run run;
+    uint64_t position;            // Bytes of the run consumed
+    bool done;
+    uint8_t* record;              // Current record, which `values` point into
+    uint32_t record_capacity;
+    Value values[SORTER_MAX_VALUES];
+    uint32_t count;
+} RunReader;
+
+// A record of the in-memory run, with an order-preserving image of its
+// first key, so most comparisons never touch the record
+typedef struct {
+    size_t offset;
+    uint64_t prefix;              // Integers with the sign bit flipped, text's first 8 bytes big-endian
+    uint8_t type;
+} SortEntry;
+
+struct Sorter {
+    uint32_t num_keys;
+    uint32_t descending;
+    size_t memory_budget;
+    size_t run_budget;            // Bytes of records and entries held in memory
+
+    // In-memory run: records back to back, and their entries in sort order
+    uint8_t* memory;
+    size_t memory_used;
+    size_t memory_capacity;
+    SortEntry* entries;
+    uint32_t num_records;
+    uint32_t entries_capacity;
+    uint32_t position;            // Unspilled input: the current record
+    Value row[SORTER_MAX_VALUES]; // Unspilled input: the current row
+    uint32_t row_count;
+
+    Pager* pager;                 // Temporary file, NULL until the first spill
+    Run* runs;
+    uint32_t num_runs;
+
+    RunReader* readers;           // Inputs of the merge in progress
+    uint32_t num_readers;
+    uint32_t* tree;               // Loser tree: tree[0] the winner, tree[1, k) losers
+
+    bool sorted;
+    bool merging;
+    SorterStats stats;
+};
+
+static void* resize(void* memory, size_t size) {
+    void* resized = realloc(memory, size ? size : 1);
+    if (!resized) {
+        printf("ERROR: Out of memory sorting\n");
+        exit(EXIT_FAILURE);
+    }
+    return resized;
+}
+
+Sorter* sorter_new(uint32_t num_keys, uint32_t descending, size_t memory_budget) {
+    if (num_keys > SORTER_MAX_KEYS) {
+        return NULL;
+    }
+    Sorter* sorter = calloc(1, sizeof(Sorter));
+    if (!sorter) {
+        return NULL;
+    }
+    sorter->num_keys = num_keys;
+    sorter->descending = descending;
+    sorter->memory_budget = memory_budget < SORTER_MIN_MEMORY ? SORTER_MIN_MEMORY : memory_budget;
+    sorter->run_budget = sorter->memory_budget - sorter->memory_budget / 4;
+    return sorter;
+}
+
+void sorter_free(Sorter* sorter) {
+    for (uint32_t i = 0; i < sorter->num_readers; i++) {
+        free(sorter->readers[i].record);
+    }
+    free(sorter->readers);
+    free(sorter->tree);
+    free(sorter->runs);
+    free(sorter->memory);
+    free(sorter->entries);
+    if (sorter->pager) {
+        pager_close(sorter->pager);
+    }
+    free(sorter);
+}
+
+static int compare_keys(const Sorter* sorter, const Value* a, const Value* b) {
+    for (uint32_t i = 0; i < sorter->num_keys; i++) {
+        int cmp = vm_value_compare(&a[i], &b[i]);
+        if (cmp != 0) {
+            return (sorter->descending >> i) & 1 ? -cmp : cmp;
+        }
+    }
+    return 0;
+}
+
+static int compare_records(const Sorter* sorter, const uint8_t* a, const uint8_t* b) {
+    Value left[SORTER_MAX_KEYS];
+    Value right[SORTER_MAX_KEYS];
+    value_record_decode(a, left, sorter->num_keys);
+    value_record_decode(b, right, sorter->num_keys);
+    return compare_keys(sorter, left, right);
+}
+
+static SortEntry make_entry(const Sorter* sorter, const Value* row, size_t offset) {
+    SortEntry entry = { .offset = offset, .prefix = 0, .type = VALUE_NULL };
+    if (sorter->num_keys == 0) {
+        return entry;
+    }
+    entry.type = (uint8_t)row[0].type;
+    if (row[0].type == VALUE_INT) {
+        entry.prefix = (uint64_t)row[0].integer ^ (1ull << 63);
+    } else if (row[0].type != VALUE_NULL) {
+        for (uint32_t i = 0; i < 8; i++) {
+            entry.prefix = entry.prefix << 8 | (i < row[0].length ? (uint8_t)row[0].text[i] : 0);
+        }
+    }
+    return entry;
+}
+
+static int compare_entries(const Sorter* sorter, const SortEntry* a, const SortEntry* b) {
+    int cmp = a->type != b->type ? (a->type < b->type ? -1 : 1) : (a->prefix > b->prefix) - (a->prefix < b->prefix);
+    if (cmp != 0) {
+        return sorter->descending & 1 ? -cmp : cmp;
+    }
+    // Equal images settle NULL and integer keys, but not text
+    if (sorter->num_keys <= 1 && (a->type == VALUE_NULL || a->type == VALUE_INT)) {
+        return 0;
+    }
+    return compare_records(sorter, sorter->memory + a->offset, sorter->memory + b->offset);
+}
+
+// Bottom-up merge sort of the in-memory run's entries: stable, and its
+// scratch array is accounted for in the run's budget
+static void sort_run(Sorter* sorter) {
+    uint32_t n = sorter->num_records;
+    SortEntry* scratch = resize(NULL, n * sizeof(SortEntry));
+    SortEntry* from = sorter->entries;
+    SortEntry* to = scratch;
+    for (uint32_t width = 1; width < n; width *= 2) {
+        for (uint32_t low = 0; low < n; low += 2 * width) {
+            uint32_t middle = low + width < n ? low + width : n;
+            uint32_t high = low + 2 * width < n ? low + 2 * width : n;
+            uint32_t i = low;
+            uint32_t j = middle;
+            uint32_t k = low;
+            while (i < middle && j < high) {
+                bool right_first = compare_entries(sorter, &from[j], &from[i]) < 0;
+                to[k++] = right_first ? from[j++] : from[i++];
+            }
+            while (i < middle) {
+                to[k++] = from[i++];
+            }
+            while (j < high) {
+                to[k++] = from[j++];
+            }
+        }
+        SortEntry* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != sorter->entries) {
+        memcpy(sorter->entries, from, n * sizeof(SortEntry));
+    }
+    free(scratch);
+}
+
+static bool open_file(Sorter* sorter) {
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = (uint32_t)((sorter->memory_budget - sorter->run_budget) / options.page_size);
+    options.read_ahead_pages = 0;  // Run readers prefetch for themselves
+    sorter->pager = pager_open_temporary(&options);
+    return sorter->pager != NULL;
+}
+
+static void write_bytes(Sorter* sorter, Run* run, const uint8_t* bytes, uint32_t size) {
+    uint32_t page_size = pager_get_page_size(sorter->pager);
+    while (size > 0) {
+        uint32_t offset = (uint32_t)(run->bytes % page_size);
+        if (offset == 0) {
+            // Runs are written one at a time, so each takes consecutive pages
+            pager_begin_op(sorter->pager);
+            run->num_pages++;
+            sorter->stats.pages_written++;
+        }
+        page_num_t page_num = run->first_page + run->num_pages - 1;
+        uint8_t* page = pager_get_page(sorter->pager, page_num);
+        uint32_t chunk = size < page_size - offset ? size : page_size - offset;
+        memcpy(page + offset, bytes, chunk);
+        pager_mark_dirty(sorter->pager, page_num);
+        run->bytes += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+static Run new_run(Sorter* sorter) {
+    Run run = { .first_page = pager_get_num_pages(sorter->pager), .num_pages = 0, .bytes = 0 };
+    return run;
+}
+
+static bool spill(Sorter* sorter) {
+    if (!sorter->pager && !open_file(sorter)) {
+        return false;
+    }
+    sort_run(sorter);
+    Run run = new_run(sorter);
+    for (uint32_t i = 0; i < sorter->num_records; i++) {
+        const uint8_t* record = sorter->memory + sorter->entries[i].offset;
+        write_bytes(sorter, &run, record, value_record_length(record));
+    }
+    sorter->runs = resize(sorter->runs, (sorter->num_runs + 1) * sizeof(Run));
+    sorter->runs[sorter->num_runs++] = run;
+    sorter->stats.runs++;
+    sorter->memory_used = 0;
+    sorter->num_records = 0;
+    return true;
+}
+
+bool sorter_add(Sorter* sorter, const Value* row, uint32_t count) {
+    if (sorter->sorted || count < sorter->num_keys || count > SORTER_MAX_VALUES) {
+        return false;
+    }
+    uint32_t size = value_record_size(row, count);
+    // Each record also costs its entry and its slot in the sort's scratch array
+    size_t needed = sorter->memory_used + size + (sorter->num_records + 1) * 2 * sizeof(SortEntry);
+    if (sorter->num_records > 0 && needed > sorter->run_budget && !spill(sorter)) {
+        return false;
+    }
+    if (sorter->memory_used + size > sorter->memory_capacity) {
+        size_t capacity = sorter->memory_capacity ? sorter->memory_capacity : 4096;
+        while (capacity < sorter->memory_used + size) {
+            capacity *= 2;
+        }
+        sorter->memory = resize(sorter->memory, capacity);
+        sorter->memory_capacity = capacity;
+    }
+    if (sorter->num_records == sorter->entries_capacity) {
+        sorter->entries_capacity = sorter->entries_capacity ? sorter->entries_capacity * 2 : 256;
+        sorter->entries = resize(sorter->entries, sorter->entries_capacity * sizeof(SortEntry));
+    }
+    value_record_encode(row, count, size, sorter->memory + sorter->memory_used);
+    sorter->entries[sorter->num_records++] = make_entry(sorter, row, sorter->memory_used);
+    sorter->memory_used += size;
+    sorter->stats.rows++;
+    return true;
+}
+
+// Reads from a run, prefetching a window of its pages whenever the reader
+// enters one
+static void read_bytes(Sorter* sorter, RunReader* reader, uint8_t* out, uint32_t size) {
+    uint32_t page_size = pager_get_page_size(sorter->pager);
+    while (size > 0) {
+        uint32_t index = (uint32_t)(reader->position / page_size);
+        uint32_t offset = (uint32_t)(reader->position % page_size);
+        if (offset == 0 && index % SORTER_PREFETCH_PAGES == 0) {
+            page_num_t pages[SORTER_PREFETCH_PAGES];
+            uint32_t count = reader->run.num_pages - index;
+            count = count < SORTER_PREFETCH_PAGES ? count : SORTER_PREFETCH_PAGES;
+            for (uint32_t i = 0; i < count; i++) {
+                pages[i] = reader->run.first_page + index + i;
+            }
+            pager_prefetch(sorter->pager, pages, count, PAGE_HINT_SCAN);
+        }
+        const uint8_t* page = pager_get_page_hinted(sorter->pager, reader->run.first_page + index, PAGE_HINT_SCAN);
+        uint32_t chunk = size < page_size - offset ? size : page_size - offset;
+        memcpy(out, page + offset, chunk);
+        reader->position += chunk;
+        out += chunk;
+        size -= chunk;
+    }
+}
+
+static void reader_advance(Sorter* sorter, RunReader* reader) {
+    if (reader->position == reader->run.bytes) {
+        reader->done = true;
+        return;
+    }
+    uint32_t size;
+    read_bytes(sorter, reader, (uint8_t*)&size, sizeof(size));
+    if (size > reader->record_capacity) {
+        reader->record = resize(reader->record, size);
+        reader->record_capacity = size;
+    }
+    memcpy(reader->record, &size, sizeof(size));
+    read_bytes(sorter, reader, reader->record + sizeof(size), size - (uint32_t)sizeof(size));
+    reader->count = value_record_decode(reader->record, reader->values, SORTER_MAX_VALUES);
+}
+
+// Whether reader a's row comes out before reader b's. Index num_readers
+// stands for a source that beats every other, used to build the tree, and
+// exhausted readers lose to every other. Ties go to the earlier run, which
+// holds the rows added earlier.
+static bool beats(Sorter* sorter, uint32_t a, uint32_t b) {
+    uint32_t sentinel = sorter->num_readers;
+    if (a == sentinel || b == sentinel) {
+        return a == sentinel;
+    }
+    RunReader* left = &sorter->readers[a];
+    RunReader* right = &sorter->readers[b];
+    if (left->done || right->done) {
+        return !left->done;
+    }
+    int cmp = compare_keys(sorter, left->values, right->values);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+// Replays the matches on the path from a reader's leaf to the root after
+// its row changed
+static void replay(Sorter* sorter, uint32_t reader) {
+    uint32_t winner = reader;
+    for (uint32_t node = (reader + sorter->num_readers) / 2; node > 0; node /= 2) {
+        if (beats(sorter, sorter->tree[node], winner)) {
+            uint32_t loser = winner;
+            winner = sorter->tree[node];
+            sorter->tree[node] = loser;
+        }
+    }
+    sorter->tree[0] = winner;
+}
+
+static void merge_start(Sorter* sorter, const Run* runs, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        RunReader* reader = &sorter->readers[i];
+        reader->run = runs[i];
+        reader->position = 0;
+        reader->done = false;
+        pager_begin_op(sorter->pager);
+        reader_advance(sorter, reader);
+    }
+    sorter->num_readers = count;
+    for (uint32_t node = 0; node < count; node++) {
+        sorter->tree[node] = count;
+    }
+    for (uint32_t i = count; i-- > 0;) {
+        replay(sorter, i);
+    }
+}
+
+static RunReader* merge_winner(Sorter* sorter) {
+    RunReader* winner = &sorter->readers[sorter->tree[0]];
+    return winner->done ? NULL : winner;
+}
+
+static void merge_step(Sorter* sorter) {
+    uint32_t winner = sorter->tree[0];
+    pager_begin_op(sorter->pager);
+    reader_advance(sorter, &sorter->readers[winner]);
+    replay(sorter, winner);
+}
+
+static bool load_row(Sorter* sorter) {
+    if (sorter->position >= sorter->num_records) {
+        return false;
+    }
+    const uint8_t* record = sorter->memory + sorter->entries[sorter->position].offset;
+    sorter->row_count = value_record_decode(record, sorter->row, SORTER_MAX_VALUES);
+    return true;
+}
+
+bool sorter_sort(Sorter* sorter) {
+    if (sorter->sorted) {
+        return false;
+    }
+    sorter->sorted = true;
+    if (!sorter->pager) {
+        sort_run(sorter);
+        sorter->position = 0;
+        return load_row(sorter);
+    }
+    if (sorter->num_records > 0) {
+        spill(sorter);
+    }
+    free(sorter->memory);
+    free(sorter->entries);
+    sorter->memory = NULL;
+    sorter->entries = NULL;
+    sorter->memory_capacity = 0;
+    sorter->entries_capacity = 0;
+
+    // Every input keeps a prefetch window in the pool's probation queue,
+    // which holds a quarter of the pool
+    uint32_t fan_in = pager_get_capacity(sorter->pager) / (4 * SORTER_PREFETCH_PAGES);
+    fan_in = fan_in < 2 ? 2 : fan_in > SORTER_MAX_FAN_IN ? SORTER_MAX_FAN_IN : fan_in;
+    uint32_t num_inputs = sorter->num_runs < fan_in ? sorter->num_runs : fan_in;
+    sorter->readers = calloc(num_inputs, sizeof(RunReader));
+    sorter->tree = calloc(num_inputs, sizeof(uint32_t));
+    if (!sorter->readers || !sorter->tree) {
+        printf("ERROR: Out of memory sorting\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Each pass merges consecutive groups of runs, so the runs stay in the
+    // order of their rows and ties keep coming out in order. A pass stops
+    // merging once the final merge can take the runs that are left.
+    while (sorter->num_runs > fan_in) {
+        uint32_t excess = sorter->num_runs - fan_in;
+        uint32_t num_merged = 0;
+        for (uint32_t first = 0, count; first < sorter->num_runs; first += count) {
+            count = sorter->num_runs - first < fan_in ? sorter->num_runs - first : fan_in;
+            count = count - 1 > excess ? excess + 1 : count;
+            Run merged = sorter->runs[first];
+            if (count > 1) {
+                merge_start(sorter, &sorter->runs[first], count);
+                merged = new_run(sorter);
+                for (RunReader* winner = merge_winner(sorter); winner; winner = merge_winner(sorter)) {
+                    write_bytes(sorter, &merged, winner->record, value_record_length(winner->record));
+                    merge_step(sorter);
+                }
+                sorter->stats.runs++;
+                excess -= count - 1;
+            }
+            sorter->runs[num_merged++] = merged;
+        }
+        sorter->num_runs = num_merged;
+        sorter->stats.merge_passes++;
+    }
+    merge_start(sorter, sorter->runs, sorter->num_runs);
+    sorter->merging = true;
+    return merge_winner(sorter) != NULL;
+}
+
+bool sorter_next(Sorter* sorter) {
+    if (!sorter->merging) {
+        sorter->position++;
+        return load_row(sorter);
+    }
+    if (!merge_winner(sorter)) {
+        return false;
+    }
+    merge_step(sorter);
+    return merge_winner(sorter) != NULL;
+}
+
+const Value* sorter_row(Sorter* sorter, uint32_t* count) {
+    if (sorter->merging) {
+        RunReader* winner = merge_winner(sorter);
+        *count = winner ? winner->count : 0;
+        return winner ? winner->values : NULL;
+    }
+    *count = sorter->position < sorter->num_records ? sorter->row_count : 0;
+    return *count ? sorter->row : NULL;
+}
+
+SorterStats sorter_stats(const Sorter* sorter) {
+    return sorter->stats;
+}
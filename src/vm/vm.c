@@ -0,0 +1,1332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vm.h"
+#include "batch.h"
+#include "sorter.h"
+#include "hashjoin.h"
+#include "pager.h"
+
+// GCC and Clang dispatch through a table of label addresses: one indirect
+// jump per instruction, each from its own site, so the branch predictor
+// learns opcode sequences. Other compilers (or -DVM_NO_COMPUTED_GOTO) use a
+// switch in a loop.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define PROGRAM_INITIAL_CAPACITY 32
+#define VM_ERROR_SIZE 128
+
+typedef struct {
+    BTree* btree;
+    const RowSchema* schema;
+    BTreeCursor* cursor;          // NULL while closed
+    bool on_row;
+    Batch* batch;                 // Allocated by the first OP_BATCH_NEXT
+    uint32_t batch_position;      // Next entry of the batch's selection
+    int32_t batch_row;            // Row OP_KEY/OP_COLUMN read, -1 outside a batch
+    const SecondaryIndex* index;  // Index cursors: the index, NULL for table cursors
+    IndexCursor* index_cursor;    // Allocated by the first seek
+    Sorter* sorter;               // Sorter cursors: the sorter, NULL for the others
+    HashJoin* hash_join;          // Hash cursors: the join, NULL for the others
+    uint32_t probe_width;         // Hash cursors: values in a probe row
+} VmCursor;
+
+// Profiling state: the instruction being timed and the clock and page
+// counters at its dispatch
+typedef struct {
+    VmProfile* entries;           // One per instruction
+    Pager* pager;                 // NULL for programs without tables
+    uint32_t current;             // UINT32_MAX outside vm_step()
+    uint64_t start;
+    uint64_t hits;
+    uint64_t misses;
+} VmProfiler;
+
+struct Vm {
+    Program* program;
+    Value* registers;
+    Value* parameters;
+    VmCursor* cursors;
+    size_t sort_memory;           // Budget of each sorter
+    size_t join_memory;           // Budget of each hash join
+    uint32_t pc;
+    const Value* row;             // Registers of the last OP_RESULT_ROW
+    uint32_t row_length;
+    VmRowCallback callback;       // Set during vm_run()
+    void* callback_context;
+    VmProfiler* profiler;         // NULL unless profiling
+    uint8_t record[VM_MAX_RECORD_SIZE];
+    char error[VM_ERROR_SIZE];
+};
+
+Program* program_new(void) {
+    Program* program = calloc(1, sizeof(Program));
+    if (!program) {
+        return NULL;
+    }
+    program->capacity = PROGRAM_INITIAL_CAPACITY;
+    program->code = malloc(program->capacity * sizeof(Instruction));
+    if (!program->code) {
+        free(program);
+        return NULL;
+    }
+    return program;
+}
+
+void program_free(Program* program) {
+    free(program->code);
+    free(program->text_pool);
+    free(program->text_offsets);
+    free(program->tables);
+    free(program->schemas);
+    free(program->indexes);
+    free(program);
+}
+
+static void* grow(void* array, uint32_t* capacity, uint32_t needed, size_t element_size) {
+    if (needed <= *capacity) {
+        return array;
+    }
+    uint32_t new_capacity = *capacity ? *capacity : PROGRAM_INITIAL_CAPACITY;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    void* grown = realloc(array, new_capacity * element_size);
+    if (!grown) {
+        printf("ERROR: Out of memory building program\n");
+        exit(EXIT_FAILURE);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+// Register and cursor counts follow from the operands, so code generators
+// never have to declare them
+static void note_register(Program* program, int32_t reg) {
+    if (reg >= 0 && (uint32_t)reg + 1 > program->num_registers) {
+        program->num_registers = (uint32_t)reg + 1;
+    }
+}
+
+static void note_cursor(Program* program, int32_t cursor) {
+    if (cursor >= 0 && (uint32_t)cursor + 1 > program->num_cursors) {
+        program->num_cursors = (uint32_t)cursor + 1;
+    }
+}
+
+uint32_t program_emit(Program* program, Opcode opcode, int32_t p1, int32_t p2, int32_t p3) {
+    program->code = grow(program->code, &program->capacity, program->length + 1, sizeof(Instruction));
+    Instruction* instruction = &program->code[program->length];
+    instruction->opcode = (uint8_t)opcode;
+    instruction->p1 = p1;
+    instruction->p2 = p2;
+    instruction->p3 = p3;
+
+    switch (opcode) {
+        case OP_INTEGER:
+        case OP_INT64:
+        case OP_STRING:
+        case OP_NULL:
+        case OP_IS_NULL:
+            note_register(program, p1);
+            break;
+        case OP_VARIABLE:
+            note_register(program, p1);
+            if (p3 >= 0 && (uint32_t)p3 + 1 > program->num_parameters) {
+                program->num_parameters = (uint32_t)p3 + 1;
+            }
+            break;
+        case OP_MOVE:
+        case OP_ADD:
+        case OP_EQ:
+        case OP_NE:
+        case OP_LT:
+        case OP_LE:
+        case OP_GT:
+        case OP_GE:
+        case OP_INSERT:
+            note_register(program, p1);
+            note_register(program, p3);
+            break;
+        case OP_INDEX_INSERT:
+            if (p2 >= 0 && (uint32_t)p2 < program->num_indexes) {
+                const SecondaryIndex* index = program->indexes[p2];
+                for (uint32_t i = 0; i < index->num_columns; i++) {
+                    note_register(program, p1 + (int32_t)index->columns[i]);
+                }
+            }
+            break;
+        case OP_MAKE_RECORD:
+            note_register(program, p1);
+            if (p2 >= 0 && (uint32_t)p2 < program->num_tables) {
+                note_register(program, p3 + program->schemas[p2]->num_columns - 1);
+            }
+            break;
+        case OP_RESULT_ROW:
+            note_register(program, p1 + p3 - 1);
+            break;
+        case OP_OPEN_READ:
+        case OP_OPEN_INDEX:
+        case OP_SORTER_OPEN:
+        case OP_SORTER_SORT:
+        case OP_SORTER_NEXT:
+        case OP_HASH_OPEN:
+        case OP_HASH_BUILD:
+        case OP_HASH_NEXT:
+        case OP_INDEX_NEXT:
+        case OP_CLOSE:
+        case OP_REWIND:
+        case OP_NEXT:
+        case OP_BATCH_ROW:
+            note_cursor(program, p1);
+            break;
+        case OP_BATCH_NEXT:
+            note_cursor(program, p1);
+            note_register(program, p3);
+            break;
+        case OP_SEEK_GE:
+        case OP_INDEX_SEEK_EQ:
+            note_cursor(program, p1);
+            note_register(program, p3);
+            break;
+        case OP_INDEX_SEEK_RANGE:
+            note_cursor(program, p1);
+            note_register(program, p3 + 1);
+            break;
+        case OP_KEY:
+            note_register(program, p1);
+            note_cursor(program, p3);
+            break;
+        case OP_AGGREGATE_STEP:
+            note_register(program, p1);
+            note_register(program, p3);
+            break;
+        case OP_SORTER_INSERT:
+        case OP_HASH_INSERT:
+            note_cursor(program, p1);
+            note_register(program, p3 + p2 - 1);
+            break;
+        case OP_HASH_PROBE:
+        case OP_HASH_REPLAY:
+            // The probe width is OP_HASH_OPEN's, which registers p3 onwards were sized for
+            note_cursor(program, p1);
+            note_register(program, p3);
+            break;
+        case OP_COLUMN:
+        case OP_BATCH_FILTER:
+        case OP_BATCH_AGGREGATE:
+        case OP_TABLE_AGGREGATE:
+            note_register(program, p1);
+            note_cursor(program, p3 >> 16);
+            break;
+        default:
+            break;
+    }
+    return program->length++;
+}
+
+void program_set_jump(Program* program, uint32_t address, uint32_t target) {
+    program->code[address].p2 = (int32_t)target;
+}
+
+uint32_t program_add_text(Program* program, const char* text, uint32_t length) {
+    program->text_pool = grow(program->text_pool, &program->text_pool_capacity,
+                              program->text_pool_size + length, sizeof(char));
+    memcpy(program->text_pool + program->text_pool_size, text, length);
+
+    program->text_offsets = grow(program->text_offsets, &program->text_offsets_capacity,
+                                 (program->num_texts + 1) * 2, sizeof(uint32_t));
+    program->text_offsets[program->num_texts * 2] = program->text_pool_size;
+    program->text_offsets[program->num_texts * 2 + 1] = length;
+    program->text_pool_size += length;
+    return program->num_texts++;
+}
+
+uint32_t program_add_table(Program* program, BTree* btree, const RowSchema* schema) {
+    for (uint32_t i = 0; i < program->num_tables; i++) {
+        if (program->tables[i] == btree) {
+            return i;
+        }
+    }
+    uint32_t capacity = program->tables_capacity;
+    program->tables = grow(program->tables, &capacity, program->num_tables + 1, sizeof(BTree*));
+    program->schemas = grow(program->schemas, &program->tables_capacity, program->num_tables + 1,
+                            sizeof(RowSchema*));
+    program->tables[program->num_tables] = btree;
+    program->schemas[program->num_tables] = schema;
+    return program->num_tables++;
+}
+
+uint32_t program_add_index(Program* program, const SecondaryIndex* index) {
+    for (uint32_t i = 0; i < program->num_indexes; i++) {
+        if (program->indexes[i] == index) {
+            return i;
+        }
+    }
+    program->indexes = grow(program->indexes, &program->indexes_capacity, program->num_indexes + 1,
+                            sizeof(SecondaryIndex*));
+    program->indexes[program->num_indexes] = index;
+    return program->num_indexes++;
+}
+
+int32_t program_column_operand(uint32_t cursor, uint32_t column) {
+    return (int32_t)((cursor << 16) | (column & 0xffff));
+}
+
+// Orders NULL < integers < text < blobs; text compares bytewise
+int vm_value_compare(const Value* a, const Value* b) {
+    if (a->type != b->type) {
+        return a->type < b->type ? -1 : 1;
+    }
+    switch (a->type) {
+        case VALUE_NULL:
+            return 0;
+        case VALUE_INT:
+            return (a->integer > b->integer) - (a->integer < b->integer);
+        case VALUE_TEXT:
+        case VALUE_BLOB: {
+            uint32_t common = a->length < b->length ? a->length : b->length;
+            int result = memcmp(a->text, b->text, common);
+            if (result != 0) {
+                return result < 0 ? -1 : 1;
+            }
+            return (a->length > b->length) - (a->length < b->length);
+        }
+    }
+    return 0;
+}
+
+bool vm_aggregate_fold(Value* aggregate, AggregateFunction function, const Value* value) {
+    if (value->type == VALUE_NULL) {
+        return true;
+    }
+    if (function == AGGREGATE_COUNT) {
+        aggregate->integer++;
+        return true;
+    }
+    if (value->type != VALUE_INT) {
+        return false;
+    }
+    if (aggregate->type == VALUE_NULL) {
+        *aggregate = *value;
+        return true;
+    }
+    int64_t a = aggregate->integer;
+    int64_t b = value->integer;
+    switch (function) {
+        case AGGREGATE_SUM:
+            if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) {
+                return false;
+            }
+            aggregate->integer = a + b;
+            break;
+        case AGGREGATE_MIN:
+            aggregate->integer = b < a ? b : a;
+            break;
+        case AGGREGATE_MAX:
+            aggregate->integer = b > a ? b : a;
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+Vm* vm_new(Program* program) {
+    Vm* vm = calloc(1, sizeof(Vm));
+    if (!vm) {
+        return NULL;
+    }
+    vm->program = program;
+    vm->sort_memory = SORTER_DEFAULT_MEMORY;
+    vm->join_memory = HASH_JOIN_DEFAULT_MEMORY;
+    vm->registers = calloc(program->num_registers ? program->num_registers : 1, sizeof(Value));
+    vm->parameters = calloc(program->num_parameters ? program->num_parameters : 1, sizeof(Value));
+    vm->cursors = calloc(program->num_cursors ? program->num_cursors : 1, sizeof(VmCursor));
+    if (!vm->registers || !vm->parameters || !vm->cursors) {
+        free(vm->registers);
+        free(vm->parameters);
+        free(vm->cursors);
+        free(vm);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < program->num_cursors; i++) {
+        vm->cursors[i].batch_row = -1;
+    }
+    return vm;
+}
+
+static void close_cursor(VmCursor* cursor) {
+    free(cursor->cursor);
+    cursor->cursor = NULL;
+    if (cursor->index_cursor) {
+        index_cursor_free(cursor->index_cursor);
+        cursor->index_cursor = NULL;
+    }
+    cursor->index = NULL;
+    if (cursor->sorter) {
+        sorter_free(cursor->sorter);
+        cursor->sorter = NULL;
+    }
+    if (cursor->hash_join) {
+        hash_join_free(cursor->hash_join);
+        cursor->hash_join = NULL;
+    }
+    cursor->on_row = false;
+    cursor->batch_position = 0;
+    cursor->batch_row = -1;
+}
+
+// Closes cursors and rewinds to the first instruction, keeping allocations
+void vm_reset(Vm* vm) {
+    for (uint32_t i = 0; i < vm->program->num_cursors; i++) {
+        close_cursor(&vm->cursors[i]);
+    }
+    memset(vm->registers, 0, vm->program->num_registers * sizeof(Value));
+    if (vm->profiler) {
+        memset(vm->profiler->entries, 0, vm->program->length * sizeof(VmProfile));
+        vm->profiler->current = UINT32_MAX;
+    }
+    vm->pc = 0;
+    vm->row = NULL;
+    vm->row_length = 0;
+    vm->error[0] = '\0';
+}
+
+void vm_free(Vm* vm) {
+    vm_reset(vm);
+    for (uint32_t i = 0; i < vm->program->num_cursors; i++) {
+        if (vm->cursors[i].batch) {
+            batch_free(vm->cursors[i].batch);
+        }
+    }
+    vm_set_profiling(vm, false);
+    free(vm->registers);
+    free(vm->parameters);
+    free(vm->cursors);
+    free(vm);
+}
+
+void vm_bind(Vm* vm, uint32_t parameter, const Value* value) {
+    if (parameter < vm->program->num_parameters) {
+        vm->parameters[parameter] = *value;
+    }
+}
+
+const Value* vm_binding(const Vm* vm, uint32_t parameter) {
+    return parameter < vm->program->num_parameters ? &vm->parameters[parameter] : NULL;
+}
+
+static bool discard_row(void* context, const Value* row, uint32_t num_columns) {
+    (void)context;
+    (void)row;
+    (void)num_columns;
+    return true;
+}
+
+VmStatus vm_run(Vm* vm, VmRowCallback callback, void* context) {
+    vm->callback = callback ? callback : discard_row;
+    vm->callback_context = context;
+    VmStatus status = vm_step(vm);
+    vm->callback = NULL;
+    vm->callback_context = NULL;
+    return status;
+}
+
+const Value* vm_row(Vm* vm, uint32_t* num_columns) {
+    *num_columns = vm->row_length;
+    return vm->row;
+}
+
+void vm_set_sort_memory(Vm* vm, size_t bytes) {
+    vm->sort_memory = bytes;
+}
+
+void vm_set_join_memory(Vm* vm, size_t bytes) {
+    vm->join_memory = bytes;
+}
+
+const char* vm_error(Vm* vm) {
+    return vm->error;
+}
+
+bool vm_set_profiling(Vm* vm, bool enabled) {
+    if (!enabled) {
+        if (vm->profiler) {
+            free(vm->profiler->entries);
+            free(vm->profiler);
+            vm->profiler = NULL;
+        }
+        return true;
+    }
+    if (vm->profiler) {
+        return true;
+    }
+    const Program* program = vm->program;
+    VmProfiler* profiler = calloc(1, sizeof(VmProfiler));
+    VmProfile* entries = calloc(program->length ? program->length : 1, sizeof(VmProfile));
+    if (!profiler || !entries) {
+        free(profiler);
+        free(entries);
+        return false;
+    }
+    profiler->entries = entries;
+    // Every table of a program lives in one database file
+    profiler->pager = program->num_tables > 0 ? program->tables[0]->pager : NULL;
+    profiler->current = UINT32_MAX;
+    vm->profiler = profiler;
+    return true;
+}
+
+const VmProfile* vm_profile(const Vm* vm) {
+    return vm->profiler ? vm->profiler->entries : NULL;
+}
+
+const char* vm_opcode_name(Opcode opcode) {
+    static const char* names[OP_COUNT_OPCODES] = {
+        [OP_HALT] = "HALT",
+        [OP_GOTO] = "GOTO",
+        [OP_INTEGER] = "INTEGER",
+        [OP_INT64] = "INT64",
+        [OP_STRING] = "STRING",
+        [OP_NULL] = "NULL",
+        [OP_VARIABLE] = "VARIABLE",
+        [OP_MOVE] = "MOVE",
+        [OP_ADD] = "ADD",
+        [OP_OPEN_READ] = "OPEN_READ",
+        [OP_CLOSE] = "CLOSE",
+        [OP_REWIND] = "REWIND",
+        [OP_SEEK_GE] = "SEEK_GE",
+        [OP_NEXT] = "NEXT",
+        [OP_KEY] = "KEY",
+        [OP_COLUMN] = "COLUMN",
+        [OP_OPEN_INDEX] = "OPEN_INDEX",
+        [OP_INDEX_SEEK_EQ] = "INDEX_SEEK_EQ",
+        [OP_INDEX_SEEK_RANGE] = "INDEX_SEEK_RANGE",
+        [OP_INDEX_NEXT] = "INDEX_NEXT",
+        [OP_INDEX_INSERT] = "INDEX_INSERT",
+        [OP_BATCH_NEXT] = "BATCH_NEXT",
+        [OP_BATCH_FILTER] = "BATCH_FILTER",
+        [OP_BATCH_ROW] = "BATCH_ROW",
+        [OP_AGGREGATE_STEP] = "AGGREGATE_STEP",
+        [OP_BATCH_AGGREGATE] = "BATCH_AGGREGATE",
+        [OP_TABLE_AGGREGATE] = "TABLE_AGGREGATE",
+        [OP_SORTER_OPEN] = "SORTER_OPEN",
+        [OP_SORTER_INSERT] = "SORTER_INSERT",
+        [OP_SORTER_SORT] = "SORTER_SORT",
+        [OP_SORTER_NEXT] = "SORTER_NEXT",
+        [OP_HASH_OPEN] = "HASH_OPEN",
+        [OP_HASH_INSERT] = "HASH_INSERT",
+        [OP_HASH_BUILD] = "HASH_BUILD",
+        [OP_HASH_PROBE] = "HASH_PROBE",
+        [OP_HASH_NEXT] = "HASH_NEXT",
+        [OP_HASH_REPLAY] = "HASH_REPLAY",
+        [OP_EQ] = "EQ",
+        [OP_NE] = "NE",
+        [OP_LT] = "LT",
+        [OP_LE] = "LE",
+        [OP_GT] = "GT",
+        [OP_GE] = "GE",
+        [OP_IS_NULL] = "IS_NULL",
+        [OP_MAKE_RECORD] = "MAKE_RECORD",
+        [OP_INSERT] = "INSERT",
+        [OP_RESULT_ROW] = "RESULT_ROW",
+    };
+    return opcode < OP_COUNT_OPCODES && names[opcode] ? names[opcode] : "UNKNOWN";
+}
+
+static uint64_t profile_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Rows selected in the batch a batch instruction works on
+static uint64_t profile_batch_rows(Vm* vm, const Instruction* instruction) {
+    uint32_t cursor = instruction->opcode == OP_BATCH_NEXT ? (uint32_t)instruction->p1 : (uint32_t)instruction->p3 >> 16;
+    Batch* batch = vm->cursors[cursor].batch;
+    return batch ? batch_num_selected(batch) : 0;
+}
+
+// Whether the instruction at `address` went on with a row when control
+// passed from it to `next`: NEXTs branch to a row, the others away from one
+static bool profile_carried_on(Opcode opcode, uint32_t address, uint32_t next) {
+    bool branched = next != address + 1;
+    switch (opcode) {
+        case OP_GOTO:
+            return true;
+        case OP_NEXT:
+        case OP_INDEX_NEXT:
+        case OP_SORTER_NEXT:
+        case OP_HASH_NEXT:
+            return branched;
+        default:
+            return !branched;
+    }
+}
+
+// Charges the time and pages since the current instruction's dispatch to it
+static void profile_charge(Vm* vm, bool carried_on) {
+    VmProfiler* profiler = vm->profiler;
+    if (profiler->current == UINT32_MAX) {
+        return;
+    }
+    uint64_t now = profile_clock();
+    const Instruction* instruction = &vm->program->code[profiler->current];
+    VmProfile* entry = &profiler->entries[profiler->current];
+    entry->cycles += now - profiler->start;
+    if (profiler->pager) {
+        uint64_t hits, misses;
+        pager_access_counts(profiler->pager, &hits, &misses);
+        entry->page_hits += hits - profiler->hits;
+        entry->page_misses += misses - profiler->misses;
+    }
+    if (instruction->opcode == OP_BATCH_NEXT || instruction->opcode == OP_BATCH_FILTER) {
+        entry->rows_out += carried_on ? profile_batch_rows(vm, instruction) : 0;
+    } else {
+        entry->rows_out += carried_on;
+    }
+    profiler->current = UINT32_MAX;
+}
+
+// Called before the instruction at `address` runs: ends the previous one's
+// span and starts this one's
+static void profile_dispatch(Vm* vm, uint32_t address) {
+    VmProfiler* profiler = vm->profiler;
+    const Instruction* code = vm->program->code;
+    if (profiler->current != UINT32_MAX) {
+        profile_charge(vm, profile_carried_on(code[profiler->current].opcode, profiler->current, address));
+    }
+    const Instruction* instruction = &code[address];
+    VmProfile* entry = &profiler->entries[address];
+    if (instruction->opcode == OP_BATCH_FILTER || instruction->opcode == OP_BATCH_AGGREGATE) {
+        entry->rows_in += profile_batch_rows(vm, instruction);
+    } else {
+        entry->rows_in++;
+    }
+    profiler->current = address;
+    if (profiler->pager) {
+        pager_access_counts(profiler->pager, &profiler->hits, &profiler->misses);
+    }
+    profiler->start = profile_clock();
+}
+
+// btree_find() leaves the cursor at the insertion point, which can be one
+// past the last cell of a leaf; step onto the next leaf's first row then
+static void cursor_settle(VmCursor* cursor) {
+    BTreeCursor* btree_cursor = cursor->cursor;
+    if (btree_cursor->end_of_table) {
+        cursor->on_row = false;
+        return;
+    }
+    void* node = pager_get_page(btree_cursor->btree->pager, btree_cursor->page_num);
+    while (btree_cursor->cell_num >= *leaf_node_num_cells(node)) {
+        page_num_t next = *leaf_node_next_leaf(node);
+        if (next == 0) {
+            btree_cursor->end_of_table = true;
+            cursor->on_row = false;
+            return;
+        }
+        btree_cursor->page_num = next;
+        btree_cursor->cell_num = 0;
+        node = pager_get_page_hinted(btree_cursor->btree->pager, next, PAGE_HINT_SCAN);
+    }
+    cursor->on_row = true;
+}
+
+static bool cursor_row(VmCursor* cursor, void** node, uint32_t* cell) {
+    if (!cursor->cursor || !cursor->on_row) {
+        return false;
+    }
+    *node = pager_get_page(cursor->btree->pager, cursor->cursor->page_num);
+    *cell = cursor->cursor->cell_num;
+    return true;
+}
+
+// Profiling computed-goto builds dispatch through a second table whose
+// entries all lead to the profiling hook, which then jumps on through the
+// first, so the instructions themselves are the same either way. Switch
+// builds test for a profiler before each instruction instead.
+#ifdef VM_COMPUTED_GOTO
+#define VM_CASE(op) label_##op:
+#define VM_NEXT()                                         \
+    do {                                                  \
+        instruction = &code[pc++];                        \
+        goto *targets[instruction->opcode];               \
+    } while (0)
+#define VM_SWITCH_BEGIN VM_NEXT();
+#define VM_SWITCH_END
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT() goto dispatch
+#define VM_SWITCH_BEGIN \
+    dispatch:           \
+    instruction = &code[pc++]; \
+    if (vm->profiler) {        \
+        profile_dispatch(vm, pc - 1); \
+    }                          \
+    switch (instruction->opcode) {
+#define VM_SWITCH_END \
+    default:          \
+        goto invalid_opcode; \
+    }
+#endif
+
+#define VM_FAIL(...)                                                 \
+    do {                                                             \
+        snprintf(vm->error, sizeof(vm->error), __VA_ARGS__);         \
+        vm->pc = pc;                                                 \
+        return VM_ERROR;                                             \
+    } while (0)
+
+// A comparison jumps when its condition holds and neither side is NULL
+#define VM_COMPARE_JUMP(condition)                                            \
+    do {                                                                      \
+        Value* a = &registers[instruction->p1];                               \
+        Value* b = &registers[instruction->p3];                               \
+        if (a->type != VALUE_NULL && b->type != VALUE_NULL) {                 \
+            int cmp = vm_value_compare(a, b);                                 \
+            if (condition) {                                                  \
+                pc = (uint32_t)instruction->p2;                               \
+            }                                                                 \
+        }                                                                     \
+        VM_NEXT();                                                            \
+    } while (0)
+
+static VmStatus execute(Vm* vm) {
+    const Instruction* code = vm->program->code;
+    Value* registers = vm->registers;
+    VmCursor* cursors = vm->cursors;
+    uint32_t pc = vm->pc;
+    const Instruction* instruction;
+
+#ifdef VM_COMPUTED_GOTO
+    static const void* dispatch_table[OP_COUNT_OPCODES] = {
+        [OP_HALT] = &&label_OP_HALT,
+        [OP_GOTO] = &&label_OP_GOTO,
+        [OP_INTEGER] = &&label_OP_INTEGER,
+        [OP_INT64] = &&label_OP_INT64,
+        [OP_STRING] = &&label_OP_STRING,
+        [OP_NULL] = &&label_OP_NULL,
+        [OP_VARIABLE] = &&label_OP_VARIABLE,
+        [OP_MOVE] = &&label_OP_MOVE,
+        [OP_ADD] = &&label_OP_ADD,
+        [OP_OPEN_READ] = &&label_OP_OPEN_READ,
+        [OP_CLOSE] = &&label_OP_CLOSE,
+        [OP_REWIND] = &&label_OP_REWIND,
+        [OP_SEEK_GE] = &&label_OP_SEEK_GE,
+        [OP_NEXT] = &&label_OP_NEXT,
+        [OP_KEY] = &&label_OP_KEY,
+        [OP_COLUMN] = &&label_OP_COLUMN,
+        [OP_OPEN_INDEX] = &&label_OP_OPEN_INDEX,
+        [OP_INDEX_SEEK_EQ] = &&label_OP_INDEX_SEEK_EQ,
+        [OP_INDEX_SEEK_RANGE] = &&label_OP_INDEX_SEEK_RANGE,
+        [OP_INDEX_NEXT] = &&label_OP_INDEX_NEXT,
+        [OP_INDEX_INSERT] = &&label_OP_INDEX_INSERT,
+        [OP_BATCH_NEXT] = &&label_OP_BATCH_NEXT,
+        [OP_BATCH_FILTER] = &&label_OP_BATCH_FILTER,
+        [OP_BATCH_ROW] = &&label_OP_BATCH_ROW,
+        [OP_AGGREGATE_STEP] = &&label_OP_AGGREGATE_STEP,
+        [OP_BATCH_AGGREGATE] = &&label_OP_BATCH_AGGREGATE,
+        [OP_TABLE_AGGREGATE] = &&label_OP_TABLE_AGGREGATE,
+        [OP_SORTER_OPEN] = &&label_OP_SORTER_OPEN,
+        [OP_SORTER_INSERT] = &&label_OP_SORTER_INSERT,
+        [OP_SORTER_SORT] = &&label_OP_SORTER_SORT,
+        [OP_SORTER_NEXT] = &&label_OP_SORTER_NEXT,
+        [OP_HASH_OPEN] = &&label_OP_HASH_OPEN,
+        [OP_HASH_INSERT] = &&label_OP_HASH_INSERT,
+        [OP_HASH_BUILD] = &&label_OP_HASH_BUILD,
+        [OP_HASH_PROBE] = &&label_OP_HASH_PROBE,
+        [OP_HASH_NEXT] = &&label_OP_HASH_NEXT,
+        [OP_HASH_REPLAY] = &&label_OP_HASH_REPLAY,
+        [OP_EQ] = &&label_OP_EQ,
+        [OP_NE] = &&label_OP_NE,
+        [OP_LT] = &&label_OP_LT,
+        [OP_LE] = &&label_OP_LE,
+        [OP_GT] = &&label_OP_GT,
+        [OP_GE] = &&label_OP_GE,
+        [OP_IS_NULL] = &&label_OP_IS_NULL,
+        [OP_MAKE_RECORD] = &&label_OP_MAKE_RECORD,
+        [OP_INSERT] = &&label_OP_INSERT,
+        [OP_RESULT_ROW] = &&label_OP_RESULT_ROW,
+    };
+    static const void* profile_table[OP_COUNT_OPCODES] = {
+        [0 ... OP_COUNT_OPCODES - 1] = &&profile,
+    };
+    const void* const* targets = vm->profiler ? profile_table : dispatch_table;
+#endif
+
+    VM_SWITCH_BEGIN
+
+#ifdef VM_COMPUTED_GOTO
+profile:
+    profile_dispatch(vm, pc - 1);
+    goto *dispatch_table[instruction->opcode];
+#endif
+
+    VM_CASE(OP_HALT) {
+        vm->pc = pc - 1;  // Stay halted if stepped again
+        vm->row = NULL;
+        vm->row_length = 0;
+        return VM_DONE;
+    }
+
+    VM_CASE(OP_GOTO) {
+        pc = (uint32_t)instruction->p2;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_INTEGER) {
+        Value* out = &registers[instruction->p1];
+        out->type = VALUE_INT;
+        out->integer = instruction->p3;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_INT64) {
+        const Program* program = vm->program;
+        Value* out = &registers[instruction->p1];
+        out->type = VALUE_INT;
+        memcpy(&out->integer, program->text_pool + program->text_offsets[instruction->p3 * 2], sizeof(int64_t));
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_STRING) {
+        const Program* program = vm->program;
+        Value* out = &registers[instruction->p1];
+        out->type = VALUE_TEXT;
+        out->text = program->text_pool + program->text_offsets[instruction->p3 * 2];
+        out->length = program->text_offsets[instruction->p3 * 2 + 1];
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_NULL) {
+        registers[instruction->p1].type = VALUE_NULL;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_VARIABLE) {
+        registers[instruction->p1] = vm->parameters[instruction->p3];
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_MOVE) {
+        registers[instruction->p1] = registers[instruction->p3];
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_ADD) {
+        Value* out = &registers[instruction->p1];
+        const Value* in = &registers[instruction->p3];
+        if (out->type == VALUE_NULL || in->type == VALUE_NULL) {
+            out->type = VALUE_NULL;
+        } else if (out->type == VALUE_INT && in->type == VALUE_INT) {
+            out->integer += in->integer;
+        } else {
+            VM_FAIL("ADD on non-integer values");
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_OPEN_READ) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        close_cursor(cursor);
+        cursor->btree = vm->program->tables[instruction->p3];
+        cursor->schema = vm->program->schemas[instruction->p3];
+        // Batches and pushed-down aggregates walk the leaf chain directly
+        btree_flush_buffers(cursor->btree);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_CLOSE) {
+        close_cursor(&cursors[instruction->p1]);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_REWIND) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        free(cursor->cursor);
+        cursor->batch_row = -1;
+        cursor->cursor = btree_start(cursor->btree);
+        cursor_settle(cursor);
+        if (!cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_SEEK_GE) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        const Value* key = &registers[instruction->p3];
+        free(cursor->cursor);
+        cursor->batch_row = -1;
+        // NULL compares false with every key and text sorts after them all
+        if (key->type != VALUE_INT || key->integer > (int64_t)UINT32_MAX) {
+            cursor->cursor = NULL;
+            cursor->on_row = false;
+            pc = (uint32_t)instruction->p2;
+            VM_NEXT();
+        }
+        uint32_t seek_key = key->integer < 0 ? 0 : (uint32_t)key->integer;
+        cursor->cursor = btree_find(cursor->btree, seek_key);
+        cursor_settle(cursor);
+        if (!cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_NEXT) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        if (cursor->on_row) {
+            btree_cursor_advance(cursor->cursor);
+            cursor_settle(cursor);
+            if (cursor->on_row) {
+                pc = (uint32_t)instruction->p2;
+            }
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_KEY) {
+        VmCursor* cursor = &cursors[instruction->p3];
+        Value* out = &registers[instruction->p1];
+        if (cursor->index) {
+            if (!cursor->on_row) {
+                VM_FAIL("KEY on index cursor %d with no current entry", instruction->p3);
+            }
+            out->type = VALUE_INT;
+            out->integer = index_cursor_key(cursor->index_cursor);
+            VM_NEXT();
+        }
+        if (cursor->batch_row >= 0) {
+            out->type = VALUE_INT;
+            out->integer = batch_key(cursor->batch, (uint32_t)cursor->batch_row);
+            VM_NEXT();
+        }
+        void* node;
+        uint32_t cell;
+        if (!cursor_row(cursor, &node, &cell)) {
+            VM_FAIL("KEY on cursor %d with no current row", instruction->p3);
+        }
+        out->type = VALUE_INT;
+        out->integer = *leaf_node_key(node, cell);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_COLUMN) {
+        uint32_t cursor_index = (uint32_t)instruction->p3 >> 16;
+        uint32_t column = (uint32_t)instruction->p3 & 0xffff;
+        VmCursor* cursor = &cursors[cursor_index];
+        if (cursor->sorter) {
+            uint32_t count;
+            const Value* row = cursor->on_row ? sorter_row(cursor->sorter, &count) : NULL;
+            if (!row || column >= count) {
+                VM_FAIL("COLUMN %u on sorter cursor %u with no such value", column, cursor_index);
+            }
+            registers[instruction->p1] = row[column];
+            VM_NEXT();
+        }
+        if (cursor->hash_join) {
+            uint32_t count;
+            const Value* row = hash_join_match(cursor->hash_join, &count);
+            if (!row || column >= count) {
+                VM_FAIL("COLUMN %u on hash cursor %u with no such value", column, cursor_index);
+            }
+            registers[instruction->p1] = row[column];
+            VM_NEXT();
+        }
+        if (cursor->batch_row >= 0) {
+            if (!batch_column(cursor->batch, (uint32_t)cursor->batch_row, column, &registers[instruction->p1])) {
+                VM_FAIL("Corrupt row at key %u", batch_key(cursor->batch, (uint32_t)cursor->batch_row));
+            }
+            VM_NEXT();
+        }
+        if (cursor->index) {
+            if (!cursor->on_row) {
+                VM_FAIL("COLUMN on index cursor %u with no current entry", cursor_index);
+            }
+            uint32_t size;
+            const uint8_t* payload = index_cursor_payload(cursor->index_cursor, &size);
+            if (!row_column(cursor->schema, payload, size, column, &registers[instruction->p1])) {
+                VM_FAIL("Corrupt index entry for key %u", index_cursor_key(cursor->index_cursor));
+            }
+            VM_NEXT();
+        }
+        void* node;
+        uint32_t cell;
+        if (!cursor_row(cursor, &node, &cell)) {
+            VM_FAIL("COLUMN on cursor %u with no current row", cursor_index);
+        }
+        const uint8_t* row = leaf_node_value(node, cell);
+        if (!row_column(cursor->schema, row, *leaf_node_value_size(node, cell), column, &registers[instruction->p1])) {
+            VM_FAIL("Corrupt row at key %u", *leaf_node_key(node, cell));
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_OPEN_INDEX) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        close_cursor(cursor);
+        cursor->index = vm->program->indexes[instruction->p3];
+        cursor->schema = &cursor->index->schema;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_INDEX_SEEK_EQ) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        const Value* value = &registers[instruction->p3];
+        if (!cursor->index_cursor && !(cursor->index_cursor = index_cursor_new(cursor->index))) {
+            VM_FAIL("Out of memory opening index cursor");
+        }
+        uint32_t image = index_image(value);
+        cursor->on_row = value->type != VALUE_NULL && index_cursor_seek(cursor->index_cursor, image, image);
+        if (!cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_INDEX_SEEK_RANGE) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        const Value* lower = &registers[instruction->p3];
+        const Value* upper = &registers[instruction->p3 + 1];
+        if (!cursor->index_cursor && !(cursor->index_cursor = index_cursor_new(cursor->index))) {
+            VM_FAIL("Out of memory opening index cursor");
+        }
+        cursor->on_row = index_cursor_seek(cursor->index_cursor, lower->type == VALUE_INT ? index_image(lower) : 0,
+                                           upper->type == VALUE_INT ? index_image(upper) : UINT32_MAX);
+        if (!cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_INDEX_NEXT) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        cursor->on_row = cursor->on_row && index_cursor_next(cursor->index_cursor);
+        if (cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_INDEX_INSERT) {
+        const SecondaryIndex* index = vm->program->indexes[instruction->p2];
+        const Value* row = &registers[instruction->p1];
+        if (index_insert(index, (uint32_t)row[0].integer, row) != 0) {
+            VM_FAIL("Could not index key %lld", (long long)row[0].integer);
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_BATCH_NEXT) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        cursor->batch_row = -1;
+        cursor->batch_position = 0;
+        if (!cursor->cursor || !cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+            VM_NEXT();
+        }
+        if (!cursor->batch) {
+            cursor->batch = batch_new();
+            if (!cursor->batch) {
+                VM_FAIL("Out of memory allocating batch");
+            }
+        }
+        // Leave most of the cache to other cursors: the batch's pages stay
+        // pinned until the next pager operation
+        uint32_t max_leaves = pager_get_capacity(cursor->btree->pager) / 4;
+        int64_t max_key = INT64_MAX;
+        if (instruction->p3 >= 0 && registers[instruction->p3].type == VALUE_INT) {
+            max_key = registers[instruction->p3].integer;
+        }
+        batch_fill(cursor->batch, cursor->cursor, cursor->schema, max_leaves ? max_leaves : 1, max_key);
+        cursor_settle(cursor);
+        if (batch_num_rows(cursor->batch) == 0) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_BATCH_FILTER) {
+        VmCursor* cursor = &cursors[(uint32_t)instruction->p3 >> 16];
+        if (!cursor->batch) {
+            VM_FAIL("BATCH_FILTER on cursor %d with no batch", instruction->p3 >> 16);
+        }
+        batch_filter(cursor->batch, (uint32_t)instruction->p3 & 0xffff, (CompareOp)instruction->p2,
+                     &registers[instruction->p1]);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_BATCH_ROW) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        if (cursor->batch && cursor->batch_position < batch_num_selected(cursor->batch)) {
+            cursor->batch_row = batch_selection(cursor->batch)[cursor->batch_position++];
+        } else {
+            cursor->batch_row = -1;
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_AGGREGATE_STEP) {
+        if (!vm_aggregate_fold(&registers[instruction->p1], (AggregateFunction)instruction->p2,
+                               &registers[instruction->p3])) {
+            VM_FAIL("Integer overflow or non-integer value in aggregate");
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_BATCH_AGGREGATE) {
+        VmCursor* cursor = &cursors[(uint32_t)instruction->p3 >> 16];
+        if (!cursor->batch) {
+            VM_FAIL("BATCH_AGGREGATE on cursor %d with no batch", instruction->p3 >> 16);
+        }
+        if (!batch_aggregate(cursor->batch, (uint32_t)instruction->p3 & 0xffff, (AggregateFunction)instruction->p2,
+                             &registers[instruction->p1])) {
+            VM_FAIL("Integer overflow or non-integer value in aggregate");
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_TABLE_AGGREGATE) {
+        VmCursor* cursor = &cursors[(uint32_t)instruction->p3 >> 16];
+        if (!cursor->btree) {
+            VM_FAIL("TABLE_AGGREGATE on cursor %d with no table", instruction->p3 >> 16);
+        }
+        // The run of aggregates over this cursor that starts here shares one pass
+        uint32_t columns[BATCH_MAX_AGGREGATES];
+        AggregateFunction functions[BATCH_MAX_AGGREGATES];
+        Value results[BATCH_MAX_AGGREGATES];
+        uint32_t count = 0;
+        while (count < BATCH_MAX_AGGREGATES && instruction[count].opcode == OP_TABLE_AGGREGATE &&
+               instruction[count].p3 >> 16 == instruction->p3 >> 16) {
+            columns[count] = (uint32_t)instruction[count].p3 & 0xffff;
+            functions[count] = (AggregateFunction)instruction[count].p2;
+            count++;
+        }
+        if (!leaf_aggregate(cursor->btree, cursor->schema, columns, functions, count, results)) {
+            VM_FAIL("Integer overflow or non-integer value in aggregate");
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            registers[instruction[i].p1] = results[i];
+        }
+        pc += count - 1;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_SORTER_OPEN) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        close_cursor(cursor);
+        cursor->sorter = sorter_new((uint32_t)instruction->p2, (uint32_t)instruction->p3, vm->sort_memory);
+        if (!cursor->sorter) {
+            VM_FAIL("Cannot sort on %d keys", instruction->p2);
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_SORTER_INSERT) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        if (!cursor->sorter) {
+            VM_FAIL("SORTER_INSERT on cursor %d with no sorter", instruction->p1);
+        }
+        if (!sorter_add(cursor->sorter, &registers[instruction->p3], (uint32_t)instruction->p2)) {
+            VM_FAIL("Cannot add a row to the sorter on cursor %d", instruction->p1);
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_SORTER_SORT) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        if (!cursor->sorter) {
+            VM_FAIL("SORTER_SORT on cursor %d with no sorter", instruction->p1);
+        }
+        cursor->on_row = sorter_sort(cursor->sorter);
+        if (!cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_SORTER_NEXT) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        cursor->on_row = cursor->on_row && sorter_next(cursor->sorter);
+        if (cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_HASH_OPEN) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        close_cursor(cursor);
+        if (instruction->p2 < 1 || instruction->p2 > HASH_JOIN_MAX_VALUES) {
+            VM_FAIL("Cannot join probe rows of %d values", instruction->p2);
+        }
+        cursor->hash_join = hash_join_new(vm->join_memory);
+        if (!cursor->hash_join) {
+            VM_FAIL("Cannot open a hash join on cursor %d", instruction->p1);
+        }
+        cursor->probe_width = (uint32_t)instruction->p2;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_HASH_INSERT) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        if (!cursor->hash_join) {
+            VM_FAIL("HASH_INSERT on cursor %d with no hash join", instruction->p1);
+        }
+        if (!hash_join_insert(cursor->hash_join, &registers[instruction->p3], (uint32_t)instruction->p2)) {
+            VM_FAIL("Cannot add a row to the hash join on cursor %d", instruction->p1);
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_HASH_BUILD) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        if (!cursor->hash_join) {
+            VM_FAIL("HASH_BUILD on cursor %d with no hash join", instruction->p1);
+        }
+        hash_join_build(cursor->hash_join);
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_HASH_PROBE) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        if (!cursor->hash_join) {
+            VM_FAIL("HASH_PROBE on cursor %d with no hash join", instruction->p1);
+        }
+        cursor->on_row = hash_join_probe(cursor->hash_join, &registers[instruction->p3], cursor->probe_width);
+        if (!cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_HASH_NEXT) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        cursor->on_row = cursor->on_row && hash_join_next(cursor->hash_join);
+        if (cursor->on_row) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_HASH_REPLAY) {
+        VmCursor* cursor = &cursors[instruction->p1];
+        if (!cursor->hash_join) {
+            VM_FAIL("HASH_REPLAY on cursor %d with no hash join", instruction->p1);
+        }
+        uint32_t count;
+        const Value* row = hash_join_replay(cursor->hash_join, &count);
+        if (!row) {
+            pc = (uint32_t)instruction->p2;
+            VM_NEXT();
+        }
+        if (count != cursor->probe_width) {
+            VM_FAIL("Saved probe row of %u values on hash cursor %d", count, instruction->p1);
+        }
+        memcpy(&registers[instruction->p3], row, count * sizeof(Value));
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_EQ) {
+        VM_COMPARE_JUMP(cmp == 0);
+    }
+
+    VM_CASE(OP_NE) {
+        VM_COMPARE_JUMP(cmp != 0);
+    }
+
+    VM_CASE(OP_LT) {
+        VM_COMPARE_JUMP(cmp < 0);
+    }
+
+    VM_CASE(OP_LE) {
+        VM_COMPARE_JUMP(cmp <= 0);
+    }
+
+    VM_CASE(OP_GT) {
+        VM_COMPARE_JUMP(cmp > 0);
+    }
+
+    VM_CASE(OP_GE) {
+        VM_COMPARE_JUMP(cmp >= 0);
+    }
+
+    VM_CASE(OP_IS_NULL) {
+        if (registers[instruction->p1].type == VALUE_NULL) {
+            pc = (uint32_t)instruction->p2;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_MAKE_RECORD) {
+        const RowSchema* schema = vm->program->schemas[instruction->p2];
+        uint32_t size = row_encode(schema, &registers[instruction->p3], schema->num_columns, vm->record,
+                                   sizeof(vm->record));
+        if (size == 0) {
+            VM_FAIL("Row does not match its table's columns or exceeds %d bytes", VM_MAX_RECORD_SIZE);
+        }
+        Value* out = &registers[instruction->p1];
+        out->type = VALUE_BLOB;
+        out->text = (const char*)vm->record;
+        out->length = size;
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_INSERT) {
+        const Value* key = &registers[instruction->p1];
+        const Value* record = &registers[instruction->p3];
+        if (key->type != VALUE_INT || key->integer < 0 || key->integer > (int64_t)UINT32_MAX) {
+            VM_FAIL("Key must be an integer in [0, %u]", UINT32_MAX);
+        }
+        if (record->type != VALUE_BLOB) {
+            VM_FAIL("INSERT needs a record");
+        }
+        BTree* btree = vm->program->tables[instruction->p2];
+        if (btree_insert(btree, (uint32_t)key->integer, (void*)record->text, record->length) != 0) {
+            VM_FAIL("Duplicate key %lld", (long long)key->integer);
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(OP_RESULT_ROW) {
+        vm->row = &registers[instruction->p1];
+        vm->row_length = (uint32_t)instruction->p3;
+        if (vm->callback && vm->callback(vm->callback_context, vm->row, vm->row_length)) {
+            VM_NEXT();
+        }
+        vm->pc = pc;
+        return VM_ROW;
+    }
+
+    VM_SWITCH_END
+
+#ifndef VM_COMPUTED_GOTO
+invalid_opcode:
+    VM_FAIL("Invalid opcode %u at %u", instruction->opcode, pc - 1);
+#endif
+}
+
+VmStatus vm_step(Vm* vm) {
+    VmStatus status = execute(vm);
+    if (vm->profiler) {
+        // A yielded row is the last instruction's output; the time until the
+        // next step is the caller's
+        profile_charge(vm, status == VM_ROW);
+    }
+    return status;
+}
@@ -10,6 +10,12 @@ void print_test_result(const char* test_name, int success) {
     printf("%s: %s\n", test_name, success ? "PASSED" : "FAILED");
 }
 
+// Databases are file-backed, so every test starts from a fresh file
+Pager* open_test_pager(const char* filename, uint32_t page_size) {
+    remove(filename);
+    return pager_open_with_page_size(filename, page_size);
+}
+
 void print_tree_structure(BTree* btree, page_num_t page_num, int depth) {
     void* node = pager_get_page(btree->pager, page_num);
     
@@ -75,7 +81,7 @@ int validate_tree_structure(BTree* btree, page_num_t page_num, uint32_t min_key,
 int test_basic_operations() {
     printf("\n=== Testing Basic Operations ===\n");
     
-    Pager* pager = pager_open("test_basic.db");
+    Pager* pager = open_test_pager("test_basic.db", DEFAULT_PAGE_SIZE);
     BTree* btree = btree_open(pager);
     
     // Test insertion
@@ -125,7 +131,7 @@ int test_basic_operations() {
 int test_sequential_insertion() {
     printf("\n=== Testing Sequential Insertion ===\n");
     
-    Pager* pager = pager_open("test_sequential.db");
+    Pager* pager = open_test_pager("test_sequential.db", DEFAULT_PAGE_SIZE);
     BTree* btree = btree_open(pager);
     
     int num_inserts = 30; // Reduced for easier debugging
@@ -204,7 +210,7 @@ int test_sequential_insertion() {
 int test_random_insertion() {
     printf("\n=== Testing Random Insertion ===\n");
     
-    Pager* pager = pager_open("test_random.db");
+    Pager* pager = open_test_pager("test_random.db", DEFAULT_PAGE_SIZE);
     BTree* btree = btree_open(pager);
     
     int num_inserts = 25; // Reduced for easier debugging
@@ -307,7 +313,7 @@ int test_random_insertion() {
 int test_duplicate_keys() {
     printf("\n=== Testing Duplicate Key Handling ===\n");
     
-    Pager* pager = pager_open("test_duplicates.db");
+    Pager* pager = open_test_pager("test_duplicates.db", DEFAULT_PAGE_SIZE);
     BTree* btree = btree_open(pager);
     
     char value1[] = "first_value";
@@ -359,7 +365,7 @@ int test_duplicate_keys() {
 int test_stress_insertion() {
     printf("\n=== Testing Stress Insertion (Force Node Splits) ===\n");
     
-    Pager* pager = pager_open("test_stress.db");
+    Pager* pager = open_test_pager("test_stress.db", DEFAULT_PAGE_SIZE);
     BTree* btree = btree_open(pager);
     
     int num_inserts = 100;  // This should cause multiple splits
@@ -436,6 +442,566 @@ int test_stress_insertion() {
     return success;
 }
 
+// Checks point lookups and scan order for keys 0..num_keys-1
+int verify_all_keys(BTree* btree, int num_keys) {
+    for (int i = 0; i < num_keys; i++) {
+        char expected_value[32];
+        char retrieved_value[32];
+        uint32_t retrieved_size;
+        sprintf(expected_value, "value_%d", i);
+
+        BTreeCursor* cursor = btree_find(btree, i);
+        btree_cursor_get_value(cursor, retrieved_value, sizeof(retrieved_value), &retrieved_size);
+        free(cursor);
+        if (strcmp(retrieved_value, expected_value) != 0) {
+            printf("Lookup of key %d failed: got '%s'\n", i, retrieved_value);
+            return 0;
+        }
+    }
+
+    BTreeCursor* cursor = btree_start(btree);
+    int count = 0;
+    while (!cursor->end_of_table) {
+        void* node = pager_get_page(btree->pager, cursor->page_num);
+        if (*leaf_node_key(node, cursor->cell_num) != (uint32_t)count) {
+            printf("Scan out of order at position %d\n", count);
+            free(cursor);
+            return 0;
+        }
+        btree_cursor_advance(cursor);
+        count++;
+    }
+    free(cursor);
+
+    if (count != num_keys) {
+        printf("Scan returned %d keys, expected %d\n", count, num_keys);
+        return 0;
+    }
+    return 1;
+}
+
+// Inserts shuffled keys 0..num_keys-1 and checks that both point lookups and a
+// full scan return every key. Returns 1 on success.
+int insert_and_verify_shuffled(BTree* btree, int num_keys, unsigned int seed) {
+    int* keys = malloc(sizeof(int) * num_keys);
+    for (int i = 0; i < num_keys; i++) {
+        keys[i] = i;
+    }
+    srand(seed);
+    for (int i = num_keys - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int temp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = temp;
+    }
+
+    int success = 1;
+    for (int i = 0; i < num_keys && success; i++) {
+        char value[32];
+        sprintf(value, "value_%d", keys[i]);
+        if (btree_insert(btree, keys[i], value, strlen(value) + 1) != 0) {
+            printf("Insertion failed at key %d\n", keys[i]);
+            success = 0;
+        }
+    }
+    free(keys);
+
+    return success && verify_all_keys(btree, num_keys);
+}
+
+int test_multi_level_tree() {
+    printf("\n=== Testing Multi-Level Tree (Internal Node Splits) ===\n");
+
+    Pager* pager = open_test_pager("test_multi_level.db", DEFAULT_PAGE_SIZE);
+    BTree* btree = btree_open(pager);
+
+    // Enough leaves that internal nodes below the root have to split
+    int success = insert_and_verify_shuffled(btree, 20000, 7);
+
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
+int test_page_sizes() {
+    printf("\n=== Testing Runtime Page Sizes ===\n");
+
+    uint32_t page_sizes[] = { 16384, 65536 };
+    int success = 1;
+
+    for (uint32_t i = 0; i < sizeof(page_sizes) / sizeof(page_sizes[0]) && success; i++) {
+        Pager* pager = open_test_pager("test_page_size.db", page_sizes[i]);
+        BTree* btree = btree_open(pager);
+        printf("Page size %u: internal fanout %u, leaf capacity %u\n",
+               btree->page_size, btree->internal_node_max_cells, btree->leaf_node_max_cells);
+        success = insert_and_verify_shuffled(btree, 5000, 11);
+        btree_close(btree);
+        pager_close(pager);
+
+        // The page size comes back from the file header on reopen
+        pager = pager_open("test_page_size.db");
+        btree = btree_open(pager);
+        if (success && btree->page_size != page_sizes[i]) {
+            printf("Reopened with page size %u, expected %u\n", btree->page_size, page_sizes[i]);
+            success = 0;
+        }
+        if (success) {
+            success = verify_all_keys(btree, 5000);
+        }
+        btree_close(btree);
+        pager_close(pager);
+    }
+
+    return success;
+}
+
+int test_batched_lookups() {
+    printf("\n=== Testing Batched Lookups With Async I/O ===\n");
+
+    Pager* pager = open_test_pager("test_batched.db", DEFAULT_PAGE_SIZE);
+    BTree* btree = btree_open(pager);
+    int success = insert_and_verify_shuffled(btree, 20000, 13);
+    btree_close(btree);
+    pager_close(pager);
+
+    // Reopen cold with a pool much smaller than the tree
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = 64;
+    options.io_backend = PAGE_IO_URING;
+    pager = pager_open_with_options("test_batched.db", &options);
+    printf("io_uring requested, %s in effect\n",
+           pager_get_io_backend(pager) == PAGE_IO_URING ? "io_uring" : "synchronous I/O");
+    btree = btree_open(pager);
+
+    uint32_t keys[200];
+    for (uint32_t i = 0; i < 200; i++) {
+        keys[i] = (i * 7919) % 20000;
+    }
+    for (uint32_t start = 0; start < 200 && success; start += 10) {
+        btree_prefetch(btree, keys + start, 10);
+        for (uint32_t i = start; i < start + 10 && success; i++) {
+            BTreeCursor* cursor = btree_find(btree, keys[i]);
+            char value[32];
+            char expected[32];
+            uint32_t value_size;
+            btree_cursor_get_value(cursor, value, sizeof(value), &value_size);
+            sprintf(expected, "value_%u", keys[i]);
+            if (strcmp(value, expected) != 0) {
+                printf("Key %u: expected %s, got %s\n", keys[i], expected, value);
+                success = 0;
+            }
+            free(cursor);
+        }
+    }
+
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
+int test_tree_stats() {
+    printf("\n=== Testing Tree Statistics ===\n");
+
+    Pager* pager = open_test_pager("test_tree_stats.db", DEFAULT_PAGE_SIZE);
+    BTree* btree = btree_open(pager);
+    BTreeStats stats = btree_stats(btree);
+    int success = 1;
+    if (stats.height != 1 || stats.leaf_pages != 1 || stats.num_keys != 0) {
+        printf("Empty tree: height %u, %llu leaves, %llu keys\n", stats.height,
+               (unsigned long long)stats.leaf_pages, (unsigned long long)stats.num_keys);
+        success = 0;
+    }
+
+    success = success && insert_and_verify_shuffled(btree, 20000, 17);
+    stats = btree_stats(btree);
+    printf("Height %u, %llu leaves, %llu internal, fill %.2f, %llu leaf / %llu internal / %llu root splits\n",
+           stats.height, (unsigned long long)stats.leaf_pages, (unsigned long long)stats.internal_pages,
+           stats.average_leaf_fill, (unsigned long long)stats.leaf_splits,
+           (unsigned long long)stats.internal_splits, (unsigned long long)stats.root_splits);
+
+    // Every split adds exactly one node
+    if (stats.num_keys != 20000 || stats.leaf_pages != stats.leaf_splits + 1 ||
+        stats.internal_pages != stats.internal_splits + stats.root_splits ||
+        stats.height != stats.root_splits + 1 || stats.internal_splits == 0) {
+        printf("Tree statistics do not add up\n");
+        success = 0;
+    }
+    if (stats.average_leaf_fill <= 0.4 || stats.average_leaf_fill > 1.0) {
+        printf("Implausible average leaf fill %.2f\n", stats.average_leaf_fill);
+        success = 0;
+    }
+    if (stats.bytes_allocated != (uint64_t)pager_get_num_pages(pager) * DEFAULT_PAGE_SIZE ||
+        stats.pager.misses == 0) {
+        printf("Missing allocation or pager figures\n");
+        success = 0;
+    }
+
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
+int test_buffered_inserts() {
+    printf("\n=== Testing Buffered Inserts ===\n");
+
+    Pager* pager = open_test_pager("test_buffered.db", DEFAULT_PAGE_SIZE);
+    BTree* btree = btree_open(pager);
+    btree_set_buffered(btree, true);
+
+    int num_keys = 20000;
+    int* keys = malloc(sizeof(int) * num_keys);
+    for (int i = 0; i < num_keys; i++) {
+        keys[i] = i;
+    }
+    srand(19);
+    for (int i = num_keys - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int temp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = temp;
+    }
+
+    int success = 1;
+    for (int i = 0; i < num_keys && success; i++) {
+        char value[32];
+        sprintf(value, "value_%d", keys[i]);
+        if (btree_insert(btree, keys[i], value, strlen(value) + 1) != 0) {
+            printf("Buffered insertion failed at key %d\n", keys[i]);
+            success = 0;
+        }
+
+        if (i == num_keys / 2) {
+            BTreeStats stats = btree_stats(btree);
+            printf("Halfway: height %u, %llu keys in leaves, %llu buffered, %llu flushes\n", stats.height,
+                   (unsigned long long)stats.num_keys, (unsigned long long)stats.buffered_messages,
+                   (unsigned long long)stats.buffer_flushes);
+            if (stats.buffered_messages == 0 || stats.buffer_flushes == 0 ||
+                stats.num_keys + stats.buffered_messages != (uint64_t)i + 1) {
+                printf("Buffers do not account for every insert\n");
+                success = 0;
+            }
+
+            // A cursor from a lookup sees the pending inserts as it goes
+            char* inserted = calloc(num_keys, 1);
+            for (int j = 0; j <= i; j++) {
+                inserted[keys[j]] = 1;
+            }
+            BTreeCursor* cursor = btree_find(btree, 0);
+            int expected = 0;
+            while (success && !cursor->end_of_table) {
+                while (!inserted[expected]) {
+                    expected++;
+                }
+                void* node = pager_get_page(btree->pager, cursor->page_num);
+                if (*leaf_node_key(node, cursor->cell_num) != (uint32_t)expected) {
+                    printf("Cursor read %u, expected %d\n", *leaf_node_key(node, cursor->cell_num), expected);
+                    success = 0;
+                }
+                expected++;
+                btree_cursor_advance(cursor);
+            }
+            free(cursor);
+            free(inserted);
+        }
+    }
+    free(keys);
+
+    // A second, unbuffered handle honours the buffers in the pages
+    BTree* plain = btree_open(pager);
+    for (uint32_t key = 0; key < (uint32_t)num_keys && success; key += 997) {
+        BTreeCursor* cursor = btree_find(plain, key);
+        void* node = pager_get_page(pager, cursor->page_num);
+        if (cursor->cell_num >= *leaf_node_num_cells(node) || *leaf_node_key(node, cursor->cell_num) != key) {
+            printf("Unbuffered handle missed key %u\n", key);
+            success = 0;
+        }
+        free(cursor);
+    }
+    btree_close(plain);
+
+    success = success && verify_all_keys(btree, num_keys);
+    success = success && validate_tree_structure(btree, btree->root_page_num, 0, num_keys - 1, 0);
+
+    // A key pending in a buffer and one already in a leaf are both refused
+    char value[32];
+    sprintf(value, "value_%d", num_keys);
+    if (success && (btree_insert(btree, num_keys, value, strlen(value) + 1) != 0 ||
+                    btree_insert(btree, num_keys, value, strlen(value) + 1) != -1 ||
+                    btree_insert(btree, 5, "stale", 6) != -1)) {
+        printf("Duplicate buffered inserts were not handled\n");
+        success = 0;
+    }
+    btree_flush_buffers(btree);
+    BTreeStats stats = btree_stats(btree);
+    printf("Height %u, %llu leaves, %llu internal, fill %.2f, %llu flushes, %llu duplicates\n",
+           stats.height, (unsigned long long)stats.leaf_pages, (unsigned long long)stats.internal_pages,
+           stats.average_leaf_fill, (unsigned long long)stats.buffer_flushes,
+           (unsigned long long)stats.buffered_duplicates);
+    if (stats.num_keys != (uint64_t)num_keys + 1 || stats.buffered_messages != 0 || stats.buffered_duplicates != 0) {
+        printf("Buffered statistics do not add up\n");
+        success = 0;
+    }
+
+    btree_close(btree);
+    pager_close(pager);
+
+    // Reopened without buffering, the tree is an ordinary one
+    pager = pager_open("test_buffered.db");
+    btree = btree_open(pager);
+    success = success && verify_all_keys(btree, num_keys + 1);
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
+// Reads the value under `key` into `value`; 0 if the key is missing
+static int read_value(BTree* btree, uint32_t key, char* value, uint32_t size) {
+    BTreeCursor* cursor = btree_find(btree, key);
+    void* node = pager_get_page(btree->pager, cursor->page_num);
+    int found = cursor->cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, cursor->cell_num) == key;
+    if (found) {
+        uint32_t value_size;
+        btree_cursor_get_value(cursor, value, size, &value_size);
+    }
+    free(cursor);
+    return found;
+}
+
+int test_upsert_and_update() {
+    printf("\n=== Testing Upsert And In-Place Update ===\n");
+
+    Pager* pager = open_test_pager("test_upsert.db", DEFAULT_PAGE_SIZE);
+    BTree* btree = btree_open(pager);
+    int num_keys = 2000;
+    int success = 1;
+    char value[64];
+    for (int i = 0; i < num_keys && success; i++) {
+        sprintf(value, "v%d", i);
+        if (btree_upsert(btree, i, value, strlen(value) + 1) != 0) {
+            printf("Upsert of new key %d did not insert\n", i);
+            success = 0;
+        }
+    }
+    BTreeStats before = btree_stats(btree);
+
+    // Values that keep their size, shrink and grow are all rewritten in the
+    // leaf, without a split
+    for (int round = 0; round < 3 && success; round++) {
+        for (int i = 0; i < num_keys && success; i++) {
+            int length = (i + round) % 3 == 0 ? 1 : (i + round) % 3 == 1 ? 12 : 40;
+            memset(value, 'a' + (i + round) % 26, length);
+            value[length] = '\0';
+            int result = (i % 2) ? btree_update(btree, i, value, length + 1) : btree_upsert(btree, i, value, length + 1);
+            if (result != ((i % 2) ? 0 : 1)) {
+                printf("Replacing key %d returned %d\n", i, result);
+                success = 0;
+            }
+        }
+    }
+    BTreeStats after = btree_stats(btree);
+    if (after.leaf_splits != before.leaf_splits || after.num_keys != (uint64_t)num_keys) {
+        printf("Replacements split leaves or changed the key count\n");
+        success = 0;
+    }
+    for (int i = 0; i < num_keys && success; i++) {
+        int length = (i + 2) % 3 == 0 ? 1 : (i + 2) % 3 == 1 ? 12 : 40;
+        char expected[64];
+        memset(expected, 'a' + (i + 2) % 26, length);
+        expected[length] = '\0';
+        if (!read_value(btree, i, value, sizeof(value)) || strcmp(value, expected) != 0) {
+            printf("Key %d has the wrong value\n", i);
+            success = 0;
+        }
+    }
+    if (btree_update(btree, num_keys, "missing", 8) != -1 || read_value(btree, num_keys, value, sizeof(value))) {
+        printf("Update of a missing key did not fail\n");
+        success = 0;
+    }
+    success = success && validate_tree_structure(btree, btree->root_page_num, 0, num_keys - 1, 0);
+
+    // A buffered tree: an upsert sees the insert still pending in a buffer
+    btree_set_buffered(btree, true);
+    for (int i = num_keys; i < num_keys + 500; i++) {
+        btree_insert(btree, i, "pending", 8);
+    }
+    if (btree_upsert(btree, num_keys + 250, "replaced", 9) != 1 ||
+        !read_value(btree, num_keys + 250, value, sizeof(value)) || strcmp(value, "replaced") != 0) {
+        printf("Upsert missed a buffered insert\n");
+        success = 0;
+    }
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
+// Fills a value of `length` bytes with a pattern tied to its key
+static void fill_grown_value(char* value, uint32_t key, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        value[i] = (char)('a' + (key + i) % 26);
+    }
+}
+
+static int check_grown_value(BTree* btree, uint32_t key, uint32_t length) {
+    static char expected[DEFAULT_PAGE_SIZE];
+    static char actual[DEFAULT_PAGE_SIZE];
+    BTreeCursor* cursor = btree_find(btree, key);
+    void* node = pager_get_page(btree->pager, cursor->page_num);
+    uint32_t value_size = 0;
+    int found = cursor->cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, cursor->cell_num) == key;
+    if (found) {
+        btree_cursor_get_value(cursor, actual, sizeof(actual), &value_size);
+    }
+    free(cursor);
+    fill_grown_value(expected, key, length);
+    if (!found || value_size != length || memcmp(actual, expected, length) != 0) {
+        printf("Key %u does not hold its %u-byte value\n", key, length);
+        return 0;
+    }
+    return 1;
+}
+
+int test_grow_values_in_full_leaves() {
+    printf("\n=== Testing Values That Outgrow Their Leaf ===\n");
+
+    Pager* pager = open_test_pager("test_grow.db", DEFAULT_PAGE_SIZE);
+    BTree* btree = btree_open(pager);
+    uint32_t num_keys = 100;
+    static char value[2 * DEFAULT_PAGE_SIZE];
+    for (uint32_t key = 0; key < num_keys; key++) {
+        fill_grown_value(value, key, 8);
+        btree_insert(btree, key, value, 8);
+    }
+    BTreeStats before = btree_stats(btree);
+
+    // Full leaves hold 13 small cells; a few hundred bytes each no longer
+    // fit, and 2000 bytes leaves room for two to a leaf
+    int success = 1;
+    uint32_t lengths[] = {300, 2000};
+    for (uint32_t round = 0; round < 2 && success; round++) {
+        for (uint32_t key = 0; key < num_keys && success; key++) {
+            fill_grown_value(value, key, lengths[round]);
+            int result = (key % 2) ? btree_update(btree, key, value, lengths[round])
+                                   : btree_upsert(btree, key, value, lengths[round]);
+            if (result != ((key % 2) ? 0 : 1)) {
+                printf("Growing key %u to %u bytes returned %d\n", key, lengths[round], result);
+                success = 0;
+            }
+        }
+    }
+    for (uint32_t key = 0; key < num_keys && success; key++) {
+        success = check_grown_value(btree, key, 2000);
+    }
+
+    // One value can take a leaf to itself; one larger than a page cannot be
+    // stored, and the old value stays
+    fill_grown_value(value, 50, 4000);
+    if (success && btree_update(btree, 50, value, 4000) != 0) {
+        printf("A value filling a leaf was refused\n");
+        success = 0;
+    }
+    fill_grown_value(value, 51, 5000);
+    if (success && (btree_update(btree, 51, value, 5000) != -1 || btree_upsert(btree, 51, value, 5000) != -1)) {
+        printf("A value larger than a page was accepted\n");
+        success = 0;
+    }
+    success = success && check_grown_value(btree, 50, 4000) && check_grown_value(btree, 51, 2000);
+
+    BTreeStats after = btree_stats(btree);
+    printf("Leaf splits: %llu before growing, %llu after; %llu leaves\n",
+           (unsigned long long)before.leaf_splits, (unsigned long long)after.leaf_splits,
+           (unsigned long long)after.leaf_pages);
+    if (after.num_keys != num_keys || after.leaf_pages < num_keys / 2) {
+        printf("Grown values were not split out to more leaves\n");
+        success = 0;
+    }
+    for (uint32_t key = 0; key < num_keys && success; key++) {
+        success = check_grown_value(btree, key, key == 50 ? 4000 : 2000);
+    }
+    success = success && validate_tree_structure(btree, btree->root_page_num, 0, num_keys - 1, 0);
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
+static uint32_t large_value_length(uint32_t key) {
+    return key <= 3 ? 1500 : key == 1000 ? 4000 : 100 + key * 397 % 2400;
+}
+
+int test_insert_large_values() {
+    printf("\n=== Testing New Keys With Large Values ===\n");
+
+    Pager* pager = open_test_pager("test_large_values.db", DEFAULT_PAGE_SIZE);
+    BTree* btree = btree_open(pager);
+    static char value[2 * DEFAULT_PAGE_SIZE];
+    int success = 1;
+
+    // Three 1500-byte cells do not fit one 4 KB leaf
+    for (uint32_t key = 1; key <= 3 && success; key++) {
+        fill_grown_value(value, key, large_value_length(key));
+        if (btree_upsert(btree, key, value, large_value_length(key)) != 0) {
+            printf("Upsert of new key %u did not insert\n", key);
+            success = 0;
+        }
+    }
+    // New keys land between ones with large values, through both calls
+    for (uint32_t key = 4; key <= 120 && success; key++) {
+        uint32_t length = large_value_length(key);
+        fill_grown_value(value, key, length);
+        int result = (key % 2) ? btree_insert(btree, key, value, length) : btree_upsert(btree, key, value, length);
+        if (result != 0) {
+            printf("Inserting key %u with %u bytes returned %d\n", key, length, result);
+            success = 0;
+        }
+    }
+    // Buffered inserts of large values go straight to their leaves
+    btree_set_buffered(btree, true);
+    for (uint32_t key = 121; key <= 200 && success; key++) {
+        uint32_t length = large_value_length(key);
+        fill_grown_value(value, key, length);
+        if (btree_insert(btree, key, value, length) != 0) {
+            printf("Buffered insert of key %u with %u bytes failed\n", key, length);
+            success = 0;
+        }
+    }
+    btree_set_buffered(btree, false);
+
+    // A value can take a leaf to itself; one larger than a page is refused
+    fill_grown_value(value, 1000, 4000);
+    if (success && btree_insert(btree, 1000, value, 4000) != 0) {
+        printf("A value filling a leaf was refused\n");
+        success = 0;
+    }
+    fill_grown_value(value, 1001, 5000);
+    if (success && (btree_insert(btree, 1001, value, 5000) != -1 || btree_upsert(btree, 1001, value, 5000) != -1)) {
+        printf("A value larger than a page was accepted\n");
+        success = 0;
+    }
+    btree_close(btree);
+    pager_close(pager);
+
+    pager = pager_open("test_large_values.db");
+    btree = btree_open(pager);
+    for (uint32_t key = 1; key <= 200 && success; key++) {
+        success = check_grown_value(btree, key, large_value_length(key));
+    }
+    success = success && check_grown_value(btree, 1000, 4000);
+    BTreeCursor* cursor = btree_find(btree, 1001);
+    void* node = pager_get_page(pager, cursor->page_num);
+    if (cursor->cell_num < *leaf_node_num_cells(node) && *leaf_node_key(node, cursor->cell_num) == 1001) {
+        printf("A refused value was stored\n");
+        success = 0;
+    }
+    free(cursor);
+    BTreeStats stats = btree_stats(btree);
+    printf("%llu keys in %llu leaves\n", (unsigned long long)stats.num_keys, (unsigned long long)stats.leaf_pages);
+    success = success && stats.num_keys == 201;
+    success = success && validate_tree_structure(btree, btree->root_page_num, 1, 1000, 0);
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
 int main() {
     printf("Starting Comprehensive B-Tree Test Suite\n");
     printf("========================================\n");
@@ -450,7 +1016,15 @@ int main() {
         test_sequential_insertion(),
         test_random_insertion(),
         test_duplicate_keys(),
-        test_stress_insertion()
+        test_stress_insertion(),
+        test_multi_level_tree(),
+        test_page_sizes(),
+        test_batched_lookups(),
+        test_tree_stats(),
+        test_buffered_inserts(),
+        test_upsert_and_update(),
+        test_grow_values_in_full_leaves(),
+        test_insert_large_values()
     };
     
     const char* test_names[] = {
@@ -458,7 +1032,15 @@ int main() {
         "Sequential Insertion",
         "Random Insertion", 
         "Duplicate Key Handling",
-        "Stress Insertion"
+        "Stress Insertion",
+        "Multi-Level Tree",
+        "Runtime Page Sizes",
+        "Batched Lookups With Async I/O",
+        "Tree Statistics",
+        "Buffered Inserts",
+        "Upsert And In-Place Update",
+        "Values That Outgrow Their Leaf",
+        "New Keys With Large Values"
     };
     
     test_count = sizeof(tests) / sizeof(tests[0]);
@@ -0,0 +1,714 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "pager.h"
+
+void print_test_result(const char* test_name, int success) {
+    printf("%s: %s\n", test_name, success ? "PASSED" : "FAILED");
+}
+
+int test_default_page_size() {
+    printf("\n=== Testing Default Page Size ===\n");
+
+    remove("test_pager_default.db");
+    Pager* pager = pager_open("test_pager_default.db");
+    if (!pager) {
+        printf("Failed to open pager\n");
+        return 0;
+    }
+
+    int success = (pager_get_page_size(pager) == DEFAULT_PAGE_SIZE);
+    if (!success) {
+        printf("Expected page size %d, got %u\n", DEFAULT_PAGE_SIZE, pager_get_page_size(pager));
+    }
+    pager_close(pager);
+    return success;
+}
+
+int test_page_size_persisted() {
+    printf("\n=== Testing Page Size Persisted In Header ===\n");
+
+    remove("test_pager_size.db");
+    Pager* pager = pager_open_with_page_size("test_pager_size.db", 65536);
+    if (!pager) {
+        printf("Failed to create pager with 64 KB pages\n");
+        return 0;
+    }
+
+    // Write a marker at both ends of a page to check the full page round-trips
+    char* page = pager_get_page(pager, 3);
+    strcpy(page, "first");
+    strcpy(page + 65536 - 8, "last");
+    pager_mark_dirty(pager, 3);
+    pager_close(pager);
+
+    // Asking for a different size must not override the header
+    pager = pager_open_with_page_size("test_pager_size.db", 4096);
+    int success = 1;
+    if (pager_get_page_size(pager) != 65536) {
+        printf("Reopened with page size %u, expected 65536\n", pager_get_page_size(pager));
+        success = 0;
+    }
+    if (pager_get_num_pages(pager) != 4) {
+        printf("Reopened with %u pages, expected 4\n", pager_get_num_pages(pager));
+        success = 0;
+    }
+
+    page = pager_get_page(pager, 3);
+    if (strcmp(page, "first") != 0 || strcmp(page + 65536 - 8, "last") != 0) {
+        printf("Page contents were not persisted\n");
+        success = 0;
+    }
+    pager_close(pager);
+    return success;
+}
+
+int test_invalid_page_sizes() {
+    printf("\n=== Testing Invalid Page Sizes ===\n");
+
+    uint32_t invalid_sizes[] = { 0, 1024, 5000, 131072 };
+    int success = 1;
+
+    for (uint32_t i = 0; i < sizeof(invalid_sizes) / sizeof(invalid_sizes[0]); i++) {
+        remove("test_pager_invalid.db");
+        Pager* pager = pager_open_with_page_size("test_pager_invalid.db", invalid_sizes[i]);
+        if (pager) {
+            printf("Page size %u should have been rejected\n", invalid_sizes[i]);
+            pager_close(pager);
+            success = 0;
+        }
+    }
+    return success;
+}
+
+int test_rejects_foreign_file() {
+    printf("\n=== Testing Foreign File Rejection ===\n");
+
+    FILE* file = fopen("test_pager_foreign.db", "w");
+    fputs("this is not a database", file);
+    fclose(file);
+
+    Pager* pager = pager_open("test_pager_foreign.db");
+    if (pager) {
+        printf("Opening a foreign file should have failed\n");
+        pager_close(pager);
+        return 0;
+    }
+    return 1;
+}
+
+// Opens a fresh database whose buffer pool holds only `cache_frames` pages
+Pager* open_small_pool(const char* filename, uint32_t cache_frames) {
+    remove(filename);
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = cache_frames;
+    return pager_open_with_options(filename, &options);
+}
+
+// Touches each page in [first, last] once, as separate operations
+void touch_pages(Pager* pager, page_num_t first, page_num_t last, PageHint hint) {
+    for (page_num_t page_num = first; page_num <= last; page_num++) {
+        pager_begin_op(pager);
+        pager_get_page_hinted(pager, page_num, hint);
+    }
+}
+
+// Makes pages [first, last] hot: used, then used again after other work
+void warm_pages(Pager* pager, page_num_t first, page_num_t last) {
+    touch_pages(pager, first, last, PAGE_HINT_NORMAL);
+    touch_pages(pager, 1000, 1039, PAGE_HINT_NORMAL);
+    touch_pages(pager, first, last, PAGE_HINT_NORMAL);
+}
+
+int all_cached(Pager* pager, page_num_t first, page_num_t last) {
+    for (page_num_t page_num = first; page_num <= last; page_num++) {
+        if (!pager_page_is_cached(pager, page_num)) {
+            printf("Page %u was evicted\n", page_num);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_eviction_writeback() {
+    printf("\n=== Testing Eviction Writes Back Dirty Pages ===\n");
+
+    Pager* pager = open_small_pool("test_pager_evict.db", 16);
+    for (page_num_t page_num = 0; page_num < 500; page_num++) {
+        pager_begin_op(pager);
+        uint32_t* page = pager_get_page(pager, page_num);
+        *page = page_num * 7;
+        pager_mark_dirty(pager, page_num);
+    }
+
+    // Early pages are long gone from a 16-frame pool; they must come back from disk
+    int success = 1;
+    for (page_num_t page_num = 0; page_num < 500 && success; page_num++) {
+        pager_begin_op(pager);
+        uint32_t* page = pager_get_page(pager, page_num);
+        if (*page != page_num * 7) {
+            printf("Page %u lost its contents after eviction\n", page_num);
+            success = 0;
+        }
+    }
+    pager_close(pager);
+    return success;
+}
+
+int test_scan_resistance() {
+    printf("\n=== Testing Scan Resistance ===\n");
+
+    Pager* pager = open_small_pool("test_pager_scan.db", 64);
+    warm_pages(pager, 0, 19);
+
+    // A long hinted scan and a long unhinted sequential run must both stay on
+    // probation instead of evicting the hot set
+    touch_pages(pager, 2000, 2999, PAGE_HINT_SCAN);
+    int success = all_cached(pager, 0, 19);
+    touch_pages(pager, 3000, 3999, PAGE_HINT_NORMAL);
+    success = success && all_cached(pager, 0, 19);
+
+    pager_close(pager);
+    return success;
+}
+
+int test_internal_nodes_retained() {
+    printf("\n=== Testing Internal Node Retention ===\n");
+
+    Pager* pager = open_small_pool("test_pager_internal.db", 64);
+    touch_pages(pager, 0, 3, PAGE_HINT_INTERNAL);
+
+    // Churn the protected queue with many re-referenced point-lookup pages,
+    // spaced out so they are not mistaken for a sequential scan
+    for (page_num_t round = 0; round < 10; round++) {
+        for (page_num_t i = 0; i < 30; i++) {
+            pager_begin_op(pager);
+            pager_get_page(pager, 5000 + (round * 30 + i) * 3);
+        }
+        for (page_num_t i = 0; i < 30; i++) {
+            pager_begin_op(pager);
+            pager_get_page(pager, 5000 + (round * 30 + i) * 3);
+        }
+    }
+
+    int success = all_cached(pager, 0, 3);
+    pager_close(pager);
+    return success;
+}
+
+int test_frame_arena() {
+    printf("\n=== Testing Frame Arena ===\n");
+
+    PagerHugePages modes[] = { PAGER_HUGE_PAGES_OFF, PAGER_HUGE_PAGES_TRANSPARENT, PAGER_HUGE_PAGES_EXPLICIT };
+    int success = 1;
+
+    for (uint32_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && success; m++) {
+        remove("test_pager_arena.db");
+        PagerOptions options;
+        pager_default_options(&options);
+        options.cache_frames = 32;
+        options.huge_pages = modes[m];
+        Pager* pager = pager_open_with_options("test_pager_arena.db", &options);
+        if (!pager) {
+            printf("Failed to open pager with huge page mode %d\n", modes[m]);
+            return 0;
+        }
+        // Explicit huge pages need a reserved pool and may fall back
+        printf("Huge page mode %d requested, %d in effect\n", modes[m], pager_get_huge_pages(pager));
+
+        for (page_num_t page_num = 0; page_num < 100; page_num++) {
+            pager_begin_op(pager);
+            uint32_t* page = pager_get_page(pager, page_num);
+            if ((uintptr_t)page % 4096 != 0) {
+                printf("Frame for page %u is not page-aligned\n", page_num);
+                success = 0;
+            }
+            *page = page_num + 1;
+            pager_mark_dirty(pager, page_num);
+        }
+        for (page_num_t page_num = 0; page_num < 100; page_num++) {
+            pager_begin_op(pager);
+            uint32_t* page = pager_get_page(pager, page_num);
+            if (*page != page_num + 1) {
+                printf("Page %u has wrong contents\n", page_num);
+                success = 0;
+            }
+        }
+        pager_close(pager);
+    }
+    return success;
+}
+
+int test_pinned_pages_survive_overflow() {
+    printf("\n=== Testing Pages Held By One Operation Stay Valid ===\n");
+
+    Pager* pager = open_small_pool("test_pager_overflow.db", 16);
+    uint32_t* pages[40];
+
+    // One operation holding more pages than the pool has frames
+    pager_begin_op(pager);
+    for (page_num_t page_num = 0; page_num < 40; page_num++) {
+        pages[page_num] = pager_get_page(pager, page_num);
+        *pages[page_num] = page_num + 100;
+        pager_mark_dirty(pager, page_num);
+    }
+
+    int success = 1;
+    for (page_num_t page_num = 0; page_num < 40; page_num++) {
+        if (*pages[page_num] != page_num + 100) {
+            printf("Pointer to page %u was invalidated\n", page_num);
+            success = 0;
+        }
+    }
+    pager_close(pager);
+    return success;
+}
+
+int test_direct_io() {
+    printf("\n=== Testing Direct I/O ===\n");
+
+    remove("test_pager_direct.db");
+    PagerOptions options;
+    pager_default_options(&options);
+    options.page_size = 16384;
+    options.cache_frames = 16;
+    options.direct_io = true;
+    Pager* pager = pager_open_with_options("test_pager_direct.db", &options);
+    if (!pager) {
+        printf("Failed to open pager with direct I/O\n");
+        return 0;
+    }
+    // tmpfs and some other filesystems refuse O_DIRECT
+    printf("Direct I/O requested, %s in effect\n", pager_is_direct_io(pager) ? "on" : "off");
+
+    for (page_num_t page_num = 0; page_num < 200; page_num++) {
+        pager_begin_op(pager);
+        uint32_t* page = pager_get_page(pager, page_num);
+        page[0] = page_num * 3;
+        page[16384 / sizeof(uint32_t) - 1] = page_num;
+        pager_mark_dirty(pager, page_num);
+    }
+    pager_close(pager);
+
+    // Reopen and read everything back through read-ahead
+    pager = pager_open_with_options("test_pager_direct.db", &options);
+    int success = (pager_get_num_pages(pager) == 200);
+    for (page_num_t page_num = 0; page_num < 200 && success; page_num++) {
+        pager_begin_op(pager);
+        uint32_t* page = pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN);
+        if (page[0] != page_num * 3 || page[16384 / sizeof(uint32_t) - 1] != page_num) {
+            printf("Page %u has wrong contents\n", page_num);
+            success = 0;
+        }
+    }
+    pager_close(pager);
+    return success;
+}
+
+int test_scan_read_ahead() {
+    printf("\n=== Testing Scan Read-Ahead ===\n");
+
+    Pager* pager = open_small_pool("test_pager_read_ahead.db", 256);
+    for (page_num_t page_num = 0; page_num < 100; page_num++) {
+        pager_begin_op(pager);
+        *(uint32_t*)pager_get_page(pager, page_num) = page_num;
+        pager_mark_dirty(pager, page_num);
+    }
+    pager_close(pager);
+
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = 256;
+    pager = pager_open_with_options("test_pager_read_ahead.db", &options);
+
+    // A scan miss reads the following pages too, with contents intact
+    pager_begin_op(pager);
+    pager_get_page_hinted(pager, 10, PAGE_HINT_SCAN);
+    int success = all_cached(pager, 11, 11 + 1);
+    for (page_num_t page_num = 11; page_num < 100 && success; page_num++) {
+        pager_begin_op(pager);
+        if (*(uint32_t*)pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN) != page_num) {
+            printf("Read-ahead page %u has wrong contents\n", page_num);
+            success = 0;
+        }
+    }
+
+    // Point misses do not read ahead, and nothing reads past the end of the file
+    pager_begin_op(pager);
+    pager_get_page(pager, 0);
+    if (pager_page_is_cached(pager, 1) || pager_get_num_pages(pager) != 100) {
+        printf("Read-ahead ran on a point miss or past the end of the file\n");
+        success = 0;
+    }
+    pager_close(pager);
+    return success;
+}
+
+int test_io_uring_backend() {
+    printf("\n=== Testing io_uring Backend ===\n");
+
+    remove("test_pager_uring.db");
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = 256;
+    options.io_backend = PAGE_IO_URING;
+    options.io_queue_depth = 8;
+    Pager* pager = pager_open_with_options("test_pager_uring.db", &options);
+    // io_uring may be unavailable (old kernel, seccomp); the pager falls back
+    printf("io_uring requested, %s in effect\n",
+           pager_get_io_backend(pager) == PAGE_IO_URING ? "io_uring" : "synchronous I/O");
+
+    // A checkpoint writes more dirty pages than the queue depth in one batch
+    for (page_num_t page_num = 0; page_num < 100; page_num++) {
+        pager_begin_op(pager);
+        *(uint32_t*)pager_get_page(pager, page_num) = page_num ^ 0x5a5a;
+        pager_mark_dirty(pager, page_num);
+    }
+    pager_flush_all(pager);
+    pager_close(pager);
+
+    pager = pager_open_with_options("test_pager_uring.db", &options);
+    int success = (pager_get_num_pages(pager) == 100);
+
+    // Scattered pages prefetched as one batch are all resident afterwards
+    page_num_t wanted[] = { 90, 3, 47, 3, 12, 71, 99, 0 };
+    uint32_t num_wanted = sizeof(wanted) / sizeof(wanted[0]);
+    pager_begin_op(pager);
+    pager_prefetch(pager, wanted, num_wanted, PAGE_HINT_NORMAL);
+    for (uint32_t i = 0; i < num_wanted && success; i++) {
+        if (!pager_page_is_cached(pager, wanted[i])) {
+            printf("Page %u was not prefetched\n", wanted[i]);
+            success = 0;
+        }
+    }
+    for (page_num_t page_num = 0; page_num < 100 && success; page_num++) {
+        pager_begin_op(pager);
+        if (*(uint32_t*)pager_get_page_hinted(pager, page_num, PAGE_HINT_SCAN) != (page_num ^ 0x5a5a)) {
+            printf("Page %u has wrong contents\n", page_num);
+            success = 0;
+        }
+    }
+    pager_close(pager);
+    return success;
+}
+
+int test_pager_stats() {
+    printf("\n=== Testing Pager Statistics ===\n");
+
+    Pager* pager = open_small_pool("test_pager_stats.db", 16);
+    for (page_num_t page_num = 0; page_num < 40; page_num++) {
+        pager_begin_op(pager);
+        pager_get_page(pager, page_num);
+        pager_mark_dirty(pager, page_num);
+    }
+    // Page 39 is resident, so this is a hit
+    pager_begin_op(pager);
+    pager_get_page(pager, 39);
+
+    PagerStats stats = pager_stats(pager);
+    int success = 1;
+    if (stats.misses != 40 || stats.hits != 1) {
+        printf("Expected 40 misses and 1 hit, got %llu and %llu\n", (unsigned long long)stats.misses,
+               (unsigned long long)stats.hits);
+        success = 0;
+    }
+    // New pages are never read; every eviction of a dirty page is a write
+    if (stats.page_reads != 0 || stats.evictions != 24 || stats.page_writes != 24) {
+        printf("Expected 0 reads, 24 evictions and 24 writes, got %llu, %llu and %llu\n",
+               (unsigned long long)stats.page_reads, (unsigned long long)stats.evictions,
+               (unsigned long long)stats.page_writes);
+        success = 0;
+    }
+    if (stats.cached_pages != 16 || stats.dirty_pages != 16 || stats.capacity != 16 ||
+        stats.bytes_allocated < 16 * 4096) {
+        printf("Unexpected pool snapshot: %u cached, %u dirty, %u capacity, %llu bytes\n", stats.cached_pages,
+               stats.dirty_pages, stats.capacity, (unsigned long long)stats.bytes_allocated);
+        success = 0;
+    }
+
+    pager_flush_all(pager);
+    stats = pager_stats(pager);
+    if (stats.page_writes != 40 || stats.dirty_pages != 0) {
+        printf("Flush left %u dirty pages after %llu writes\n", stats.dirty_pages,
+               (unsigned long long)stats.page_writes);
+        success = 0;
+    }
+    pager_close(pager);
+    return success;
+}
+
+// Fills a page with text-like content that compresses well
+static void fill_compressible(uint8_t* page, uint32_t page_size, page_num_t page_num) {
+    for (uint32_t i = 0; i < page_size; i++) {
+        page[i] = (uint8_t)('a' + (i / 16 + page_num) % 26);
+    }
+    memcpy(page, &page_num, sizeof(page_num));
+}
+
+// Fills a page with content no compressor can shrink
+static void fill_random(uint8_t* page, uint32_t page_size, uint32_t seed) {
+    for (uint32_t i = 0; i < page_size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        page[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static long file_size(const char* filename) {
+    struct stat st;
+    return stat(filename, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static int check_pages(Pager* pager, uint32_t num_pages, uint32_t first_random, uint32_t last_random) {
+    uint8_t expected[4096];
+    for (page_num_t page_num = 0; page_num < num_pages; page_num++) {
+        pager_begin_op(pager);
+        if (page_num >= first_random && page_num < last_random) {
+            fill_random(expected, 4096, page_num);
+        } else {
+            fill_compressible(expected, 4096, page_num);
+        }
+        if (memcmp(pager_get_page(pager, page_num), expected, 4096) != 0) {
+            printf("Page %u has wrong contents\n", page_num);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_compressed_pages() {
+    printf("\n=== Testing Compressed Pages ===\n");
+
+    remove("test_pager_plain.db");
+    remove("test_pager_compressed.db");
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = 16;
+    Pager* plain = pager_open_with_options("test_pager_plain.db", &options);
+    options.compression = PAGER_COMPRESSION_LZ;
+    Pager* pager = pager_open_with_options("test_pager_compressed.db", &options);
+    if (!plain || !pager) {
+        printf("Failed to open pagers\n");
+        return 0;
+    }
+    for (page_num_t page_num = 0; page_num < 100; page_num++) {
+        pager_begin_op(plain);
+        pager_begin_op(pager);
+        fill_compressible(pager_get_page(plain, page_num), 4096, page_num);
+        fill_compressible(pager_get_page(pager, page_num), 4096, page_num);
+        pager_mark_dirty(plain, page_num);
+        pager_mark_dirty(pager, page_num);
+    }
+    PagerStats stats = pager_stats(pager);
+    pager_close(plain);
+    pager_close(pager);
+
+    int success = 1;
+    long plain_size = file_size("test_pager_plain.db");
+    long compressed_size = file_size("test_pager_compressed.db");
+    printf("100 pages: %ld bytes plain, %ld compressed\n", plain_size, compressed_size);
+    if (compressed_size <= 0 || compressed_size * 4 > plain_size ||
+        stats.bytes_written >= stats.page_writes * 4096) {
+        printf("Compression did not shrink the file\n");
+        success = 0;
+    }
+
+    // The format is in the header: reopening without the option still decompresses
+    options.compression = PAGER_COMPRESSION_NONE;
+    pager = pager_open_with_options("test_pager_compressed.db", &options);
+    if (!pager || pager_get_compression(pager) != PAGER_COMPRESSION_LZ || pager_get_num_pages(pager) != 100) {
+        printf("Reopened file lost its compression or pages\n");
+        return 0;
+    }
+    success = success && check_pages(pager, 100, 0, 0);
+
+    // Incompressible pages outgrow their extents and are stored raw
+    for (page_num_t page_num = 20; page_num < 40; page_num++) {
+        pager_begin_op(pager);
+        fill_random(pager_get_page(pager, page_num), 4096, page_num);
+        pager_mark_dirty(pager, page_num);
+    }
+    Pager* reader = pager_open_reader(pager, 8);
+    success = success && check_pages(reader, 100, 20, 40);
+    pager_close(reader);
+    pager_close(pager);
+
+    pager = pager_open_with_options("test_pager_compressed.db", &options);
+    success = success && check_pages(pager, 100, 20, 40);
+
+    // Shrinking them again moves them back into the space their first images
+    // left. The raw extents they leave stay in use until the checkpoint.
+    for (page_num_t page_num = 20; page_num < 40; page_num++) {
+        pager_begin_op(pager);
+        fill_compressible(pager_get_page(pager, page_num), 4096, page_num);
+        pager_mark_dirty(pager, page_num);
+    }
+    pager_close(pager);
+    long rewritten_size = file_size("test_pager_compressed.db");
+    if (rewritten_size > compressed_size + 20 * 4096 + 4096) {
+        printf("Rewritten file grew to %ld bytes\n", rewritten_size);
+        success = 0;
+    }
+    pager = pager_open_with_options("test_pager_compressed.db", &options);
+    success = success && check_pages(pager, 100, 0, 0);
+
+    // Growing them once more reuses the raw extents freed at that checkpoint;
+    // only the new extent map goes at the end
+    for (page_num_t page_num = 20; page_num < 40; page_num++) {
+        pager_begin_op(pager);
+        fill_random(pager_get_page(pager, page_num), 4096, page_num);
+        pager_mark_dirty(pager, page_num);
+    }
+    pager_close(pager);
+    long regrown_size = file_size("test_pager_compressed.db");
+    printf("Rewritten: %ld bytes, grown again: %ld\n", rewritten_size, regrown_size);
+    if (regrown_size > rewritten_size + 4096) {
+        printf("Freed extents were not reused\n");
+        success = 0;
+    }
+    pager = pager_open_with_options("test_pager_compressed.db", &options);
+    success = success && check_pages(pager, 100, 20, 40);
+    pager_close(pager);
+    return success;
+}
+
+// A session that ends without pager_close() must leave the file as of its
+// last checkpoint: its later writes may not touch what that map references
+int test_compressed_crash() {
+    printf("\n=== Testing Compressed File After A Crash ===\n");
+
+    remove("test_pager_crash.db");
+    PagerOptions options;
+    pager_default_options(&options);
+    options.cache_frames = 16;
+    options.compression = PAGER_COMPRESSION_LZ;
+    Pager* pager = pager_open_with_options("test_pager_crash.db", &options);
+    if (!pager) {
+        printf("Failed to open pager\n");
+        return 0;
+    }
+    for (page_num_t page_num = 0; page_num < 100; page_num++) {
+        pager_begin_op(pager);
+        fill_compressible(pager_get_page(pager, page_num), 4096, page_num);
+        pager_mark_dirty(pager, page_num);
+    }
+    pager_close(pager);
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        // Checkpoint some changes, then write more through evictions: pages
+        // that grow move, pages that shrink back get new extents, and new
+        // pages go past the old map. Then die without closing.
+        pager = pager_open_with_options("test_pager_crash.db", &options);
+        if (!pager) {
+            _exit(1);
+        }
+        for (page_num_t page_num = 20; page_num < 40; page_num++) {
+            pager_begin_op(pager);
+            fill_random(pager_get_page(pager, page_num), 4096, page_num);
+            pager_mark_dirty(pager, page_num);
+        }
+        pager_flush_all(pager);
+        for (page_num_t page_num = 0; page_num < 150; page_num++) {
+            pager_begin_op(pager);
+            uint8_t* page = pager_get_page(pager, page_num);
+            if (page_num >= 20 && page_num < 40) {
+                fill_compressible(page, 4096, page_num + 1);
+            } else {
+                fill_random(page, 4096, page_num + 1000);
+            }
+            pager_mark_dirty(pager, page_num);
+        }
+        _exit(0);
+    }
+    int status;
+    if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Crashing session did not run\n");
+        return 0;
+    }
+
+    pager = pager_open_with_options("test_pager_crash.db", &options);
+    if (!pager || pager_get_num_pages(pager) != 100) {
+        printf("File did not reopen at its last checkpoint\n");
+        return 0;
+    }
+    int success = check_pages(pager, 100, 20, 40);
+
+    // The reopened file takes writes again
+    for (page_num_t page_num = 0; page_num < 20; page_num++) {
+        pager_begin_op(pager);
+        fill_random(pager_get_page(pager, page_num), 4096, page_num);
+        pager_mark_dirty(pager, page_num);
+    }
+    pager_close(pager);
+    pager = pager_open_with_options("test_pager_crash.db", &options);
+    success = success && check_pages(pager, 100, 0, 40);
+    pager_close(pager);
+    return success;
+}
+
+int main() {
+    printf("Starting Pager Test Suite\n");
+    printf("========================================\n");
+
+    int overall_success = 1;
+    int test_count = 0;
+    int passed_count = 0;
+
+    int tests[] = {
+        test_default_page_size(),
+        test_page_size_persisted(),
+        test_invalid_page_sizes(),
+        test_rejects_foreign_file(),
+        test_eviction_writeback(),
+        test_scan_resistance(),
+        test_internal_nodes_retained(),
+        test_frame_arena(),
+        test_pinned_pages_survive_overflow(),
+        test_direct_io(),
+        test_scan_read_ahead(),
+        test_io_uring_backend(),
+        test_pager_stats(),
+        test_compressed_pages(),
+        test_compressed_crash()
+    };
+
+    const char* test_names[] = {
+        "Default Page Size",
+        "Page Size Persisted In Header",
+        "Invalid Page Sizes",
+        "Foreign File Rejection",
+        "Eviction Writes Back Dirty Pages",
+        "Scan Resistance",
+        "Internal Node Retention",
+        "Frame Arena",
+        "Pages Held By One Operation Stay Valid",
+        "Direct I/O",
+        "Scan Read-Ahead",
+        "io_uring Backend",
+        "Pager Statistics",
+        "Compressed Pages",
+        "Compressed File After A Crash"
+    };
+
+    test_count = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < test_count; i++) {
+        print_test_result(test_names[i], tests[i]);
+        if (tests[i]) {
+            passed_count++;
+        } else {
+            overall_success = 0;
+        }
+    }
+
+    printf("\n========================================\n");
+    printf("Test Summary: %d/%d tests passed\n", passed_count, test_count);
+    printf("Overall Result: %s\n", overall_success ? "ALL TESTS PASSED" : "SOME TESTS FAILED");
+
+    return overall_success ? 0 : 1;
+}
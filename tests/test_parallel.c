@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parallel.h"
+
+void print_test_result(const char* test_name, int success) {
+    printf("%s: %s\n", test_name, success ? "PASSED" : "FAILED");
+}
+
+// Values hold key * 3 in their first 4 bytes and are padded, so a tree of a
+// few thousand keys has several levels
+#define TEST_VALUE_SIZE 200
+
+typedef struct {
+    uint64_t rows;
+    uint64_t key_sum;
+    uint32_t min_key;
+    uint32_t max_key;
+    uint32_t bad_values;          // Rows whose value does not match their key
+} Totals;
+
+void totals_init(void* state, void* context) {
+    (void)context;
+    Totals* totals = state;
+    memset(totals, 0, sizeof(*totals));
+    totals->min_key = UINT32_MAX;
+}
+
+void totals_row(void* state, void* context, uint32_t key, const uint8_t* value, uint32_t value_size) {
+    (void)context;
+    Totals* totals = state;
+    uint32_t stored;
+    memcpy(&stored, value, sizeof(stored));
+    if (stored != key * 3 || value_size != TEST_VALUE_SIZE) {
+        totals->bad_values++;
+    }
+    totals->rows++;
+    totals->key_sum += key;
+    totals->min_key = key < totals->min_key ? key : totals->min_key;
+    totals->max_key = key > totals->max_key ? key : totals->max_key;
+}
+
+void totals_merge(void* state, const void* partial, void* context) {
+    (void)context;
+    Totals* totals = state;
+    const Totals* other = partial;
+    totals->rows += other->rows;
+    totals->key_sum += other->key_sum;
+    totals->bad_values += other->bad_values;
+    totals->min_key = other->min_key < totals->min_key ? other->min_key : totals->min_key;
+    totals->max_key = other->max_key > totals->max_key ? other->max_key : totals->max_key;
+}
+
+static const ScanAggregate totals_aggregate = { sizeof(Totals), totals_init, totals_row, totals_merge };
+
+// Inserts the even keys 2 * [first, first + count) in a scrambled order
+void insert_keys(BTree* btree, uint32_t first, uint32_t count) {
+    uint8_t value[TEST_VALUE_SIZE];
+    memset(value, 'x', sizeof(value));
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t key = 2 * (first + (i * 7919u) % count);
+        uint32_t stored = key * 3;
+        memcpy(value, &stored, sizeof(stored));
+        btree_insert(btree, key, value, sizeof(value));
+    }
+}
+
+// Checks the totals of [lower, upper] in a tree of the even keys 2 .. max_key
+int check_totals(const char* label, const Totals* totals, uint32_t lower, uint32_t upper, uint32_t max_key) {
+    lower = lower < 2 ? 2 : lower;
+    upper = upper > max_key ? max_key : upper;
+    uint32_t first = lower % 2 ? lower + 1 : lower;
+    uint32_t last = upper % 2 ? upper - 1 : upper;
+    uint64_t rows = last >= first ? (last - first) / 2 + 1 : 0;
+    uint64_t key_sum = rows * (first + (uint64_t)last) / 2;
+    if (totals->rows != rows || totals->key_sum != key_sum || totals->bad_values != 0 ||
+        (rows > 0 && (totals->min_key != first || totals->max_key != last))) {
+        printf("%s: %llu rows summing to %llu (%u bad values), expected %llu summing to %llu\n", label,
+               (unsigned long long)totals->rows, (unsigned long long)totals->key_sum, totals->bad_values,
+               (unsigned long long)rows, (unsigned long long)key_sum);
+        return 0;
+    }
+    return 1;
+}
+
+int test_parallel_scan_totals() {
+    printf("\n=== Testing Parallel Scan Totals ===\n");
+
+    remove("test_parallel.db");
+    Pager* pager = pager_open("test_parallel.db");
+    BTree* btree = btree_open(pager);
+    insert_keys(btree, 1, 20000);
+
+    int success = 1;
+    uint32_t thread_counts[] = { 1, 2, 4, 8, 16 };
+    for (uint32_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        ThreadPool* pool = thread_pool_new(thread_counts[i]);
+        Totals totals;
+        ParallelScanStats stats;
+        char label[64];
+        snprintf(label, sizeof(label), "%u threads", thread_counts[i]);
+        success = success && parallel_scan(pool, btree, 0, UINT32_MAX, &totals_aggregate, NULL, &totals, &stats) == 0 &&
+                  check_totals(label, &totals, 0, UINT32_MAX, 40000);
+        // The tree has enough separators for several morsels per worker
+        if (stats.morsels < thread_counts[i] * 2) {
+            printf("%s: only %u morsels\n", label, stats.morsels);
+            success = 0;
+        }
+        // Ranges that start and end inside morsels
+        success = success && parallel_scan(pool, btree, 777, 31001, &totals_aggregate, NULL, &totals, NULL) == 0 &&
+                  check_totals(label, &totals, 777, 31001, 40000);
+        success = success && parallel_scan(pool, btree, 39999, 50000, &totals_aggregate, NULL, &totals, NULL) == 0 &&
+                  check_totals(label, &totals, 39999, 50000, 40000);
+        success = success && parallel_scan(pool, btree, 9, 9, &totals_aggregate, NULL, &totals, NULL) == 0 &&
+                  check_totals(label, &totals, 9, 9, 40000);
+        thread_pool_free(pool);
+    }
+
+    // Without a pool the caller scans alone
+    Totals totals;
+    success = success && parallel_scan(NULL, btree, 0, UINT32_MAX, &totals_aggregate, NULL, &totals, NULL) == 0 &&
+              check_totals("No pool", &totals, 0, UINT32_MAX, 40000);
+
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
+int test_scan_sees_unflushed_writes() {
+    printf("\n=== Testing Parallel Scan Sees Unflushed Writes ===\n");
+
+    remove("test_parallel_writes.db");
+    Pager* pager = pager_open("test_parallel_writes.db");
+    BTree* btree = btree_open(pager);
+    ThreadPool* pool = thread_pool_new(4);
+    int success = 1;
+    // Each round's rows are still dirty in the tree's pager when the scan
+    // starts, and the tree is written again between scans
+    for (uint32_t round = 1; round <= 4 && success; round++) {
+        insert_keys(btree, 1 + (round - 1) * 3000, 3000);
+        Totals totals;
+        success = parallel_scan(pool, btree, 0, UINT32_MAX, &totals_aggregate, NULL, &totals, NULL) == 0 &&
+                  check_totals("After writes", &totals, 0, UINT32_MAX, 2 * 3000 * round);
+    }
+    thread_pool_free(pool);
+    btree_close(btree);
+    pager_close(pager);
+    return success;
+}
+
+typedef struct {
+    uint32_t runs[PARALLEL_MAX_THREADS];
+} PoolCounts;
+
+void count_run(void* context, uint32_t worker) {
+    PoolCounts* counts = context;
+    counts->runs[worker]++;
+}
+
+int test_thread_pool_reuse() {
+    printf("\n=== Testing Thread Pool Reuse ===\n");
+
+    ThreadPool* pool = thread_pool_new(6);
+    PoolCounts counts;
+    memset(&counts, 0, sizeof(counts));
+    for (uint32_t i = 0; i < 100; i++) {
+        thread_pool_run(pool, count_run, &counts);
+    }
+    int success = thread_pool_size(pool) == 6;
+    for (uint32_t i = 0; i < PARALLEL_MAX_THREADS; i++) {
+        if (counts.runs[i] != (i < 6 ? 100u : 0u)) {
+            printf("Worker %u ran %u times\n", i, counts.runs[i]);
+            success = 0;
+        }
+    }
+    thread_pool_free(pool);
+
+    pool = thread_pool_new(0);
+    success = success && pool && thread_pool_size(pool) >= 1;
+    thread_pool_free(pool);
+    return success;
+}
+
+int main() {
+    printf("Starting Parallel Scan Test Suite\n");
+    printf("========================================\n");
+
+    int overall_success = 1;
+    int test_count = 0;
+    int passed_count = 0;
+
+    int tests[] = {
+        test_parallel_scan_totals(),
+        test_scan_sees_unflushed_writes(),
+        test_thread_pool_reuse()
+    };
+
+    const char* test_names[] = {
+        "Parallel Scan Totals",
+        "Parallel Scan Sees Unflushed Writes",
+        "Thread Pool Reuse"
+    };
+
+    test_count = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < test_count; i++) {
+        print_test_result(test_names[i], tests[i]);
+        if (tests[i]) {
+            passed_count++;
+        } else {
+            overall_success = 0;
+        }
+    }
+
+    printf("\n========================================\n");
+    printf("Test Summary: %d/%d tests passed\n", passed_count, test_count);
+    printf("Overall Result: %s\n", overall_success ? "ALL TESTS PASSED" : "SOME TESTS FAILED");
+
+    return overall_success ? 0 : 1;
+}
@@ -0,0 +1,510 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+void print_test_result(const char* test_name, int success) {
+    printf("%s: %s\n", test_name, success ? "PASSED" : "FAILED");
+}
+
+#define TEST_SOCKET "/tmp/miniSQL-test-server.sock"
+#define TEST_MAX_FRAME 4096
+
+// A server on its own thread over a fresh database
+typedef struct {
+    Database* db;
+    Server* server;
+    pthread_t thread;
+} TestServer;
+
+void* run_server(void* argument) {
+    server_run(argument);
+    return NULL;
+}
+
+int start_server(TestServer* test, const char* filename, uint32_t num_workers) {
+    remove(filename);
+    test->db = db_open(filename);
+    test->server = test->db ? server_open(test->db, TEST_SOCKET, num_workers) : NULL;
+    if (!test->server) {
+        printf("Failed to start the server\n");
+        return 0;
+    }
+    pthread_create(&test->thread, NULL, run_server, test->server);
+    return 1;
+}
+
+void stop_server(TestServer* test) {
+    server_stop(test->server);
+    pthread_join(test->thread, NULL);
+    server_close(test->server);
+    db_close(test->db);
+}
+
+int connect_client() {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, TEST_SOCKET);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        printf("Failed to connect\n");
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// Client-side encoding: requests are appended to a buffer, so a batch of
+// them goes out in one write
+typedef struct {
+    uint8_t* data;
+    size_t used;
+    size_t capacity;
+} Buffer;
+
+void buffer_put(Buffer* buffer, const void* bytes, size_t length) {
+    if (buffer->used + length > buffer->capacity) {
+        buffer->capacity = (buffer->used + length) * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->used, bytes, length);
+    buffer->used += length;
+}
+
+// Parameters are given as Values; only NULL, INT and TEXT are sent
+void put_query(Buffer* buffer, uint32_t request_id, const char* sql, const Value* parameters,
+               uint16_t num_parameters) {
+    size_t start = buffer->used;
+    uint32_t length = 0;
+    uint8_t type = SERVER_REQUEST_QUERY;
+    buffer_put(buffer, &length, sizeof(length));
+    buffer_put(buffer, &request_id, sizeof(request_id));
+    buffer_put(buffer, &type, sizeof(type));
+    buffer_put(buffer, &num_parameters, sizeof(num_parameters));
+    for (uint16_t i = 0; i < num_parameters; i++) {
+        uint8_t value_type = (uint8_t)parameters[i].type;
+        buffer_put(buffer, &value_type, sizeof(value_type));
+        if (parameters[i].type == VALUE_INT) {
+            buffer_put(buffer, &parameters[i].integer, sizeof(int64_t));
+        } else if (parameters[i].type == VALUE_TEXT) {
+            buffer_put(buffer, &parameters[i].length, sizeof(uint32_t));
+            buffer_put(buffer, parameters[i].text, parameters[i].length);
+        }
+    }
+    buffer_put(buffer, sql, strlen(sql));
+    length = (uint32_t)(buffer->used - start - sizeof(length));
+    memcpy(buffer->data + start, &length, sizeof(length));
+}
+
+int send_all(int fd, Buffer* buffer) {
+    size_t sent = 0;
+    while (sent < buffer->used) {
+        ssize_t written = write(fd, buffer->data + sent, buffer->used - sent);
+        if (written <= 0) {
+            return 0;
+        }
+        sent += (size_t)written;
+    }
+    buffer->used = 0;
+    return 1;
+}
+
+int read_all(int fd, void* destination, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+        ssize_t count = read(fd, (uint8_t*)destination + received, length - received);
+        if (count <= 0) {
+            return 0;
+        }
+        received += (size_t)count;
+    }
+    return 1;
+}
+
+typedef struct {
+    uint32_t request_id;
+    uint8_t type;
+    uint32_t length;              // Of the body
+    uint8_t body[TEST_MAX_FRAME];
+} Frame;
+
+int read_frame(int fd, Frame* frame) {
+    uint32_t length;
+    if (!read_all(fd, &length, sizeof(length)) || length < 5 || length - 5 > TEST_MAX_FRAME ||
+        !read_all(fd, &frame->request_id, sizeof(frame->request_id)) || !read_all(fd, &frame->type, 1)) {
+        return 0;
+    }
+    frame->length = length - 5;
+    return read_all(fd, frame->body, frame->length);
+}
+
+// Decodes column `column` of a ROW frame
+Value row_value(const Frame* frame, uint16_t column) {
+    Value value;
+    memset(&value, 0, sizeof(value));
+    const uint8_t* position = frame->body + sizeof(uint16_t);
+    for (uint16_t i = 0; i <= column; i++) {
+        value.type = (ValueType)*position++;
+        if (value.type == VALUE_INT) {
+            memcpy(&value.integer, position, sizeof(int64_t));
+            position += sizeof(int64_t);
+        } else if (value.type != VALUE_NULL) {
+            memcpy(&value.length, position, sizeof(uint32_t));
+            value.text = (const char*)position + sizeof(uint32_t);
+            position += sizeof(uint32_t) + value.length;
+        }
+    }
+    return value;
+}
+
+Value int_value(int64_t integer) {
+    Value value = {VALUE_INT, 0, integer, NULL};
+    return value;
+}
+
+Value text_value(const char* text) {
+    Value value = {VALUE_TEXT, (uint32_t)strlen(text), 0, text};
+    return value;
+}
+
+int test_pipelined_requests() {
+    printf("\n=== Testing Pipelined Requests ===\n");
+
+    TestServer test;
+    if (!start_server(&test, "test_server_pipelined.db", 2)) {
+        return 0;
+    }
+    int fd = connect_client();
+    if (fd == -1) {
+        stop_server(&test);
+        return 0;
+    }
+
+    // Every request goes out before any response is read
+    Buffer buffer = {NULL, 0, 0};
+    put_query(&buffer, 1, "CREATE TABLE users (id INT, name TEXT, age INT)", NULL, 0);
+    for (uint32_t id = 1; id <= 100; id++) {
+        char name[32];
+        sprintf(name, "user_%u", id);
+        Value parameters[3] = {int_value(id), text_value(name), int_value(id % 40)};
+        if (id % 10 == 0) {
+            parameters[1].type = VALUE_NULL;
+        }
+        put_query(&buffer, 1 + id, "INSERT INTO users VALUES (?, ?, ?)", parameters, 3);
+    }
+    Value range[2] = {int_value(40), int_value(45)};
+    put_query(&buffer, 200, "SELECT id, name FROM users WHERE id >= ? AND id <= ?", range, 2);
+    put_query(&buffer, 201, "SELEKT nothing", NULL, 0);
+    put_query(&buffer, 202, "SELECT COUNT(*), SUM(age) FROM users", NULL, 0);
+    int success = send_all(fd, &buffer);
+
+    Frame frame;
+    for (uint32_t request_id = 1; request_id <= 101 && success; request_id++) {
+        uint32_t changes = 0;
+        if (!read_frame(fd, &frame) || frame.request_id != request_id || frame.type != SERVER_RESPONSE_DONE) {
+            printf("Request %u was not answered with DONE\n", request_id);
+            success = 0;
+            break;
+        }
+        memcpy(&changes, frame.body, sizeof(changes));
+        if (changes != (request_id == 1 ? 0u : 1u)) {
+            printf("Request %u changed %u rows\n", request_id, changes);
+            success = 0;
+        }
+    }
+    for (int64_t id = 40; id <= 45 && success; id++) {
+        success = read_frame(fd, &frame) && frame.request_id == 200 && frame.type == SERVER_RESPONSE_ROW;
+        Value key = row_value(&frame, 0);
+        Value name = row_value(&frame, 1);
+        char expected[32];
+        sprintf(expected, "user_%lld", (long long)id);
+        if (!success || key.type != VALUE_INT || key.integer != id ||
+            (id % 10 == 0 ? name.type != VALUE_NULL
+                          : name.type != VALUE_TEXT || name.length != strlen(expected) ||
+                                memcmp(name.text, expected, name.length) != 0)) {
+            printf("Row for id %lld is wrong\n", (long long)id);
+            success = 0;
+        }
+    }
+    success = success && read_frame(fd, &frame) && frame.request_id == 200 && frame.type == SERVER_RESPONSE_DONE;
+    success = success && read_frame(fd, &frame) && frame.request_id == 201 && frame.type == SERVER_RESPONSE_ERROR;
+    if (success) {
+        printf("Error for bad SQL: %.*s\n", (int)frame.length, frame.body);
+    }
+
+    // An error does not end the connection's later requests
+    int64_t age_sum = 0;
+    for (uint32_t id = 1; id <= 100; id++) {
+        age_sum += id % 40;
+    }
+    success = success && read_frame(fd, &frame) && frame.request_id == 202 && frame.type == SERVER_RESPONSE_ROW &&
+              row_value(&frame, 0).integer == 100 && row_value(&frame, 1).integer == age_sum;
+    success = success && read_frame(fd, &frame) && frame.request_id == 202 && frame.type == SERVER_RESPONSE_DONE;
+
+    close(fd);
+    free(buffer.data);
+    ServerStats stats = server_stats(test.server);
+    stop_server(&test);
+    if (success && (stats.requests != 104 || stats.errors != 1)) {
+        printf("Expected 104 requests and 1 error, got %llu and %llu\n", (unsigned long long)stats.requests,
+               (unsigned long long)stats.errors);
+        success = 0;
+    }
+    return success;
+}
+
+#define CLIENT_THREADS 8
+#define CLIENT_ROWS 200
+
+typedef struct {
+    uint32_t client;
+    int success;
+} ClientTask;
+
+// Inserts its own range of ids, pipelined, then reads each row back
+void* run_client(void* argument) {
+    ClientTask* task = argument;
+    int fd = connect_client();
+    if (fd == -1) {
+        return NULL;
+    }
+    Buffer buffer = {NULL, 0, 0};
+    int64_t first = (int64_t)task->client * CLIENT_ROWS + 1;
+    for (int64_t id = first; id < first + CLIENT_ROWS; id++) {
+        Value parameters[2] = {int_value(id), int_value(id * 7)};
+        put_query(&buffer, (uint32_t)id, "INSERT INTO counters VALUES (?, ?)", parameters, 2);
+    }
+    for (int64_t id = first; id < first + CLIENT_ROWS; id++) {
+        Value parameter = int_value(id);
+        put_query(&buffer, (uint32_t)id, "SELECT total FROM counters WHERE id = ?", &parameter, 1);
+    }
+    int success = send_all(fd, &buffer);
+
+    Frame frame;
+    for (int64_t id = first; id < first + CLIENT_ROWS && success; id++) {
+        success = read_frame(fd, &frame) && frame.request_id == id && frame.type == SERVER_RESPONSE_DONE;
+    }
+    for (int64_t id = first; id < first + CLIENT_ROWS && success; id++) {
+        success = read_frame(fd, &frame) && frame.request_id == id && frame.type == SERVER_RESPONSE_ROW &&
+                  row_value(&frame, 0).integer == id * 7 && read_frame(fd, &frame) &&
+                  frame.type == SERVER_RESPONSE_DONE;
+    }
+    if (!success) {
+        printf("Client %u got a wrong response\n", task->client);
+    }
+    close(fd);
+    free(buffer.data);
+    task->success = success;
+    return NULL;
+}
+
+int test_concurrent_clients() {
+    printf("\n=== Testing Concurrent Clients ===\n");
+
+    TestServer test;
+    if (!start_server(&test, "test_server_concurrent.db", 4)) {
+        return 0;
+    }
+    int success = 1;
+    int fd = connect_client();
+    Buffer buffer = {NULL, 0, 0};
+    Frame frame;
+    put_query(&buffer, 1, "CREATE TABLE counters (id INT, total INT)", NULL, 0);
+    success = fd != -1 && send_all(fd, &buffer) && read_frame(fd, &frame) && frame.type == SERVER_RESPONSE_DONE;
+
+    pthread_t threads[CLIENT_THREADS];
+    ClientTask tasks[CLIENT_THREADS];
+    for (uint32_t i = 0; i < CLIENT_THREADS; i++) {
+        tasks[i].client = i;
+        tasks[i].success = 0;
+        pthread_create(&threads[i], NULL, run_client, &tasks[i]);
+    }
+    for (uint32_t i = 0; i < CLIENT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        success = success && tasks[i].success;
+    }
+
+    // Every client's rows are in the one database
+    int64_t rows = CLIENT_THREADS * CLIENT_ROWS;
+    put_query(&buffer, 2, "SELECT COUNT(*), SUM(total) FROM counters", NULL, 0);
+    success = success && send_all(fd, &buffer) && read_frame(fd, &frame) && frame.type == SERVER_RESPONSE_ROW &&
+              row_value(&frame, 0).integer == rows && row_value(&frame, 1).integer == 7 * rows * (rows + 1) / 2;
+    if (fd != -1) {
+        close(fd);
+    }
+    free(buffer.data);
+
+    ServerStats stats = server_stats(test.server);
+    printf("%llu connections, %llu requests\n", (unsigned long long)stats.connections,
+           (unsigned long long)stats.requests);
+    success = success && stats.connections == CLIENT_THREADS + 1 && stats.errors == 0;
+    stop_server(&test);
+    return success;
+}
+
+int test_malformed_frames() {
+    printf("\n=== Testing Malformed Frames ===\n");
+
+    TestServer test;
+    if (!start_server(&test, "test_server_malformed.db", 1)) {
+        return 0;
+    }
+
+    // A frame over the limit closes the connection without a response
+    int bad = connect_client();
+    uint32_t huge = SERVER_MAX_FRAME + 1;
+    Frame frame;
+    int success = bad != -1 && write(bad, &huge, sizeof(huge)) == sizeof(huge) && !read_frame(bad, &frame);
+    if (bad != -1) {
+        close(bad);
+    }
+
+    // A truncated parameter list is answered with an error
+    int fd = connect_client();
+    Buffer buffer = {NULL, 0, 0};
+    uint32_t length = 4 + 1 + 2 + 1;
+    uint32_t request_id = 9;
+    uint8_t bytes[] = {SERVER_REQUEST_QUERY, 1, 0, VALUE_INT};
+    buffer_put(&buffer, &length, sizeof(length));
+    buffer_put(&buffer, &request_id, sizeof(request_id));
+    buffer_put(&buffer, bytes, sizeof(bytes));
+    put_query(&buffer, 10, "CREATE TABLE t (id INT)", NULL, 0);
+    success = success && fd != -1 && send_all(fd, &buffer) && read_frame(fd, &frame) && frame.request_id == 9 &&
+              frame.type == SERVER_RESPONSE_ERROR && read_frame(fd, &frame) && frame.request_id == 10 &&
+              frame.type == SERVER_RESPONSE_DONE;
+    if (fd != -1) {
+        close(fd);
+    }
+    free(buffer.data);
+    stop_server(&test);
+    return success;
+}
+
+#define LARGE_ROWS 20000
+#define LARGE_PAYLOAD 200
+
+// Answers a SELECT of every row, with request id `request_id`: counts the
+// ROW frames before the final frame and returns that frame's type
+int read_large_result(int fd, uint32_t request_id, uint32_t* rows) {
+    Frame frame;
+    *rows = 0;
+    while (read_frame(fd, &frame) && frame.request_id == request_id) {
+        if (frame.type != SERVER_RESPONSE_ROW) {
+            return frame.type;
+        }
+        Value payload = row_value(&frame, 1);
+        if (row_value(&frame, 0).integer != *rows + 1 || payload.length != LARGE_PAYLOAD) {
+            return 0;
+        }
+        (*rows)++;
+    }
+    return 0;
+}
+
+int test_large_results() {
+    printf("\n=== Testing Results Larger Than The High-Water Mark ===\n");
+
+    TestServer test;
+    if (!start_server(&test, "test_server_large.db", 2)) {
+        return 0;
+    }
+    int fd = connect_client();
+    Buffer buffer = {NULL, 0, 0};
+    Frame frame;
+    put_query(&buffer, 1, "CREATE TABLE big (id INT, payload TEXT)", NULL, 0);
+    int success = fd != -1 && send_all(fd, &buffer) && read_frame(fd, &frame) && frame.type == SERVER_RESPONSE_DONE;
+    char payload[LARGE_PAYLOAD + 1];
+    memset(payload, 'x', LARGE_PAYLOAD);
+    payload[LARGE_PAYLOAD] = '\0';
+    for (int64_t id = 1; id <= LARGE_ROWS && success; id++) {
+        Value parameters[2] = {int_value(id), text_value(payload)};
+        put_query(&buffer, (uint32_t)id, "INSERT INTO big VALUES (?, ?)", parameters, 2);
+        if (id % 500 == 0) {
+            success = send_all(fd, &buffer);
+            for (int i = 0; i < 500 && success; i++) {
+                success = read_frame(fd, &frame) && frame.type == SERVER_RESPONSE_DONE;
+            }
+        }
+    }
+
+    // About 4 MB of rows reach a client that keeps reading
+    uint32_t rows = 0;
+    put_query(&buffer, 2, "SELECT id, payload FROM big", NULL, 0);
+    success = success && send_all(fd, &buffer) && read_large_result(fd, 2, &rows) == SERVER_RESPONSE_DONE &&
+              rows == LARGE_ROWS;
+    printf("Read %u rows of %u bytes\n", rows, LARGE_PAYLOAD);
+
+    // A client that stops reading gives up the database after the write
+    // timeout: another client's query gets through, and the stalled one finds
+    // an ERROR after the rows that were sent
+    put_query(&buffer, 3, "SELECT id, payload FROM big", NULL, 0);
+    success = success && send_all(fd, &buffer);
+    usleep(100 * 1000);
+    int other = connect_client();
+    put_query(&buffer, 4, "SELECT COUNT(*) FROM big", NULL, 0);
+    success = success && other != -1 && send_all(other, &buffer) && read_frame(other, &frame) &&
+              frame.type == SERVER_RESPONSE_ROW && row_value(&frame, 0).integer == LARGE_ROWS;
+    int last = success ? read_large_result(fd, 3, &rows) : 0;
+    printf("Stalled client read %u rows before the end\n", rows);
+    if (success && (last != SERVER_RESPONSE_ERROR || rows >= LARGE_ROWS)) {
+        printf("Stalled result was not cut off with an ERROR\n");
+        success = 0;
+    }
+    if (other != -1) {
+        close(other);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    free(buffer.data);
+    stop_server(&test);
+    return success;
+}
+
+int main() {
+    printf("Starting Server Test Suite\n");
+    printf("========================================\n");
+
+    int overall_success = 1;
+    int test_count = 0;
+    int passed_count = 0;
+
+    int tests[] = {
+        test_pipelined_requests(),
+        test_concurrent_clients(),
+        test_malformed_frames(),
+        test_large_results()
+    };
+
+    const char* test_names[] = {
+        "Pipelined Requests",
+        "Concurrent Clients",
+        "Malformed Frames",
+        "Results Larger Than The High-Water Mark"
+    };
+
+    test_count = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < test_count; i++) {
+        print_test_result(test_names[i], tests[i]);
+        if (tests[i]) {
+            passed_count++;
+        } else {
+            overall_success = 0;
+        }
+    }
+
+    printf("\n========================================\n");
+    printf("Test Summary: %d/%d tests passed\n", passed_count, test_count);
+    printf("Overall Result: %s\n", overall_success ? "ALL TESTS PASSED" : "SOME TESTS FAILED");
+
+    return overall_success ? 0 : 1;
+}
@@ -0,0 +1,1041 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "db.h"
+#include "codegen.h"
+#include "sorter.h"
+#include "hashjoin.h"
+
+void print_test_result(const char* test_name, int success) {
+    printf("%s: %s\n", test_name, success ? "PASSED" : "FAILED");
+}
+
+// Runs a statement that returns no rows
+int exec(Database* db, const char* sql) {
+    PreparedStatement* statement = db_prepare(db, sql, -1);
+    if (!statement) {
+        printf("Prepare failed for %s: %s\n", sql, db_error(db));
+        return 0;
+    }
+    VmStatus status = stmt_step(statement);
+    stmt_finalize(statement);
+    if (status != VM_DONE) {
+        printf("%s failed: %s\n", sql, db_error(db));
+        return 0;
+    }
+    return 1;
+}
+
+// Runs a query and sums the first column of its rows; -1 on error
+int64_t sum_first_column(PreparedStatement* statement, uint32_t* rows) {
+    int64_t sum = 0;
+    VmStatus status;
+    *rows = 0;
+    while ((status = stmt_step(statement)) == VM_ROW) {
+        uint32_t num_columns;
+        const Value* row = stmt_row(statement, &num_columns);
+        sum += row[0].integer;
+        (*rows)++;
+    }
+    return status == VM_DONE ? sum : -1;
+}
+
+int64_t query_sum(Database* db, const char* sql, uint32_t* rows) {
+    PreparedStatement* statement = db_prepare(db, sql, -1);
+    if (!statement) {
+        printf("Prepare failed for %s: %s\n", sql, db_error(db));
+        return -1;
+    }
+    int64_t sum = sum_first_column(statement, rows);
+    stmt_finalize(statement);
+    return sum;
+}
+
+// users(id, name, age) with ids 1..num_users, age = id % 40, and NULL names
+// for multiples of 10
+Database* open_users(const char* filename, uint32_t num_users) {
+    remove(filename);
+    Database* db = db_open(filename);
+    if (!exec(db, "CREATE TABLE users (id INT, name TEXT, age INT)")) {
+        return db;
+    }
+    PreparedStatement* insert = db_prepare(db, "INSERT INTO users VALUES (?, ?, ?)", -1);
+    for (uint32_t id = 1; id <= num_users; id++) {
+        char name[32];
+        int length = sprintf(name, "user_%u", id);
+        stmt_reset(insert);
+        stmt_bind_int(insert, 1, id);
+        if (id % 10 == 0) {
+            stmt_bind_null(insert, 2);
+        } else {
+            stmt_bind_text(insert, 2, name, (uint32_t)length);
+        }
+        stmt_bind_int(insert, 3, id % 40);
+        if (stmt_step(insert) != VM_DONE) {
+            printf("Insert of %u failed: %s\n", id, db_error(db));
+            break;
+        }
+    }
+    stmt_finalize(insert);
+    return db;
+}
+
+int test_create_insert_select() {
+    printf("\n=== Testing Create, Insert And Select ===\n");
+
+    remove("test_sql_basic.db");
+    Database* db = db_open("test_sql_basic.db");
+    int success = exec(db, "CREATE TABLE users (id INT, name TEXT)");
+    success = success && exec(db, "insert into USERS values (1, \"Alice\"), (2, 'Bob'), (3000000000, NULL);");
+
+    PreparedStatement* statement = db_prepare(db, "SELECT * FROM users", -1);
+    success = success && statement && stmt_num_columns(statement) == 2 &&
+              strcmp(stmt_column_name(statement, 1), "name") == 0;
+    const char* names[] = { "Alice", "Bob", NULL };
+    int64_t ids[] = { 1, 2, 3000000000LL };
+    uint32_t rows = 0;
+    while (success && stmt_step(statement) == VM_ROW) {
+        uint32_t num_columns;
+        const Value* row = stmt_row(statement, &num_columns);
+        if (rows >= 3 || num_columns != 2 || row[0].integer != ids[rows] ||
+            (names[rows] ? (row[1].type != VALUE_TEXT || row[1].length != strlen(names[rows]) ||
+                            memcmp(row[1].text, names[rows], row[1].length) != 0)
+                         : row[1].type != VALUE_NULL)) {
+            printf("Unexpected row %u\n", rows);
+            success = 0;
+        }
+        rows++;
+    }
+    success = success && rows == 3;
+    if (statement) {
+        stmt_finalize(statement);
+    }
+
+    // Duplicate keys, unknown names and syntax errors are reported
+    PreparedStatement* duplicate = db_prepare(db, "INSERT INTO users VALUES (1, 'again')", -1);
+    success = success && duplicate && stmt_step(duplicate) == VM_ERROR && strstr(db_error(db), "Duplicate");
+    if (duplicate) {
+        stmt_finalize(duplicate);
+    }
+    success = success && !db_prepare(db, "SELECT missing FROM users", -1) && strstr(db_error(db), "missing");
+    success = success && !db_prepare(db, "SELECT * FROM nowhere", -1);
+    success = success && !db_prepare(db, "SELECT * FROM users WHERE", -1);
+    success = success && !db_prepare(db, "INSERT INTO users VALUES ('text key', 'x')", -1);
+    db_close(db);
+
+    // The catalog persists: the table is there after reopening
+    db = db_open("test_sql_basic.db");
+    uint32_t count;
+    success = success && query_sum(db, "SELECT id FROM users", &count) == 3000000003LL && count == 3;
+    success = success && !exec(db, "CREATE TABLE users (id INT)");
+    db_close(db);
+    return success;
+}
+
+int test_where_clauses() {
+    printf("\n=== Testing Where Clauses ===\n");
+
+    Database* db = open_users("test_sql_where.db", 3000);
+    struct {
+        const char* sql;
+        int64_t sum;
+        uint32_t rows;
+    } cases[] = {
+        { "SELECT id FROM users WHERE id = 1234", 1234, 1 },
+        { "SELECT id FROM users WHERE id = 5000", 0, 0 },
+        { "SELECT id FROM users WHERE id >= 2990", 32945, 11 },
+        { "SELECT id FROM users WHERE id > 10 AND id < 15", 50, 4 },
+        { "SELECT id FROM users WHERE id <= 3 AND id != 2", 4, 2 },
+        // Filters on other columns; ids with age 7 are 7, 47, 87, ...
+        { "SELECT id FROM users WHERE age = 7", 75 * 7 + 40 * (74 * 75 / 2), 75 },
+        { "SELECT id FROM users WHERE age = 7 AND id < 100", 7 + 47 + 87, 3 },
+        { "SELECT id FROM users WHERE name = 'user_2021'", 2021, 1 },
+        { "SELECT id FROM users WHERE name >= 'user_999'", 999, 1 },
+        { "SELECT id FROM users WHERE id = 11 AND age = 11", 11, 1 },
+        { "SELECT id FROM users WHERE id = 11 AND age = 12", 0, 0 },
+        // NULL never compares true
+        { "SELECT id FROM users WHERE name = NULL", 0, 0 },
+        { "SELECT id FROM users WHERE id < 30 AND name != 'x'", 435 - 30, 27 },
+        { "SELECT id FROM users WHERE id = 20 AND name != 'x'", 0, 0 },
+    };
+    int success = 1;
+    for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint32_t rows;
+        int64_t sum = query_sum(db, cases[i].sql, &rows);
+        if (sum != cases[i].sum || rows != cases[i].rows) {
+            printf("%s: got sum %lld over %u rows, expected %lld over %u\n", cases[i].sql, (long long)sum, rows,
+                   (long long)cases[i].sum, cases[i].rows);
+            success = 0;
+        }
+    }
+    db_close(db);
+    return success;
+}
+
+int test_prepared_statements() {
+    printf("\n=== Testing Prepared Statements ===\n");
+
+    Database* db = open_users("test_sql_prepared.db", 500);
+    StatementCacheStats before = db_statement_cache_stats(db);
+    int success = 1;
+    for (uint32_t id = 1; id <= 500 && success; id += 7) {
+        // Layout and case differences normalize to the same cache entry
+        PreparedStatement* statement =
+            db_prepare(db, id % 2 ? "SELECT age FROM users WHERE id = ?" : "select age\n  from USERS where id=?", -1);
+        success = statement && stmt_num_parameters(statement) == 1 && stmt_bind_int(statement, 1, id) &&
+                  !stmt_bind_int(statement, 2, id);
+        uint32_t rows;
+        success = success && sum_first_column(statement, &rows) == id % 40 && rows == 1;
+        if (statement) {
+            stmt_finalize(statement);
+        }
+    }
+    StatementCacheStats after = db_statement_cache_stats(db);
+    if (after.misses - before.misses != 1 || after.hits - before.hits != 71) {
+        printf("Expected 1 miss and 71 hits, got %llu and %llu\n",
+               (unsigned long long)(after.misses - before.misses), (unsigned long long)(after.hits - before.hits));
+        success = 0;
+    }
+
+    // A statement already in use is not handed out twice
+    PreparedStatement* first = db_prepare(db, "SELECT id FROM users WHERE age = ?", -1);
+    PreparedStatement* second = db_prepare(db, "SELECT id FROM users WHERE age = ?", -1);
+    success = success && first && second && first != second;
+    stmt_bind_int(first, 1, 3);
+    stmt_bind_int(second, 1, 4);
+    uint32_t first_rows, second_rows;
+    success = success && sum_first_column(first, &first_rows) > 0 && sum_first_column(second, &second_rows) > 0 &&
+              first_rows == 13 && second_rows == 13;
+    stmt_finalize(first);
+    stmt_finalize(second);
+
+    // The cache is bounded and evicts the least recently used statement
+    db_set_statement_cache_size(db, 2);
+    const char* queries[] = { "SELECT id FROM users WHERE id = 1", "SELECT id FROM users WHERE id = 2",
+                              "SELECT id FROM users WHERE id = 1", "SELECT id FROM users WHERE id = 3",
+                              "SELECT id FROM users WHERE id = 2" };
+    before = db_statement_cache_stats(db);
+    for (uint32_t i = 0; i < 5; i++) {
+        uint32_t rows;
+        query_sum(db, queries[i], &rows);
+    }
+    after = db_statement_cache_stats(db);
+    // Misses: 1, 2, 3, then 2 again (evicted by 3); the second 1 hits
+    if (after.size != 2 || after.hits - before.hits != 1 || after.misses - before.misses != 4) {
+        printf("Bounded cache: size %u, %llu hits, %llu misses\n", after.size,
+               (unsigned long long)(after.hits - before.hits), (unsigned long long)(after.misses - before.misses));
+        success = 0;
+    }
+    db_close(db);
+    return success;
+}
+
+typedef struct {
+    uint32_t rows;
+    uint32_t stop_after;          // 0 runs to the end
+    int64_t sum;
+    uint32_t text_bytes;
+} RowTally;
+
+bool tally_row(void* context, const Value* row, uint32_t num_columns) {
+    RowTally* tally = context;
+    tally->rows++;
+    tally->sum += row[0].integer;
+    for (uint32_t i = 1; i < num_columns; i++) {
+        tally->text_bytes += row[i].type == VALUE_TEXT ? row[i].length : 0;
+    }
+    return tally->rows != tally->stop_after;
+}
+
+int test_row_callbacks() {
+    printf("\n=== Testing Row Callbacks ===\n");
+
+    Database* db = open_users("test_sql_callbacks.db", 3000);
+    RowTally tally = { 0, 0, 0, 0 };
+    int success = db_exec(db, "SELECT id, name FROM users", tally_row, &tally) == VM_DONE;
+    // Names user_1 .. user_3000 without the multiples of 10
+    uint32_t text_bytes = 0;
+    for (uint32_t id = 1; id <= 3000; id++) {
+        text_bytes += id % 10 ? 5 + (id >= 10) + (id >= 100) + (id >= 1000) + 1 : 0;
+    }
+    success = success && tally.rows == 3000 && tally.sum == 3000 * 3001 / 2 && tally.text_bytes == text_bytes;
+
+    // A callback that stops leaves the statement on its next row
+    PreparedStatement* statement = db_prepare(db, "SELECT id FROM users WHERE id > 100", -1);
+    RowTally first = { 0, 10, 0, 0 };
+    success = success && stmt_execute(statement, tally_row, &first) == VM_ROW && first.rows == 10 &&
+              first.sum == 101 + 102 + 103 + 104 + 105 + 106 + 107 + 108 + 109 + 110;
+    uint32_t num_columns;
+    success = success && stmt_step(statement) == VM_ROW && stmt_row(statement, &num_columns)[0].integer == 111;
+    RowTally rest = { 0, 0, 0, 0 };
+    success = success && stmt_execute(statement, tally_row, &rest) == VM_DONE && rest.rows == 3000 - 111;
+    stmt_finalize(statement);
+
+    // Statements without rows run the same way; errors come back as VM_ERROR
+    success = success && db_exec(db, "INSERT INTO users VALUES (5000, 'x', 1)", NULL, NULL) == VM_DONE;
+    success = success && db_exec(db, "INSERT INTO users VALUES (5000, 'x', 1)", NULL, NULL) == VM_ERROR &&
+              strstr(db_error(db), "Duplicate");
+    success = success && db_exec(db, "SELECT nothing FROM users", tally_row, &tally) == VM_ERROR;
+    db_close(db);
+    return success;
+}
+
+int test_streaming_scripts() {
+    printf("\n=== Testing Streaming Scripts ===\n");
+
+    // Larger than a read, so statements span reads; `;` and quotes inside
+    // strings do not end statements
+    FILE* script = fopen("test_sql_script.sql", "w");
+    fprintf(script, "CREATE TABLE notes (id INT, body TEXT);\n");
+    for (uint32_t id = 1; id <= 5000; id++) {
+        fprintf(script, "INSERT INTO notes VALUES (%u,\n  'a;b \"%u\"; c');  ", id, id);
+    }
+    fprintf(script, "\n.unknown command;\n;;\nINSERT INTO notes VALUES (9000, \"it's\"), (9001, NULL)");
+    fclose(script);
+
+    SqlArena arena;
+    sql_arena_init(&arena);
+    char error[128];
+    const char* sql;
+    uint32_t length;
+    uint32_t statements = 0;
+    int success = 1;
+    int fd = open("test_sql_script.sql", O_RDONLY);
+    SqlReader reader;
+    sql_reader_init(&reader, fd);
+    while (sql_reader_next(&reader, &sql, &length)) {
+        statements++;
+        if (sql[0] == '.') {
+            success = success && length == 17 && memcmp(sql, ".unknown command;", 17) == 0;
+            continue;
+        }
+        sql_arena_reset(&arena);
+        ParsedStatement* statement = sql_parse(&arena, sql, length, error, sizeof(error));
+        if (!statement) {
+            printf("Statement %u did not parse: %s\n", statements, error);
+            success = 0;
+        } else if (statement->type == STATEMENT_INSERT && statement->values[0].integer <= 5000 &&
+                   statement->values[1].text.length != (uint32_t)(10 + (statement->values[0].integer >= 10) +
+                                                                  (statement->values[0].integer >= 100) +
+                                                                  (statement->values[0].integer >= 1000))) {
+            printf("Statement %u read %.*s\n", statements, (int)length, sql);
+            success = 0;
+        }
+    }
+    sql_reader_free(&reader);
+    close(fd);
+    success = success && statements == 5003;
+
+    // A multi-row INSERT grows its values in the arena
+    char insert[64 * 1024];
+    uint32_t used = (uint32_t)sprintf(insert, "INSERT INTO notes VALUES (0, 'x')");
+    for (uint32_t i = 1; i < 2000; i++) {
+        used += (uint32_t)sprintf(insert + used, ", (%u, 'x')", 10000 + i);
+    }
+    sql_arena_reset(&arena);
+    ParsedStatement* statement = sql_parse(&arena, insert, used, error, sizeof(error));
+    success = success && statement && statement->num_rows == 2000 && statement->values[2 * 1999].integer == 11999;
+    sql_arena_free(&arena);
+
+    // Running the script loads every row; the unknown command is the one failure
+    remove("test_sql_script.db");
+    Database* db = db_open("test_sql_script.db");
+    fd = open("test_sql_script.sql", O_RDONLY);
+    uint32_t failures = repl_run(db, fd);
+    close(fd);
+    uint32_t rows;
+    int64_t sum = query_sum(db, "SELECT id FROM notes", &rows);
+    if (failures != 1 || sum != 5000 * 5001 / 2 + 9000 + 9001 || rows != 5002) {
+        printf("Script: %u failures, sum %lld over %u rows\n", failures, (long long)sum, rows);
+        success = 0;
+    }
+    db_close(db);
+    remove("test_sql_script.sql");
+    return success;
+}
+
+int test_secondary_indexes() {
+    printf("\n=== Testing Secondary Indexes ===\n");
+
+    // Held across CREATE INDEX: its first step recompiles it
+    Database* db = open_users("test_sql_index.db", 3000);
+    PreparedStatement* insert = db_prepare(db, "INSERT INTO users VALUES (?, 'late', 7)", -1);
+    int success = insert && exec(db, "CREATE INDEX users_age ON users (age)");
+    stmt_bind_int(insert, 1, 3001);
+    success = success && stmt_step(insert) == VM_DONE;
+    stmt_finalize(insert);
+    // Indexes created before the rows are maintained by INSERT
+    success = success && exec(db, "CREATE INDEX users_name ON users (name)") &&
+              exec(db, "INSERT INTO users VALUES (3002, 'user_2021', 7), (3003, NULL, 5000000000)");
+
+    struct {
+        const char* sql;
+        int64_t sum;
+        uint32_t rows;
+    } cases[] = {
+        // 75 ids with age 7 (7, 47, ...), more than fit inline, then 3001 and 3002
+        { "SELECT id FROM users WHERE age = 7", 75 * 7 + 40 * (74 * 75 / 2) + 3001 + 3002, 77 },
+        { "SELECT id FROM users WHERE age = 7 AND id < 100", 7 + 47 + 87, 3 },
+        { "SELECT id FROM users WHERE age = 5000000000", 3003, 1 },
+        { "SELECT id FROM users WHERE age = 2147483647", 0, 0 },
+        { "SELECT id FROM users WHERE age = 41", 0, 0 },
+        { "SELECT id FROM users WHERE name = 'user_2021'", 2021 + 3002, 2 },
+        { "SELECT id FROM users WHERE name = 'late'", 3001, 1 },
+        { "SELECT id FROM users WHERE name = 'user_20'", 0, 0 },
+        // Ranges on the INT index; a key range still scans the table
+        { "SELECT id FROM users WHERE age > 37", 75 * (38 + 39) + 2 * 40 * (74 * 75 / 2) + 3003, 151 },
+        { "SELECT id FROM users WHERE age >= 38 AND age < 39", 75 * 38 + 40 * (74 * 75 / 2), 75 },
+        { "SELECT id FROM users WHERE age < 1", 40 * (75 * 76 / 2), 75 },
+        { "SELECT id FROM users WHERE age <= 1 AND id < 50", 40 + 1 + 41, 3 },
+        { "SELECT id FROM users WHERE age = NULL", 0, 0 },
+    };
+    for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint32_t rows;
+        int64_t sum = query_sum(db, cases[i].sql, &rows);
+        if (sum != cases[i].sum || rows != cases[i].rows) {
+            printf("%s: got sum %lld over %u rows, expected %lld over %u\n", cases[i].sql, (long long)sum, rows,
+                   (long long)cases[i].sum, cases[i].rows);
+            success = 0;
+        }
+    }
+
+    PreparedStatement* duplicate = db_prepare(db, "CREATE INDEX users_age ON users (name)", -1);
+    success = success && duplicate && stmt_step(duplicate) == VM_ERROR;
+    stmt_finalize(duplicate);
+    PreparedStatement* on_key = db_prepare(db, "CREATE INDEX users_id ON users (id)", -1);
+    success = success && on_key && stmt_step(on_key) == VM_ERROR;
+    stmt_finalize(on_key);
+    db_close(db);
+
+    // Indexes persist with the catalog
+    db = db_open("test_sql_index.db");
+    uint32_t rows;
+    success = success && query_sum(db, "SELECT id FROM users WHERE name = 'user_2021'", &rows) == 2021 + 3002 &&
+              rows == 2 && exec(db, "INSERT INTO users VALUES (3004, 'user_2021', 0)") &&
+              query_sum(db, "SELECT id FROM users WHERE name = 'user_2021'", &rows) == 2021 + 3002 + 3004;
+    db_close(db);
+    return success;
+}
+
+// Sums the lengths of the second column's text
+bool sum_text_lengths(void* context, const Value* row, uint32_t num_columns) {
+    int64_t* total = context;
+    if (num_columns >= 2 && row[1].type == VALUE_TEXT) {
+        *total += row[1].length;
+    }
+    return true;
+}
+
+int test_covering_indexes() {
+    printf("\n=== Testing Covering Indexes ===\n");
+
+    Database* db = open_users("test_sql_covering.db", 3000);
+    int success = exec(db, "CREATE INDEX users_age ON users (age) INCLUDE (name)") &&
+                  exec(db, "CREATE INDEX users_name ON users (name) INCLUDE (age)") &&
+                  exec(db, "INSERT INTO users VALUES (3001, 'late', 7)");
+    struct {
+        const char* sql;
+        int64_t sum;
+        uint32_t rows;
+    } cases[] = {
+        // Answered from the index entries alone
+        { "SELECT id, name FROM users WHERE age = 7", 75 * 7 + 40 * (74 * 75 / 2) + 3001, 76 },
+        { "SELECT age FROM users WHERE age = 7 AND id > 2950", 7 * 2, 2 },
+        { "SELECT id FROM users WHERE age = 7 AND name = 'user_47'", 47, 1 },
+        { "SELECT id FROM users WHERE age >= 38 AND name != 'x'", 75 * (38 + 39) + 2 * 40 * (74 * 75 / 2), 150 },
+        // Every id with age 0 is a multiple of 10, with a NULL name
+        { "SELECT id FROM users WHERE age = 0 AND name != 'x'", 0, 0 },
+        { "SELECT * FROM users WHERE name = 'user_2021'", 2021, 1 },
+        { "SELECT age, id FROM users WHERE name = 'user_2021'", 2021 % 40, 1 },
+    };
+    for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint32_t rows;
+        int64_t sum = query_sum(db, cases[i].sql, &rows);
+        if (sum != cases[i].sum || rows != cases[i].rows) {
+            printf("%s: got sum %lld over %u rows, expected %lld over %u\n", cases[i].sql, (long long)sum, rows,
+                   (long long)cases[i].sum, cases[i].rows);
+            success = 0;
+        }
+    }
+
+    // Text read from an index entry
+    int64_t expected = 4;
+    for (uint32_t id = 7; id <= 3000; id += 40) {
+        expected += (int64_t)snprintf(NULL, 0, "user_%u", id);
+    }
+    int64_t total = 0;
+    success = success && db_exec(db, "SELECT id, name FROM users WHERE age = 7", sum_text_lengths, &total) == VM_DONE &&
+              total == expected;
+
+    const char* invalid[] = { "CREATE INDEX users_bad ON users (age) INCLUDE (id)",
+                              "CREATE INDEX users_bad ON users (age) INCLUDE (name, age)",
+                              "CREATE INDEX users_bad ON users (age) INCLUDE (height)" };
+    for (uint32_t i = 0; i < 3; i++) {
+        success = success && db_exec(db, invalid[i], NULL, NULL) == VM_ERROR;
+    }
+    db_close(db);
+
+    // INCLUDE columns persist with the catalog
+    db = db_open("test_sql_covering.db");
+    total = 0;
+    success = success && db_exec(db, "SELECT id, name FROM users WHERE age = 7", sum_text_lengths, &total) == VM_DONE &&
+              total == expected;
+    db_close(db);
+    return success;
+}
+
+// Stands for NULL among expected aggregate values
+#define EXPECT_NULL INT64_MIN
+
+// Runs a query that yields one row and compares its values
+int check_row(Database* db, const char* sql, const int64_t* expected, uint32_t count) {
+    PreparedStatement* statement = db_prepare(db, sql, -1);
+    if (!statement) {
+        printf("Prepare failed for %s: %s\n", sql, db_error(db));
+        return 0;
+    }
+    int success = stmt_step(statement) == VM_ROW;
+    uint32_t num_columns = 0;
+    const Value* row = success ? stmt_row(statement, &num_columns) : NULL;
+    success = success && num_columns == count;
+    for (uint32_t i = 0; i < count && success; i++) {
+        int64_t got = row[i].type == VALUE_NULL ? EXPECT_NULL : row[i].integer;
+        if (got != expected[i] || (row[i].type != VALUE_NULL && row[i].type != VALUE_INT)) {
+            printf("%s: column %u is %lld, expected %lld\n", sql, i, (long long)got, (long long)expected[i]);
+            success = 0;
+        }
+    }
+    success = success && stmt_step(statement) == VM_DONE;
+    stmt_finalize(statement);
+    if (!success) {
+        printf("%s did not give the expected row\n", sql);
+    }
+    return success;
+}
+
+int test_aggregates() {
+    printf("\n=== Testing Aggregates ===\n");
+
+    Database* db = open_users("test_sql_aggregates.db", 3000);
+    int success = 1;
+    struct {
+        const char* sql;
+        int64_t expected[8];
+        uint32_t count;
+    } cases[] = {
+        // Computed from the leaf pages
+        { "SELECT COUNT(*), COUNT(name), SUM(age), MIN(age), MAX(age), MIN(id), MAX(id), SUM(id) FROM users",
+          { 3000, 2700, 75 * 780, 0, 39, 1, 3000, 3000 * 3001 / 2 }, 8 },
+        { "SELECT MAX(id), MIN(id) FROM users", { 3000, 1 }, 2 },
+        // Folded from batches, or through the index once there is one
+        { "SELECT COUNT(*), SUM(id), MIN(id), MAX(id) FROM users WHERE age >= 38",
+          { 150, 75 * (38 + 39) + 2 * 40 * (74 * 75 / 2), 38, 2999 }, 4 },
+        { "SELECT COUNT(name), COUNT(*) FROM users WHERE age = 0", { 0, 75 }, 2 },
+        { "SELECT COUNT(*), SUM(id), MIN(age), COUNT(name) FROM users WHERE id > 100 AND id <= 200",
+          { 100, 15050, 0, 90 }, 4 },
+        { "SELECT COUNT(*), SUM(age) FROM users WHERE id = 77", { 1, 37 }, 2 },
+        // No rows still give one row
+        { "SELECT COUNT(*), SUM(age), MAX(id) FROM users WHERE id = 5000", { 0, EXPECT_NULL, EXPECT_NULL }, 3 },
+        { "SELECT COUNT(*), MIN(age) FROM users WHERE age = NULL", { 0, EXPECT_NULL }, 2 },
+        { "SELECT SUM(age), COUNT(age) FROM users WHERE age = 3 AND id < 0", { EXPECT_NULL, 0 }, 2 },
+    };
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            success = check_row(db, cases[i].sql, cases[i].expected, cases[i].count) && success;
+        }
+        success = success && (pass == 1 || exec(db, "CREATE INDEX users_age ON users (age)"));
+    }
+
+    PreparedStatement* statement = db_prepare(db, "SELECT COUNT(*), sum(age) FROM users", -1);
+    success = success && statement && strcmp(stmt_column_name(statement, 0), "count(*)") == 0 &&
+              strcmp(stmt_column_name(statement, 1), "sum(age)") == 0;
+    if (statement) {
+        stmt_finalize(statement);
+    }
+
+    // An empty table has no ends to read
+    int64_t empty[] = { 0, EXPECT_NULL, EXPECT_NULL, EXPECT_NULL, 0 };
+    success = success && exec(db, "CREATE TABLE empty (id INT, value INT)") &&
+              check_row(db, "SELECT COUNT(*), SUM(value), MIN(id), MAX(id), COUNT(value) FROM empty", empty, 5);
+
+    // SUM stops at the int64 range on every path
+    success = success && exec(db, "CREATE TABLE big (id INT, value INT)") &&
+              exec(db, "INSERT INTO big VALUES (1, 9223372036854775000), (2, 1000)");
+    const char* overflows[] = { "SELECT SUM(value) FROM big", "SELECT SUM(value) FROM big WHERE id > 0",
+                                "SELECT SUM(value) FROM big WHERE id = 1 AND value > 0" };
+    for (uint32_t i = 0; i < 2; i++) {
+        success = success && db_exec(db, overflows[i], NULL, NULL) == VM_ERROR;
+    }
+    int64_t largest[] = { 9223372036854775000 };
+    success = success && check_row(db, overflows[2], largest, 1);
+
+    const char* invalid[] = { "SELECT SUM(name) FROM users", "SELECT MIN(name) FROM users",
+                              "SELECT id, COUNT(*) FROM users", "SELECT COUNT(*), id FROM users",
+                              "SELECT AVG(age) FROM users", "SELECT SUM(*) FROM users",
+                              "SELECT COUNT(height) FROM users" };
+    for (uint32_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        if (db_exec(db, invalid[i], NULL, NULL) != VM_ERROR) {
+            printf("%s did not fail\n", invalid[i]);
+            success = 0;
+        }
+    }
+    db_close(db);
+    return success;
+}
+
+// Runs a query whose first num_keys result columns are the columns it sorts
+// by, and checks it returns `expected_rows` rows in that order: column i
+// descending if bit i of `descending` is set
+int check_sorted(Database* db, const char* sql, uint32_t num_keys, uint32_t descending, uint32_t expected_rows) {
+    PreparedStatement* statement = db_prepare(db, sql, -1);
+    if (!statement) {
+        printf("Prepare failed for %s: %s\n", sql, db_error(db));
+        return 0;
+    }
+    Value previous[4];
+    char text[4][64];
+    uint32_t rows = 0;
+    int success = 1;
+    VmStatus status;
+    while (success && (status = stmt_step(statement)) == VM_ROW) {
+        uint32_t num_columns;
+        const Value* row = stmt_row(statement, &num_columns);
+        for (uint32_t i = 0; i < num_keys && rows > 0; i++) {
+            int cmp = vm_value_compare(&previous[i], &row[i]);
+            cmp = (descending >> i) & 1 ? -cmp : cmp;
+            if (cmp > 0) {
+                printf("%s: row %u is out of order\n", sql, rows);
+                success = 0;
+            }
+            if (cmp != 0) {
+                break;
+            }
+        }
+        for (uint32_t i = 0; i < num_keys; i++) {
+            previous[i] = row[i];
+            if (row[i].type == VALUE_TEXT) {
+                memcpy(text[i], row[i].text, row[i].length);
+                previous[i].text = text[i];
+            }
+        }
+        rows++;
+    }
+    stmt_finalize(statement);
+    if (success && (status != VM_DONE || rows != expected_rows)) {
+        printf("%s: %u rows, expected %u (%s)\n", sql, rows, expected_rows, db_error(db));
+        success = 0;
+    }
+    return success;
+}
+
+int test_order_by() {
+    printf("\n=== Testing Order By ===\n");
+
+    Database* db = open_users("test_sql_order.db", 3000);
+    int success = 1;
+    struct {
+        const char* sql;
+        uint32_t num_keys;
+        uint32_t descending;
+        uint32_t rows;
+    } cases[] = {
+        { "SELECT age, id FROM users ORDER BY age, id DESC", 2, 2, 3000 },
+        { "SELECT name, id FROM users ORDER BY name DESC, id", 2, 1, 3000 },
+        { "SELECT age, name FROM users WHERE age >= 30 ORDER BY age DESC", 1, 1, 750 },
+        { "SELECT id, age FROM users WHERE age = 7 ORDER BY id DESC", 1, 1, 75 },
+        { "SELECT id FROM users ORDER BY id DESC", 1, 1, 3000 },
+        { "SELECT age FROM users WHERE id > 100 AND id <= 200 ORDER BY age", 1, 0, 100 },
+        // Already in order: no sort
+        { "SELECT id, age FROM users WHERE id > 100 ORDER BY id, age DESC", 1, 0, 2900 },
+        { "SELECT * FROM users WHERE id = 5 ORDER BY age", 1, 0, 1 },
+        // Rows that tie keep the order the scan found them in
+        { "SELECT age, id FROM users ORDER BY age", 2, 0, 3000 },
+    };
+    // In memory, then spilling runs to a temporary file, then through the index
+    for (uint32_t pass = 0; pass < 3; pass++) {
+        for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            if (pass == 2 && i == sizeof(cases) / sizeof(cases[0]) - 1) {
+                continue;  // Index scans find ties in the index's order
+            }
+            success = check_sorted(db, cases[i].sql, cases[i].num_keys, cases[i].descending, cases[i].rows) &&
+                      success;
+        }
+        if (pass == 0) {
+            db_set_sort_memory(db, SORTER_MIN_MEMORY);
+        } else if (pass == 1) {
+            success = exec(db, "CREATE INDEX users_age ON users (age) INCLUDE (name)") && success;
+        }
+    }
+
+    // An aggregate's one row needs no sort, but its ORDER BY columns must exist
+    int64_t count[] = { 3000 };
+    success = success && check_row(db, "SELECT COUNT(*) FROM users ORDER BY age DESC", count, 1);
+    const char* invalid[] = { "SELECT id FROM users ORDER BY height", "SELECT id FROM users ORDER age",
+                              "SELECT COUNT(*) FROM users ORDER BY height", "SELECT id FROM users ORDER BY" };
+    for (uint32_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        if (db_exec(db, invalid[i], NULL, NULL) != VM_ERROR) {
+            printf("%s did not fail\n", invalid[i]);
+            success = 0;
+        }
+    }
+    db_close(db);
+    return success;
+}
+
+int test_joins() {
+    printf("\n=== Testing Joins ===\n");
+
+    // orders(id, user_id, amount) with ids 1..9000, user_id = id % 3500 (NULL
+    // for multiples of 997), so some orders have no user, and amount = id % 100
+    Database* db = open_users("test_sql_join.db", 3000);
+    int success = exec(db, "CREATE TABLE orders (id INT, user_id INT, amount INT)");
+    PreparedStatement* insert = db_prepare(db, "INSERT INTO orders VALUES (?, ?, ?)", -1);
+    int64_t all[2] = { 0, 0 };
+    int64_t filtered[2] = { 0, 0 };
+    uint32_t early_rows = 0;
+    for (uint32_t id = 1; id <= 9000 && success; id++) {
+        uint32_t user = id % 3500;
+        stmt_reset(insert);
+        stmt_bind_int(insert, 1, id);
+        if (id % 997 == 0) {
+            stmt_bind_null(insert, 2);
+        } else {
+            stmt_bind_int(insert, 2, user);
+        }
+        stmt_bind_int(insert, 3, id % 100);
+        success = stmt_step(insert) == VM_DONE;
+        if (id % 997 == 0 || user < 1 || user > 3000) {
+            continue;
+        }
+        all[0]++;
+        all[1] += id % 100;
+        if (user % 40 == 7 && id % 100 < 50) {
+            filtered[0]++;
+            filtered[1] += id % 100;
+        }
+        early_rows += user <= 500;
+    }
+    stmt_finalize(insert);
+
+    // In memory, then with partitions spilled to a temporary file
+    int64_t one[] = { 1234, 1234, 34 };
+    for (uint32_t pass = 0; pass < 2 && success; pass++) {
+        success = check_row(db, "SELECT COUNT(*), SUM(orders.amount) FROM orders JOIN users ON user_id = users.id",
+                            all, 2) &&
+                  check_row(db,
+                            "SELECT COUNT(*), SUM(amount) FROM users INNER JOIN orders ON users.id = orders.user_id "
+                            "WHERE age = 7 AND amount < 50",
+                            filtered, 2) &&
+                  check_row(db, "SELECT orders.id, users.id, age FROM users JOIN orders ON users.id = user_id "
+                                "WHERE orders.id = 1234", one, 3) &&
+                  check_sorted(db,
+                               "SELECT users.age, orders.id, name FROM orders JOIN users ON orders.user_id = users.id "
+                               "WHERE users.id <= 500 ORDER BY users.age DESC, orders.id",
+                               2, 1, early_rows) &&
+                  success;
+        db_set_join_memory(db, HASH_JOIN_MIN_MEMORY);
+    }
+
+    // SELECT * returns the FROM table's columns, then the JOIN table's
+    const char* names[] = { "id", "user_id", "amount", "id", "name", "age" };
+    PreparedStatement* statement = db_prepare(db, "SELECT * FROM orders JOIN users ON user_id = users.id", -1);
+    success = success && statement && stmt_num_columns(statement) == 6;
+    for (uint32_t i = 0; i < 6 && success; i++) {
+        success = strcmp(stmt_column_name(statement, i), names[i]) == 0;
+    }
+    if (statement) {
+        stmt_finalize(statement);
+    }
+
+    const char* invalid[] = { "SELECT id FROM users JOIN orders ON users.id = user_id",
+                              "SELECT name FROM users JOIN orders ON name = user_id",
+                              "SELECT name FROM users JOIN orders ON users.id = age",
+                              "SELECT users.amount FROM users JOIN orders ON users.id = user_id",
+                              "SELECT name FROM users JOIN users ON id = id",
+                              "SELECT name FROM users JOIN payments ON users.id = user_id",
+                              "SELECT name FROM users JOIN orders users.id = user_id",
+                              "SELECT name FROM users INNER orders ON users.id = user_id" };
+    for (uint32_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        if (db_exec(db, invalid[i], NULL, NULL) != VM_ERROR) {
+            printf("%s did not fail\n", invalid[i]);
+            success = 0;
+        }
+    }
+    db_close(db);
+    return success;
+}
+
+// Compiles a query the way db_prepare() would, to look at its plan
+Program* compile_query(Database* db, const char* sql) {
+    SqlArena arena;
+    sql_arena_init(&arena);
+    char error[DB_ERROR_SIZE];
+    ParsedStatement* parsed = sql_parse(&arena, sql, (uint32_t)strlen(sql), error, sizeof(error));
+    Program* program = parsed ? codegen_compile(db_catalog(db), parsed, error, sizeof(error)) : NULL;
+    sql_arena_free(&arena);
+    return program;
+}
+
+int uses_index(Database* db, const char* sql) {
+    Program* program = compile_query(db, sql);
+    int found = 0;
+    for (uint32_t i = 0; program && i < program->length; i++) {
+        found = found || program->code[i].opcode == OP_OPEN_INDEX;
+    }
+    if (program) {
+        program_free(program);
+    }
+    return found;
+}
+
+// Which of a join's tables the hash join is built from, 0 for the FROM
+// table: the one opened on the build cursor, 3
+int build_table(Database* db, const char* sql) {
+    Program* program = compile_query(db, sql);
+    int table = -1;
+    for (uint32_t i = 0; program && i < program->length; i++) {
+        if (program->code[i].opcode == OP_OPEN_READ && program->code[i].p1 == 3) {
+            table = program->code[i].p3;
+        }
+    }
+    if (program) {
+        program_free(program);
+    }
+    return table;
+}
+
+int test_statistics() {
+    printf("\n=== Testing Statistics ===\n");
+
+    Database* db = open_users("test_sql_stats.db", 3000);
+    int success = exec(db, "CREATE INDEX users_age ON users (age)") &&
+                  exec(db, "CREATE INDEX users_name ON users (name)") &&
+                  exec(db, "CREATE TABLE teams (id INT, label TEXT)") &&
+                  exec(db, "INSERT INTO teams VALUES (3, 'c'), (7, 'g'), (11, 'k'), (39, 'm')");
+    const char* queries[] = { "SELECT id, name FROM users WHERE age >= 1",
+                              "SELECT id FROM users WHERE name = 'user_2021'",
+                              "SELECT id FROM users WHERE id > 2900 AND age < 20",
+                              "SELECT users.id FROM teams JOIN users ON teams.id = users.age" };
+    const uint32_t num_queries = sizeof(queries) / sizeof(queries[0]);
+    int64_t sums[sizeof(queries) / sizeof(queries[0])];
+    uint32_t rows[sizeof(queries) / sizeof(queries[0])];
+    for (uint32_t i = 0; i < num_queries; i++) {
+        sums[i] = query_sum(db, queries[i], &rows[i]);
+    }
+    // Held across ANALYZE: its first step plans it again
+    PreparedStatement* held = db_prepare(db, queries[0], -1);
+
+    // Without statistics an index is used whenever the conditions allow, and
+    // the JOIN table builds
+    Table* users = catalog_find_table(db_catalog(db), "users", 5);
+    success = success && !users->stats.analyzed && uses_index(db, queries[0]) && uses_index(db, queries[1]) &&
+              !uses_index(db, queries[2]) && build_table(db, queries[3]) == 1;
+    success = success && exec(db, "ANALYZE");
+
+    const TableStats* stats = &users->stats;
+    const ColumnStats* age = &stats->columns[2];
+    success = success && stats->analyzed && stats->rows == 3000 && stats->shape.height >= 2 &&
+              stats->shape.leaf_pages > 100 && stats->columns[0].distinct == 3000 &&
+              stats->columns[1].nulls == 300 && stats->columns[1].num_bounds == 0 && age->distinct >= 38 &&
+              age->distinct <= 42 && age->nulls == 0 && age->num_bounds == ANALYZE_HISTOGRAM_BUCKETS + 1 &&
+              age->bounds[0] == 0 && age->bounds[ANALYZE_HISTOGRAM_BUCKETS] == 39;
+    for (uint32_t i = 0; i < ANALYZE_HISTOGRAM_BUCKETS && success; i++) {
+        success = age->bounds[i] <= age->bounds[i + 1];
+    }
+    // Ages are uniform, so a quarter of them is a quarter of the rows
+    int64_t lower = 10;
+    int64_t upper = 19;
+    double estimate = estimate_range_rows(stats, 2, &lower, &upper);
+    success = success && estimate > 600 && estimate < 900 && estimate_range_rows(stats, 2, &upper, &lower) == 0 &&
+              users->indexes[0]->stats.analyzed && users->indexes[0]->stats.images == 40;
+    if (!success) {
+        printf("Statistics of users: %llu rows, %llu distinct ages, %.0f rows estimated for ages 10 to 19\n",
+               (unsigned long long)stats->rows, (unsigned long long)age->distinct, estimate);
+    }
+
+    // An index is used only where it reads fewer pages than the table scan,
+    // and the smaller table builds; results do not change
+    success = success && !uses_index(db, queries[0]) && uses_index(db, queries[1]) && build_table(db, queries[3]) == 0;
+    for (uint32_t i = 0; i < num_queries && success; i++) {
+        uint32_t count;
+        int64_t sum = query_sum(db, queries[i], &count);
+        if (sum != sums[i] || count != rows[i]) {
+            printf("%s: got sum %lld over %u rows, expected %lld over %u\n", queries[i], (long long)sum, count,
+                   (long long)sums[i], rows[i]);
+            success = 0;
+        }
+    }
+    uint32_t count;
+    success = success && held && sum_first_column(held, &count) == sums[0] && count == rows[0];
+    stmt_finalize(held);
+
+    // Refreshing one table replaces its statistics rows
+    success = success && exec(db, "INSERT INTO users VALUES (3001, 'late', 7)") && exec(db, "ANALYZE users") &&
+              stats->rows == 3001 && db_exec(db, "ANALYZE players", NULL, NULL) == VM_ERROR &&
+              db_exec(db, "ANALYZE users teams", NULL, NULL) == VM_ERROR;
+    TableStats before = *stats;
+    db_close(db);
+
+    // Statistics persist with the catalog
+    db = db_open("test_sql_stats.db");
+    users = catalog_find_table(db_catalog(db), "users", 5);
+    success = success && users->stats.analyzed && users->stats.rows == 3001 &&
+              users->stats.shape.leaf_pages == before.shape.leaf_pages &&
+              memcmp(users->stats.columns, before.columns, sizeof(before.columns)) == 0 &&
+              users->indexes[1]->stats.analyzed && !uses_index(db, queries[0]) && build_table(db, queries[3]) == 0;
+    db_close(db);
+    return success;
+}
+
+static bool count_row(void* context, const Value* row, uint32_t num_columns) {
+    (void)row;
+    (void)num_columns;
+    (*(uint32_t*)context)++;
+    return true;
+}
+
+// Reads an EXPLAIN ANALYZE's rows into per-opcode totals of one profile
+// column; -1 on error
+int64_t profile_total(Database* db, const char* sql, Opcode opcode, uint32_t column) {
+    PreparedStatement* statement = db_prepare(db, sql, -1);
+    if (!statement) {
+        printf("Prepare failed for %s: %s\n", sql, db_error(db));
+        return -1;
+    }
+    int64_t total = 0;
+    const char* name = vm_opcode_name(opcode);
+    VmStatus status;
+    while ((status = stmt_step(statement)) == VM_ROW) {
+        uint32_t num_columns;
+        const Value* row = stmt_row(statement, &num_columns);
+        if (row[1].length == strlen(name) && memcmp(row[1].text, name, row[1].length) == 0) {
+            total += row[column].integer;
+        }
+    }
+    stmt_finalize(statement);
+    return status == VM_DONE ? total : -1;
+}
+
+int test_explain() {
+    printf("\n=== Testing Explain ===\n");
+
+    Database* db = open_users("test_sql_explain.db", 3000);
+    const char* query = "SELECT id FROM users WHERE age = 7";
+
+    // EXPLAIN lists the program without running it
+    Program* program = compile_query(db, query);
+    PreparedStatement* statement = db_prepare(db, "EXPLAIN SELECT id FROM users WHERE age = 7", -1);
+    int success = program && statement && stmt_explain(statement) == EXPLAIN_PROGRAM &&
+                  stmt_num_columns(statement) == 5 && strcmp(stmt_column_name(statement, 1), "opcode") == 0;
+    uint32_t rows = 0;
+    while (success && stmt_step(statement) == VM_ROW) {
+        uint32_t num_columns;
+        const Value* row = stmt_row(statement, &num_columns);
+        const Instruction* instruction = &program->code[rows];
+        const char* name = vm_opcode_name((Opcode)instruction->opcode);
+        success = rows < program->length && num_columns == 5 && row[0].integer == rows &&
+                  row[1].length == strlen(name) && memcmp(row[1].text, name, row[1].length) == 0 &&
+                  row[2].integer == instruction->p1 && row[3].integer == instruction->p2 &&
+                  row[4].integer == instruction->p3;
+        rows++;
+    }
+    success = success && rows == program->length;
+    if (statement) {
+        stmt_finalize(statement);
+    }
+    uint32_t count = 0;
+    success = success && db_exec(db, "EXPLAIN INSERT INTO users VALUES (5000, 'x', 7)", count_row, &count) == VM_DONE &&
+              count > 0 && query_sum(db, "SELECT id FROM users WHERE id = 5000", &rows) == 0 && rows == 0;
+
+    // EXPLAIN ANALYZE runs it first: the scan fills batches with every row,
+    // the filter keeps 75 of them, and each is a result row
+    const char* analyze = "EXPLAIN ANALYZE SELECT id FROM users WHERE age = 7";
+    for (uint32_t run = 0; run < 2 && success; run++) {
+        int64_t scanned = profile_total(db, analyze, OP_BATCH_NEXT, 6);
+        int64_t kept = profile_total(db, analyze, OP_BATCH_FILTER, 6);
+        int64_t results = profile_total(db, analyze, OP_RESULT_ROW, 5);
+        int64_t misses = profile_total(db, analyze, OP_BATCH_NEXT, 9);
+        int64_t pages = profile_total(db, analyze, OP_BATCH_NEXT, 8) + misses + profile_total(db, analyze, OP_REWIND, 8);
+        int64_t cycles = profile_total(db, analyze, OP_BATCH_FILTER, 7);
+        if (scanned != 3000 || kept != 75 || results != 75 || pages <= 0 || misses < 0 || cycles <= 0) {
+            printf("Run %u: %lld scanned, %lld kept, %lld results, %lld pages, %lld cycles\n", run,
+                   (long long)scanned, (long long)kept, (long long)results, (long long)pages, (long long)cycles);
+            success = 0;
+        }
+    }
+
+    // EXPLAIN ANALYZE of an INSERT inserts
+    statement = db_prepare(db, "EXPLAIN ANALYZE INSERT INTO users VALUES (5000, 'x', 7)", -1);
+    count = 0;
+    success = success && statement && stmt_num_columns(statement) == 10 && stmt_changes(statement) == 1 &&
+              stmt_execute(statement, count_row, &count) == VM_DONE && count > 0 &&
+              query_sum(db, "SELECT id FROM users WHERE id = 5000", &rows) == 5000 && rows == 1;
+    if (statement) {
+        stmt_finalize(statement);
+    }
+    success = success && db_prepare(db, "EXPLAIN CREATE TABLE players (id INT)", -1) == NULL &&
+              db_prepare(db, "EXPLAIN ANALYZE users", -1) == NULL;
+    if (program) {
+        program_free(program);
+    }
+    db_close(db);
+    return success;
+}
+
+int main() {
+    printf("Starting SQL Test Suite\n");
+    printf("========================================\n");
+
+    int overall_success = 1;
+    int test_count = 0;
+    int passed_count = 0;
+
+    int tests[] = {
+        test_create_insert_select(),
+        test_where_clauses(),
+        test_prepared_statements(),
+        test_streaming_scripts(),
+        test_row_callbacks(),
+        test_secondary_indexes(),
+        test_covering_indexes(),
+        test_aggregates(),
+        test_order_by(),
+        test_joins(),
+        test_statistics(),
+        test_explain()
+    };
+
+    const char* test_names[] = {
+        "Create, Insert And Select",
+        "Where Clauses",
+        "Prepared Statements",
+        "Streaming Scripts",
+        "Row Callbacks",
+        "Secondary Indexes",
+        "Covering Indexes",
+        "Aggregates",
+        "Order By",
+        "Joins",
+        "Statistics",
+        "Explain"
+    };
+
+    test_count = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < test_count; i++) {
+        print_test_result(test_names[i], tests[i]);
+        if (tests[i]) {
+            passed_count++;
+        } else {
+            overall_success = 0;
+        }
+    }
+
+    printf("\n========================================\n");
+    printf("Test Summary: %d/%d tests passed\n", passed_count, test_count);
+    printf("Overall Result: %s\n", overall_success ? "ALL TESTS PASSED" : "SOME TESTS FAILED");
+
+    return overall_success ? 0 : 1;
+}
@@ -0,0 +1,692 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h"
+#include "batch.h"
+#include "sorter.h"
+#include "hashjoin.h"
+
+void print_test_result(const char* test_name, int success) {
+    printf("%s: %s\n", test_name, success ? "PASSED" : "FAILED");
+}
+
+Value int_value(int64_t integer) {
+    Value value;
+    memset(&value, 0, sizeof(value));
+    value.type = VALUE_INT;
+    value.integer = integer;
+    return value;
+}
+
+Value text_value(const char* text) {
+    Value value;
+    memset(&value, 0, sizeof(value));
+    value.type = VALUE_TEXT;
+    value.text = text;
+    value.length = strlen(text);
+    return value;
+}
+
+// people(key, name text, age int)
+RowSchema people_schema;
+
+// Builds people with keys 0..num_rows-1 and age = key % 50
+BTree* open_people_table(const char* filename, uint32_t num_rows) {
+    ColumnType types[2] = { COLUMN_TEXT, COLUMN_INT };
+    row_schema_init(&people_schema, types, 2);
+    remove(filename);
+    Pager* pager = pager_open(filename);
+    BTree* btree = btree_open(pager);
+    for (uint32_t key = 0; key < num_rows; key++) {
+        char name[32];
+        sprintf(name, "person_%u", key);
+        Value columns[2] = { text_value(name), int_value(key % 50) };
+        uint8_t record[VM_MAX_RECORD_SIZE];
+        uint32_t size = row_encode(&people_schema, columns, 2, record, sizeof(record));
+        btree_insert(btree, key, record, size);
+    }
+    return btree;
+}
+
+void close_table(BTree* btree) {
+    Pager* pager = btree->pager;
+    btree_close(btree);
+    pager_close(pager);
+}
+
+int test_row_format() {
+    printf("\n=== Testing Row Format ===\n");
+
+    ColumnType types[4] = { COLUMN_INT, COLUMN_TEXT, COLUMN_INT, COLUMN_TEXT };
+    RowSchema schema;
+    int success = row_schema_init(&schema, types, 4);
+    Value columns[4] = { int_value(-42), text_value("hello"), int_value(0), text_value("world!") };
+    columns[2].type = VALUE_NULL;
+    uint8_t row[VM_MAX_RECORD_SIZE];
+    uint32_t size = row_encode(&schema, columns, 4, row, sizeof(row));
+
+    Value value;
+    success = success && size > 0;
+    success = success && row_column(&schema, row, size, 0, &value) && value.type == VALUE_INT &&
+              value.integer == -42;
+    success = success && row_column(&schema, row, size, 1, &value) && value.type == VALUE_TEXT &&
+              value.length == 5 && memcmp(value.text, "hello", 5) == 0;
+    success = success && row_column(&schema, row, size, 2, &value) && value.type == VALUE_NULL;
+    // Text is read in place, straight out of the row
+    success = success && row_column(&schema, row, size, 3, &value) && value.length == 6 &&
+              value.text == (const char*)row + size - 6;
+    // Truncated rows are rejected rather than read past
+    success = success && !row_column(&schema, row, size - 3, 3, &value);
+    // Values must match their column's type
+    Value mismatched[2] = { text_value("x"), text_value("y") };
+    success = success && row_encode(&schema, mismatched, 2, row, sizeof(row)) == 0;
+
+    // A row written before the last two columns were added reads them as NULL
+    size = row_encode(&schema, columns, 2, row, sizeof(row));
+    success = success && size > 0 && row_column(&schema, row, size, 1, &value) && value.length == 5 &&
+              row_column(&schema, row, size, 2, &value) && value.type == VALUE_NULL &&
+              row_column(&schema, row, size, 3, &value) && value.type == VALUE_NULL;
+    if (!success) {
+        printf("Row round trip failed\n");
+    }
+    return success;
+}
+
+int test_filtered_scan() {
+    printf("\n=== Testing Filtered Scan ===\n");
+
+    // SELECT key, name FROM people WHERE age > 45
+    BTree* btree = open_people_table("test_vm_scan.db", 1000);
+    Program* program = program_new();
+    uint32_t table = program_add_table(program, btree, &people_schema);
+    program_emit(program, OP_OPEN_READ, 0, 0, table);
+    program_emit(program, OP_INTEGER, 3, 0, 45);
+    uint32_t rewind = program_emit(program, OP_REWIND, 0, 0, 0);
+    uint32_t loop = program_emit(program, OP_COLUMN, 2, 0, program_column_operand(0, 1));
+    uint32_t filter = program_emit(program, OP_LE, 2, 0, 3);
+    program_emit(program, OP_KEY, 0, 0, 0);
+    program_emit(program, OP_COLUMN, 1, 0, program_column_operand(0, 0));
+    program_emit(program, OP_RESULT_ROW, 0, 0, 2);
+    uint32_t next = program_emit(program, OP_NEXT, 0, loop, 0);
+    uint32_t done = program_emit(program, OP_HALT, 0, 0, 0);
+    program_set_jump(program, rewind, done);
+    program_set_jump(program, filter, next);
+
+    Vm* vm = vm_new(program);
+    int success = 1;
+    uint32_t rows = 0;
+    VmStatus status;
+    while ((status = vm_step(vm)) == VM_ROW) {
+        uint32_t num_columns;
+        const Value* row = vm_row(vm, &num_columns);
+        char expected[32];
+        sprintf(expected, "person_%lld", (long long)row[0].integer);
+        if (num_columns != 2 || row[0].integer % 50 <= 45 || row[1].length != strlen(expected) ||
+            memcmp(row[1].text, expected, row[1].length) != 0) {
+            printf("Unexpected row for key %lld\n", (long long)row[0].integer);
+            success = 0;
+        }
+        rows++;
+    }
+    if (status != VM_DONE || rows != 80) {
+        printf("Expected 80 rows and VM_DONE, got %u rows, status %d (%s)\n", rows, status, vm_error(vm));
+        success = 0;
+    }
+
+    vm_free(vm);
+    program_free(program);
+    close_table(btree);
+    return success;
+}
+
+int test_batch_scan() {
+    printf("\n=== Testing Batch Scan ===\n");
+
+    // SELECT key, name FROM people WHERE age > 45 AND key >= 1000, vectorized.
+    // 5000 rows span several batches and many leaves.
+    BTree* btree = open_people_table("test_vm_batch.db", 5000);
+    Program* program = program_new();
+    uint32_t table = program_add_table(program, btree, &people_schema);
+    program_emit(program, OP_OPEN_READ, 0, 0, table);
+    program_emit(program, OP_INTEGER, 2, 0, 45);
+    program_emit(program, OP_INTEGER, 3, 0, 1000);
+    uint32_t rewind = program_emit(program, OP_REWIND, 0, 0, 0);
+    uint32_t fill = program_emit(program, OP_BATCH_NEXT, 0, 0, -1);
+    program_emit(program, OP_BATCH_FILTER, 2, COMPARE_GT, program_column_operand(0, 1));
+    program_emit(program, OP_BATCH_FILTER, 3, COMPARE_GE, program_column_operand(0, BATCH_KEY_COLUMN));
+    uint32_t row = program_emit(program, OP_BATCH_ROW, 0, fill, 0);
+    program_emit(program, OP_KEY, 0, 0, 0);
+    program_emit(program, OP_COLUMN, 1, 0, program_column_operand(0, 0));
+    program_emit(program, OP_RESULT_ROW, 0, 0, 2);
+    program_emit(program, OP_GOTO, 0, row, 0);
+    uint32_t done = program_emit(program, OP_HALT, 0, 0, 0);
+    program_set_jump(program, rewind, done);
+    program_set_jump(program, fill, done);
+
+    Vm* vm = vm_new(program);
+    int success = 1;
+    int64_t expected = 1046;
+    VmStatus status;
+    while ((status = vm_step(vm)) == VM_ROW) {
+        uint32_t num_columns;
+        const Value* values = vm_row(vm, &num_columns);
+        char name[32];
+        sprintf(name, "person_%lld", (long long)expected);
+        if (values[0].integer != expected || values[1].length != strlen(name) ||
+            memcmp(values[1].text, name, values[1].length) != 0) {
+            printf("Expected key %lld, got %lld\n", (long long)expected, (long long)values[0].integer);
+            success = 0;
+            break;
+        }
+        // Next key with age > 45
+        expected += (expected % 50 == 49) ? 47 : 1;
+    }
+    if (success && (status != VM_DONE || expected != 5046)) {
+        printf("Scan ended at %lld with status %d (%s)\n", (long long)expected, status, vm_error(vm));
+        success = 0;
+    }
+    vm_free(vm);
+    program_free(program);
+
+    // Text filters and the batch API directly: batches stop at BATCH_SIZE
+    // rows and resume where the previous one ended
+    BTreeCursor* cursor = btree_start(btree);
+    Batch* batch = batch_new();
+    Value name = text_value("person_4999");
+    uint32_t total = 0;
+    uint32_t matches = 0;
+    uint32_t rows;
+    while ((rows = batch_fill(batch, cursor, &people_schema, UINT32_MAX, INT64_MAX)) > 0) {
+        if (rows > BATCH_SIZE || batch_key(batch, 0) != total) {
+            printf("Batch of %u rows starts at key %u, expected %u\n", rows, batch_key(batch, 0), total);
+            success = 0;
+            break;
+        }
+        total += rows;
+        batch_filter(batch, 0, COMPARE_EQ, &name);
+        matches += batch_num_selected(batch);
+    }
+    if (total != 5000 || matches != 1) {
+        printf("Batches read %u rows with %u text matches\n", total, matches);
+        success = 0;
+    }
+    batch_free(batch);
+    free(cursor);
+    close_table(btree);
+    return success;
+}
+
+int test_range_seek() {
+    printf("\n=== Testing Range Seek ===\n");
+
+    // SELECT key FROM people WHERE key >= 500 AND key < 510, run twice
+    BTree* btree = open_people_table("test_vm_seek.db", 3000);
+    Program* program = program_new();
+    uint32_t table = program_add_table(program, btree, &people_schema);
+    program_emit(program, OP_OPEN_READ, 0, 0, table);
+    program_emit(program, OP_INTEGER, 1, 0, 500);
+    program_emit(program, OP_INTEGER, 2, 0, 510);
+    uint32_t seek = program_emit(program, OP_SEEK_GE, 0, 0, 1);
+    uint32_t loop = program_emit(program, OP_KEY, 0, 0, 0);
+    uint32_t bound = program_emit(program, OP_GE, 0, 0, 2);
+    program_emit(program, OP_RESULT_ROW, 0, 0, 1);
+    program_emit(program, OP_NEXT, 0, loop, 0);
+    uint32_t done = program_emit(program, OP_HALT, 0, 0, 0);
+    program_set_jump(program, seek, done);
+    program_set_jump(program, bound, done);
+
+    Vm* vm = vm_new(program);
+    int success = 1;
+    for (int run = 0; run < 2 && success; run++) {
+        vm_reset(vm);
+        int64_t expected = 500;
+        while (vm_step(vm) == VM_ROW) {
+            uint32_t num_columns;
+            const Value* row = vm_row(vm, &num_columns);
+            if (row[0].integer != expected) {
+                printf("Expected key %lld, got %lld\n", (long long)expected, (long long)row[0].integer);
+                success = 0;
+                break;
+            }
+            expected++;
+        }
+        if (expected != 510) {
+            printf("Range ended at %lld\n", (long long)expected);
+            success = 0;
+        }
+    }
+
+    vm_free(vm);
+    program_free(program);
+    close_table(btree);
+    return success;
+}
+
+int test_insert_program() {
+    printf("\n=== Testing Insert Program ===\n");
+
+    // INSERT INTO people VALUES (5000, 'new', 7), then the same key again
+    BTree* btree = open_people_table("test_vm_insert.db", 100);
+    Program* program = program_new();
+    uint32_t table = program_add_table(program, btree, &people_schema);
+    uint32_t name = program_add_text(program, "new", 3);
+    program_emit(program, OP_INTEGER, 0, 0, 5000);
+    program_emit(program, OP_STRING, 1, 0, name);
+    program_emit(program, OP_INTEGER, 2, 0, 7);
+    program_emit(program, OP_MAKE_RECORD, 3, table, 1);
+    program_emit(program, OP_INSERT, 0, table, 3);
+    program_emit(program, OP_HALT, 0, 0, 0);
+
+    Vm* vm = vm_new(program);
+    int success = (vm_step(vm) == VM_DONE);
+    vm_reset(vm);
+    if (vm_step(vm) != VM_ERROR || strstr(vm_error(vm), "Duplicate") == NULL) {
+        printf("Second insert of the same key should fail\n");
+        success = 0;
+    }
+    vm_free(vm);
+    program_free(program);
+
+    BTreeCursor* cursor = btree_find(btree, 5000);
+    uint8_t record[VM_MAX_RECORD_SIZE];
+    uint32_t size;
+    btree_cursor_get_value(cursor, record, sizeof(record), &size);
+    free(cursor);
+    Value value;
+    if (!row_column(&people_schema, record, size, 0, &value) || value.length != 3 ||
+        memcmp(value.text, "new", 3) != 0 || !row_column(&people_schema, record, size, 1, &value) ||
+        value.integer != 7) {
+        printf("Inserted row reads back wrong\n");
+        success = 0;
+    }
+    close_table(btree);
+    return success;
+}
+
+int test_empty_table() {
+    printf("\n=== Testing Scan Of Empty Table ===\n");
+
+    BTree* btree = open_people_table("test_vm_empty.db", 0);
+    Program* program = program_new();
+    uint32_t table = program_add_table(program, btree, &people_schema);
+    program_emit(program, OP_OPEN_READ, 0, 0, table);
+    uint32_t rewind = program_emit(program, OP_REWIND, 0, 0, 0);
+    uint32_t loop = program_emit(program, OP_KEY, 0, 0, 0);
+    program_emit(program, OP_RESULT_ROW, 0, 0, 1);
+    program_emit(program, OP_NEXT, 0, loop, 0);
+    uint32_t done = program_emit(program, OP_HALT, 0, 0, 0);
+    program_set_jump(program, rewind, done);
+
+    Vm* vm = vm_new(program);
+    int success = (vm_step(vm) == VM_DONE) && (vm_step(vm) == VM_DONE);
+    vm_free(vm);
+    program_free(program);
+    close_table(btree);
+    return success;
+}
+
+// Rows are (group, name, sequence) with group = sequence * 7919 % num_groups,
+// every 97th group NULL. Sorted by group, then by sequence within a group,
+// since equal groups must keep the order they were added in.
+int check_sorted_rows(Sorter* sorter, uint32_t num_rows, bool descending) {
+    uint32_t seen = 0;
+    Value previous_group;
+    int64_t previous_sequence = -1;
+    for (bool on_row = sorter_sort(sorter); on_row; on_row = sorter_next(sorter)) {
+        uint32_t count;
+        const Value* row = sorter_row(sorter, &count);
+        char name[32];
+        sprintf(name, "name_%lld", (long long)row[2].integer);
+        if (count != 3 || row[1].length != strlen(name) || memcmp(row[1].text, name, row[1].length) != 0) {
+            printf("Row %u is corrupt\n", seen);
+            return 0;
+        }
+        if (seen > 0) {
+            int cmp = vm_value_compare(&previous_group, &row[0]);
+            cmp = descending ? -cmp : cmp;
+            if (cmp > 0 || (cmp == 0 && row[2].integer < previous_sequence)) {
+                printf("Row %u is out of order\n", seen);
+                return 0;
+            }
+        }
+        previous_group = row[0];
+        previous_sequence = row[2].integer;
+        seen++;
+    }
+    if (seen != num_rows) {
+        printf("Sorted %u rows, expected %u\n", seen, num_rows);
+        return 0;
+    }
+    return 1;
+}
+
+Sorter* fill_sorter(uint32_t num_rows, uint32_t num_groups, bool descending, size_t memory) {
+    Sorter* sorter = sorter_new(1, descending ? 1 : 0, memory);
+    for (uint32_t i = 0; i < num_rows; i++) {
+        char name[32];
+        sprintf(name, "name_%u", i);
+        uint32_t group = (uint32_t)((i * 7919ull) % num_groups);
+        Value row[3] = { int_value(group), text_value(name), int_value(i) };
+        if (group % 97 == 0) {
+            row[0].type = VALUE_NULL;
+        }
+        sorter_add(sorter, row, 3);
+    }
+    return sorter;
+}
+
+int test_external_sort() {
+    printf("\n=== Testing External Sort ===\n");
+
+    // Fits in memory: no runs
+    Sorter* sorter = fill_sorter(5000, 1000, false, SORTER_DEFAULT_MEMORY);
+    int success = check_sorted_rows(sorter, 5000, false) && sorter_stats(sorter).runs == 0;
+    sorter_free(sorter);
+
+    // The smallest budget spills dozens of runs, more than one merge takes
+    sorter = fill_sorter(50000, 3000, false, SORTER_MIN_MEMORY);
+    success = success && check_sorted_rows(sorter, 50000, false);
+    SorterStats stats = sorter_stats(sorter);
+    printf("%llu rows, %u runs, %u merge passes, %llu pages written\n", (unsigned long long)stats.rows, stats.runs,
+           stats.merge_passes, (unsigned long long)stats.pages_written);
+    success = success && stats.rows == 50000 && stats.runs > 20 && stats.merge_passes > 0;
+    sorter_free(sorter);
+
+    // Descending, with a budget whose pool merges several runs at once
+    sorter = fill_sorter(60000, 50000, true, 1024 * 1024);
+    success = success && check_sorted_rows(sorter, 60000, true) && sorter_stats(sorter).runs > 1;
+    sorter_free(sorter);
+
+    // Text keys across runs, and no rows at all
+    sorter = sorter_new(2, 2, SORTER_MIN_MEMORY);
+    for (uint32_t i = 0; i < 20000; i++) {
+        char text[32];
+        sprintf(text, "k%05u", (i * 7919u) % 20000);
+        Value row[2] = { text_value(text), int_value(i % 3) };
+        sorter_add(sorter, row, 2);
+    }
+    uint32_t seen = 0;
+    for (bool on_row = sorter_sort(sorter); on_row && success; on_row = sorter_next(sorter)) {
+        uint32_t count;
+        const Value* row = sorter_row(sorter, &count);
+        char expected[32];
+        sprintf(expected, "k%05u", seen++);
+        success = row[0].length == strlen(expected) && memcmp(row[0].text, expected, row[0].length) == 0;
+    }
+    success = success && seen == 20000;
+    sorter_free(sorter);
+
+    sorter = sorter_new(1, 0, SORTER_MIN_MEMORY);
+    success = success && !sorter_sort(sorter) && !sorter_next(sorter);
+    sorter_free(sorter);
+    return success;
+}
+
+int test_sorter_program() {
+    printf("\n=== Testing Sorter Program ===\n");
+
+    // SELECT name, age FROM people ORDER BY age DESC, name
+    BTree* btree = open_people_table("test_vm_sorter.db", 2000);
+    Program* program = program_new();
+    uint32_t table = program_add_table(program, btree, &people_schema);
+    program_emit(program, OP_OPEN_READ, 0, 0, table);
+    program_emit(program, OP_SORTER_OPEN, 1, 2, 1);
+    uint32_t rewind = program_emit(program, OP_REWIND, 0, 0, 0);
+    uint32_t loop = program_emit(program, OP_COLUMN, 0, 0, program_column_operand(0, 1));
+    program_emit(program, OP_COLUMN, 1, 0, program_column_operand(0, 0));
+    program_emit(program, OP_SORTER_INSERT, 1, 2, 0);
+    program_emit(program, OP_NEXT, 0, loop, 0);
+    uint32_t sort = program_emit(program, OP_SORTER_SORT, 1, 0, 0);
+    program_set_jump(program, rewind, sort);
+    uint32_t output = program_emit(program, OP_COLUMN, 2, 0, program_column_operand(1, 1));
+    program_emit(program, OP_COLUMN, 3, 0, program_column_operand(1, 0));
+    program_emit(program, OP_RESULT_ROW, 2, 0, 2);
+    program_emit(program, OP_SORTER_NEXT, 1, output, 0);
+    uint32_t done = program_emit(program, OP_HALT, 0, 0, 0);
+    program_set_jump(program, sort, done);
+
+    Vm* vm = vm_new(program);
+    vm_set_sort_memory(vm, SORTER_MIN_MEMORY);
+    int success = 1;
+    for (uint32_t round = 0; round < 2 && success; round++) {
+        uint32_t rows = 0;
+        int64_t previous_age = 50;
+        while (success && vm_step(vm) == VM_ROW) {
+            uint32_t num_columns;
+            const Value* row = vm_row(vm, &num_columns);
+            success = num_columns == 2 && row[1].type == VALUE_INT && row[1].integer <= previous_age;
+            previous_age = row[1].integer;
+            rows++;
+        }
+        success = success && rows == 2000 && vm_error(vm)[0] == '\0';
+        // A reset frees the sorter, and the program runs again from scratch
+        vm_reset(vm);
+    }
+    vm_free(vm);
+    program_free(program);
+    close_table(btree);
+    return success;
+}
+
+// A match is (key, "build_<i>", i) for probe row (key, "probe_<key / 3>")
+int check_match(HashJoin* join, const Value* probe) {
+    uint32_t count;
+    const Value* match = hash_join_match(join, &count);
+    char build_name[32];
+    char probe_name[32];
+    sprintf(build_name, "build_%lld", (long long)(count == 3 ? match[2].integer : -1));
+    sprintf(probe_name, "probe_%lld", (long long)probe[0].integer / 3);
+    if (count != 3 || vm_value_compare(&match[0], &probe[0]) != 0 || match[1].length != strlen(build_name) ||
+        memcmp(match[1].text, build_name, match[1].length) != 0 || probe[1].length != strlen(probe_name) ||
+        memcmp(probe[1].text, probe_name, probe[1].length) != 0) {
+        printf("Bad match for probe key %lld\n", (long long)probe[0].integer);
+        return 0;
+    }
+    return 1;
+}
+
+// Joins build rows (i % num_keys, "build_<i>", i) with probe rows (j * 3,
+// "probe_<j>"), where every 101st build key and every 103rd probe key is
+// NULL, and checks every match, including those of replayed probe rows
+int run_join(uint32_t num_build, uint32_t num_keys, uint32_t num_probe, size_t memory, HashJoinStats* stats) {
+    uint32_t* per_key = calloc(num_keys, sizeof(uint32_t));
+    HashJoin* join = hash_join_new(memory);
+    for (uint32_t i = 0; i < num_build; i++) {
+        char name[32];
+        sprintf(name, "build_%u", i);
+        Value row[3] = { int_value(i % num_keys), text_value(name), int_value(i) };
+        if (i % 101 == 0) {
+            row[0].type = VALUE_NULL;
+        } else {
+            per_key[i % num_keys]++;
+        }
+        hash_join_insert(join, row, 3);
+    }
+    hash_join_build(join);
+
+    int success = 1;
+    uint64_t expected = 0;
+    uint64_t matches = 0;
+    for (uint32_t j = 0; j < num_probe && success; j++) {
+        char name[32];
+        sprintf(name, "probe_%u", j);
+        Value probe[2] = { int_value(j * 3), text_value(name) };
+        if (j % 103 == 0) {
+            probe[0].type = VALUE_NULL;
+        } else if (j * 3 < num_keys) {
+            expected += per_key[j * 3];
+        }
+        for (bool on_match = hash_join_probe(join, probe, 2); on_match && success; on_match = hash_join_next(join)) {
+            success = check_match(join, probe);
+            matches++;
+        }
+    }
+    uint32_t count;
+    const Value* probe;
+    while (success && (probe = hash_join_replay(join, &count)) != NULL) {
+        success = count == 2;
+        for (bool on_match = hash_join_probe(join, probe, 2); on_match && success; on_match = hash_join_next(join)) {
+            success = check_match(join, probe);
+            matches++;
+        }
+    }
+    if (success && matches != expected) {
+        printf("%llu matches, expected %llu\n", (unsigned long long)matches, (unsigned long long)expected);
+        success = 0;
+    }
+    *stats = hash_join_stats(join);
+    hash_join_free(join);
+    free(per_key);
+    return success;
+}
+
+int test_hash_join() {
+    printf("\n=== Testing Hash Join ===\n");
+
+    // Fits in memory: nothing spills
+    HashJoinStats stats;
+    int success = run_join(5000, 1000, 3000, HASH_JOIN_DEFAULT_MEMORY, &stats) && stats.spilled_partitions == 0 &&
+                  stats.pages_written == 0 && stats.build_rows == 5000 - 50;
+
+    // The smallest budget spills every partition, and the saved probe rows
+    // are joined partition by partition
+    success = success && run_join(60000, 20000, 30000, HASH_JOIN_MIN_MEMORY, &stats);
+    printf("%llu build rows, %u partitions spilled, %llu build and %llu probe rows saved, %llu pages written\n",
+           (unsigned long long)stats.build_rows, stats.spilled_partitions,
+           (unsigned long long)stats.spilled_build_rows, (unsigned long long)stats.spilled_probe_rows,
+           (unsigned long long)stats.pages_written);
+    success = success && stats.spilled_partitions == HASH_JOIN_PARTITIONS && stats.spilled_probe_rows > 0 &&
+              stats.spilled_build_rows == stats.build_rows;
+
+    // A budget that keeps the first partition in memory
+    success = success && run_join(40000, 40000, 20000, 1024 * 1024, &stats) &&
+              stats.spilled_partitions == HASH_JOIN_PARTITIONS - 1;
+
+    // Text keys never match integers
+    HashJoin* join = hash_join_new(HASH_JOIN_MIN_MEMORY);
+    Value text_row[1] = { text_value("7") };
+    Value int_row[1] = { int_value(7) };
+    hash_join_insert(join, text_row, 1);
+    hash_join_build(join);
+    uint32_t count;
+    success = success && !hash_join_probe(join, int_row, 1) && hash_join_probe(join, text_row, 1) &&
+              hash_join_match(join, &count) != NULL && count == 1 && !hash_join_next(join) &&
+              hash_join_replay(join, &count) == NULL;
+    hash_join_free(join);
+    return success;
+}
+
+int test_hash_join_program() {
+    printf("\n=== Testing Hash Join Program ===\n");
+
+    // SELECT build.name, probe.name FROM people probe JOIN people build ON probe.key = build.key,
+    // in join memory small enough to spill
+    BTree* btree = open_people_table("test_vm_join.db", 20000);
+    Program* program = program_new();
+    uint32_t table = program_add_table(program, btree, &people_schema);
+    program_emit(program, OP_OPEN_READ, 0, 0, table);
+    program_emit(program, OP_OPEN_READ, 1, 0, table);
+    program_emit(program, OP_HASH_OPEN, 2, 2, 0);
+    uint32_t rewind_build = program_emit(program, OP_REWIND, 0, 0, 0);
+    uint32_t build = program_emit(program, OP_KEY, 0, 0, 0);
+    program_emit(program, OP_COLUMN, 1, 0, program_column_operand(0, 0));
+    program_emit(program, OP_HASH_INSERT, 2, 2, 0);
+    program_emit(program, OP_NEXT, 0, build, 0);
+    uint32_t built = program_emit(program, OP_HASH_BUILD, 2, 0, 0);
+    program_set_jump(program, rewind_build, built);
+    uint32_t rewind_probe = program_emit(program, OP_REWIND, 1, 0, 0);
+    uint32_t probe = program_emit(program, OP_KEY, 2, 0, 1);
+    program_emit(program, OP_COLUMN, 3, 0, program_column_operand(1, 0));
+    uint32_t lookup = program_emit(program, OP_HASH_PROBE, 2, 0, 2);
+    uint32_t match = program_emit(program, OP_COLUMN, 4, 0, program_column_operand(2, 1));
+    program_emit(program, OP_MOVE, 5, 0, 3);
+    program_emit(program, OP_RESULT_ROW, 4, 0, 2);
+    program_emit(program, OP_HASH_NEXT, 2, match, 0);
+    uint32_t next = program_emit(program, OP_NEXT, 1, probe, 0);
+    program_set_jump(program, lookup, next);
+    uint32_t replay = program_emit(program, OP_HASH_REPLAY, 2, 0, 2);
+    program_set_jump(program, rewind_probe, replay);
+    program_emit(program, OP_HASH_PROBE, 2, replay, 2);
+    uint32_t rematch = program_emit(program, OP_COLUMN, 4, 0, program_column_operand(2, 1));
+    program_emit(program, OP_MOVE, 5, 0, 3);
+    program_emit(program, OP_RESULT_ROW, 4, 0, 2);
+    program_emit(program, OP_HASH_NEXT, 2, rematch, 0);
+    program_emit(program, OP_GOTO, 0, replay, 0);
+    uint32_t done = program_emit(program, OP_HALT, 0, 0, 0);
+    program_set_jump(program, replay, done);
+
+    Vm* vm = vm_new(program);
+    vm_set_join_memory(vm, HASH_JOIN_MIN_MEMORY);
+    int success = 1;
+    for (uint32_t round = 0; round < 2 && success; round++) {
+        uint32_t rows = 0;
+        while (success && vm_step(vm) == VM_ROW) {
+            uint32_t num_columns;
+            const Value* row = vm_row(vm, &num_columns);
+            success = num_columns == 2 && vm_value_compare(&row[0], &row[1]) == 0;
+            rows++;
+        }
+        if (success && (rows != 20000 || vm_error(vm)[0] != '\0')) {
+            printf("%u rows joined: %s\n", rows, vm_error(vm));
+            success = 0;
+        }
+        // A reset frees the hash join and its temporary file
+        vm_reset(vm);
+    }
+    vm_free(vm);
+    program_free(program);
+    close_table(btree);
+    return success;
+}
+
+int main() {
+    printf("Starting VM Test Suite\n");
+    printf("========================================\n");
+
+    int overall_success = 1;
+    int test_count = 0;
+    int passed_count = 0;
+
+    int tests[] = {
+        test_row_format(),
+        test_filtered_scan(),
+        test_batch_scan(),
+        test_range_seek(),
+        test_insert_program(),
+        test_empty_table(),
+        test_external_sort(),
+        test_sorter_program(),
+        test_hash_join(),
+        test_hash_join_program()
+    };
+
+    const char* test_names[] = {
+        "Row Format",
+        "Filtered Scan",
+        "Batch Scan",
+        "Range Seek",
+        "Insert Program",
+        "Scan Of Empty Table",
+        "External Sort",
+        "Sorter Program",
+        "Hash Join",
+        "Hash Join Program"
+    };
+
+    test_count = sizeof(tests) / sizeof(tests[0]);
+
+    for (int i = 0; i < test_count; i++) {
+        print_test_result(test_names[i], tests[i]);
+        if (tests[i]) {
+            passed_count++;
+        } else {
+            overall_success = 0;
+        }
+    }
+
+    printf("\n========================================\n");
+    printf("Test Summary: %d/%d tests passed\n", passed_count, test_count);
+    printf("Overall Result: %s\n", overall_success ? "ALL TESTS PASSED" : "SOME TESTS FAILED");
+
+    return overall_success ? 0 : 1;
+}